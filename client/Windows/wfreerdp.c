@@ -78,7 +78,6 @@ void wf_sw_begin_paint(rdpContext* context)
 {
 	rdpGdi* gdi = context->gdi;
 	gdi->primary->hdc->hwnd->invalid->null = 1;
-	gdi->primary->hdc->hwnd->ninvalid = 0;
 }
 
 void wf_sw_end_paint(rdpContext* context)
@@ -88,25 +87,23 @@ void wf_sw_end_paint(rdpContext* context)
 	wfInfo* wfi;
 	sint32 x, y;
 	uint32 w, h;
-	int ninvalid;
 	RECT update_rect;
-	HGDI_RGN cinvalid;
+	HGDI_REGION region;
 
 	gdi = context->gdi;
 	wfi = ((wfContext*) context)->wfi;
 
-	if (gdi->primary->hdc->hwnd->ninvalid < 1)
+	if (gdi->primary->hdc->hwnd->invalid->null)
 		return;
 
-	ninvalid = gdi->primary->hdc->hwnd->ninvalid;
-	cinvalid = gdi->primary->hdc->hwnd->cinvalid;
+	region = &gdi->primary->hdc->hwnd->region;
 
-	for (i = 0; i < ninvalid; i++)
+	for (i = 0; i < region->count; i++)
 	{
-		x = cinvalid[i].x;
-		y = cinvalid[i].y;
-		w = cinvalid[i].w;
-		h = cinvalid[i].h;
+		x = region->rects[i].x;
+		y = region->rects[i].y;
+		w = region->rects[i].w;
+		h = region->rects[i].h;
 
 		update_rect.left = x;
 		update_rect.top = y;
@@ -121,7 +118,6 @@ void wf_hw_begin_paint(rdpContext* context)
 {
 	wfInfo* wfi = ((wfContext*) context)->wfi;
 	wfi->hdc->hwnd->invalid->null = 1;
-	wfi->hdc->hwnd->ninvalid = 0;
 }
 
 void wf_hw_end_paint(rdpContext* context)
@@ -219,17 +215,18 @@ void cpuid(unsigned info, unsigned *eax, unsigned *ebx, unsigned *ecx, unsigned
 #if defined(__GNUC__)
 #if defined(__i386__) || defined(__x86_64__)
 	*eax = info;
+	*ecx = 0; /* sub-leaf, needed for leaf 7 */
 	__asm volatile
 		("mov %%ebx, %%edi;" /* 32bit PIC: don't clobber ebx */
 		 "cpuid;"
 		 "mov %%ebx, %%esi;"
 		 "mov %%edi, %%ebx;"
-		 :"+a" (*eax), "=S" (*ebx), "=c" (*ecx), "=d" (*edx)
+		 :"+a" (*eax), "=S" (*ebx), "+c" (*ecx), "=d" (*edx)
 		 : :"edi");
 #endif
 #elif defined(_MSC_VER)
 	int a[4];
-	__cpuid(a, info);
+	__cpuidex(a, info, 0);
 	*eax = a[0];
 	*ebx = a[1];
 	*ecx = a[2];
@@ -237,6 +234,24 @@ void cpuid(unsigned info, unsigned *eax, unsigned *ebx, unsigned *ecx, unsigned
 #endif
 }
 
+/* XCR0, tells which register states the OS saves on context switch */
+unsigned xgetbv0()
+{
+#ifdef __GNUC__
+#if defined(__i386__) || defined(__x86_64__)
+	unsigned eax, edx;
+	__asm volatile
+		(".byte 0x0f, 0x01, 0xd0" /* xgetbv */
+		 :"=a" (eax), "=d" (edx)
+		 :"c" (0));
+	return eax;
+#endif
+#elif defined(_MSC_VER)
+	return (unsigned) _xgetbv(0);
+#endif
+	return 0;
+}
+
 uint32 wfi_detect_cpu()
 {
 	uint32 cpu_opt = 0;
@@ -249,6 +264,15 @@ uint32 wfi_detect_cpu()
 		cpu_opt |= CPU_SSE2;
 	}
 
+	/* AVX2 needs OSXSAVE and the OS saving the XMM and YMM state */
+	if ((ecx & (1<<27)) && ((xgetbv0() & 0x6) == 0x6))
+	{
+		cpuid(7, &eax, &ebx, &ecx, &edx);
+
+		if (ebx & (1<<5))
+			cpu_opt |= CPU_AVX2;
+	}
+
 	return cpu_opt;
 }
 
@@ -278,7 +302,7 @@ tbool wf_post_connect(freerdp* instance)
 		wfi->hdc = gdi->primary->hdc;
 		wfi->primary = wf_image_new(wfi, width, height, wfi->dstBpp, gdi->primary_buffer);
 
-		rfx_context_set_cpu_opt(gdi->rfx_context, wfi_detect_cpu());
+		gdi_set_cpu_opt(gdi, wfi_detect_cpu());
 	}
 	else
 	{
@@ -298,8 +322,7 @@ tbool wf_post_connect(freerdp* instance)
 		wfi->hdc->hwnd->invalid->null = 1;
 
 		wfi->hdc->hwnd->count = 32;
-		wfi->hdc->hwnd->cinvalid = (HGDI_RGN) malloc(sizeof(GDI_RGN) * wfi->hdc->hwnd->count);
-		wfi->hdc->hwnd->ninvalid = 0;
+		gdi_InitRegion(&wfi->hdc->hwnd->region);
 
 		wfi->image = wf_bitmap_new(wfi, 64, 64, 32, NULL);
 		wfi->image->_bitmap.data = NULL;
@@ -313,6 +336,8 @@ tbool wf_post_connect(freerdp* instance)
 
 		if (settings->ns_codec)
 			wfi->nsc_context = nsc_context_new();
+
+		freerdp_color_set_cpu_opt(wfi_detect_cpu());
 	}
 
 	if (settings->window_title != NULL)
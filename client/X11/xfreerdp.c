@@ -109,7 +109,6 @@ void xf_sw_begin_paint(rdpContext* context)
 {
 	rdpGdi* gdi = context->gdi;
 	gdi->primary->hdc->hwnd->invalid->null = 1;
-	gdi->primary->hdc->hwnd->ninvalid = 0;
 }
 
 void xf_sw_end_paint(rdpContext* context)
@@ -140,21 +139,19 @@ void xf_sw_end_paint(rdpContext* context)
 		else
 		{
 			int i;
-			int ninvalid;
-			HGDI_RGN cinvalid;
+			HGDI_REGION region;
 
-			if (gdi->primary->hdc->hwnd->ninvalid < 1)
+			if (gdi->primary->hdc->hwnd->invalid->null)
 				return;
 
-			ninvalid = gdi->primary->hdc->hwnd->ninvalid;
-			cinvalid = gdi->primary->hdc->hwnd->cinvalid;
+			region = &gdi->primary->hdc->hwnd->region;
 
-			for (i = 0; i < ninvalid; i++)
+			for (i = 0; i < region->count; i++)
 			{
-				x = cinvalid[i].x;
-				y = cinvalid[i].y;
-				w = cinvalid[i].w;
-				h = cinvalid[i].h;
+				x = region->rects[i].x;
+				y = region->rects[i].y;
+				w = region->rects[i].w;
+				h = region->rects[i].h;
 
 				XPutImage(xfi->display, xfi->primary, xfi->gc, xfi->image, x, y, x, y, w, h);
 				XCopyArea(xfi->display, xfi->primary, xfi->window->handle, xfi->gc, x, y, w, h, x, y);
@@ -205,7 +202,6 @@ void xf_hw_begin_paint(rdpContext* context)
 	xfInfo* xfi;
 	xfi = ((xfContext*) context)->xfi;
 	xfi->hdc->hwnd->invalid->null = 1;
-	xfi->hdc->hwnd->ninvalid = 0;
 }
 
 void xf_hw_end_paint(rdpContext* context)
@@ -615,17 +611,34 @@ void cpuid(unsigned info, unsigned *eax, unsigned *ebx, unsigned *ecx, unsigned
 #ifdef __GNUC__
 #if defined(__i386__) || defined(__x86_64__)
 	*eax = info;
+	*ecx = 0; /* sub-leaf, needed for leaf 7 */
 	__asm volatile
 		("mov %%ebx, %%edi;" /* 32bit PIC: don't clobber ebx */
 		 "cpuid;"
 		 "mov %%ebx, %%esi;"
 		 "mov %%edi, %%ebx;"
-		 :"+a" (*eax), "=S" (*ebx), "=c" (*ecx), "=d" (*edx)
+		 :"+a" (*eax), "=S" (*ebx), "+c" (*ecx), "=d" (*edx)
 		 : :"edi");
 #endif
 #endif
 }
 
+/* XCR0, tells which register states the OS saves on context switch */
+unsigned xgetbv0()
+{
+#ifdef __GNUC__
+#if defined(__i386__) || defined(__x86_64__)
+	unsigned eax, edx;
+	__asm volatile
+		(".byte 0x0f, 0x01, 0xd0" /* xgetbv */
+		 :"=a" (eax), "=d" (edx)
+		 :"c" (0));
+	return eax;
+#endif
+#endif
+	return 0;
+}
+
 uint32 xf_detect_cpu()
 {
 	unsigned int eax, ebx, ecx, edx = 0;
@@ -639,6 +652,18 @@ uint32 xf_detect_cpu()
 		cpu_opt |= CPU_SSE2;
 	}
 
+	/* AVX2 needs OSXSAVE and the OS saving the XMM and YMM state */
+	if ((ecx & (1<<27)) && ((xgetbv0() & 0x6) == 0x6))
+	{
+		cpuid(7, &eax, &ebx, &ecx, &edx);
+
+		if (ebx & (1<<5))
+		{
+			DEBUG("AVX2 detected");
+			cpu_opt |= CPU_AVX2;
+		}
+	}
+
 	return cpu_opt;
 }
 
@@ -675,7 +700,10 @@ tbool xf_post_connect(freerdp* instance)
 		gdi = instance->context->gdi;
 		xfi->primary_buffer = gdi->primary_buffer;
 
-		rfx_context = gdi->rfx_context;
+#if defined(WITH_SSE2) || defined(WITH_AVX2)
+		/* covers the RemoteFX decoder of the GDI as well */
+		gdi_set_cpu_opt(gdi, xf_detect_cpu());
+#endif
 	}
 	else
 	{
@@ -692,11 +720,15 @@ tbool xf_post_connect(freerdp* instance)
 
 		if (instance->settings->ns_codec)
 			xfi->nsc_context = (void*) nsc_context_new();
+
+#if defined(WITH_SSE2) || defined(WITH_AVX2)
+		freerdp_color_set_cpu_opt(xf_detect_cpu());
+#endif
 	}
 
 	if (rfx_context)
 	{
-#ifdef WITH_SSE2
+#if defined(WITH_SSE2) || defined(WITH_AVX2)
 		/* detect only if needed */
 		rfx_context_set_cpu_opt(rfx_context, xf_detect_cpu());
 #endif
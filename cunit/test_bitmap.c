@@ -17,6 +17,7 @@
  * limitations under the License.
  */
 
+#include <sys/time.h>
 #include <freerdp/freerdp.h>
 #include <freerdp/utils/hexdump.h>
 #include <freerdp/utils/stream.h>
@@ -1141,6 +1142,7 @@ int add_bitmap_suite(void)
 	add_test_suite(bitmap);
 
 	add_test_function(bitmap);
+	add_test_function(bitmap_bench);
 
 	return 0;
 }
@@ -1248,3 +1250,50 @@ void test_bitmap(void)
 
 	free(t);
 }
+
+static void bench_bitmap_vector(uint8* compressed, int size, int width, int height, int bpp, uint8* temp)
+{
+	int i;
+	int loops;
+	long int dur;
+	uint8* decompressed;
+	bitmapExtra be;
+	struct timeval start_time;
+	struct timeval end_time;
+
+	memset(&be, 0, sizeof(be));
+	be.temp = temp;
+	decompressed = (uint8*) malloc(width * height * ((bpp + 7) / 8));
+
+	/* about the same number of pixels for every vector */
+	loops = (4 * 1024 * 1024) / (width * height);
+
+	gettimeofday(&start_time, NULL);
+	for (i = 0; i < loops; i++)
+		bitmap_decompress_ex(compressed, decompressed, width, height, size, bpp, bpp, &be);
+	gettimeofday(&end_time, NULL);
+
+	dur = ((end_time.tv_sec - start_time.tv_sec) * 1000000) + (end_time.tv_usec - start_time.tv_usec);
+	printf("\n%dx%dx%d: %.2f ns/pixel", width, height, bpp, (dur * 1000.0) / ((double) loops * width * height));
+
+	free(decompressed);
+}
+
+void test_bitmap_bench(void)
+{
+	uint8* temp;
+
+	temp = (uint8*) malloc(32 * 1024);
+
+	bench_bitmap_vector(compressed_16x1x8, sizeof(compressed_16x1x8), 16, 1, 8, temp);
+	bench_bitmap_vector(compressed_32x32x8, sizeof(compressed_32x32x8), 32, 32, 8, temp);
+	bench_bitmap_vector(compressed_16x1x16, sizeof(compressed_16x1x16), 16, 1, 16, temp);
+	bench_bitmap_vector(compressed_32x32x16, sizeof(compressed_32x32x16), 32, 32, 16, temp);
+	bench_bitmap_vector(compressed_16x1x24, sizeof(compressed_16x1x24), 16, 1, 24, temp);
+	bench_bitmap_vector(compressed_32x32x24, sizeof(compressed_32x32x24), 32, 32, 24, temp);
+	bench_bitmap_vector(compressed_16x1x32, sizeof(compressed_16x1x32), 16, 1, 32, temp);
+	bench_bitmap_vector(compressed_32x32x32, sizeof(compressed_32x32x32), 32, 32, 32, temp);
+	printf("\n");
+
+	free(temp);
+}
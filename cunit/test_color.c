@@ -19,9 +19,13 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
 #include <freerdp/freerdp.h>
+#include <freerdp/constants.h>
 #include <freerdp/gdi/gdi.h>
 #include <freerdp/codec/color.h>
+#include <freerdp/utils/memory.h>
 #include "test_color.h"
 
 int init_color_suite(void)
@@ -44,6 +48,8 @@ int add_color_suite(void)
 	add_test_function(color_GetRGB16);
 	add_test_function(color_GetBGR_565);
 	add_test_function(color_GetBGR16);
+	add_test_function(color_ImageConvert);
+	add_test_function(color_bench);
 
 	return 0;
 }
@@ -150,3 +156,325 @@ void test_color_GetBGR16(void)
 	CU_ASSERT(b == 0xEF);
 }
 
+
+/* one pixel at a time, as freerdp_image_convert has always converted */
+static uint8* test_color_convert_pixels(uint8* src, uint8* dst, int width, int height, int srcBpp, int dstBpp, HCLRCONV clrconv)
+{
+	int i;
+	uint32 pixel;
+	uint8 red, green, blue;
+	int dst15 = (dstBpp == 15 || (dstBpp == 16 && clrconv->rgb555));
+
+	if (srcBpp == 8 && (dstBpp == 8 || dstBpp == 15 || dstBpp == 16 || dstBpp == 32)) ;
+	else if (srcBpp == 15 && (dst15 || dstBpp == 16 || dstBpp == 32)) ;
+	else if (srcBpp == 16 && (dstBpp == 16 || dstBpp == 24 || dstBpp == 32)) ;
+	else if (srcBpp == 24 && dstBpp == 32) ;
+	else if (srcBpp == 32 && (dstBpp == 16 || dstBpp == 24 || dstBpp == 32)) ;
+	else
+		return src;
+
+	for (i = 0; i < width * height; i++)
+	{
+		switch (srcBpp)
+		{
+			case 8:
+				pixel = src[i];
+				red = clrconv->palette->entries[pixel].red;
+				green = clrconv->palette->entries[pixel].green;
+				blue = clrconv->palette->entries[pixel].blue;
+
+				if (dstBpp == 8)
+					dst[i] = pixel;
+				else if (dst15)
+					((uint16*) dst)[i] = (clrconv->invert) ? BGR15(red, green, blue) : RGB15(red, green, blue);
+				else if (dstBpp == 16)
+					((uint16*) dst)[i] = (clrconv->invert) ? BGR16(red, green, blue) : RGB16(red, green, blue);
+				else
+					((uint32*) dst)[i] = (clrconv->invert) ? RGB32(red, green, blue) : BGR32(red, green, blue);
+				break;
+
+			case 15:
+				pixel = ((uint16*) src)[i];
+
+				if (dst15)
+				{
+					((uint16*) dst)[i] = pixel;
+				}
+				else if (dstBpp == 16)
+				{
+					GetRGB_555(red, green, blue, pixel);
+					RGB_555_565(red, green, blue);
+					((uint16*) dst)[i] = (clrconv->invert) ? BGR565(red, green, blue) : RGB565(red, green, blue);
+				}
+				else
+				{
+					GetBGR15(red, green, blue, pixel);
+					((uint32*) dst)[i] = (clrconv->invert) ? RGB32(red, green, blue) : BGR32(red, green, blue);
+				}
+				break;
+
+			case 16:
+				pixel = ((uint16*) src)[i];
+
+				if (dstBpp == 16 && !clrconv->rgb555)
+				{
+					((uint16*) dst)[i] = pixel;
+				}
+				else if (dstBpp == 16)
+				{
+					GetRGB_565(red, green, blue, pixel);
+					RGB_565_555(red, green, blue);
+					((uint16*) dst)[i] = (clrconv->invert) ? BGR555(red, green, blue) : RGB555(red, green, blue);
+				}
+				else if (dstBpp == 24)
+				{
+					GetBGR16(red, green, blue, pixel);
+					dst[i * 3] = (clrconv->invert) ? blue : red;
+					dst[i * 3 + 1] = green;
+					dst[i * 3 + 2] = (clrconv->invert) ? red : blue;
+				}
+				else
+				{
+					GetBGR16(red, green, blue, pixel);
+					((uint32*) dst)[i] = (clrconv->invert) ? RGB32(red, green, blue) : BGR32(red, green, blue);
+				}
+				break;
+
+			case 24:
+				memcpy(&dst[i * 4], &src[i * 3], 3);
+				dst[i * 4 + 3] = 0xFF;
+				break;
+
+			case 32:
+				pixel = ((uint32*) src)[i];
+
+				if (dstBpp == 16)
+				{
+					GetBGR32(blue, green, red, pixel);
+					((uint16*) dst)[i] = (clrconv->invert) ? BGR16(red, green, blue) : RGB16(red, green, blue);
+				}
+				else if (dstBpp == 24)
+				{
+					dst[i * 3] = src[i * 4 + ((clrconv->invert) ? 2 : 0)];
+					dst[i * 3 + 1] = src[i * 4 + 1];
+					dst[i * 3 + 2] = src[i * 4 + ((clrconv->invert) ? 0 : 2)];
+				}
+				else
+				{
+					((uint32*) dst)[i] = pixel;
+
+					if (clrconv->alpha)
+						dst[i * 4 + 3] = 0xFF;
+				}
+				break;
+		}
+	}
+
+	return dst;
+}
+
+static const int test_color_bpps[] = { 8, 15, 16, 24, 32 };
+
+/* every format pair and flag combination against the pixel by pixel conversion */
+static void test_color_image_convert(HCLRCONV clrconv, uint8* src, uint8* expected, uint8* dst)
+{
+	int i;
+	int k;
+	int y;
+	int flags;
+	int width;
+	int height;
+	int srcBpp;
+	int dstBpp;
+	int srcSize;
+	int dstSize;
+	int dstStride;
+	uint8* image;
+	tbool same;
+
+	for (flags = 0; flags < 8; flags++)
+	{
+		clrconv->alpha = (flags & CLRCONV_ALPHA) ? true : false;
+		clrconv->invert = (flags & CLRCONV_INVERT) ? true : false;
+		clrconv->rgb555 = (flags & CLRCONV_RGB555) ? true : false;
+
+		for (i = 0; i < 5; i++)
+		{
+			for (k = 0; k < 5; k++)
+			{
+				srcBpp = test_color_bpps[i];
+				dstBpp = test_color_bpps[k];
+				srcSize = (srcBpp + 7) / 8;
+				dstSize = (dstBpp + 7) / 8;
+
+				/* 256 by 256 covers every 8, 15 and 16bpp pixel value */
+				if (test_color_convert_pixels(src, expected, 256, 256, srcBpp, dstBpp, clrconv) == src)
+				{
+					CU_ASSERT(freerdp_image_convert(src, dst, 256, 256, srcBpp, dstBpp, clrconv) == src);
+					continue;
+				}
+
+				CU_ASSERT(freerdp_image_convert(src, dst, 256, 256, srcBpp, dstBpp, clrconv) == dst);
+				CU_ASSERT(memcmp(dst, expected, 256 * 256 * dstSize) == 0);
+
+				image = freerdp_image_convert(src, NULL, 256, 256, srcBpp, dstBpp, clrconv);
+				CU_ASSERT(memcmp(image, expected, 256 * 256 * dstSize) == 0);
+				xfree(image);
+
+				/* odd widths, with the source read bottom-up into a padded destination */
+				for (width = 1; width < 80; width += 7)
+				{
+					height = 5;
+					dstStride = width * dstSize + 12;
+					memset(dst, 0xCD, dstStride * height);
+
+					freerdp_image_convert_ex(src + (height - 1) * width * srcSize, -width * srcSize,
+						dst, dstStride, width, height, srcBpp, dstBpp, clrconv);
+
+					same = true;
+
+					for (y = 0; y < height; y++)
+					{
+						test_color_convert_pixels(src + (height - 1 - y) * width * srcSize,
+							expected, width, 1, srcBpp, dstBpp, clrconv);
+
+						if (memcmp(&dst[y * dstStride], expected, width * dstSize) != 0)
+							same = false;
+
+						if (dst[y * dstStride + width * dstSize] != 0xCD ||
+								dst[y * dstStride + dstStride - 1] != 0xCD)
+							same = false;
+					}
+
+					CU_ASSERT(same == true);
+				}
+			}
+		}
+	}
+}
+
+void test_color_ImageConvert(void)
+{
+	int i;
+	uint8* src;
+	uint8* dst;
+	uint8* expected;
+	CLRCONV clrconv;
+	rdpPalette palette;
+	PALETTE_ENTRY entries[256];
+
+	src = (uint8*) malloc(256 * 256 * 4);
+	dst = (uint8*) malloc(256 * 256 * 4);
+	expected = (uint8*) malloc(256 * 256 * 4);
+
+	/* every 16 bit value, twice over */
+	for (i = 0; i < 256 * 256 * 2; i++)
+		((uint16*) src)[i] = (uint16) (i & 0xFFFF);
+
+	srand(1);
+
+	for (i = 0; i < 256; i++)
+	{
+		entries[i].red = rand() & 0xFF;
+		entries[i].green = rand() & 0xFF;
+		entries[i].blue = rand() & 0xFF;
+	}
+
+	palette.count = 256;
+	palette.entries = entries;
+	clrconv.palette = &palette;
+
+	freerdp_color_set_cpu_opt(0);
+	test_color_image_convert(&clrconv, src, expected, dst);
+
+#if defined(WITH_SSE2)
+	freerdp_color_set_cpu_opt(CPU_SSE2);
+	test_color_image_convert(&clrconv, src, expected, dst);
+#endif
+
+#if defined(WITH_AVX2) && defined(__GNUC__)
+	if (__builtin_cpu_supports("avx2"))
+	{
+		freerdp_color_set_cpu_opt(CPU_SSE2 | CPU_AVX2);
+		test_color_image_convert(&clrconv, src, expected, dst);
+	}
+#endif
+
+	freerdp_color_set_cpu_opt(0);
+
+	free(src);
+	free(dst);
+	free(expected);
+}
+
+static void bench_color_convert(HCLRCONV clrconv, uint8* src, uint8* dst, int srcBpp, int dstBpp, char* name)
+{
+	int i;
+	int loops;
+	long int dur;
+	struct timeval start_time;
+	struct timeval end_time;
+
+	loops = 64;
+
+	/* 64 by 64 tiles into a 32bpp sized destination */
+	gettimeofday(&start_time, NULL);
+	for (i = 0; i < loops * 64; i++)
+		freerdp_image_convert_ex(src, 64 * ((srcBpp + 7) / 8), dst, 64 * 4, 64, 64, srcBpp, dstBpp, clrconv);
+	gettimeofday(&end_time, NULL);
+
+	dur = ((end_time.tv_sec - start_time.tv_sec) * 1000000) + (end_time.tv_usec - start_time.tv_usec);
+	printf("\n%d to %d bpp (%s): %.2f ns/pixel", srcBpp, dstBpp, name, (dur * 1000.0) / ((double) loops * 64 * 64 * 64));
+}
+
+static void bench_color_pairs(HCLRCONV clrconv, uint8* src, uint8* dst, char* name)
+{
+	clrconv->alpha = true;
+	clrconv->invert = false;
+	clrconv->rgb555 = false;
+
+	bench_color_convert(clrconv, src, dst, 8, 32, name);
+	bench_color_convert(clrconv, src, dst, 15, 32, name);
+	bench_color_convert(clrconv, src, dst, 16, 32, name);
+	bench_color_convert(clrconv, src, dst, 24, 32, name);
+	bench_color_convert(clrconv, src, dst, 32, 32, name);
+	bench_color_convert(clrconv, src, dst, 32, 16, name);
+}
+
+void test_color_bench(void)
+{
+	uint8* src;
+	uint8* dst;
+	CLRCONV clrconv;
+	rdpPalette palette;
+	PALETTE_ENTRY entries[256];
+
+	src = (uint8*) calloc(1, 64 * 64 * 4);
+	dst = (uint8*) calloc(1, 64 * 64 * 4);
+
+	memset(entries, 0x80, sizeof(entries));
+	palette.count = 256;
+	palette.entries = entries;
+	clrconv.palette = &palette;
+
+	freerdp_color_set_cpu_opt(0);
+	bench_color_pairs(&clrconv, src, dst, "C");
+
+#if defined(WITH_SSE2)
+	freerdp_color_set_cpu_opt(CPU_SSE2);
+	bench_color_pairs(&clrconv, src, dst, "SSE2");
+#endif
+
+#if defined(WITH_AVX2) && defined(__GNUC__)
+	if (__builtin_cpu_supports("avx2"))
+	{
+		freerdp_color_set_cpu_opt(CPU_SSE2 | CPU_AVX2);
+		bench_color_pairs(&clrconv, src, dst, "AVX2");
+	}
+#endif
+
+	freerdp_color_set_cpu_opt(0);
+
+	free(src);
+	free(dst);
+}
@@ -39,6 +39,7 @@
 #include "test_rail.h"
 #include "test_pcap.h"
 #include "test_mppc.h"
+#include "test_transport.h"
 
 void dump_data(unsigned char * p, int len, int width, char* name)
 {
@@ -130,6 +131,7 @@ int main(int argc, char* argv[])
 		add_license_suite();
 		add_stream_suite();
 		add_mppc_suite();
+		add_transport_suite();
 	}
 	else
 	{
@@ -211,6 +213,10 @@ int main(int argc, char* argv[])
 			{
 				add_mppc_suite();
 			}
+			else if (strcmp("transport", argv[*pindex]) == 0)
+			{
+				add_transport_suite();
+			}
 
 			*pindex = *pindex + 1;
 		}
@@ -20,7 +20,9 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <sys/time.h>
 #include <freerdp/freerdp.h>
+#include <freerdp/constants.h>
 
 #include <freerdp/gdi/gdi.h>
 
@@ -35,6 +37,12 @@
 #include <freerdp/gdi/drawing.h>
 #include <freerdp/gdi/clipping.h>
 #include <freerdp/gdi/32bpp.h>
+#include <freerdp/codec/color.h>
+#include <freerdp/cache/cache.h>
+#include <freerdp/gdi/16bpp.h>
+#include <freerdp/utils/memory.h>
+
+#include "rop.h"
 
 #include "test_libgdi.h"
 
@@ -74,6 +82,10 @@ int add_libgdi_suite(void)
 	add_test_function(gdi_BitBlt_8bpp);
 	add_test_function(gdi_ClipCoords);
 	add_test_function(gdi_InvalidateRegion);
+	add_test_function(gdi_Region);
+	add_test_function(gdi_bitmap_update);
+	add_test_function(gdi_glyph_run);
+	add_test_function(gdi_rop);
 
 	return 0;
 }
@@ -2870,7 +2882,7 @@ void test_gdi_InvalidateRegion(void)
 	invalid = hdc->hwnd->invalid;
 	
 	hdc->hwnd->count = 16;
-	hdc->hwnd->cinvalid = (HGDI_RGN) malloc(sizeof(GDI_RGN) * hdc->hwnd->count);
+	gdi_InitRegion(&hdc->hwnd->region);
 
 	rgn1 = gdi_CreateRectRgn(0, 0, 0, 0);
 	rgn2 = gdi_CreateRectRgn(0, 0, 0, 0);
@@ -2989,3 +3001,936 @@ void test_gdi_InvalidateRegion(void)
 	gdi_InvalidateRegion(hdc, rgn1->x, rgn1->y, rgn1->w, rgn1->h);
 	CU_ASSERT(gdi_EqualRgn(invalid, rgn2) == 1);
 }
+
+#define REGION_WIDTH	48
+#define REGION_HEIGHT	40
+
+static uint32 region_seed = 1;
+
+static int region_rand(int n)
+{
+	region_seed = region_seed * 1103515245 + 12345;
+	return (region_seed >> 16) % n;
+}
+
+static void region_add_random(HGDI_REGION region, uint8* mask)
+{
+	int i;
+	int j;
+	int x;
+	int y;
+	int w;
+	int h;
+	int count;
+
+	count = region_rand(6);
+
+	for (i = 0; i < count; i++)
+	{
+		x = region_rand(REGION_WIDTH);
+		y = region_rand(REGION_HEIGHT);
+		w = 1 + region_rand(REGION_WIDTH - x);
+		h = 1 + region_rand(REGION_HEIGHT - y);
+
+		gdi_UnionRectRegion(region, x, y, w, h);
+
+		for (j = 0; j < h; j++)
+			memset(&mask[(y + j) * REGION_WIDTH + x], 1, w);
+	}
+}
+
+/* checks the region is banded, coalesced and covers exactly the mask */
+static int region_matches(HGDI_REGION region, uint8* mask)
+{
+	int i;
+	int x;
+	int y;
+	int band;
+	int prev;
+	HGDI_RGN r;
+	HGDI_RGN extents;
+	uint8 covered[REGION_WIDTH * REGION_HEIGHT];
+	int left = REGION_WIDTH;
+	int right = 0;
+
+	memset(covered, 0, sizeof(covered));
+	band = 0;
+	prev = -1;
+
+	for (i = 0; i < region->count; i++)
+	{
+		r = &region->rects[i];
+
+		if (r->w <= 0 || r->h <= 0 || r->x < 0 || r->y < 0 ||
+			r->x + r->w > REGION_WIDTH || r->y + r->h > REGION_HEIGHT)
+			return 0;
+
+		if (i > band && r->y != region->rects[band].y)
+		{
+			/* a new band, below the previous one and not mergeable with it */
+			if (r->y < region->rects[band].y + region->rects[band].h)
+				return 0;
+
+			prev = band;
+			band = i;
+		}
+		else if (i > band)
+		{
+			/* same band, same height, left to right with a gap */
+			if (r->h != region->rects[band].h || r->x <= region->rects[i - 1].x + region->rects[i - 1].w)
+				return 0;
+		}
+
+		if (i == band && prev >= 0 && i > 0 && r->y == region->rects[prev].y + region->rects[prev].h)
+		{
+			int j;
+			int n;
+			int same = 1;
+
+			for (n = 1; i + n < region->count && region->rects[i + n].y == r->y; n++)
+				;
+
+			if (n != band - prev)
+				same = 0;
+
+			for (j = 0; same && j < n; j++)
+			{
+				if (region->rects[i + j].x != region->rects[prev + j].x ||
+					region->rects[i + j].w != region->rects[prev + j].w)
+					same = 0;
+			}
+
+			if (same)
+				return 0;
+		}
+
+		for (y = r->y; y < r->y + r->h; y++)
+		{
+			for (x = r->x; x < r->x + r->w; x++)
+				covered[y * REGION_WIDTH + x] = 1;
+		}
+
+		left = MIN(left, r->x);
+		right = MAX(right, r->x + r->w);
+	}
+
+	if (memcmp(covered, mask, sizeof(covered)) != 0)
+		return 0;
+
+	extents = &region->extents;
+
+	if (region->count == 0)
+		return extents->null;
+
+	return (!extents->null && extents->x == left && extents->w == right - left &&
+		extents->y == region->rects[0].y &&
+		extents->y + extents->h == region->rects[region->count - 1].y + region->rects[region->count - 1].h);
+}
+
+static sint64 region_area(HGDI_REGION region)
+{
+	int i;
+	sint64 area = 0;
+
+	for (i = 0; i < region->count; i++)
+		area += (sint64) region->rects[i].w * region->rects[i].h;
+
+	return area;
+}
+
+void test_gdi_Region(void)
+{
+	int i;
+	int k;
+	int mode;
+	int failures;
+	int a;
+	int b;
+	HGDI_DC hdc;
+	GDI_REGION src1;
+	GDI_REGION src2;
+	GDI_REGION dst;
+	GDI_REGION rect;
+	HGDI_REGION region;
+	uint8 mask1[REGION_WIDTH * REGION_HEIGHT];
+	uint8 mask2[REGION_WIDTH * REGION_HEIGHT];
+	uint8 expected[REGION_WIDTH * REGION_HEIGHT];
+	int modes[4] = { GDI_RGN_AND, GDI_RGN_OR, GDI_RGN_XOR, GDI_RGN_DIFF };
+
+	gdi_InitRegion(&src1);
+	gdi_InitRegion(&src2);
+	gdi_InitRegion(&dst);
+	gdi_InitRegion(&rect);
+	failures = 0;
+
+	for (i = 0; i < 500; i++)
+	{
+		gdi_EmptyRegion(&src1);
+		gdi_EmptyRegion(&src2);
+		memset(mask1, 0, sizeof(mask1));
+		memset(mask2, 0, sizeof(mask2));
+
+		region_add_random(&src1, mask1);
+		region_add_random(&src2, mask2);
+
+		if (!region_matches(&src1, mask1) || !region_matches(&src2, mask2))
+			failures++;
+
+		for (mode = 0; mode < 4; mode++)
+		{
+			for (k = 0; k < REGION_WIDTH * REGION_HEIGHT; k++)
+			{
+				a = mask1[k];
+				b = mask2[k];
+
+				switch (modes[mode])
+				{
+					case GDI_RGN_AND: expected[k] = a & b; break;
+					case GDI_RGN_OR: expected[k] = a | b; break;
+					case GDI_RGN_XOR: expected[k] = a ^ b; break;
+					default: expected[k] = a & !b; break;
+				}
+			}
+
+			gdi_CombineRegion(&dst, &src1, &src2, modes[mode]);
+
+			if (!region_matches(&dst, expected))
+				failures++;
+		}
+
+		/* in place, the destination being one of the sources */
+		gdi_CombineRegion(&src1, &src1, &src2, GDI_RGN_DIFF);
+
+		for (k = 0; k < REGION_WIDTH * REGION_HEIGHT; k++)
+			mask1[k] = mask1[k] & !mask2[k];
+
+		if (!region_matches(&src1, mask1))
+			failures++;
+
+		/* simplifying only grows a region, down to the rectangles asked for */
+		gdi_CombineRegion(&dst, &src1, &src2, GDI_RGN_OR);
+		gdi_CombineRegion(&rect, &dst, &dst, GDI_RGN_OR);
+		gdi_SimplifyRegion(&dst, 3);
+		gdi_CombineRegion(&rect, &rect, &dst, GDI_RGN_DIFF);
+
+		if (dst.count > 3 || rect.count != 0)
+			failures++;
+	}
+
+	CU_ASSERT(failures == 0);
+
+	gdi_UninitRegion(&src1);
+	gdi_UninitRegion(&src2);
+	gdi_UninitRegion(&dst);
+	gdi_EmptyRegion(&rect);
+
+	hdc = gdi_GetDC();
+	hdc->hwnd = (HGDI_WND) malloc(sizeof(GDI_WND));
+	hdc->hwnd->invalid = gdi_CreateRectRgn(0, 0, 0, 0);
+	hdc->hwnd->invalid->null = 1;
+	hdc->hwnd->count = 32;
+	gdi_InitRegion(&hdc->hwnd->region);
+	region = &hdc->hwnd->region;
+
+	/* opposite corners of a 4K screen stay two small rectangles */
+	gdi_InvalidateRegion(hdc, 0, 0, 64, 64);
+	gdi_InvalidateRegion(hdc, 3776, 2096, 64, 64);
+	CU_ASSERT(region->count == 2);
+	CU_ASSERT(region_area(region) == 2 * 64 * 64);
+	CU_ASSERT(hdc->hwnd->invalid->x == 0 && hdc->hwnd->invalid->w == 3840);
+	CU_ASSERT(hdc->hwnd->invalid->y == 0 && hdc->hwnd->invalid->h == 2160);
+
+	/* overlapping and repeated updates are counted once */
+	gdi_InvalidateRegion(hdc, 32, 32, 64, 64);
+	gdi_InvalidateRegion(hdc, 32, 32, 64, 64);
+	CU_ASSERT(region_area(region) == 3 * 64 * 64 - 32 * 32);
+
+	/* setting invalid->null starts over */
+	hdc->hwnd->invalid->null = 1;
+	gdi_InvalidateRegion(hdc, 100, 100, 10, 10);
+	CU_ASSERT(region->count == 1);
+	CU_ASSERT(hdc->hwnd->invalid->x == 100 && hdc->hwnd->invalid->w == 10);
+
+	/* scattered updates are kept to count rectangles still covering them all */
+	hdc->hwnd->invalid->null = 1;
+	failures = 0;
+
+	for (i = 0; i < 200; i++)
+	{
+		int x = region_rand(3800);
+		int y = region_rand(2100);
+
+		gdi_InvalidateRegion(hdc, x, y, 40, 40);
+
+		if (region->count > hdc->hwnd->count)
+			failures++;
+
+		gdi_EmptyRegion(&rect);
+		gdi_UnionRectRegion(&rect, x, y, 40, 40);
+		gdi_CombineRegion(&rect, &rect, region, GDI_RGN_DIFF);
+
+		if (rect.count != 0)
+			failures++;
+	}
+
+	CU_ASSERT(failures == 0);
+	CU_ASSERT(region_area(region) < (sint64) 3840 * 2160);
+
+	gdi_UninitRegion(&rect);
+	gdi_DeleteDC(hdc);
+}
+
+static int bitmap_update_matches(rdpGdi* gdi, BITMAP_DATA* bitmap_data)
+{
+	int y;
+	int width;
+	int height;
+	int stride;
+	uint8* expected;
+	uint8* flipped;
+	HGDI_BITMAP surface = gdi->primary->bitmap;
+	int match = 1;
+
+	width = bitmap_data->destRight - bitmap_data->destLeft + 1;
+	height = bitmap_data->destBottom - bitmap_data->destTop + 1;
+	stride = bitmap_data->width * 2;
+
+	flipped = (uint8*) xmalloc(stride * bitmap_data->height);
+	freerdp_image_flip(bitmap_data->bitmapDataStream, flipped, bitmap_data->width, bitmap_data->height, 16);
+	expected = freerdp_image_convert(flipped, NULL, bitmap_data->width, bitmap_data->height, 16, 32, gdi->clrconv);
+
+	for (y = 0; y < height; y++)
+	{
+		if (memcmp(surface->data + (bitmap_data->destTop + y) * surface->scanline + bitmap_data->destLeft * 4,
+				expected + y * bitmap_data->width * 4, width * 4) != 0)
+			match = 0;
+	}
+
+	xfree(flipped);
+	free(expected);
+
+	return match;
+}
+
+void test_gdi_bitmap_update(void)
+{
+	int i;
+	rdpGdi* gdi;
+	uint32 direct;
+	uint32 pooled;
+	uint32 allocs;
+	freerdp* instance;
+	uint8 data[8 * 4 * 2];
+	BITMAP_DATA rectangle;
+	BITMAP_UPDATE bitmap_update;
+
+	instance = freerdp_new();
+	freerdp_context_new(instance);
+	instance->settings->width = 64;
+	instance->settings->height = 32;
+	instance->settings->color_depth = 16;
+
+	gdi_init(instance, CLRBUF_32BPP, NULL);
+	gdi = instance->context->gdi;
+
+	for (i = 0; i < (int) sizeof(data); i++)
+		data[i] = (uint8) (i * 37 + 11);
+
+	memset(&rectangle, 0, sizeof(rectangle));
+	rectangle.width = 8;
+	rectangle.height = 4;
+	rectangle.bitsPerPixel = 16;
+	rectangle.compressed = false;
+	rectangle.bitmapLength = sizeof(data);
+	rectangle.bitmapDataStream = data;
+
+	bitmap_update.number = 1;
+	bitmap_update.rectangles = &rectangle;
+
+	/* no clipping region, converted straight into the primary surface */
+	rectangle.destLeft = 4;
+	rectangle.destTop = 2;
+	rectangle.destRight = 10;
+	rectangle.destBottom = 5;
+	instance->update->BitmapUpdate(instance->context, &bitmap_update);
+	CU_ASSERT(bitmap_update_matches(gdi, &rectangle));
+
+	gdi_get_bitmap_update_stats(gdi, &direct, &pooled, &allocs);
+	CU_ASSERT(direct == 1);
+	CU_ASSERT(pooled == 0);
+	CU_ASSERT(allocs == 0);
+
+	/* a clipping region goes through a pooled bitmap and BitBlt */
+	gdi_SetClipRgn(gdi->primary->hdc, 0, 0, 64, 32);
+	rectangle.destLeft = 40;
+	rectangle.destTop = 20;
+	rectangle.destRight = 47;
+	rectangle.destBottom = 23;
+	instance->update->BitmapUpdate(instance->context, &bitmap_update);
+	CU_ASSERT(bitmap_update_matches(gdi, &rectangle));
+
+	/* the pooled bitmap is reused */
+	rectangle.destLeft = 20;
+	rectangle.destRight = 27;
+	instance->update->BitmapUpdate(instance->context, &bitmap_update);
+	CU_ASSERT(bitmap_update_matches(gdi, &rectangle));
+
+	gdi_get_bitmap_update_stats(gdi, &direct, &pooled, &allocs);
+	CU_ASSERT(direct == 1);
+	CU_ASSERT(pooled == 2);
+	CU_ASSERT(allocs == 1);
+
+	/* partly off the surface */
+	gdi_SetNullClipRgn(gdi->primary->hdc);
+	rectangle.destLeft = 60;
+	rectangle.destRight = 67;
+	instance->update->BitmapUpdate(instance->context, &bitmap_update);
+
+	gdi_get_bitmap_update_stats(gdi, &direct, &pooled, &allocs);
+	CU_ASSERT(direct == 1);
+	CU_ASSERT(pooled == 3);
+	CU_ASSERT(allocs == 1);
+
+	gdi_free(instance);
+	cache_free(instance->context->cache);
+	freerdp_free(instance);
+}
+
+#define TEXT_GLYPHS		96
+#define TEXT_LINES		48
+#define TEXT_LINE_LENGTH	120
+
+/* per glyph BitBlt, what gdi_Glyph_Draw did before glyph runs were batched */
+static void test_glyph_draw_blt(rdpContext* context, rdpGlyph* glyph, int x, int y)
+{
+	gdiGlyph* gdi_glyph = (gdiGlyph*) glyph;
+
+	gdi_BitBlt(context->gdi->drawing->hdc, x, y, gdi_glyph->bitmap->width,
+			gdi_glyph->bitmap->height, gdi_glyph->hdc, 0, 0, GDI_DSPDxax);
+}
+
+/* stems, bars and a few stray pixels, with empty rows above and below */
+static void text_glyph_shape(rdpGlyph* glyph, uint32* seed)
+{
+	int x, y;
+	int scanline;
+	tbool set;
+
+	scanline = (glyph->cx + 7) / 8;
+	memset(glyph->aj, 0, glyph->cb);
+
+	for (y = 3; y < (int) glyph->cy - 3; y++)
+	{
+		for (x = 0; x < (int) glyph->cx; x++)
+		{
+			*seed = *seed * 1103515245 + 12345;
+			set = (x == 1 || x == 2 || x == (int) glyph->cx - 2 || y == 7 || y == 12 || ((*seed >> 16) & 7) == 0);
+
+			if (set)
+				glyph->aj[y * scanline + x / 8] |= 0x80 >> (x % 8);
+		}
+	}
+}
+
+static void text_glyphs_put(rdpContext* context)
+{
+	int i;
+	rdpGlyph* glyph;
+	uint32 seed = 12345;
+
+	for (i = 0; i < TEXT_GLYPHS; i++)
+	{
+		glyph = Glyph_Alloc(context);
+		glyph->x = -(i % 3);
+		glyph->y = -12;
+		glyph->cx = 5 + (i % 11);
+		glyph->cy = 16;
+		glyph->cb = ((glyph->cx + 7) / 8) * glyph->cy;
+		glyph->aj = (uint8*) xmalloc(glyph->cb);
+		text_glyph_shape(glyph, &seed);
+
+		Glyph_New(context, glyph);
+		glyph_cache_put(context->cache->glyph, 0, i, glyph);
+	}
+}
+
+/* a screen of terminal text, some lines running off the edges */
+static GLYPH_INDEX_ORDER* text_orders_new(int width)
+{
+	int i, j;
+	GLYPH_INDEX_ORDER* orders;
+
+	orders = (GLYPH_INDEX_ORDER*) xzalloc(sizeof(GLYPH_INDEX_ORDER) * TEXT_LINES);
+
+	for (i = 0; i < TEXT_LINES; i++)
+	{
+		orders[i].cacheId = 0;
+		orders[i].backColor = 0x00FF00 + i;
+		orders[i].foreColor = 0x102030 * (i + 1);
+		orders[i].x = (i % 7 == 0) ? -20 : 4;
+		orders[i].y = 14 + i * 16;
+		orders[i].bkLeft = MAX(orders[i].x, 0);
+		orders[i].bkTop = orders[i].y - 12;
+		orders[i].bkRight = width;
+		orders[i].bkBottom = orders[i].bkTop + 16;
+
+		if (i % 2 == 0)
+		{
+			orders[i].opLeft = orders[i].bkLeft;
+			orders[i].opTop = orders[i].bkTop;
+			orders[i].opRight = orders[i].bkRight;
+			orders[i].opBottom = orders[i].bkBottom;
+		}
+
+		orders[i].cbData = TEXT_LINE_LENGTH * 2;
+
+		for (j = 0; j < TEXT_LINE_LENGTH; j++)
+		{
+			orders[i].data[j * 2] = (i * 7 + j * 13) % TEXT_GLYPHS;
+			orders[i].data[j * 2 + 1] = (j == 0) ? 0 : 9;
+		}
+	}
+
+	return orders;
+}
+
+static void text_orders_replay(freerdp* instance, GLYPH_INDEX_ORDER* orders)
+{
+	int i;
+	HGDI_DC hdc = instance->context->gdi->primary->hdc;
+
+	for (i = 0; i < TEXT_LINES; i++)
+	{
+		/* every third line is clipped by bounds, as a scrolled region would be */
+		if (i % 3 == 0)
+			gdi_SetClipRgn(hdc, 100, orders[i].bkTop + 3, 400, 8);
+		else
+			gdi_SetNullClipRgn(hdc);
+
+		instance->update->primary->GlyphIndex(instance->context, &orders[i]);
+	}
+
+	gdi_SetNullClipRgn(hdc);
+}
+
+static void test_glyph_run_bpp(uint32 flags, int color_depth)
+{
+	int i;
+	rdpGdi* gdi;
+	int size;
+	uint8* batched;
+	freerdp* instance;
+	long int dur[2];
+	pGlyph_Draw batched_draw;
+	GLYPH_INDEX_ORDER* orders;
+	struct timeval start_time;
+	struct timeval end_time;
+
+	instance = freerdp_new();
+	freerdp_context_new(instance);
+	instance->settings->width = 1024;
+	instance->settings->height = 768;
+	instance->settings->color_depth = color_depth;
+
+	gdi_init(instance, flags, NULL);
+	gdi = instance->context->gdi;
+	size = gdi->primary->bitmap->scanline * gdi->primary->bitmap->height;
+
+	text_glyphs_put(instance->context);
+	orders = text_orders_new(gdi->width);
+
+	memset(gdi->primary->bitmap->data, 0x5A, size);
+	text_orders_replay(instance, orders);
+	batched = (uint8*) xmalloc(size);
+	memcpy(batched, gdi->primary->bitmap->data, size);
+
+	batched_draw = instance->context->graphics->Glyph_Prototype->Draw;
+	instance->context->graphics->Glyph_Prototype->Draw = test_glyph_draw_blt;
+	memset(gdi->primary->bitmap->data, 0x5A, size);
+	text_orders_replay(instance, orders);
+	CU_ASSERT(memcmp(batched, gdi->primary->bitmap->data, size) == 0);
+
+	/* replay the stream both ways */
+	for (i = 0; i < 2; i++)
+	{
+		instance->context->graphics->Glyph_Prototype->Draw = (i == 0) ? test_glyph_draw_blt : batched_draw;
+		gettimeofday(&start_time, NULL);
+		text_orders_replay(instance, orders);
+		text_orders_replay(instance, orders);
+		text_orders_replay(instance, orders);
+		text_orders_replay(instance, orders);
+		gettimeofday(&end_time, NULL);
+		dur[i] = ((end_time.tv_sec - start_time.tv_sec) * 1000000) + (end_time.tv_usec - start_time.tv_usec);
+	}
+
+	printf("\n%dbpp text: per glyph BitBlt %ld ns/glyph, glyph runs %ld ns/glyph", gdi->dstBpp,
+		dur[0] * 1000 / (4 * TEXT_LINES * TEXT_LINE_LENGTH), dur[1] * 1000 / (4 * TEXT_LINES * TEXT_LINE_LENGTH));
+
+	xfree(batched);
+	xfree(orders);
+	gdi_free(instance);
+	cache_free(instance->context->cache);
+	freerdp_free(instance);
+}
+
+void test_gdi_glyph_run(void)
+{
+	test_glyph_run_bpp(CLRBUF_32BPP, 24);
+	test_glyph_run_bpp(CLRBUF_16BPP, 16);
+}
+
+#define ROP_WIDTH	67
+#define ROP_HEIGHT	19
+
+struct rop_rect
+{
+	int x, y;
+	int width, height;
+	int srcx, srcy;
+};
+
+/* odd widths for the kernel tails, plus rectangles hanging off the bitmap */
+static const struct rop_rect rop_rects[] =
+{
+	{ 0, 0, ROP_WIDTH, ROP_HEIGHT, 0, 0 },
+	{ 3, 2, 1, 5, 7, 1 },
+	{ 5, 1, 17, 9, 40, 6 },
+	{ 2, 4, 61, 11, 1, 3 },
+	{ -6, -3, 30, 10, 9, 5 },
+	{ 50, 12, 40, 20, 2, 0 }
+};
+
+static void rop_fill(uint8* data, int size, uint32 seed)
+{
+	int i;
+
+	for (i = 0; i < size; i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		data[i] = (uint8) (seed >> 16);
+	}
+}
+
+static uint8 rop_ref_byte(uint8 rop3, uint8 d, uint8 s, uint8 p)
+{
+	int k;
+	uint8 r = 0;
+
+	for (k = 0; k < 8; k++)
+	{
+		if (rop3 & (1 << k))
+			r |= ((k & 4) ? p : ~p) & ((k & 2) ? s : ~s) & ((k & 1) ? d : ~d);
+	}
+
+	return r;
+}
+
+/* the pattern pixel a raster operation sees at (x, y) of its clipped rectangle */
+static void rop_ref_pattern(HGDI_DC hdc, int x, int y, uint8* pixel)
+{
+	uint8 color8;
+	uint16 color16;
+	uint32 color32;
+	HGDI_BITMAP pattern;
+	int bpp = hdc->bytesPerPixel;
+
+	if (hdc->brush != NULL && hdc->brush->style == GDI_BS_PATTERN)
+	{
+		pattern = hdc->brush->pattern;
+		memcpy(pixel, pattern->data + (y % pattern->height) * pattern->scanline +
+				(x % pattern->width) * pattern->bytesPerPixel, bpp);
+	}
+	else if (hdc->brush != NULL && hdc->brush->style == GDI_BS_SOLID)
+	{
+		color8 = (hdc->brush->color >> 16) & 0xFF;
+		color16 = gdi_get_color_16bpp(hdc, hdc->brush->color);
+		color32 = gdi_get_color_32bpp(hdc, hdc->brush->color);
+		memcpy(pixel, (bpp == 1) ? &color8 : ((bpp == 2) ? (uint8*) &color16 : (uint8*) &color32), bpp);
+	}
+	else
+	{
+		memcpy(pixel, &hdc->textColor, bpp);
+	}
+}
+
+/* one pixel at a time, from a copy of the source taken before the blit */
+static void rop_ref_blt(HGDI_DC hdcDst, struct rop_rect* rect, uint8* dst, uint8* src, int src_width, uint8 rop3)
+{
+	int i;
+	int x, y;
+	int nXDst, nYDst;
+	int nWidth, nHeight;
+	int nXSrc, nYSrc;
+	uint8* d;
+	uint8* s;
+	uint8 p[4];
+	int bpp = hdcDst->bytesPerPixel;
+
+	nXDst = rect->x;
+	nYDst = rect->y;
+	nWidth = rect->width;
+	nHeight = rect->height;
+	nXSrc = rect->srcx;
+	nYSrc = rect->srcy;
+
+	if (gdi_ClipCoords(hdcDst, &nXDst, &nYDst, &nWidth, &nHeight, &nXSrc, &nYSrc) == 0)
+		return;
+
+	for (y = 0; y < nHeight; y++)
+	{
+		for (x = 0; x < nWidth; x++)
+		{
+			/* the rectangle is clipped to the source as well, if there is one */
+			if (GDI_ROP3_USES_SRC(rop3) && (nXSrc + x < 0 || nXSrc + x >= src_width || nYSrc + y < 0 || nYSrc + y >= ROP_HEIGHT))
+				continue;
+
+			d = dst + ((nYDst + y) * ROP_WIDTH + nXDst + x) * bpp;
+			s = GDI_ROP3_USES_SRC(rop3) ? src + ((nYSrc + y) * src_width + nXSrc + x) * bpp : d;
+			rop_ref_pattern(hdcDst, x, y, p);
+
+			for (i = 0; i < bpp; i++)
+				d[i] = rop_ref_byte(rop3, d[i], s[i], p[i]);
+		}
+	}
+}
+
+/* every ROP3 index the engine handles, for one brush */
+static void test_rop_brush(HGDI_DC hdcDst, HGDI_DC hdcSrc, int* failures)
+{
+	int i;
+	int rop3;
+	int size;
+	uint8* expected;
+	uint8* original;
+	struct rop_rect rect;
+	HGDI_BITMAP hBmpDst = (HGDI_BITMAP) hdcDst->selectedObject;
+	HGDI_BITMAP hBmpSrc = (HGDI_BITMAP) hdcSrc->selectedObject;
+
+	size = ROP_WIDTH * ROP_HEIGHT * hdcDst->bytesPerPixel;
+	expected = (uint8*) xmalloc(size);
+	original = (uint8*) xmalloc(size);
+
+	for (rop3 = 0; rop3 < 256; rop3++)
+	{
+		/* done by the depth specific code */
+		if (rop3 == 0x00 || rop3 == 0xFF || rop3 == 0xCC || rop3 == 0xE2)
+			continue;
+
+		for (i = 0; i < (int) (sizeof(rop_rects) / sizeof(rop_rects[0])); i++)
+		{
+			rect = rop_rects[i];
+			gdi_SetClipRgn(hdcDst, 4, 2, 50, 14);
+
+			if (i % 2 == 0)
+				gdi_SetNullClipRgn(hdcDst);
+
+			/* separate bitmaps */
+			rop_fill(hBmpDst->data, size, rop3 * 7 + i);
+			memcpy(expected, hBmpDst->data, size);
+			rop_ref_blt(hdcDst, &rect, expected, hBmpSrc->data, ROP_WIDTH, rop3);
+			gdi_BitBlt(hdcDst, rect.x, rect.y, rect.width, rect.height,
+					hdcSrc, rect.srcx, rect.srcy, gdi_rop3_code(rop3));
+
+			if (memcmp(expected, hBmpDst->data, size) != 0)
+				(*failures)++;
+
+			/* the source overlapping the destination, shifted a pixel or a row either way */
+			rop_fill(hBmpDst->data, size, rop3 * 13 + i);
+			memcpy(original, hBmpDst->data, size);
+			memcpy(expected, hBmpDst->data, size);
+			rect.srcx = MAX(rect.x, 0) + (i % 3) - 1;
+			rect.srcy = MAX(rect.y, 0) + ((i + 1) % 3) - 1;
+			rop_ref_blt(hdcDst, &rect, expected, original, ROP_WIDTH, rop3);
+			gdi_BitBlt(hdcDst, rect.x, rect.y, rect.width, rect.height,
+					hdcDst, rect.srcx, rect.srcy, gdi_rop3_code(rop3));
+
+			if (memcmp(expected, hBmpDst->data, size) != 0)
+				(*failures)++;
+
+			if (GDI_ROP3_USES_SRC(rop3))
+				continue;
+
+			rop_fill(hBmpDst->data, size, rop3 * 5 + i);
+			memcpy(expected, hBmpDst->data, size);
+			rop_ref_blt(hdcDst, &rect, expected, expected, ROP_WIDTH, rop3);
+			gdi_PatBlt(hdcDst, rect.x, rect.y, rect.width, rect.height, gdi_rop3_code(rop3));
+
+			if (memcmp(expected, hBmpDst->data, size) != 0)
+				(*failures)++;
+		}
+	}
+
+	gdi_SetNullClipRgn(hdcDst);
+
+	xfree(original);
+	xfree(expected);
+}
+
+static void test_rop_bpp(int bpp, uint32 cpu_opt)
+{
+	int failures;
+	uint8* data;
+	HGDI_DC hdcDst;
+	HGDI_DC hdcSrc;
+	HGDI_BRUSH hBrush;
+	HGDI_BITMAP hBmpDst;
+	HGDI_BITMAP hBmpSrc;
+	HGDI_BITMAP hBmpPat;
+	HGDI_BITMAP hBmpOdd;
+
+	gdi_rop_set_cpu_opt(cpu_opt);
+
+	hdcDst = gdi_GetDC();
+	hdcDst->bytesPerPixel = bpp / 8;
+	hdcDst->bitsPerPixel = bpp;
+	hdcDst->alpha = 0;
+	hdcDst->invert = 0;
+	hdcDst->textColor = 0x00A1B2C3;
+	hdcDst->brush = NULL;
+
+	hdcSrc = gdi_GetDC();
+	hdcSrc->bytesPerPixel = bpp / 8;
+	hdcSrc->bitsPerPixel = bpp;
+
+	hBmpDst = gdi_CreateBitmap(ROP_WIDTH, ROP_HEIGHT, bpp, (uint8*) xmalloc(ROP_WIDTH * ROP_HEIGHT * bpp / 8));
+	hBmpSrc = gdi_CreateBitmap(ROP_WIDTH, ROP_HEIGHT, bpp, (uint8*) xmalloc(ROP_WIDTH * ROP_HEIGHT * bpp / 8));
+	rop_fill(hBmpSrc->data, ROP_WIDTH * ROP_HEIGHT * bpp / 8, 4321);
+	gdi_SelectObject(hdcDst, (HGDIOBJECT) hBmpDst);
+	gdi_SelectObject(hdcSrc, (HGDIOBJECT) hBmpSrc);
+
+	/* an 8x8 brush fits the pattern tile, a 5x3 one is wrapped pixel by pixel */
+	data = (uint8*) xmalloc(8 * 8 * bpp / 8);
+	rop_fill(data, 8 * 8 * bpp / 8, 99);
+	hBmpPat = gdi_CreateBitmap(8, 8, bpp, data);
+	data = (uint8*) xmalloc(5 * 3 * bpp / 8);
+	rop_fill(data, 5 * 3 * bpp / 8, 77);
+	hBmpOdd = gdi_CreateBitmap(5, 3, bpp, data);
+
+	failures = 0;
+
+	/* no brush, the text color is the pattern */
+	test_rop_brush(hdcDst, hdcSrc, &failures);
+
+	hBrush = gdi_CreateSolidBrush(0x00123456);
+	hdcDst->brush = hBrush;
+	test_rop_brush(hdcDst, hdcSrc, &failures);
+	gdi_DeleteObject((HGDIOBJECT) hBrush);
+
+	/* deleting a pattern brush deletes its bitmap */
+	hBrush = gdi_CreatePatternBrush(hBmpPat);
+	hdcDst->brush = hBrush;
+	test_rop_brush(hdcDst, hdcSrc, &failures);
+	gdi_DeleteObject((HGDIOBJECT) hBrush);
+
+	hBrush = gdi_CreatePatternBrush(hBmpOdd);
+	hdcDst->brush = hBrush;
+	test_rop_brush(hdcDst, hdcSrc, &failures);
+	gdi_DeleteObject((HGDIOBJECT) hBrush);
+
+	hdcDst->brush = NULL;
+	CU_ASSERT(failures == 0);
+
+	gdi_DeleteObject((HGDIOBJECT) hBmpDst);
+	gdi_DeleteObject((HGDIOBJECT) hBmpSrc);
+	gdi_DeleteDC(hdcDst);
+	gdi_DeleteDC(hdcSrc);
+}
+
+/* full screen blits with one kernel set, in ns per pixel */
+static void bench_rop_kernels(HGDI_DC hdcDst, HGDI_DC hdcSrc, const char* name)
+{
+	int i;
+	long int dur[3];
+	struct timeval start_time;
+	struct timeval end_time;
+	const int rops[3] = { GDI_SRCINVERT, GDI_PATINVERT, GDI_PATPAINT };
+	HGDI_BITMAP hBmp = (HGDI_BITMAP) hdcDst->selectedObject;
+
+	for (i = 0; i < 3; i++)
+	{
+		gettimeofday(&start_time, NULL);
+		gdi_BitBlt(hdcDst, 0, 0, hBmp->width, hBmp->height, hdcSrc, 0, 0, rops[i]);
+		gdi_BitBlt(hdcDst, 0, 0, hBmp->width, hBmp->height, hdcSrc, 0, 0, rops[i]);
+		gdi_BitBlt(hdcDst, 0, 0, hBmp->width, hBmp->height, hdcSrc, 0, 0, rops[i]);
+		gdi_BitBlt(hdcDst, 0, 0, hBmp->width, hBmp->height, hdcSrc, 0, 0, rops[i]);
+		gettimeofday(&end_time, NULL);
+		dur[i] = ((end_time.tv_sec - start_time.tv_sec) * 1000000) + (end_time.tv_usec - start_time.tv_usec);
+	}
+
+	printf("\n32bpp %s: SRCINVERT %.2f ns/pixel, PATINVERT %.2f ns/pixel, PATPAINT %.2f ns/pixel", name,
+		dur[0] * 1000.0 / (4 * hBmp->width * hBmp->height), dur[1] * 1000.0 / (4 * hBmp->width * hBmp->height),
+		dur[2] * 1000.0 / (4 * hBmp->width * hBmp->height));
+}
+
+static void bench_rop(void)
+{
+	uint8* data;
+	HGDI_DC hdcDst;
+	HGDI_DC hdcSrc;
+	HGDI_BRUSH hBrush;
+	HGDI_BITMAP hBmpDst;
+	HGDI_BITMAP hBmpSrc;
+	HGDI_BITMAP hBmpPat;
+
+	hdcDst = gdi_GetDC();
+	hdcDst->alpha = 0;
+	hdcDst->invert = 0;
+	hdcSrc = gdi_GetDC();
+
+	hBmpDst = gdi_CreateBitmap(1024, 768, 32, (uint8*) xzalloc(1024 * 768 * 4));
+	hBmpSrc = gdi_CreateBitmap(1024, 768, 32, (uint8*) xzalloc(1024 * 768 * 4));
+	gdi_SelectObject(hdcDst, (HGDIOBJECT) hBmpDst);
+	gdi_SelectObject(hdcSrc, (HGDIOBJECT) hBmpSrc);
+
+	data = (uint8*) xmalloc(8 * 8 * 4);
+	rop_fill(data, 8 * 8 * 4, 99);
+	hBmpPat = gdi_CreateBitmap(8, 8, 32, data);
+	hBrush = gdi_CreatePatternBrush(hBmpPat);
+	hdcDst->brush = hBrush;
+
+	gdi_rop_set_cpu_opt(0);
+	bench_rop_kernels(hdcDst, hdcSrc, "scalar");
+
+#ifdef WITH_SSE2
+	gdi_rop_set_cpu_opt(CPU_SSE2);
+	bench_rop_kernels(hdcDst, hdcSrc, "sse2");
+#endif
+
+#if defined(WITH_AVX2) && defined(__GNUC__)
+	if (__builtin_cpu_supports("avx2"))
+	{
+		gdi_rop_set_cpu_opt(CPU_SSE2 | CPU_AVX2);
+		bench_rop_kernels(hdcDst, hdcSrc, "avx2");
+	}
+#endif
+
+	gdi_rop_set_cpu_opt(0);
+
+	gdi_DeleteObject((HGDIOBJECT) hBrush);
+	gdi_DeleteObject((HGDIOBJECT) hBmpDst);
+	gdi_DeleteObject((HGDIOBJECT) hBmpSrc);
+	gdi_DeleteDC(hdcDst);
+	gdi_DeleteDC(hdcSrc);
+}
+
+void test_gdi_rop(void)
+{
+	int bpp;
+
+	for (bpp = 8; bpp <= 32; bpp *= 2)
+	{
+		test_rop_bpp(bpp, 0);
+
+#ifdef WITH_SSE2
+		test_rop_bpp(bpp, CPU_SSE2);
+#endif
+
+#if defined(WITH_AVX2) && defined(__GNUC__)
+		if (__builtin_cpu_supports("avx2"))
+			test_rop_bpp(bpp, CPU_SSE2 | CPU_AVX2);
+#endif
+	}
+
+	gdi_rop_set_cpu_opt(0);
+	bench_rop();
+}
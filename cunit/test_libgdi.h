@@ -45,3 +45,7 @@ void test_gdi_BitBlt_16bpp(void);
 void test_gdi_BitBlt_8bpp(void);
 void test_gdi_ClipCoords(void);
 void test_gdi_InvalidateRegion(void);
+void test_gdi_Region(void);
+void test_gdi_bitmap_update(void);
+void test_gdi_glyph_run(void);
+void test_gdi_rop(void);
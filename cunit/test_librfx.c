@@ -25,6 +25,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/time.h>
 #include <freerdp/types.h>
 #include <freerdp/utils/print.h>
 #include <freerdp/utils/memory.h>
@@ -38,6 +39,15 @@
 #include "rfx_dwt.h"
 #include "rfx_decode.h"
 #include "rfx_encode.h"
+#include "rfx_workers.h"
+
+#ifdef WITH_SSE2
+#include "rfx_sse2.h"
+#endif
+
+#ifdef WITH_AVX2
+#include "rfx_avx2.h"
+#endif
 
 #include "test_librfx.h"
 
@@ -176,12 +186,19 @@ int add_librfx_suite(void)
 	add_test_function(bitstream);
 	add_test_function(bitstream_enc);
 	add_test_function(rlgr);
+	add_test_function(rlgr_fast);
 	add_test_function(differential);
 	add_test_function(quantization);
 	add_test_function(dwt);
 	add_test_function(decode);
 	add_test_function(encode);
 	add_test_function(message);
+	add_test_function(encode_threads);
+	add_test_function(decode_threads);
+	add_test_function(tile_cache);
+	add_test_function(surface);
+	add_test_function(simd);
+	add_test_function(simd_bench);
 
 	return 0;
 }
@@ -251,6 +268,87 @@ void test_rlgr(void)
 	//dump_buffer(buffer, n);
 }
 
+static void fill_test_coefficients(sint16* data, int count, int variant)
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+	{
+		switch (variant % 4)
+		{
+			case 0: /* mostly zeros, like the high bands of a flat tile */
+				data[i] = (rand() % 16 == 0) ? (sint16) (rand() % 7 - 3) : 0;
+				break;
+			case 1: /* small values */
+				data[i] = (sint16) (rand() % 41 - 20);
+				break;
+			case 2: /* the full range */
+				data[i] = (sint16) (rand() & 0xFFFF);
+				break;
+			default: /* long runs mixed with big spikes */
+				data[i] = (rand() % 64 == 0) ? (sint16) (rand() % 4001 - 2000) : 0;
+				break;
+		}
+	}
+}
+
+void test_rlgr_fast(void)
+{
+	int i;
+	int n1, n2;
+	int len;
+	int variant;
+	int buffer_size;
+	RLGR_MODE mode;
+	sint16 data[4096];
+	sint16 out1[4096];
+	sint16 out2[4096];
+	uint8 enc1[4096 * 3];
+	uint8 enc2[4096 * 3];
+
+	srand(4);
+
+	for (variant = 0; variant < 64; variant++)
+	{
+		mode = (variant & 4) ? RLGR1 : RLGR3;
+		fill_test_coefficients(data, 4096, variant);
+
+		/* a big buffer and one the coder overflows */
+		buffer_size = (variant & 8) ? 97 : sizeof(enc1);
+
+		memset(enc1, 0xA5, sizeof(enc1));
+		memset(enc2, 0xA5, sizeof(enc2));
+		n1 = rfx_rlgr_encode(mode, data, 4096, enc1, buffer_size);
+		n2 = rfx_rlgr_encode_fast(mode, data, 4096, enc2, buffer_size);
+		CU_ASSERT(n1 == n2);
+		CU_ASSERT(memcmp(enc1, enc2, sizeof(enc1)) == 0);
+		len = n2;
+
+		/* decode what was encoded, and a truncated copy of it */
+		for (i = 0; i < 2; i++)
+		{
+			memset(out1, 0, sizeof(out1));
+			memset(out2, 0, sizeof(out2));
+			n1 = rfx_rlgr_decode(mode, enc1, i ? len / 2 : len, out1, 4096);
+			n2 = rfx_rlgr_decode_fast(mode, enc1, i ? len / 2 : len, out2, 4096);
+			CU_ASSERT(n1 == n2);
+			CU_ASSERT(memcmp(out1, out2, sizeof(out1)) == 0);
+		}
+
+		/* random garbage must decode the same way too */
+		for (i = 0; i < (int) sizeof(enc1); i++)
+			enc1[i] = (uint8) rand();
+
+		n2 = 1 + rand() % 3000;
+		memset(out1, 0, sizeof(out1));
+		memset(out2, 0, sizeof(out2));
+		n1 = rfx_rlgr_decode(mode, enc1, n2, out1, 4096);
+		n2 = rfx_rlgr_decode_fast(mode, enc1, n2, out2, 4096);
+		CU_ASSERT(n1 == n2);
+		CU_ASSERT(memcmp(out1, out2, sizeof(out1)) == 0);
+	}
+}
+
 void test_differential(void)
 {
 	rfx_differential_decode(buffer + 4032, 64);
@@ -268,7 +366,7 @@ void test_dwt(void)
 	RFX_CONTEXT* context;
 
 	context = rfx_context_new();
-	rfx_dwt_2d_decode(buffer, context->priv->dwt_buffer);
+	rfx_dwt_2d_decode(buffer, context->priv->scratch->dwt_buffer);
 	//dump_buffer(buffer, 4096);
 	rfx_context_free(context);
 }
@@ -341,7 +439,7 @@ void test_encode(void)
 	rfx_encode_rgb(context, rgb_data, 64, 64, 64 * 3,
 		test_quantization_values, test_quantization_values, test_quantization_values,
 		enc_stream, &y_size, &cb_size, &cr_size);
-	//dump_buffer(context->priv->cb_g_buffer, 4096);
+	//dump_buffer(context->priv->scratch->cb_g_buffer, 4096);
 
 	/*printf("*** Y ***\n");
 	freerdp_hexdump(stream_get_head(enc_stream), y_size);
@@ -408,3 +506,414 @@ void test_message(void)
 	rfx_context_free(context);
 	free(rgb_data);
 }
+
+static void compose_test_message(RFX_CONTEXT* context, STREAM* s, uint8* image, int width, int height)
+{
+	RFX_RECT rect;
+
+	rect.x = 0;
+	rect.y = 0;
+	rect.width = width;
+	rect.height = height;
+
+	rfx_context_reset(context);
+	stream_set_pos(s, 0);
+	rfx_compose_message(context, s, &rect, 1, image, width, height, width * 4);
+	stream_seal(s);
+}
+
+void test_encode_threads(void)
+{
+	int i;
+	int width = 300;
+	int height = 260;
+	uint8* image;
+	STREAM* serial;
+	STREAM* threaded;
+	RFX_CONTEXT* context;
+
+	/* something with enough detail to give every tile a different length */
+	image = (uint8*) xmalloc(width * height * 4);
+	srand(1);
+	for (i = 0; i < width * height * 4; i++)
+		image[i] = (i & 3) == 3 ? 0xFF : (uint8) (((i / 4) % width) + (rand() & 0x1F));
+
+	serial = stream_new(65536);
+	threaded = stream_new(65536);
+
+	context = rfx_context_new();
+	context->mode = RLGR3;
+	context->width = width;
+	context->height = height;
+	rfx_context_set_pixel_format(context, RFX_PIXEL_FORMAT_BGRA);
+
+	compose_test_message(context, serial, image, width, height);
+
+	rfx_context_set_threads(context, 3);
+
+	/* run twice so the per-row streams get reused */
+	for (i = 0; i < 2; i++)
+	{
+		compose_test_message(context, threaded, image, width, height);
+
+		CU_ASSERT(stream_get_length(threaded) == stream_get_length(serial));
+		CU_ASSERT(memcmp(stream_get_head(threaded), stream_get_head(serial),
+			stream_get_length(serial)) == 0);
+	}
+
+	rfx_context_free(context);
+	stream_free(serial);
+	stream_free(threaded);
+	xfree(image);
+}
+
+void test_decode_threads(void)
+{
+	int i;
+	int width = 300;
+	int height = 260;
+	uint8* image;
+	STREAM* s;
+	RFX_CONTEXT* context;
+	RFX_MESSAGE* serial;
+	RFX_MESSAGE* threaded;
+
+	image = (uint8*) xmalloc(width * height * 4);
+	srand(2);
+	for (i = 0; i < width * height * 4; i++)
+		image[i] = (uint8) (rand() & 0xFF);
+
+	s = stream_new(65536);
+
+	context = rfx_context_new();
+	context->mode = RLGR3;
+	context->width = width;
+	context->height = height;
+	rfx_context_set_pixel_format(context, RFX_PIXEL_FORMAT_BGRA);
+
+	compose_test_message(context, s, image, width, height);
+
+	serial = rfx_process_message(context, stream_get_head(s), stream_get_length(s));
+
+	rfx_context_set_threads(context, 3);
+	threaded = rfx_process_message(context, stream_get_head(s), stream_get_length(s));
+
+	CU_ASSERT(serial->num_tiles == 25);
+	CU_ASSERT(threaded->num_tiles == serial->num_tiles);
+
+	for (i = 0; i < serial->num_tiles; i++)
+	{
+		CU_ASSERT(threaded->tiles[i]->x == serial->tiles[i]->x);
+		CU_ASSERT(threaded->tiles[i]->y == serial->tiles[i]->y);
+		CU_ASSERT(memcmp(threaded->tiles[i]->data, serial->tiles[i]->data, 4096 * 4) == 0);
+	}
+
+	rfx_message_free(context, serial);
+	rfx_message_free(context, threaded);
+	rfx_context_free(context);
+	stream_free(s);
+	xfree(image);
+}
+
+void test_tile_cache(void)
+{
+	int i;
+	int width = 300;
+	int height = 260;
+	uint8* image;
+	STREAM* s;
+	RFX_RECT rect = { 0, 0, 300, 260 };
+	RFX_CONTEXT* context;
+	RFX_MESSAGE* message;
+	uint32 encoded;
+	uint32 skipped;
+
+	image = (uint8*) xmalloc(width * height * 4);
+	srand(3);
+	for (i = 0; i < width * height * 4; i++)
+		image[i] = (uint8) (rand() & 0xFF);
+
+	s = stream_new(65536);
+
+	context = rfx_context_new();
+	context->mode = RLGR3;
+	context->width = width;
+	context->height = height;
+	rfx_context_set_pixel_format(context, RFX_PIXEL_FORMAT_BGRA);
+	rfx_context_set_tile_cache(context, true);
+
+	/* first frame sends every tile */
+	rfx_compose_message(context, s, &rect, 1, image, width, height, width * 4);
+	rfx_context_get_tile_stats(context, &encoded, &skipped);
+	CU_ASSERT(encoded == 25 && skipped == 0);
+
+	/* same pixels again, nothing to send */
+	stream_set_pos(s, 0);
+	rfx_compose_message(context, s, &rect, 1, image, width, height, width * 4);
+	CU_ASSERT(stream_get_pos(s) == 0);
+	rfx_context_get_tile_stats(context, &encoded, &skipped);
+	CU_ASSERT(encoded == 25 && skipped == 25);
+
+	/* touch one pixel in tile (2, 1) and one in the last tile (4, 4) */
+	image[(70 * width + 130) * 4] ^= 0xFF;
+	image[(259 * width + 299) * 4] ^= 0xFF;
+
+	stream_set_pos(s, 0);
+	rfx_compose_message(context, s, &rect, 1, image, width, height, width * 4);
+	stream_seal(s);
+	rfx_context_get_tile_stats(context, &encoded, &skipped);
+	CU_ASSERT(encoded == 27 && skipped == 48);
+
+	message = rfx_process_message(context, stream_get_head(s), stream_get_length(s));
+	CU_ASSERT(message->num_tiles == 2);
+	CU_ASSERT(message->tiles[0]->x == 128 && message->tiles[0]->y == 64);
+	CU_ASSERT(message->tiles[1]->x == 256 && message->tiles[1]->y == 256);
+	CU_ASSERT(message->num_rects == 2);
+	CU_ASSERT(message->rects[0].x == 128 && message->rects[0].y == 64 &&
+		message->rects[0].width == 64 && message->rects[0].height == 64);
+	CU_ASSERT(message->rects[1].x == 256 && message->rects[1].y == 256 &&
+		message->rects[1].width == 44 && message->rects[1].height == 4);
+	rfx_message_free(context, message);
+
+	rfx_context_free(context);
+	stream_free(s);
+	xfree(image);
+}
+
+/* the old client path, every tile blitted once per rect with clipping */
+static void blit_test_message(RFX_MESSAGE* message, uint8* dst, int dst_width, int dst_height,
+	int left, int top)
+{
+	int i, j;
+	int x, y;
+	int tx, ty;
+	RFX_RECT* rect;
+
+	for (i = 0; i < message->num_tiles; i++)
+	{
+		for (j = 0; j < message->num_rects; j++)
+		{
+			rect = &message->rects[j];
+
+			for (y = 0; y < 64; y++)
+			{
+				for (x = 0; x < 64; x++)
+				{
+					tx = message->tiles[i]->x + x;
+					ty = message->tiles[i]->y + y;
+
+					if (tx < rect->x || tx >= rect->x + rect->width ||
+						ty < rect->y || ty >= rect->y + rect->height ||
+						left + tx < 0 || left + tx >= dst_width ||
+						top + ty < 0 || top + ty >= dst_height)
+						continue;
+
+					memcpy(dst + ((top + ty) * dst_width + left + tx) * 4,
+						message->tiles[i]->data + (y * 64 + x) * 4, 4);
+				}
+			}
+		}
+	}
+}
+
+void test_surface(void)
+{
+	int i;
+	int width = 300;
+	int height = 260;
+	int dst_width = 280;
+	int dst_height = 250;
+	uint8* image;
+	uint8* expected;
+	uint8* surface;
+	STREAM* s;
+	RFX_RECT rects[2] = { { 10, 20, 150, 100 }, { 100, 150, 200, 110 } };
+	RFX_CONTEXT* context;
+	RFX_MESSAGE* message;
+
+	image = (uint8*) xmalloc(width * height * 4);
+	expected = (uint8*) xmalloc(dst_width * dst_height * 4);
+	surface = (uint8*) xmalloc(dst_width * dst_height * 4);
+	srand(5);
+	for (i = 0; i < width * height * 4; i++)
+		image[i] = (uint8) (rand() & 0xFF);
+
+	s = stream_new(65536);
+
+	context = rfx_context_new();
+	context->mode = RLGR3;
+	context->width = width;
+	context->height = height;
+	rfx_context_set_pixel_format(context, RFX_PIXEL_FORMAT_BGRA);
+	rfx_compose_message(context, s, rects, 2, image, width, height, width * 4);
+	stream_seal(s);
+
+	/* placed so that the message hangs over the right and bottom edges */
+	for (i = 0; i < 2; i++)
+	{
+		memset(expected, 0x5A, dst_width * dst_height * 4);
+		memset(surface, 0x5A, dst_width * dst_height * 4);
+
+		message = rfx_process_message(context, stream_get_head(s), stream_get_length(s));
+		blit_test_message(message, expected, dst_width, dst_height, 7, 3);
+		rfx_message_free(context, message);
+
+		message = rfx_process_message_to_surface(context, stream_get_head(s), stream_get_length(s),
+			surface, dst_width, dst_height, dst_width * 4, RFX_PIXEL_FORMAT_BGRA, 7, 3);
+		CU_ASSERT(message != NULL);
+		CU_ASSERT(message->num_rects == 2);
+		rfx_message_free(context, message);
+
+		CU_ASSERT(memcmp(expected, surface, dst_width * dst_height * 4) == 0);
+
+		/* same again on the worker pool */
+		rfx_context_set_threads(context, 3);
+	}
+
+	rfx_context_free(context);
+	stream_free(s);
+	xfree(image);
+	xfree(expected);
+	xfree(surface);
+}
+
+static void fill_test_buffer(sint16* buffer, int count, int min, int max)
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+		buffer[i] = (sint16) (min + rand() % (max - min + 1));
+}
+
+static void fill_simd_buffers(RFX_CONTEXT* context, int encode, int seed)
+{
+	RFX_SCRATCH* scratch = context->priv->scratch;
+
+	/* RGB samples to encode, small quantized coefficients to decode */
+	srand(seed);
+	fill_test_buffer(scratch->y_r_buffer, 4096, encode ? 0 : -32, encode ? 255 : 32);
+	fill_test_buffer(scratch->cb_g_buffer, 4096, encode ? 0 : -32, encode ? 255 : 32);
+	fill_test_buffer(scratch->cr_b_buffer, 4096, encode ? 0 : -32, encode ? 255 : 32);
+}
+
+static void run_simd_kernels(RFX_CONTEXT* context, int encode)
+{
+	RFX_SCRATCH* scratch = context->priv->scratch;
+	uint32 quants[10] = { 6, 6, 6, 6, 7, 7, 8, 8, 8, 9 };
+
+	if (encode)
+	{
+		context->encode_rgb_to_ycbcr(scratch->y_r_buffer, scratch->cb_g_buffer, scratch->cr_b_buffer);
+		context->dwt_2d_encode(scratch->y_r_buffer, scratch->dwt_buffer);
+		context->dwt_2d_encode(scratch->cb_g_buffer, scratch->dwt_buffer);
+		context->dwt_2d_encode(scratch->cr_b_buffer, scratch->dwt_buffer);
+		context->quantization_encode(scratch->y_r_buffer, quants);
+		context->quantization_encode(scratch->cb_g_buffer, quants);
+		context->quantization_encode(scratch->cr_b_buffer, quants);
+	}
+	else
+	{
+		context->quantization_decode(scratch->y_r_buffer, quants);
+		context->quantization_decode(scratch->cb_g_buffer, quants);
+		context->quantization_decode(scratch->cr_b_buffer, quants);
+		context->dwt_2d_decode(scratch->y_r_buffer, scratch->dwt_buffer);
+		context->dwt_2d_decode(scratch->cb_g_buffer, scratch->dwt_buffer);
+		context->dwt_2d_decode(scratch->cr_b_buffer, scratch->dwt_buffer);
+		context->decode_ycbcr_to_rgb(scratch->y_r_buffer, scratch->cb_g_buffer, scratch->cr_b_buffer);
+	}
+}
+
+static int simd_buffers_equal(RFX_CONTEXT* context1, RFX_CONTEXT* context2)
+{
+	RFX_SCRATCH* s1 = context1->priv->scratch;
+	RFX_SCRATCH* s2 = context2->priv->scratch;
+
+	return memcmp(s1->y_r_buffer, s2->y_r_buffer, 4096 * sizeof(sint16)) == 0 &&
+		memcmp(s1->cb_g_buffer, s2->cb_g_buffer, 4096 * sizeof(sint16)) == 0 &&
+		memcmp(s1->cr_b_buffer, s2->cr_b_buffer, 4096 * sizeof(sint16)) == 0;
+}
+
+void test_simd(void)
+{
+#if defined(WITH_SSE2) && defined(WITH_AVX2) && defined(__GNUC__)
+	int seed;
+	RFX_CONTEXT* sse2;
+	RFX_CONTEXT* avx2;
+
+	if (!__builtin_cpu_supports("avx2"))
+		return;
+
+	sse2 = rfx_context_new();
+	avx2 = rfx_context_new();
+	rfx_init_sse2(sse2);
+	rfx_init_avx2(avx2);
+
+	/* the AVX2 kernels must give exactly what the SSE2 ones give */
+	for (seed = 1; seed <= 8; seed++)
+	{
+		fill_simd_buffers(sse2, 1, seed);
+		fill_simd_buffers(avx2, 1, seed);
+		run_simd_kernels(sse2, 1);
+		run_simd_kernels(avx2, 1);
+		CU_ASSERT(simd_buffers_equal(sse2, avx2));
+
+		fill_simd_buffers(sse2, 0, seed);
+		fill_simd_buffers(avx2, 0, seed);
+		run_simd_kernels(sse2, 0);
+		run_simd_kernels(avx2, 0);
+		CU_ASSERT(simd_buffers_equal(sse2, avx2));
+	}
+
+	rfx_context_free(sse2);
+	rfx_context_free(avx2);
+#endif
+}
+
+static void bench_simd_kernels(RFX_CONTEXT* context, const char* name)
+{
+	int i;
+	int encode;
+	int tiles = 2000;
+	long int dur[2];
+	struct timeval start_time;
+	struct timeval end_time;
+
+	/* the kernels work in place, so later rounds run on their own output */
+	for (encode = 0; encode < 2; encode++)
+	{
+		fill_simd_buffers(context, encode, 1);
+		gettimeofday(&start_time, NULL);
+		for (i = 0; i < tiles; i++)
+			run_simd_kernels(context, encode);
+		gettimeofday(&end_time, NULL);
+		dur[encode] = ((end_time.tv_sec - start_time.tv_sec) * 1000000) + (end_time.tv_usec - start_time.tv_usec);
+	}
+
+	printf("\n%s: decode %ld ns/tile, encode %ld ns/tile", name,
+		dur[0] * 1000 / tiles, dur[1] * 1000 / tiles);
+}
+
+void test_simd_bench(void)
+{
+	RFX_CONTEXT* context;
+
+	/* scalar, then whatever SIMD backends are built and usable here */
+	context = rfx_context_new();
+	bench_simd_kernels(context, "scalar");
+
+#ifdef WITH_SSE2
+	rfx_init_sse2(context);
+	bench_simd_kernels(context, "sse2");
+#endif
+
+#if defined(WITH_AVX2) && defined(__GNUC__)
+	if (__builtin_cpu_supports("avx2"))
+	{
+		rfx_init_avx2(context);
+		bench_simd_kernels(context, "avx2");
+	}
+#endif
+
+	printf("\n");
+	rfx_context_free(context);
+}
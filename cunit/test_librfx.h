@@ -26,9 +26,16 @@ int add_librfx_suite(void);
 void test_bitstream(void);
 void test_bitstream_enc(void);
 void test_rlgr(void);
+void test_rlgr_fast(void);
 void test_differential(void);
 void test_quantization(void);
 void test_dwt(void);
 void test_decode(void);
 void test_encode(void);
 void test_message(void);
+void test_encode_threads(void);
+void test_decode_threads(void);
+void test_tile_cache(void);
+void test_surface(void);
+void test_simd(void);
+void test_simd_bench(void);
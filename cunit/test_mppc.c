@@ -22,6 +22,7 @@
 #include <sys/time.h>
 
 #include "rdp.h"
+#include "channel.h"
 #include "test_mppc.h"
 
 uint8_t compressed_rd5[] =
@@ -630,6 +631,14 @@ int add_mppc_suite(void)
 {
 	add_test_suite(mppc);
 	add_test_function(mppc);
+	add_test_function(mppc_61);
+	add_test_function(mppc_61_bench);
+	add_test_function(mppc_tokens);
+	add_test_function(mppc_history_wrap);
+	add_test_function(mppc_bench);
+	add_test_function(mppc_enc);
+	add_test_function(mppc_channel);
+	add_test_function(mppc_channel_caps);
 	return 0;
 }
 
@@ -668,3 +677,818 @@ void test_mppc(void)
     //printf("test_mppc: decompressed data in %ld micro seconds\n", dur);
 }
 
+
+/* level-1 match: MatchLength, MatchOutputOffset, MatchHistoryOffset */
+static int mppc_61_put_match(uint8* p, int length, int output_offset, int history_offset)
+{
+    p[0] = length & 0xff;
+    p[1] = (length >> 8) & 0xff;
+    p[2] = output_offset & 0xff;
+    p[3] = (output_offset >> 8) & 0xff;
+    p[4] = history_offset & 0xff;
+    p[5] = (history_offset >> 8) & 0xff;
+    p[6] = (history_offset >> 16) & 0xff;
+    p[7] = (history_offset >> 24) & 0xff;
+    return 8;
+}
+
+/* encode bytes as 64K MPPC literals only, enough to drive level-2 */
+static int mppc_61_encode_literals(uint8* in, int len, uint8* out)
+{
+    int i;
+    int bits = 0;
+    int count = 0;
+    uint32_t acc = 0;
+
+    for (i = 0; i < len; i++)
+    {
+        if (in[i] < 0x80)
+        {
+            acc = (acc << 8) | in[i];
+            bits += 8;
+        }
+        else
+        {
+            acc = (acc << 9) | 0x100 | (in[i] & 0x7f);
+            bits += 9;
+        }
+
+        while (bits >= 8)
+        {
+            out[count++] = (acc >> (bits - 8)) & 0xff;
+            bits -= 8;
+        }
+    }
+
+    if (bits > 0)
+        out[count++] = (acc << (8 - bits)) & 0xff;
+
+    return count;
+}
+
+/* second packet of the level-1 vectors, see test_mppc_61 */
+static int mppc_61_build_l1(uint8* p)
+{
+    int n = 0;
+
+    p[n++] = 3;
+    p[n++] = 0;
+    n += mppc_61_put_match(p + n, 4, 0, 0);    /* "The " */
+    n += mppc_61_put_match(p + n, 16, 9, 4);   /* "quick brown fox " */
+    n += mppc_61_put_match(p + n, 7, 26, 45);  /* overlapping "z" run */
+    memcpy(p + n, "lazy z!", 7);
+    n += 7;
+
+    return n;
+}
+
+void test_mppc_61(void)
+{
+    rdpRdp rdp;
+    int len;
+    uint32_t roff;
+    uint32_t rlen;
+    uint8 l1[64];
+    uint8 pkt[4096];
+    char* expected = "The lazy quick brown fox zzzzzzzz!";
+    int ctype = PACKET_COMPRESSED | PACKET_COMPR_TYPE_RDP61;
+
+    rdp.mppc = mppc_new(&rdp);
+    CU_ASSERT(rdp.mppc != NULL);
+    if (rdp.mppc == NULL)
+        return;
+
+    /* level-1 literals only */
+    pkt[0] = L1_COMPRESSED | L1_PACKET_AT_FRONT;
+    pkt[1] = 0;
+    pkt[2] = 0;
+    pkt[3] = 0;
+    memcpy(pkt + 4, "The quick brown fox ", 20);
+    CU_ASSERT(decompress_rdp(&rdp, pkt, 24, ctype | PACKET_FLUSHED, &roff, &rlen) == true);
+    CU_ASSERT(roff == 0 && rlen == 20);
+    CU_ASSERT(memcmp(rdp.mppc->history_buf, "The quick brown fox ", 20) == 0);
+
+    /* level-1 matches into the previous packet and into itself */
+    pkt[0] = L1_COMPRESSED;
+    pkt[1] = 0;
+    len = mppc_61_build_l1(pkt + 2) + 2;
+    CU_ASSERT(decompress_rdp(&rdp, pkt, len, ctype, &roff, &rlen) == true);
+    CU_ASSERT(roff == 20 && rlen == 34);
+    CU_ASSERT(memcmp(rdp.mppc->history_buf + roff, expected, 34) == 0);
+
+    /* same level-1 data, carried in level-2 (64K MPPC) */
+    len = mppc_61_build_l1(l1);
+    len = mppc_61_encode_literals(l1, len, pkt + 2);
+    pkt[0] = L1_COMPRESSED | L1_INNER_COMPRESSION;
+    pkt[1] = PACKET_COMPRESSED | PACKET_AT_FRONT;
+    CU_ASSERT(decompress_rdp(&rdp, pkt, len + 2, ctype, &roff, &rlen) == true);
+    CU_ASSERT(roff == 54 && rlen == 34);
+    CU_ASSERT(memcmp(rdp.mppc->history_buf + roff, expected, 34) == 0);
+
+    /* level-2 only: the RDP 5 vector, level-1 history must not move */
+    pkt[0] = L1_NO_COMPRESSION | L1_INNER_COMPRESSION;
+    pkt[1] = PACKET_COMPRESSED | PACKET_AT_FRONT | PACKET_FLUSHED;
+    memcpy(pkt + 2, compressed_rd5, sizeof(compressed_rd5));
+    CU_ASSERT(decompress_rdp(&rdp, pkt, sizeof(compressed_rd5) + 2, ctype, &roff, &rlen) == true);
+    CU_ASSERT(rlen == sizeof(decompressed_rd5));
+    CU_ASSERT(memcmp(rdp.mppc->history_buf + roff, decompressed_rd5, sizeof(decompressed_rd5)) == 0);
+    CU_ASSERT(rdp.mppc->history_ptr == rdp.mppc->history_buf + 88);
+
+    /* level-2 flush without compression still resets the level-2 history */
+    len = mppc_61_build_l1(pkt + 2);
+    pkt[0] = L1_COMPRESSED | L1_INNER_COMPRESSION;
+    pkt[1] = PACKET_FLUSHED;
+    CU_ASSERT(decompress_rdp(&rdp, pkt, len + 2, ctype, &roff, &rlen) == true);
+    CU_ASSERT(roff == 88 && rlen == 34);
+    CU_ASSERT(memcmp(rdp.mppc->history_buf + roff, expected, 34) == 0);
+    CU_ASSERT(rdp.mppc->level2->history_ptr == rdp.mppc->level2->history_buf + len);
+    CU_ASSERT(memcmp(rdp.mppc->level2->history_buf, pkt + 2, len) == 0);
+
+    /* corrupt packets are rejected */
+    pkt[0] = L1_COMPRESSED;
+    pkt[1] = 0;
+    pkt[2] = 1;
+    pkt[3] = 0;
+    mppc_61_put_match(pkt + 4, 4, 0, RDP61_HISTORY_BUF_SIZE - 2);
+    CU_ASSERT(decompress_rdp(&rdp, pkt, 12, ctype, &roff, &rlen) == false);
+    pkt[2] = 2;
+    CU_ASSERT(decompress_rdp(&rdp, pkt, 12, ctype, &roff, &rlen) == false);
+    pkt[2] = 2;
+    mppc_61_put_match(pkt + 4, 4, 8, 0);
+    mppc_61_put_match(pkt + 12, 4, 4, 0);
+    memcpy(pkt + 20, "abcdefgh", 8);
+    CU_ASSERT(decompress_rdp(&rdp, pkt, 28, ctype, &roff, &rlen) == false);
+    pkt[0] = 0;
+    CU_ASSERT(decompress_rdp(&rdp, pkt, 28, ctype, &roff, &rlen) == false);
+
+    /* RDP 6.0 can be picked by the server, but is not decoded */
+    CU_ASSERT(decompress_rdp(&rdp, pkt, 28, PACKET_COMPRESSED | PACKET_COMPR_TYPE_RDP6, &roff, &rlen) == false);
+    CU_ASSERT(rlen == 0);
+
+    mppc_free(&rdp);
+}
+
+#define MPPC_61_BENCH_LITERALS	4096
+#define MPPC_61_BENCH_MATCHES	240
+#define MPPC_61_BENCH_LOOPS	5000
+
+static double mppc_61_bench_rate(struct timeval* start_time, struct timeval* end_time, double bytes)
+{
+    double dur;
+
+    dur = (end_time->tv_sec - start_time->tv_sec) + (end_time->tv_usec - start_time->tv_usec) / 1000000.0;
+
+    return (dur > 0) ? (bytes / dur / (1024 * 1024)) : 0;
+}
+
+void test_mppc_61_bench(void)
+{
+    rdpRdp rdp;
+    int i;
+    int len;
+    int l2_len;
+    uint8* pkt;
+    uint8* l2_pkt;
+    uint32_t seed;
+    uint32_t roff;
+    uint32_t rlen;
+    uint32_t output_size;
+    int ok;
+    struct timeval start_time;
+    struct timeval end_time;
+
+    rdp.mppc = mppc_new(&rdp);
+    CU_ASSERT(rdp.mppc != NULL);
+    if (rdp.mppc == NULL)
+        return;
+
+    /* RDP 5 baseline */
+    ok = true;
+    gettimeofday(&start_time, NULL);
+    for (i = 0; i < MPPC_61_BENCH_LOOPS; i++)
+        ok &= decompress_rdp_5(&rdp, compressed_rd5, sizeof(compressed_rd5),
+            PACKET_COMPRESSED | PACKET_AT_FRONT, &roff, &rlen);
+    gettimeofday(&end_time, NULL);
+    CU_ASSERT(ok);
+    printf("\ntest_mppc_61_bench: rdp5  %8.1f MB/s\n",
+        mppc_61_bench_rate(&start_time, &end_time, (double) sizeof(decompressed_rd5) * MPPC_61_BENCH_LOOPS));
+
+    /* level-1 packet: a literal block followed by 64 byte matches into it */
+    pkt = malloc(2 + 2 + MPPC_61_BENCH_MATCHES * 8 + MPPC_61_BENCH_LITERALS);
+    l2_pkt = malloc(2 + (2 + MPPC_61_BENCH_MATCHES * 8 + MPPC_61_BENCH_LITERALS) * 2);
+    CU_ASSERT(pkt != NULL && l2_pkt != NULL);
+    if (pkt == NULL || l2_pkt == NULL)
+    {
+        free(pkt);
+        free(l2_pkt);
+        mppc_free(&rdp);
+        return;
+    }
+
+    len = 0;
+    pkt[len++] = L1_COMPRESSED | L1_PACKET_AT_FRONT;
+    pkt[len++] = 0;
+    pkt[len++] = MPPC_61_BENCH_MATCHES & 0xff;
+    pkt[len++] = MPPC_61_BENCH_MATCHES >> 8;
+    seed = 1;
+    for (i = 0; i < MPPC_61_BENCH_MATCHES; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        len += mppc_61_put_match(pkt + len, 64, MPPC_61_BENCH_LITERALS + i * 64,
+            (seed >> 8) % (MPPC_61_BENCH_LITERALS - 64));
+    }
+    for (i = 0; i < MPPC_61_BENCH_LITERALS; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        pkt[len++] = (seed >> 16) & 0x7f;
+    }
+    output_size = MPPC_61_BENCH_LITERALS + MPPC_61_BENCH_MATCHES * 64;
+
+    ok = true;
+    gettimeofday(&start_time, NULL);
+    for (i = 0; i < MPPC_61_BENCH_LOOPS; i++)
+        ok &= decompress_rdp_61(&rdp, pkt, len, PACKET_COMPRESSED, &roff, &rlen) && (rlen == output_size);
+    gettimeofday(&end_time, NULL);
+    CU_ASSERT(ok);
+    printf("test_mppc_61_bench: rdp61 %8.1f MB/s (level-1)\n",
+        mppc_61_bench_rate(&start_time, &end_time, (double) output_size * MPPC_61_BENCH_LOOPS));
+
+    /* the same packet with level-2 on top */
+    l2_pkt[0] = L1_COMPRESSED | L1_PACKET_AT_FRONT | L1_INNER_COMPRESSION;
+    l2_pkt[1] = PACKET_COMPRESSED | PACKET_AT_FRONT;
+    l2_len = mppc_61_encode_literals(pkt + 2, len - 2, l2_pkt + 2) + 2;
+
+    ok = true;
+    gettimeofday(&start_time, NULL);
+    for (i = 0; i < MPPC_61_BENCH_LOOPS; i++)
+        ok &= decompress_rdp_61(&rdp, l2_pkt, l2_len, PACKET_COMPRESSED, &roff, &rlen) && (rlen == output_size);
+    gettimeofday(&end_time, NULL);
+    CU_ASSERT(ok);
+    printf("test_mppc_61_bench: rdp61 %8.1f MB/s (level-1 + level-2)\n",
+        mppc_61_bench_rate(&start_time, &end_time, (double) output_size * MPPC_61_BENCH_LOOPS));
+
+    free(pkt);
+    free(l2_pkt);
+    mppc_free(&rdp);
+}
+
+/* MSB first bit writer for building MPPC token streams */
+struct mppc_bit_writer
+{
+    uint8* buf;
+    int bits;
+};
+
+static void mppc_put_bits(struct mppc_bit_writer* bw, uint32_t value, int n)
+{
+    while (n-- > 0)
+    {
+        if ((value >> n) & 1)
+            bw->buf[bw->bits >> 3] |= 0x80 >> (bw->bits & 7);
+        bw->bits++;
+    }
+}
+
+static void mppc_put_literal(struct mppc_bit_writer* bw, uint8 c)
+{
+    if (c < 0x80)
+        mppc_put_bits(bw, c, 8);
+    else
+        mppc_put_bits(bw, 0x100 | (c & 0x7f), 9);
+}
+
+static void mppc_put_copy(struct mppc_bit_writer* bw, int big, uint32_t offset, uint32_t lom)
+{
+    int k;
+
+    if (big)
+    {
+        if (offset < 64)
+            mppc_put_bits(bw, 0x7c0 | offset, 11);
+        else if (offset < 320)
+            mppc_put_bits(bw, 0x1e00 | (offset - 64), 13);
+        else if (offset < 2368)
+            mppc_put_bits(bw, 0x7000 | (offset - 320), 15);
+        else
+            mppc_put_bits(bw, 0x60000 | (offset - 2368), 19);
+    }
+    else
+    {
+        if (offset < 64)
+            mppc_put_bits(bw, 0x3c0 | offset, 10);
+        else if (offset < 320)
+            mppc_put_bits(bw, 0xe00 | (offset - 64), 12);
+        else
+            mppc_put_bits(bw, 0xc000 | (offset - 320), 16);
+    }
+
+    if (lom == 3)
+    {
+        mppc_put_bits(bw, 0, 1);
+        return;
+    }
+
+    for (k = 1; lom >= (1u << (k + 2)); k++)
+        ;
+
+    mppc_put_bits(bw, ((1 << k) - 1) << 1, k + 1);
+    mppc_put_bits(bw, lom - (1 << (k + 1)), k + 1);
+}
+
+/* apply a match to the reference history, one byte at a time */
+static void mppc_ref_copy(uint8* ref, uint32_t pos, uint32_t offset, uint32_t lom)
+{
+    while (lom-- > 0)
+    {
+        ref[pos] = ref[pos - offset];
+        pos++;
+    }
+}
+
+/**
+ * every copy offset class and every length of match prefix, for 8K and 64K,
+ * checked against a byte by byte reference: short overlapping distances
+ * exercise the run-length case, long ones the 8 and 16 byte copies
+ */
+
+void test_mppc_tokens(void)
+{
+    rdpRdp rdp;
+    int big;
+    int i;
+    int k;
+    uint32_t pos;
+    uint32_t roff;
+    uint32_t rlen;
+    uint32_t offset;
+    uint32_t lom;
+    uint8* ref;
+    uint8* stream;
+    struct mppc_bit_writer bw;
+    static const uint32_t offsets_8k[] = { 1, 2, 3, 7, 8, 15, 16, 17, 63, 64, 319, 320, 4000, 8191 };
+    static const uint32_t offsets_64k[] = { 1, 2, 5, 8, 16, 33, 63, 64, 319, 320, 2367, 2368, 30000, 39999 };
+    const uint32_t* offsets;
+
+    rdp.mppc = mppc_new(&rdp);
+    ref = calloc(1, RDP6_HISTORY_BUF_SIZE);
+    stream = calloc(2, RDP6_HISTORY_BUF_SIZE);
+    CU_ASSERT(rdp.mppc != NULL && ref != NULL && stream != NULL);
+    if (rdp.mppc == NULL || ref == NULL || stream == NULL)
+        return;
+
+    for (big = 0; big < 2; big++)
+    {
+        offsets = big ? offsets_64k : offsets_8k;
+        memset(ref, 0, RDP6_HISTORY_BUF_SIZE);
+        memset(stream, 0, 2 * RDP6_HISTORY_BUF_SIZE);
+        bw.buf = stream;
+        bw.bits = 0;
+        pos = 0;
+
+        /* enough distinct literals for the longest offset */
+        for (i = 0; i < (big ? 40000 : 8191); i++)
+        {
+            ref[pos] = (i * 7 + (i >> 8)) & 0xff;
+            mppc_put_literal(&bw, ref[pos++]);
+        }
+
+        /* each offset class with each length of match class */
+        for (i = 0; i < 14; i++)
+        {
+            offset = offsets[i];
+
+            for (k = 0; k <= (big ? 9 : 8); k++)
+            {
+                lom = (k == 0) ? 3 : (1 << (k + 1)) + ((offset * 13 + k) % (1 << (k + 1)));
+
+                if (pos + lom > (uint32_t) (big ? RDP6_HISTORY_BUF_SIZE : 8192 + 8192))
+                    continue;
+
+                mppc_put_copy(&bw, big, offset, lom);
+                mppc_ref_copy(ref, pos, offset, lom);
+                pos += lom;
+            }
+        }
+
+        /* pad with a literal so the last token is never cut short */
+        ref[pos] = 'x';
+        mppc_put_literal(&bw, ref[pos++]);
+
+        if (big)
+            CU_ASSERT(decompress_rdp_5(&rdp, stream, (bw.bits + 7) / 8,
+                PACKET_COMPRESSED | PACKET_FLUSHED, &roff, &rlen) == true)
+        else
+            CU_ASSERT(decompress_rdp_4(&rdp, stream, (bw.bits + 7) / 8,
+                PACKET_COMPRESSED | PACKET_FLUSHED, &roff, &rlen) == true)
+
+        CU_ASSERT(roff == 0 && rlen == pos);
+        CU_ASSERT(memcmp(rdp.mppc->history_buf, ref, pos) == 0);
+    }
+
+    /* the longest 64K length of match, wrapping from the end of the history */
+    memset(stream, 0, RDP6_HISTORY_BUF_SIZE);
+    bw.bits = 0;
+    mppc_put_literal(&bw, 'a');
+    mppc_put_copy(&bw, 1, 16, 32768 + 12345);
+    CU_ASSERT(decompress_rdp_5(&rdp, stream, (bw.bits + 7) / 8,
+        PACKET_COMPRESSED | PACKET_AT_FRONT, &roff, &rlen) == true);
+    CU_ASSERT(roff == 0 && rlen == 1 + 32768 + 12345);
+    memmove(ref + 1, ref + RDP6_HISTORY_BUF_SIZE - 15, 15);
+    ref[0] = 'a';
+    mppc_ref_copy(ref, 16, 16, 32768 + 12345 - 15);
+    CU_ASSERT(memcmp(rdp.mppc->history_buf, ref, 1 + 32768 + 12345) == 0);
+
+    /* a zero copy offset and a match past the history are rejected */
+    memset(stream, 0, RDP6_HISTORY_BUF_SIZE);
+    bw.bits = 0;
+    mppc_put_literal(&bw, 'a');
+    mppc_put_copy(&bw, 1, 0, 3);
+    CU_ASSERT(decompress_rdp_5(&rdp, stream, (bw.bits + 7) / 8,
+        PACKET_COMPRESSED | PACKET_FLUSHED, &roff, &rlen) == false);
+
+    memset(stream, 0, RDP6_HISTORY_BUF_SIZE);
+    bw.bits = 0;
+    mppc_put_literal(&bw, 'a');
+    mppc_put_literal(&bw, 'b');
+    mppc_put_copy(&bw, 1, 1, 65535);
+    CU_ASSERT(decompress_rdp_5(&rdp, stream, (bw.bits + 7) / 8,
+        PACKET_COMPRESSED | PACKET_FLUSHED, &roff, &rlen) == false);
+
+    free(ref);
+    free(stream);
+    mppc_free(&rdp);
+}
+
+/**
+ * a match whose source starts in the last bytes of a full history and
+ * runs on from the front: the source is counted back from one past the
+ * last byte, not from the last byte
+ */
+
+void test_mppc_history_wrap(void)
+{
+    rdpRdp rdp;
+    int i;
+    uint32_t roff;
+    uint32_t rlen;
+    uint8* history;
+    uint8 ref[41];
+    uint8 stream[64];
+    struct mppc_bit_writer bw;
+
+    rdp.mppc = mppc_new(&rdp);
+    history = malloc(RDP6_HISTORY_BUF_SIZE);
+    CU_ASSERT(rdp.mppc != NULL && history != NULL);
+    if (rdp.mppc == NULL || history == NULL)
+        return;
+
+    /* fill the whole history, every byte near its end different */
+    for (i = 0; i < RDP6_HISTORY_BUF_SIZE; i++)
+        history[i] = (i * 31 + (i >> 8)) & 0xff;
+
+    CU_ASSERT(decompress_rdp_5(&rdp, history, RDP6_HISTORY_BUF_SIZE,
+        PACKET_FLUSHED, &roff, &rlen) == true);
+    CU_ASSERT(roff == 0 && rlen == RDP6_HISTORY_BUF_SIZE);
+
+    /* back at the front, copy 40 bytes from 16 back */
+    memset(stream, 0, sizeof(stream));
+    bw.buf = stream;
+    bw.bits = 0;
+    mppc_put_literal(&bw, 'a');
+    mppc_put_copy(&bw, 1, 16, 40);
+    CU_ASSERT(decompress_rdp_5(&rdp, stream, (bw.bits + 7) / 8,
+        PACKET_COMPRESSED | PACKET_AT_FRONT, &roff, &rlen) == true);
+    CU_ASSERT(roff == 0 && rlen == 41);
+
+    /* 'a', the last 15 bytes of the old history, then 'a' and those again */
+    ref[0] = 'a';
+    memcpy(ref + 1, history + RDP6_HISTORY_BUF_SIZE - 15, 15);
+    for (i = 16; i < 41; i++)
+        ref[i] = ref[i - 16];
+    CU_ASSERT(memcmp(rdp.mppc->history_buf, ref, 41) == 0);
+
+    free(history);
+    mppc_free(&rdp);
+}
+
+#define MPPC_BENCH_LOOPS	200000
+
+/**
+ * replays the RDP 5 vector, then a match heavy 64K stream closer to what
+ * a server sends for screen content
+ */
+
+void test_mppc_bench(void)
+{
+    rdpRdp rdp;
+    int i;
+    int ok;
+    int len;
+    uint32_t pos;
+    uint32_t seed;
+    uint32_t roff;
+    uint32_t rlen;
+    uint8* stream;
+    struct mppc_bit_writer bw;
+    struct timeval start_time;
+    struct timeval end_time;
+
+    rdp.mppc = mppc_new(&rdp);
+    stream = calloc(1, RDP6_HISTORY_BUF_SIZE);
+    CU_ASSERT(rdp.mppc != NULL && stream != NULL);
+    if (rdp.mppc == NULL || stream == NULL)
+        return;
+
+    ok = true;
+    gettimeofday(&start_time, NULL);
+    for (i = 0; i < MPPC_BENCH_LOOPS; i++)
+        ok &= decompress_rdp_5(&rdp, compressed_rd5, sizeof(compressed_rd5),
+            PACKET_COMPRESSED | PACKET_AT_FRONT, &roff, &rlen);
+    gettimeofday(&end_time, NULL);
+    CU_ASSERT(ok);
+    CU_ASSERT(memcmp(decompressed_rd5, rdp.mppc->history_buf, sizeof(decompressed_rd5)) == 0);
+    printf("\ntest_mppc_bench: rdp5 vector %8.3f GB/s\n",
+        mppc_61_bench_rate(&start_time, &end_time, (double) sizeof(decompressed_rd5) * MPPC_BENCH_LOOPS) / 1024);
+
+    /* 256 literals, then matches of 16 to 271 bytes at random distances */
+    bw.buf = stream;
+    bw.bits = 0;
+    seed = 1;
+    for (pos = 0; pos < 256; pos++)
+    {
+        seed = seed * 1103515245 + 12345;
+        mppc_put_literal(&bw, (seed >> 16) & 0xff);
+    }
+    while (pos < RDP6_HISTORY_BUF_SIZE - 512)
+    {
+        seed = seed * 1103515245 + 12345;
+        mppc_put_copy(&bw, 1, 1 + (seed >> 8) % MIN(pos, 4096), 16 + ((seed >> 20) & 0xff));
+        pos += 16 + ((seed >> 20) & 0xff);
+    }
+    len = (bw.bits + 7) / 8;
+
+    ok = true;
+    gettimeofday(&start_time, NULL);
+    for (i = 0; i < MPPC_BENCH_LOOPS / 100; i++)
+        ok &= decompress_rdp_5(&rdp, stream, len, PACKET_COMPRESSED | PACKET_AT_FRONT, &roff, &rlen) && (rlen == pos);
+    gettimeofday(&end_time, NULL);
+    CU_ASSERT(ok);
+    printf("test_mppc_bench: rdp5 matches %8.3f GB/s\n",
+        mppc_61_bench_rate(&start_time, &end_time, (double) pos * (MPPC_BENCH_LOOPS / 100)) / 1024);
+
+    free(stream);
+    mppc_free(&rdp);
+}
+
+#define MPPC_ENC_TEST_PACKETS	64
+
+/**
+ * compress packets of screen-like data with each encoder type and check
+ * that they decompress to the input: the packets are large enough to wrap
+ * the history, and one in eight is noise that does not compress
+ */
+
+void test_mppc_enc(void)
+{
+    rdpRdp rdp;
+    int i;
+    int j;
+    int len;
+    int type;
+    int flushed;
+    int at_front;
+    int compressed;
+    uint8* src;
+    uint32_t seed;
+    uint32_t roff;
+    uint32_t rlen;
+    uint64_t total_in;
+    uint64_t total_out;
+    struct rdp_mppc_enc* enc;
+    struct timeval start_time;
+    struct timeval end_time;
+    static const int types[] = { PACKET_COMPR_TYPE_8K, PACKET_COMPR_TYPE_64K, PACKET_COMPR_TYPE_RDP61 };
+
+    src = malloc(RDP6_HISTORY_BUF_SIZE);
+    CU_ASSERT(src != NULL);
+    if (src == NULL)
+        return;
+
+    CU_ASSERT(mppc_enc_new(PACKET_COMPR_TYPE_RDP6) == NULL);
+
+    for (type = 0; type < 3; type++)
+    {
+        enc = mppc_enc_new(types[type]);
+        rdp.mppc = mppc_new(&rdp);
+        CU_ASSERT(enc != NULL && rdp.mppc != NULL);
+        if (enc == NULL || rdp.mppc == NULL)
+            break;
+
+        seed = 1;
+        flushed = 0;
+        at_front = 0;
+        compressed = 0;
+        total_in = 0;
+        total_out = 0;
+        gettimeofday(&start_time, NULL);
+
+        for (i = 0; i < MPPC_ENC_TEST_PACKETS; i++)
+        {
+            seed = seed * 1103515245 + 12345;
+            len = 1 + (seed >> 8) % (types[type] == PACKET_COMPR_TYPE_8K ? 8192 : 30000);
+
+            for (j = 0; j < len; j++)
+            {
+                seed = seed * 1103515245 + 12345;
+
+                if ((i % 8) == 7)
+                    src[j] = seed >> 16;
+                else if (((seed >> 16) & 0x3f) == 0)
+                    src[j] = seed >> 24;
+                else
+                    src[j] = decompressed_rd5[(j + i * 61) % sizeof(decompressed_rd5)];
+            }
+
+            if (!compress_rdp(enc, src, len))
+            {
+                /* sent as is, the decoder history is not involved */
+                CU_ASSERT(enc->flags_hold == PACKET_FLUSHED);
+                total_in += len;
+                total_out += len;
+                continue;
+            }
+
+            compressed++;
+            flushed += (types[type] == PACKET_COMPR_TYPE_RDP61 ? enc->output_buf[1] : enc->flags) & PACKET_FLUSHED ? 1 : 0;
+            at_front += (types[type] == PACKET_COMPR_TYPE_RDP61 ? enc->output_buf[1] : enc->flags) & PACKET_AT_FRONT ? 1 : 0;
+            total_in += len;
+            total_out += enc->bytes_in_opb;
+
+            CU_ASSERT(enc->bytes_in_opb < (uint32_t) len);
+            CU_ASSERT((enc->flags & CompressionTypeMask) == types[type]);
+            CU_ASSERT(decompress_rdp(&rdp, enc->output_buf, enc->bytes_in_opb, enc->flags, &roff, &rlen) == true);
+            CU_ASSERT(rlen == (uint32_t) len);
+            if (rlen != (uint32_t) len)
+                break;
+            CU_ASSERT(memcmp(rdp.mppc->history_buf + roff, src, len) == 0);
+        }
+
+        gettimeofday(&end_time, NULL);
+
+        /* the first packet flushes, noise forces more flushes, history wraps */
+        CU_ASSERT(compressed > MPPC_ENC_TEST_PACKETS / 2);
+        CU_ASSERT(flushed > 1);
+        CU_ASSERT(at_front > 0);
+        CU_ASSERT(total_out < total_in / 2);
+
+        printf("\ntest_mppc_enc: type %d ratio %5.3f %8.1f MB/s (with decompression)", types[type],
+            (double) total_out / total_in, mppc_61_bench_rate(&start_time, &end_time, (double) total_in));
+
+        mppc_enc_free(enc);
+        mppc_free(&rdp);
+    }
+
+    printf("\n");
+    free(src);
+}
+
+static uint8* mppc_channel_received;
+static int mppc_channel_received_len;
+
+static int mppc_channel_receive(freerdp* instance, int channelId, uint8* data, int size, int flags, int total_size)
+{
+    /* the compression flags are not passed on */
+    CU_ASSERT((flags & 0x00FF0000) == 0);
+    memcpy(mppc_channel_received + mppc_channel_received_len, data, size);
+    mppc_channel_received_len += size;
+    return 0;
+}
+
+/* channel chunks compressed by the sender, decompressed by freerdp_channel_process */
+void test_mppc_channel(void)
+{
+    int i;
+    int j;
+    int len;
+    int type;
+    int compressed;
+    uint8* src;
+    uint32 flags;
+    uint32_t seed;
+    STREAM* s;
+    rdpRdp rdp;
+    freerdp instance;
+    rdpContext context;
+    struct rdp_mppc_enc* enc;
+    static const int types[] = { PACKET_COMPR_TYPE_8K, PACKET_COMPR_TYPE_64K };
+
+    src = malloc(RDP6_HISTORY_BUF_SIZE);
+    mppc_channel_received = malloc(RDP6_HISTORY_BUF_SIZE);
+
+    memset(&instance, 0, sizeof(instance));
+    memset(&context, 0, sizeof(context));
+    instance.context = &context;
+    instance.ReceiveChannelData = mppc_channel_receive;
+    context.rdp = &rdp;
+
+    for (type = 0; type < 2; type++)
+    {
+        memset(&rdp, 0, sizeof(rdp));
+        enc = mppc_enc_new(types[type]);
+        seed = 7;
+        compressed = 0;
+
+        for (i = 0; i < MPPC_ENC_TEST_PACKETS; i++)
+        {
+            seed = seed * 1103515245 + 12345;
+            len = 1 + (seed >> 8) % 1600;
+
+            for (j = 0; j < len; j++)
+            {
+                seed = seed * 1103515245 + 12345;
+
+                if ((i % 8) == 7)
+                    src[j] = seed >> 16;
+                else
+                    src[j] = decompressed_rd5[(j + i * 37) % sizeof(decompressed_rd5)];
+            }
+
+            flags = CHANNEL_FLAG_FIRST | CHANNEL_FLAG_LAST;
+
+            if (compress_rdp(enc, src, len))
+            {
+                compressed++;
+                s = stream_new(8 + enc->bytes_in_opb);
+                stream_write_uint32(s, len);
+                stream_write_uint32(s, flags | ((uint32) enc->flags << 16));
+                stream_write(s, enc->output_buf, enc->bytes_in_opb);
+            }
+            else
+            {
+                s = stream_new(8 + len);
+                stream_write_uint32(s, len);
+                stream_write_uint32(s, flags);
+                stream_write(s, src, len);
+            }
+
+            stream_set_pos(s, 0);
+            mppc_channel_received_len = 0;
+            freerdp_channel_process(&instance, s, 1004);
+
+            CU_ASSERT(mppc_channel_received_len == len);
+            CU_ASSERT(memcmp(mppc_channel_received, src, len) == 0);
+            stream_free(s);
+        }
+
+        /* noise packets go as is, the others through the channel history */
+        CU_ASSERT(compressed > MPPC_ENC_TEST_PACKETS / 2);
+
+        mppc_enc_free(enc);
+        mppc_free(&rdp);
+    }
+
+    free(mppc_channel_received);
+    free(src);
+}
+
+/* channel data is only compressed the way the peer's capability allows */
+void test_mppc_channel_caps(void)
+{
+    rdpRdp rdp;
+    struct rdp_mppc_enc* enc;
+
+    memset(&rdp, 0, sizeof(rdp));
+    rdp.settings = settings_new(NULL);
+    rdp.settings->compression = true;
+    rdp.settings->compression_type = PACKET_COMPR_TYPE_RDP61;
+
+    /* server, the client did not offer VCCAPS_COMPR_SC */
+    rdp.settings->server_mode = true;
+    rdp.settings->vc_flags = VCCAPS_NO_COMPR;
+    CU_ASSERT(rdp_get_bulk_compressor(&rdp, true) == NULL);
+    CU_ASSERT(rdp_get_bulk_compressor(&rdp, false) != NULL);
+
+    rdp.settings->vc_flags = VCCAPS_COMPR_SC;
+    enc = rdp_get_bulk_compressor(&rdp, true);
+    CU_ASSERT(enc != NULL && enc->protocol_type == PACKET_COMPR_TYPE_64K);
+    mppc_enc_free(rdp.mppc_enc);
+    mppc_enc_free(rdp.mppc_enc_vc);
+    rdp.mppc_enc = NULL;
+    rdp.mppc_enc_vc = NULL;
+
+    /* client, only 8K and only with VCCAPS_COMPR_CS_8K from the server */
+    rdp.settings->server_mode = false;
+    rdp.settings->compress_outbound = true;
+    rdp.settings->vc_flags = VCCAPS_COMPR_SC;
+    CU_ASSERT(rdp_get_bulk_compressor(&rdp, true) == NULL);
+
+    rdp.settings->vc_flags = VCCAPS_COMPR_CS_8K;
+    enc = rdp_get_bulk_compressor(&rdp, true);
+    CU_ASSERT(enc != NULL && enc->protocol_type == PACKET_COMPR_TYPE_8K);
+
+    rdp.settings->compress_outbound = false;
+    CU_ASSERT(rdp_get_bulk_compressor(&rdp, true) == NULL);
+
+    mppc_enc_free(rdp.mppc_enc_vc);
+    settings_free(rdp.settings);
+}
@@ -24,3 +24,11 @@ int clean_mppc_suite(void);
 int add_mppc_suite(void);
 
 void test_mppc(void);
+void test_mppc_61(void);
+void test_mppc_61_bench(void);
+void test_mppc_tokens(void);
+void test_mppc_history_wrap(void);
+void test_mppc_bench(void);
+void test_mppc_enc(void);
+void test_mppc_channel(void);
+void test_mppc_channel_caps(void);
@@ -17,13 +17,21 @@
  * limitations under the License.
  */
 
+#include <unistd.h>
+#include <sys/socket.h>
 #include <freerdp/freerdp.h>
 #include <freerdp/utils/hexdump.h>
+#include <freerdp/utils/memory.h>
 #include <freerdp/utils/stream.h>
+#include <freerdp/cache/cache.h>
+#include <freerdp/cache/persistent.h>
 
 #include "test_orders.h"
 #include "libfreerdp-core/orders.h"
 #include "libfreerdp-core/update.h"
+#include "libfreerdp-core/rdp.h"
+#include "libfreerdp-core/surface.h"
+#include "libfreerdp-core/activation.h"
 
 ORDER_INFO* orderInfo;
 
@@ -66,6 +74,12 @@ int add_orders_suite(void)
 
 	add_test_function(update_recv_orders);
 
+	add_test_function(persistent_cache);
+	add_test_function(persistent_bitmap_cache);
+	add_test_function(persistent_key_list);
+
+	add_test_function(fastpath_reassembly);
+
 	return 0;
 }
 
@@ -770,3 +784,425 @@ void test_update_recv_orders(void)
 	free(update->context);
 }
 
+
+void test_persistent_cache(void)
+{
+	int i;
+	uint8 data[64];
+	uint64 keys[8];
+	char filename[64];
+	PERSISTENT_CACHE_ENTRY* entry;
+	rdpPersistentCache* persistent;
+	uint32 numEntries[PERSISTENT_CACHE_MAX_CELLS] = { 0, 0, 8, 4, 0 };
+
+	for (i = 0; i < (int) sizeof(data); i++)
+		data[i] = (uint8) i;
+
+	snprintf(filename, sizeof(filename), "/tmp/test_persistent_cache_%d.bin", (int) getpid());
+	remove(filename);
+
+	persistent = persistent_cache_open(filename, numEntries);
+	CU_ASSERT(persistent != NULL);
+	if (persistent == NULL)
+		return;
+
+	/* a second session sharing the file runs without a persistent cache */
+	CU_ASSERT(persistent_cache_open(filename, numEntries) == NULL);
+
+	CU_ASSERT(persistent_cache_get_keys(persistent, 2, keys, 8) == 0);
+	CU_ASSERT(persistent_cache_put(persistent, 2, 0, 0x11111111, 0xAAAAAAAA, 8, 2, 32, false, data, 64) == true);
+	CU_ASSERT(persistent_cache_put(persistent, 2, 3, 0x33333333, 0xBBBBBBBB, 4, 4, 16, true, data, 32) == true);
+	CU_ASSERT(persistent_cache_put(persistent, 2, 5, 0x55555555, 0xCCCCCCCC, 2, 2, 8, true, data + 8, 16) == true);
+	CU_ASSERT(persistent_cache_put(persistent, 2, 8, 0x88888888, 0, 1, 1, 8, false, data, 1) == false);
+	CU_ASSERT(persistent_cache_put(persistent, 3, 1, 0x77777777, 0xDDDDDDDD, 1, 1, 32, false, data, 4) == true);
+	persistent_cache_invalidate(persistent, 2, 3);
+
+	/* keys stop at the first hole until the file is compacted on open */
+	CU_ASSERT(persistent_cache_get_keys(persistent, 2, keys, 8) == 1);
+	persistent_cache_close(persistent);
+
+	persistent = persistent_cache_open(filename, numEntries);
+	CU_ASSERT(persistent != NULL);
+	if (persistent == NULL)
+		return;
+
+	CU_ASSERT(persistent_cache_get_keys(persistent, 2, keys, 8) == 2);
+	CU_ASSERT(keys[0] == 0xAAAAAAAA11111111ULL);
+	CU_ASSERT(keys[1] == 0xCCCCCCCC55555555ULL);
+	CU_ASSERT(persistent_cache_get_keys(persistent, 3, keys, 8) == 1);
+	CU_ASSERT(keys[0] == 0xDDDDDDDD77777777ULL);
+
+	entry = persistent_cache_get(persistent, 2, 1);
+	CU_ASSERT(entry != NULL);
+	if (entry != NULL)
+	{
+		CU_ASSERT(entry->width == 2 && entry->height == 2 && entry->bpp == 8);
+		CU_ASSERT(entry->flags & PERSISTENT_CACHE_FLAG_COMPRESSED);
+		CU_ASSERT(entry->length == 16 && memcmp(entry->data, data + 8, 16) == 0);
+	}
+	CU_ASSERT(persistent_cache_get(persistent, 2, 2) == NULL);
+	CU_ASSERT(persistent_cache_get(persistent, 2, 5) == NULL);
+
+	/* slots whose header does not describe a loadable bitmap are dropped */
+	entry = persistent_cache_get(persistent, 2, 0);
+	CU_ASSERT(entry != NULL);
+	if (entry != NULL)
+		entry->length = PERSISTENT_CACHE_MAX_DATA + 1;
+	CU_ASSERT(persistent_cache_get(persistent, 2, 0) == NULL);
+	entry = persistent_cache_get(persistent, 3, 0);
+	CU_ASSERT(entry != NULL);
+	if (entry != NULL)
+		entry->bpp = 7;
+	CU_ASSERT(persistent_cache_put(persistent, 3, 1, 0x99999999, 0, 4, 4, 32, false, data, 16) == false);
+	CU_ASSERT(persistent_cache_put(persistent, 3, 1, 0x99999999, 0, 0, 4, 32, true, data, 16) == false);
+	persistent_cache_close(persistent);
+
+	persistent = persistent_cache_open(filename, numEntries);
+	CU_ASSERT(persistent != NULL);
+	if (persistent == NULL)
+		return;
+
+	CU_ASSERT(persistent_cache_get_keys(persistent, 2, keys, 8) == 1);
+	CU_ASSERT(keys[0] == 0xCCCCCCCC55555555ULL);
+	CU_ASSERT(persistent_cache_get_keys(persistent, 3, keys, 8) == 0);
+	persistent_cache_close(persistent);
+
+	/* a different cache geometry discards the old content */
+	numEntries[2] = 16;
+	persistent = persistent_cache_open(filename, numEntries);
+	CU_ASSERT(persistent != NULL);
+	if (persistent != NULL)
+	{
+		CU_ASSERT(persistent_cache_get_keys(persistent, 2, keys, 8) == 0);
+		persistent_cache_close(persistent);
+	}
+
+	remove(filename);
+}
+
+static void test_bitmap_free(rdpContext* context, rdpBitmap* bitmap)
+{
+
+}
+
+static void test_bitmap_decompress(rdpContext* context, rdpBitmap* bitmap,
+		uint8* data, int width, int height, int bpp, int length, tbool compressed, int codec_id)
+{
+	bitmap->bpp = bpp;
+	bitmap->length = length;
+	bitmap->compressed = compressed;
+	bitmap->data = (uint8*) xmalloc(length);
+	memcpy(bitmap->data, data, length);
+}
+
+void test_persistent_bitmap_cache(void)
+{
+	int i;
+	uint8 data[64];
+	char filename[64];
+	uint32 hits;
+	uint32 loaded;
+	uint32 misses;
+	rdpBitmap* bitmap;
+	rdpBitmap prototype;
+	freerdp* instance;
+	rdpSettings* settings;
+	rdpBitmapCache* bitmap_cache;
+	rdpPersistentCache* persistent;
+	CACHE_BITMAP_V2_ORDER cache_bitmap_v2;
+	uint32 numEntries[PERSISTENT_CACHE_MAX_CELLS] = { 0, 0, 2048, 4096, 2048 };
+
+	for (i = 0; i < (int) sizeof(data); i++)
+		data[i] = (uint8) (i * 3);
+
+	snprintf(filename, sizeof(filename), "/tmp/test_persistent_bitmap_cache_%d.bin", (int) getpid());
+	remove(filename);
+
+	/* what a previous session left behind */
+	persistent = persistent_cache_open(filename, numEntries);
+	CU_ASSERT(persistent != NULL);
+	if (persistent == NULL)
+		return;
+
+	persistent_cache_put(persistent, 2, 0, 0x11111111, 0xAAAAAAAA, 4, 4, 16, false, data, 32);
+	persistent_cache_put(persistent, 2, 1, 0x22222222, 0xBBBBBBBB, 2, 2, 8, true, data + 8, 16);
+	persistent_cache_put(persistent, 4, 0, 0x33333333, 0xCCCCCCCC, 4, 2, 32, false, data, 32);
+	persistent_cache_close(persistent);
+
+	instance = freerdp_new();
+	freerdp_context_new(instance);
+	settings = instance->settings;
+
+	memset(&prototype, 0, sizeof(rdpBitmap));
+	prototype.size = sizeof(rdpBitmap);
+	prototype.New = Bitmap_New;
+	prototype.Free = test_bitmap_free;
+	prototype.Decompress = test_bitmap_decompress;
+	graphics_register_bitmap(instance->context->graphics, &prototype);
+
+	settings->persistent_bitmap_cache_file = xstrdup(filename);
+	instance->context->cache = cache_new(settings);
+	bitmap_cache_register_callbacks(instance->update);
+	bitmap_cache = instance->context->cache->bitmap;
+
+	/* the keys are advertised, nothing is decoded yet */
+	bitmap_cache_get_persistent_stats(bitmap_cache, &loaded, &hits, &misses);
+	CU_ASSERT(loaded == 3 && hits == 0 && misses == 0);
+	CU_ASSERT(settings->persistent_bitmap_cache == true);
+	CU_ASSERT(settings->bitmapCacheV2CellInfo[2].numPersistentKeys == 2);
+	CU_ASSERT(settings->bitmapCacheV2CellInfo[2].persistentKeys[1] == 0xBBBBBBBB22222222ULL);
+	CU_ASSERT(settings->bitmapCacheV2CellInfo[3].numPersistentKeys == 0);
+	CU_ASSERT(settings->bitmapCacheV2CellInfo[4].numPersistentKeys == 1);
+
+	/* the first reference loads the bitmap from the file */
+	bitmap = bitmap_cache_get(bitmap_cache, 2, 1);
+	CU_ASSERT(bitmap != NULL);
+	if (bitmap != NULL)
+	{
+		CU_ASSERT(bitmap->width == 2 && bitmap->height == 2 && bitmap->bpp == 8);
+		CU_ASSERT(bitmap->compressed == true);
+		CU_ASSERT(bitmap->length == 16 && memcmp(bitmap->data, data + 8, 16) == 0);
+	}
+
+	/* later references use the decoded bitmap */
+	CU_ASSERT(bitmap_cache_get(bitmap_cache, 2, 1) == bitmap);
+	CU_ASSERT(bitmap_cache_get(bitmap_cache, 2, 2) == NULL);
+	bitmap_cache_get_persistent_stats(bitmap_cache, &loaded, &hits, &misses);
+	CU_ASSERT(loaded == 3 && hits == 1 && misses == 0);
+
+	/* a bitmap the server has to send is a miss and is written to the file */
+	memset(&cache_bitmap_v2, 0, sizeof(CACHE_BITMAP_V2_ORDER));
+	cache_bitmap_v2.cacheId = 2;
+	cache_bitmap_v2.cacheIndex = 2;
+	cache_bitmap_v2.flags = CBR2_PERSISTENT_KEY_PRESENT;
+	cache_bitmap_v2.key1 = 0x44444444;
+	cache_bitmap_v2.key2 = 0xDDDDDDDD;
+	cache_bitmap_v2.bitmapBpp = 32;
+	cache_bitmap_v2.bitmapWidth = 2;
+	cache_bitmap_v2.bitmapHeight = 2;
+	cache_bitmap_v2.bitmapLength = 16;
+	cache_bitmap_v2.bitmapDataStream = data;
+	IFCALL(instance->update->secondary->CacheBitmapV2, instance->context, &cache_bitmap_v2);
+
+	bitmap_cache_get_persistent_stats(bitmap_cache, &loaded, &hits, &misses);
+	CU_ASSERT(loaded == 3 && hits == 1 && misses == 1);
+	CU_ASSERT(persistent_cache_get(bitmap_cache->persistent, 2, 2) != NULL);
+
+	bitmap = bitmap_cache_get(bitmap_cache, 2, 2);
+	CU_ASSERT(bitmap != NULL && bitmap->bpp == 32 && bitmap->compressed == false);
+	bitmap_cache_get_persistent_stats(bitmap_cache, &loaded, &hits, &misses);
+	CU_ASSERT(hits == 1);
+
+	cache_free(instance->context->cache);
+	instance->context->cache = NULL;
+	freerdp_free(instance);
+
+	remove(filename);
+}
+
+void test_persistent_key_list(void)
+{
+	int i;
+	int pdus;
+	int length;
+	int sv[2];
+	uint8 bBitMask;
+	uint8 type;
+	uint8 compressed_type;
+	uint16 pdu_length;
+	uint16 pdu_type;
+	uint16 channel_id;
+	uint16 compressed_len;
+	uint16 numEntries[5];
+	uint16 totalEntries[5];
+	uint32 share_id;
+	uint32 key1;
+	uint32 key2;
+	uint32 count;
+	uint32 expected;
+	uint64 key;
+	STREAM* s;
+	rdpRdp* rdp;
+	rdpSettings* settings;
+
+	CU_ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+
+	rdp = rdp_new(NULL);
+	settings = rdp->settings;
+	transport_attach(rdp->transport, sv[0]);
+
+	/* 350 keys do not fit in one PDU, cell 3 starts in the middle of the first */
+	settings->persistent_bitmap_cache = true;
+	settings->bitmapCacheV2NumCells = 5;
+	settings->bitmapCacheV2CellInfo[2].numEntries = 2048;
+	settings->bitmapCacheV2CellInfo[2].persistent = true;
+	settings->bitmapCacheV2CellInfo[2].numPersistentKeys = 100;
+	settings->bitmapCacheV2CellInfo[2].persistentKeys = (uint64*) xmalloc(sizeof(uint64) * 100);
+	settings->bitmapCacheV2CellInfo[3].numEntries = 4096;
+	settings->bitmapCacheV2CellInfo[3].persistent = true;
+	settings->bitmapCacheV2CellInfo[3].numPersistentKeys = 250;
+	settings->bitmapCacheV2CellInfo[3].persistentKeys = (uint64*) xmalloc(sizeof(uint64) * 250);
+
+	for (i = 0; i < 100; i++)
+		settings->bitmapCacheV2CellInfo[2].persistentKeys[i] = ((uint64) (0x20000 + i) << 32) | i;
+	for (i = 0; i < 250; i++)
+		settings->bitmapCacheV2CellInfo[3].persistentKeys[i] = ((uint64) (0x30000 + i) << 32) | i;
+
+	CU_ASSERT(rdp_send_client_persistent_key_list_pdu(rdp) == true);
+
+	shutdown(sv[0], SHUT_WR);
+
+	s = stream_new(16 * 1024);
+	length = 0;
+	while ((i = recv(sv[1], s->data + length, 16 * 1024 - length, 0)) > 0)
+		length += i;
+	s->size = length;
+
+	/* read it back the way the server does */
+	settings->server_mode = true;
+	pdus = 0;
+	expected = 0;
+
+	while (stream_get_left(s) > 0)
+	{
+		CU_ASSERT(rdp_read_header(rdp, s, &pdu_length, &channel_id) == true);
+		CU_ASSERT(rdp_read_share_control_header(s, &pdu_length, &pdu_type, &channel_id) == true);
+		CU_ASSERT(pdu_type == PDU_TYPE_DATA);
+		CU_ASSERT(rdp_read_share_data_header(s, &pdu_length, &type, &share_id,
+				&compressed_type, &compressed_len) == true);
+		CU_ASSERT(type == DATA_PDU_TYPE_BITMAP_CACHE_PERSISTENT_LIST);
+
+		count = 0;
+		for (i = 0; i < 5; i++)
+		{
+			stream_read_uint16(s, numEntries[i]);
+			count += numEntries[i];
+		}
+		for (i = 0; i < 5; i++)
+			stream_read_uint16(s, totalEntries[i]);
+		stream_read_uint8(s, bBitMask);
+		stream_seek(s, 3);
+
+		CU_ASSERT(totalEntries[2] == 100 && totalEntries[3] == 250);
+		CU_ASSERT(numEntries[0] == 0 && numEntries[1] == 0 && numEntries[4] == 0);
+		CU_ASSERT(count == (pdus < 2 ? PERSIST_MAX_KEYS_PER_PDU : 350 - 2 * PERSIST_MAX_KEYS_PER_PDU));
+		CU_ASSERT(bBitMask == (pdus == 0 ? PERSIST_FIRST_PDU : (pdus == 2 ? PERSIST_LAST_PDU : 0)));
+
+		/* the keys of each cell continue where the previous PDU stopped */
+		for (i = 0; i < (int) count; i++, expected++)
+		{
+			stream_read_uint32(s, key1);
+			stream_read_uint32(s, key2);
+			key = ((uint64) key2 << 32) | key1;
+
+			if (expected < 100)
+			{
+				CU_ASSERT(key == settings->bitmapCacheV2CellInfo[2].persistentKeys[expected]);
+			}
+			else
+			{
+				CU_ASSERT(key == settings->bitmapCacheV2CellInfo[3].persistentKeys[expected - 100]);
+			}
+		}
+
+		pdus++;
+	}
+
+	CU_ASSERT(pdus == 3);
+	CU_ASSERT(expected == 350);
+
+	stream_free(s);
+	rdp_free(rdp);
+	close(sv[0]);
+	close(sv[1]);
+}
+
+#define REASSEMBLY_BITMAP_LENGTH	40000
+#define REASSEMBLY_FRAGMENT_LENGTH	16000
+
+int surface_bits_count;
+uint8* surface_bits_expected;
+
+static void test_surface_bits(rdpContext* context, SURFACE_BITS_COMMAND* surface_bits_command)
+{
+	CU_ASSERT(surface_bits_command->bitmapDataLength == REASSEMBLY_BITMAP_LENGTH);
+	CU_ASSERT(memcmp(surface_bits_command->bitmapData, surface_bits_expected, REASSEMBLY_BITMAP_LENGTH) == 0);
+	surface_bits_count++;
+}
+
+void test_fastpath_reassembly(void)
+{
+	int i;
+	int pass;
+	int offset;
+	int length;
+	uint8 fragmentation;
+	uint32 size;
+	uint32 reallocs;
+	uint64 bytes;
+	uint8* bitmap;
+	STREAM* cmd;
+	STREAM* s;
+	freerdp* instance;
+	SURFACE_BITS_COMMAND surface_bits_command;
+
+	instance = freerdp_new();
+	freerdp_context_new(instance);
+	instance->update->SurfaceBits = test_surface_bits;
+
+	bitmap = (uint8*) malloc(REASSEMBLY_BITMAP_LENGTH);
+	for (i = 0; i < REASSEMBLY_BITMAP_LENGTH; i++)
+		bitmap[i] = (uint8) (i * 7);
+	surface_bits_expected = bitmap;
+
+	/* one surface bits command, split in three fast-path fragments */
+	memset(&surface_bits_command, 0, sizeof(SURFACE_BITS_COMMAND));
+	surface_bits_command.bpp = 32;
+	surface_bits_command.width = 100;
+	surface_bits_command.height = 100;
+	surface_bits_command.bitmapDataLength = REASSEMBLY_BITMAP_LENGTH;
+
+	cmd = stream_new(SURFCMD_SURFACE_BITS_HEADER_LENGTH + REASSEMBLY_BITMAP_LENGTH);
+	update_write_surfcmd_surface_bits_header(cmd, &surface_bits_command);
+	stream_write(cmd, bitmap, REASSEMBLY_BITMAP_LENGTH);
+	stream_seal(cmd);
+
+	surface_bits_count = 0;
+
+	for (pass = 0; pass < 2; pass++)
+	{
+		s = stream_new(stream_get_size(cmd) + 3 * 3);
+
+		for (offset = 0; offset < stream_get_size(cmd); offset += length)
+		{
+			length = MIN(REASSEMBLY_FRAGMENT_LENGTH, stream_get_size(cmd) - offset);
+
+			if (offset == 0)
+				fragmentation = FASTPATH_FRAGMENT_FIRST;
+			else if (offset + length == stream_get_size(cmd))
+				fragmentation = FASTPATH_FRAGMENT_LAST;
+			else
+				fragmentation = FASTPATH_FRAGMENT_NEXT;
+
+			stream_write_uint8(s, FASTPATH_UPDATETYPE_SURFCMDS | (fragmentation << 4));
+			stream_write_uint16(s, length);
+			stream_write(s, cmd->data + offset, length);
+		}
+
+		stream_seal(s);
+		stream_set_pos(s, 0);
+		CU_ASSERT(fastpath_recv_updates(instance->context->rdp->fastpath, s) == true);
+		stream_free(s);
+
+		/* the first fragment sizes the buffer for the whole command */
+		freerdp_get_reassembly_stats(instance, &bytes, &reallocs, &size);
+		CU_ASSERT(surface_bits_count == pass + 1);
+		CU_ASSERT(bytes == (uint64) (pass + 1) * stream_get_size(cmd));
+		CU_ASSERT(reallocs == 1);
+		CU_ASSERT(size == SURFCMD_SURFACE_BITS_HEADER_LENGTH + REASSEMBLY_BITMAP_LENGTH + SURFCMD_FRAME_MARKER_LENGTH);
+	}
+
+	stream_free(cmd);
+	free(bitmap);
+	freerdp_free(instance);
+}
@@ -46,3 +46,9 @@ void test_read_switch_surface_order(void);
 
 void test_update_recv_orders(void);
 
+void test_persistent_cache(void);
+void test_persistent_bitmap_cache(void);
+void test_persistent_key_list(void);
+
+void test_fastpath_reassembly(void);
+
@@ -41,6 +41,7 @@ int add_stream_suite(void)
 	add_test_suite(stream);
 
 	add_test_function(stream);
+	add_test_function(stream_pool);
 
 	return 0;
 }
@@ -74,3 +75,42 @@ void test_stream(void)
 
 	stream_free(stream);
 }
+
+void test_stream_pool(void)
+{
+	STREAM* s1;
+	STREAM* s2;
+	STREAM* s3;
+	uint8* data;
+	STREAM_POOL* pool;
+
+	pool = stream_pool_new(64, 2);
+
+	s1 = stream_pool_take(pool, 0);
+	CU_ASSERT(stream_get_size(s1) == 64);
+	CU_ASSERT(stream_get_pos(s1) == 0);
+	stream_write_uint32(s1, 0x01020304);
+	data = stream_get_head(s1);
+
+	/* buffer is only recycled once the last reference is gone */
+	stream_pool_add_ref(s1);
+	stream_pool_release(s1);
+	s2 = stream_pool_take(pool, 0);
+	CU_ASSERT(stream_get_head(s2) != data);
+
+	stream_pool_release(s1);
+	s3 = stream_pool_take(pool, 32);
+	CU_ASSERT(stream_get_head(s3) == data);
+	CU_ASSERT(stream_get_pos(s3) == 0);
+
+	/* larger requests get a larger buffer */
+	stream_pool_release(s3);
+	s3 = stream_pool_take(pool, 1000);
+	CU_ASSERT(stream_get_size(s3) >= 1000);
+
+	/* streams outlive the pool */
+	stream_pool_free(pool);
+	stream_write_uint32(s2, 0x05060708);
+	stream_pool_release(s2);
+	stream_pool_release(s3);
+}
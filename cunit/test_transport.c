@@ -0,0 +1,225 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Transport Unit Tests
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <freerdp/freerdp.h>
+#include <freerdp/utils/memory.h>
+#include <freerdp/utils/stream.h>
+
+#include "test_transport.h"
+#include "libfreerdp-core/rdp.h"
+#include "libfreerdp-core/transport.h"
+
+int init_transport_suite(void)
+{
+	return 0;
+}
+
+int clean_transport_suite(void)
+{
+	return 0;
+}
+
+int add_transport_suite(void)
+{
+	add_test_suite(transport);
+
+	add_test_function(transport_check_fds);
+	add_test_function(transport_send_queue);
+
+	return 0;
+}
+
+#define TEST_PDU_LENGTH		300
+
+uint8 test_pdus[4 * TEST_PDU_LENGTH];
+int test_pdu_count;
+
+static void test_make_pdus(void)
+{
+	int i;
+	uint8* pdu;
+
+	for (i = 0; i < (int) sizeof(test_pdus); i++)
+		test_pdus[i] = (uint8) (i * 13);
+
+	/* TPKT headers */
+	for (i = 0; i < 4; i++)
+	{
+		pdu = &test_pdus[i * TEST_PDU_LENGTH];
+		pdu[0] = 3;
+		pdu[1] = 0;
+		pdu[2] = TEST_PDU_LENGTH >> 8;
+		pdu[3] = TEST_PDU_LENGTH & 0xFF;
+	}
+}
+
+static boolean test_recv_pdu(rdpTransport* transport, STREAM* s, void* extra)
+{
+	CU_ASSERT(stream_get_size(s) == TEST_PDU_LENGTH);
+	CU_ASSERT(memcmp(stream_get_head(s), &test_pdus[test_pdu_count * TEST_PDU_LENGTH], TEST_PDU_LENGTH) == 0);
+	test_pdu_count++;
+
+	return true;
+}
+
+static freerdp* test_transport_new(int* sv)
+{
+	freerdp* instance;
+	rdpTransport* transport;
+
+	CU_ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+
+	instance = freerdp_new();
+	freerdp_context_new(instance);
+
+	transport = instance->context->rdp->transport;
+	transport_attach(transport, sv[0]);
+	transport->tcp_out = transport->tcp_in;
+	transport_set_blocking_mode(transport, false);
+	transport->recv_callback = test_recv_pdu;
+
+	return instance;
+}
+
+static void test_transport_free(freerdp* instance, int* sv)
+{
+	freerdp_free(instance);
+	close(sv[0]);
+	close(sv[1]);
+}
+
+void test_transport_check_fds(void)
+{
+	int sv[2];
+	int count;
+	int split;
+	freerdp* instance;
+
+	test_make_pdus();
+	instance = test_transport_new(sv);
+	test_pdu_count = 0;
+
+	/* three PDUs and the start of a fourth arrive in one read */
+	split = 3 * TEST_PDU_LENGTH + TEST_PDU_LENGTH / 2;
+	CU_ASSERT(send(sv[1], test_pdus, split, 0) == split);
+
+	CU_ASSERT(freerdp_check_fds_ex(instance, &count) == true);
+	CU_ASSERT(count == 3);
+	CU_ASSERT(test_pdu_count == 3);
+
+	/* the partial PDU is kept and completed by the next read */
+	CU_ASSERT(send(sv[1], &test_pdus[split], sizeof(test_pdus) - split, 0) == sizeof(test_pdus) - split);
+
+	CU_ASSERT(freerdp_check_fds_ex(instance, &count) == true);
+	CU_ASSERT(count == 1);
+	CU_ASSERT(test_pdu_count == 4);
+
+	/* nothing waiting */
+	CU_ASSERT(freerdp_check_fds_ex(instance, &count) == true);
+	CU_ASSERT(count == 0);
+
+	test_transport_free(instance, sv);
+}
+
+#define TEST_QUEUE_PDU_LENGTH	16384
+
+static int test_recv_all(int sockfd, uint8* buffer, int size)
+{
+	int status;
+	int length = 0;
+
+	while ((status = recv(sockfd, buffer + length, size - length, MSG_DONTWAIT)) > 0)
+		length += status;
+
+	return length;
+}
+
+void test_transport_send_queue(void)
+{
+	int i;
+	int sv[2];
+	uint8* buffer;
+	uint32 pdus;
+	uint32 flushes;
+	uint32 peak;
+	uint32 stall_count;
+	uint32 stall_time;
+	STREAM* s;
+	freerdp* instance;
+	rdpTransport* transport;
+
+	instance = test_transport_new(sv);
+	transport = instance->context->rdp->transport;
+	buffer = (uint8*) xmalloc(8 * TEST_QUEUE_PDU_LENGTH);
+
+	/* replies written from a receive callback are held back */
+	transport->send_cork++;
+
+	for (i = 0; i < 3; i++)
+	{
+		s = transport_send_stream_init(transport, 100);
+		memset(stream_get_tail(s), i + 1, 100);
+		stream_seek(s, 100);
+		CU_ASSERT(transport_write(transport, s) == 100);
+	}
+
+	CU_ASSERT(test_recv_all(sv[1], buffer, 8 * TEST_QUEUE_PDU_LENGTH) == 0);
+	freerdp_get_send_stats(instance, &pdus, &flushes, &peak, &stall_count, &stall_time);
+	CU_ASSERT(pdus == 3 && flushes == 0 && peak == 3);
+
+	/* and go out in one write */
+	transport->send_cork--;
+	CU_ASSERT(transport_flush(transport) > 0);
+
+	CU_ASSERT(test_recv_all(sv[1], buffer, 8 * TEST_QUEUE_PDU_LENGTH) == 300);
+	CU_ASSERT(buffer[0] == 1 && buffer[100] == 2 && buffer[299] == 3);
+	freerdp_get_send_stats(instance, &pdus, &flushes, &peak, &stall_count, &stall_time);
+	CU_ASSERT(pdus == 3 && flushes == 1 && peak == 3);
+
+	/* a full queue is written without waiting for the flush */
+	transport->send_cork++;
+
+	for (i = 0; i < 5; i++)
+	{
+		s = transport_send_stream_init(transport, TEST_QUEUE_PDU_LENGTH);
+		memset(stream_get_tail(s), i + 1, TEST_QUEUE_PDU_LENGTH);
+		stream_seek(s, TEST_QUEUE_PDU_LENGTH);
+		CU_ASSERT(transport_write(transport, s) == TEST_QUEUE_PDU_LENGTH);
+	}
+
+	CU_ASSERT(test_recv_all(sv[1], buffer, 8 * TEST_QUEUE_PDU_LENGTH) == 4 * TEST_QUEUE_PDU_LENGTH);
+	freerdp_get_send_stats(instance, &pdus, &flushes, &peak, &stall_count, &stall_time);
+	CU_ASSERT(pdus == 8 && flushes == 2 && peak == 4);
+
+	transport->send_cork--;
+	CU_ASSERT(transport_flush(transport) > 0);
+	CU_ASSERT(test_recv_all(sv[1], buffer, 8 * TEST_QUEUE_PDU_LENGTH) == TEST_QUEUE_PDU_LENGTH);
+	CU_ASSERT(buffer[0] == 5);
+
+	/* without a cork PDUs are written at once */
+	s = transport_send_stream_init(transport, 100);
+	stream_seek(s, 100);
+	CU_ASSERT(transport_write(transport, s) == 100);
+	CU_ASSERT(test_recv_all(sv[1], buffer, 8 * TEST_QUEUE_PDU_LENGTH) == 100);
+	freerdp_get_send_stats(instance, &pdus, &flushes, &peak, &stall_count, &stall_time);
+	CU_ASSERT(pdus == 8 && flushes == 3);
+
+	xfree(buffer);
+	test_transport_free(instance, sv);
+}
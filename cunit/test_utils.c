@@ -26,8 +26,13 @@
 #include <sys/select.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
 #include <termios.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
 #include <freerdp/freerdp.h>
 #include <freerdp/utils/mutex.h>
 #include <freerdp/utils/semaphore.h>
@@ -36,6 +41,12 @@
 #include <freerdp/utils/args.h>
 #include <freerdp/utils/passphrase.h>
 #include <freerdp/utils/signal.h>
+#include <freerdp/utils/hotpath.h>
+#include <freerdp/utils/sleep.h>
+#include <freerdp/utils/spsc.h>
+#include <freerdp/utils/memory.h>
+#include <freerdp/utils/svc_plugin.h>
+#include <freerdp/constants.h>
 
 #include "test_utils.h"
 
@@ -60,6 +71,9 @@ int add_utils_suite(void)
 	add_test_function(args);
 	add_test_function(passphrase_read);
 	add_test_function(handle_signals);
+	add_test_function(hotpath);
+	add_test_function(spsc_queue);
+	add_test_function(svc_plugin_receive);
 
 	return 0;
 }
@@ -117,6 +131,38 @@ void test_wait_obj(void)
 
 	wait_obj_select(&wo, 1, 1000);
 
+	/* any number of sets is cleared at once */
+	for (set = 0; set < 10000; set++)
+		wait_obj_set(wo);
+	CU_ASSERT(wait_obj_select(&wo, 1, 0) == 1);
+	wait_obj_clear(wo);
+	CU_ASSERT(wait_obj_is_set(wo) == 0);
+	CU_ASSERT(wait_obj_select(&wo, 1, 0) == 0);
+
+#ifdef __linux__
+	{
+		int epfd;
+		struct epoll_event event;
+
+		epfd = epoll_create(1);
+		CU_ASSERT(wait_obj_epoll_add(wo, epfd, wo) == 0);
+		/* registering again only updates the data */
+		CU_ASSERT(wait_obj_epoll_add(wo, epfd, wo) == 0);
+		CU_ASSERT(epoll_wait(epfd, &event, 1, 0) == 0);
+
+		wait_obj_set(wo);
+		CU_ASSERT(epoll_wait(epfd, &event, 1, 0) == 1);
+		CU_ASSERT(event.data.ptr == wo);
+		wait_obj_clear(wo);
+		CU_ASSERT(epoll_wait(epfd, &event, 1, 0) == 0);
+
+		CU_ASSERT(wait_obj_epoll_del(wo, epfd) == 0);
+		wait_obj_set(wo);
+		CU_ASSERT(epoll_wait(epfd, &event, 1, 0) == 0);
+		close(epfd);
+	}
+#endif
+
 	wait_obj_free(wo);
 }
 
@@ -670,3 +716,292 @@ void test_handle_signals(void)
 {
 	handle_signals_resets_terminal();
 }
+
+static int count_lines(const char* filename)
+{
+	int c;
+	int lines = 0;
+	FILE* fp;
+
+	fp = fopen(filename, "r");
+	if (fp == NULL)
+		return -1;
+
+	while ((c = fgetc(fp)) != EOF)
+	{
+		if (c == '\n')
+			lines++;
+	}
+
+	fclose(fp);
+	return lines;
+}
+
+void test_hotpath(void)
+{
+	int i;
+	int fd;
+	uint64 n;
+	char filename[] = "/tmp/test_hotpath.XXXXXX";
+	char line[16];
+	FILE* fp;
+	HOTPATH_COUNTER counter;
+	HOTPATH_DEFINE(start);
+
+	HOTPATH_ENTER(start);
+	CU_ASSERT(start == 0);
+
+	fd = mkstemp(filename);
+	CU_ASSERT(fd >= 0);
+	if (fd < 0)
+		return;
+	close(fd);
+
+	hotpath_set_output(filename);
+	CU_ASSERT(hotpath_enabled());
+	hotpath_reset();
+
+	for (i = 0; i < 3; i++)
+	{
+		HOTPATH_ENTER(start);
+		freerdp_usleep(2000);
+		HOTPATH_EXIT(start, HOTPATH_GDI_BLIT);
+	}
+
+	hotpath_get_counter(HOTPATH_GDI_BLIT, &counter);
+	CU_ASSERT(counter.count == 3);
+	CU_ASSERT(counter.total_ns >= 6000000);
+	CU_ASSERT(counter.max_ns >= 2000000);
+
+	/* nothing below bucket 20, 2^20ns ~ 1ms */
+	n = 0;
+	for (i = 0; i < 20; i++)
+		n += counter.buckets[i];
+	CU_ASSERT(n == 0);
+	n = 0;
+	for (i = 0; i < HOTPATH_NUM_BUCKETS; i++)
+		n += counter.buckets[i];
+	CU_ASSERT(n == 3);
+
+	hotpath_get_counter(HOTPATH_RFX_DECODE, &counter);
+	CU_ASSERT(counter.count == 0);
+
+	/* the signal only flags the dump, the next sample writes it */
+	raise(SIGUSR2);
+	CU_ASSERT(count_lines(filename) == 0);
+	HOTPATH_ENTER(start);
+	HOTPATH_EXIT(start, HOTPATH_GDI_BLIT);
+	CU_ASSERT(count_lines(filename) == 1);
+
+	hotpath_dump();
+	CU_ASSERT(count_lines(filename) == 2);
+
+	fp = fopen(filename, "r");
+	CU_ASSERT(fp != NULL);
+	if (fp != NULL)
+	{
+		CU_ASSERT(fgets(line, sizeof(line), fp) != NULL);
+		CU_ASSERT(strncmp(line, "{\"time\":", 8) == 0);
+		fclose(fp);
+	}
+
+	/* leave the profiler off for the tests that follow */
+	hotpath_set_output(NULL);
+	CU_ASSERT(!hotpath_enabled());
+	HOTPATH_ENTER(start);
+	CU_ASSERT(start == 0);
+
+	unlink(filename);
+}
+
+#define SPSC_TEST_ITEMS 200000
+
+static void* spsc_test_producer(void* arg)
+{
+	uint32 i;
+	SPSC_QUEUE* queue = (SPSC_QUEUE*) arg;
+
+	for (i = 0; i < SPSC_TEST_ITEMS; i++)
+	{
+		while (spsc_queue_push(queue, &i) == SPSC_QUEUE_FULL)
+			sched_yield();
+	}
+
+	return NULL;
+}
+
+void test_spsc_queue(void)
+{
+	uint32 i;
+	uint32 value;
+	uint32 expected;
+	pthread_t thread;
+	SPSC_QUEUE* queue;
+
+	/* rounded up to 8 slots */
+	queue = spsc_queue_new(5, sizeof(uint32));
+	CU_ASSERT(spsc_queue_is_empty(queue));
+	CU_ASSERT(spsc_queue_pop(queue, &value) == false);
+
+	/* only the push into an empty queue asks for a wakeup */
+	value = 100;
+	CU_ASSERT(spsc_queue_push(queue, &value) == SPSC_QUEUE_WAKE);
+	for (i = 1; i < 8; i++)
+	{
+		value = 100 + i;
+		CU_ASSERT(spsc_queue_push(queue, &value) == SPSC_QUEUE_PUSHED);
+	}
+	CU_ASSERT(spsc_queue_push(queue, &value) == SPSC_QUEUE_FULL);
+
+	/* a partly drained queue still has a pending wakeup */
+	CU_ASSERT(spsc_queue_pop(queue, &value) && value == 100);
+	value = 108;
+	CU_ASSERT(spsc_queue_push(queue, &value) == SPSC_QUEUE_PUSHED);
+
+	for (i = 1; i <= 8; i++)
+		CU_ASSERT(spsc_queue_pop(queue, &value) && value == 100 + i);
+	CU_ASSERT(spsc_queue_pop(queue, &value) == false);
+	CU_ASSERT(spsc_queue_is_empty(queue));
+
+	value = 200;
+	CU_ASSERT(spsc_queue_push(queue, &value) == SPSC_QUEUE_WAKE);
+	CU_ASSERT(spsc_queue_pop(queue, &value) && value == 200);
+	spsc_queue_free(queue);
+
+	/* items cross threads in order and intact */
+	queue = spsc_queue_new(64, sizeof(uint32));
+	CU_ASSERT(pthread_create(&thread, NULL, spsc_test_producer, queue) == 0);
+
+	for (expected = 0; expected < SPSC_TEST_ITEMS; )
+	{
+		if (!spsc_queue_pop(queue, &value))
+		{
+			sched_yield();
+			continue;
+		}
+
+		if (value != expected)
+			break;
+		expected++;
+	}
+
+	pthread_join(thread, NULL);
+	CU_ASSERT(expected == SPSC_TEST_ITEMS);
+	CU_ASSERT(spsc_queue_is_empty(queue));
+	spsc_queue_free(queue);
+}
+
+#define SVC_TEST_OPEN_HANDLE	0x5EC
+
+static int svc_test_init_handle;
+static PCHANNEL_INIT_EVENT_FN svc_test_init_event;
+static PCHANNEL_OPEN_EVENT_FN svc_test_open_event;
+static volatile int svc_test_received;
+static uint32 svc_test_lengths[2];
+static uint8 svc_test_data[2][4000];
+
+static uint32 FREERDP_CC svc_test_channel_init(void** ppInitHandle, PCHANNEL_DEF pChannel,
+	int channelCount, uint32 versionRequested, PCHANNEL_INIT_EVENT_FN pChannelInitEventProc)
+{
+	*ppInitHandle = &svc_test_init_handle;
+	svc_test_init_event = pChannelInitEventProc;
+	return CHANNEL_RC_OK;
+}
+
+static uint32 FREERDP_CC svc_test_channel_open(void* pInitHandle, uint32* pOpenHandle,
+	char* pChannelName, PCHANNEL_OPEN_EVENT_FN pChannelOpenEventProc)
+{
+	*pOpenHandle = SVC_TEST_OPEN_HANDLE;
+	svc_test_open_event = pChannelOpenEventProc;
+	return CHANNEL_RC_OK;
+}
+
+static uint32 FREERDP_CC svc_test_channel_close(uint32 openHandle)
+{
+	return CHANNEL_RC_OK;
+}
+
+/* runs in the plugin thread */
+static void svc_test_receive(rdpSvcPlugin* plugin, STREAM* data_in)
+{
+	int index = svc_test_received;
+
+	if (index < 2)
+	{
+		svc_test_lengths[index] = stream_get_size(data_in);
+		memcpy(svc_test_data[index], stream_get_head(data_in), MIN(stream_get_size(data_in), 4000));
+	}
+
+	stream_free(data_in);
+	svc_test_received = index + 1;
+}
+
+static void svc_test_terminate(rdpSvcPlugin* plugin)
+{
+	xfree(plugin);
+}
+
+void test_svc_plugin_receive(void)
+{
+	int i;
+	uint8 data[4000];
+	uint64 messages;
+	uint64 single_chunk;
+	uint64 bytes_copied;
+	rdpSvcPlugin* plugin;
+	CHANNEL_ENTRY_POINTS_EX entry_points;
+
+	for (i = 0; i < (int) sizeof(data); i++)
+		data[i] = (uint8) (i * 7);
+
+	memset(&entry_points, 0, sizeof(entry_points));
+	entry_points.cbSize = sizeof(entry_points);
+	entry_points.protocolVersion = VIRTUAL_CHANNEL_VERSION_WIN2000;
+	entry_points.pVirtualChannelInit = svc_test_channel_init;
+	entry_points.pVirtualChannelOpen = svc_test_channel_open;
+	entry_points.pVirtualChannelClose = svc_test_channel_close;
+
+	plugin = xnew(rdpSvcPlugin);
+	strcpy(plugin->channel_def.name, "svctest");
+	plugin->receive_callback = svc_test_receive;
+	plugin->terminate_callback = svc_test_terminate;
+	svc_test_received = 0;
+
+	svc_plugin_init(plugin, (CHANNEL_ENTRY_POINTS*) &entry_points);
+	CU_ASSERT(svc_test_init_event != NULL);
+	if (svc_test_init_event == NULL)
+		return;
+
+	svc_test_init_event(&svc_test_init_handle, CHANNEL_EVENT_CONNECTED, NULL, 0);
+	CU_ASSERT(svc_test_open_event != NULL);
+	if (svc_test_open_event == NULL)
+		return;
+
+	/* a message in one chunk */
+	svc_test_open_event(SVC_TEST_OPEN_HANDLE, CHANNEL_EVENT_DATA_RECEIVED,
+		data, 100, 100, CHANNEL_FLAG_FIRST | CHANNEL_FLAG_LAST);
+
+	/* and one in three, the chunk buffers are only valid during the call */
+	svc_test_open_event(SVC_TEST_OPEN_HANDLE, CHANNEL_EVENT_DATA_RECEIVED,
+		data, 1600, 4000, CHANNEL_FLAG_FIRST);
+	svc_test_open_event(SVC_TEST_OPEN_HANDLE, CHANNEL_EVENT_DATA_RECEIVED,
+		data + 1600, 1600, 4000, 0);
+	svc_test_open_event(SVC_TEST_OPEN_HANDLE, CHANNEL_EVENT_DATA_RECEIVED,
+		data + 3200, 800, 4000, CHANNEL_FLAG_LAST);
+
+	for (i = 0; i < 2000 && svc_test_received < 2; i++)
+		freerdp_usleep(1000);
+
+	CU_ASSERT(svc_test_received == 2);
+	CU_ASSERT(svc_test_lengths[0] == 100);
+	CU_ASSERT(memcmp(svc_test_data[0], data, 100) == 0);
+	CU_ASSERT(svc_test_lengths[1] == 4000);
+	CU_ASSERT(memcmp(svc_test_data[1], data, 4000) == 0);
+
+	svc_plugin_get_receive_stats(plugin, &messages, &single_chunk, &bytes_copied);
+	CU_ASSERT(messages == 2);
+	CU_ASSERT(single_chunk == 1);
+	CU_ASSERT(bytes_copied == 4100);
+
+	svc_test_init_event(&svc_test_init_handle, CHANNEL_EVENT_TERMINATED, NULL, 0);
+}
@@ -30,3 +30,6 @@ void test_wait_obj(void);
 void test_args(void);
 void test_passphrase_read(void);
 void test_handle_signals(void);
+void test_hotpath(void);
+void test_spsc_queue(void);
+void test_svc_plugin_receive(void);
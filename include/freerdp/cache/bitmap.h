@@ -30,6 +30,7 @@ typedef struct _BITMAP_V2_CELL BITMAP_V2_CELL;
 typedef struct rdp_bitmap_cache rdpBitmapCache;
 
 #include <freerdp/cache/cache.h>
+#include <freerdp/cache/persistent.h>
 
 struct _BITMAP_V2_CELL
 {
@@ -57,11 +58,18 @@ struct rdp_bitmap_cache
 	rdpUpdate* update;
 	rdpContext* context;
 	rdpSettings* settings;
+
+	rdpPersistentCache* persistent;
+	uint32 persistentLoaded;
+	uint32 persistentHits;
+	uint32 persistentMisses;
 };
 
 FREERDP_API rdpBitmap* bitmap_cache_get(rdpBitmapCache* bitmap_cache, uint32 id, uint32 index);
 FREERDP_API void bitmap_cache_put(rdpBitmapCache* bitmap_cache, uint32 id, uint32 index, rdpBitmap* bitmap);
 
+FREERDP_API void bitmap_cache_get_persistent_stats(rdpBitmapCache* bitmap_cache, uint32* loaded, uint32* hits, uint32* misses);
+
 FREERDP_API void bitmap_cache_register_callbacks(rdpUpdate* update);
 
 FREERDP_API rdpBitmapCache* bitmap_cache_new(rdpSettings* settings);
@@ -0,0 +1,66 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Persistent Bitmap Cache
+ *
+ * Copyright 2014 Jay Sorg <jay.sorg@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __PERSISTENT_CACHE_H
+#define __PERSISTENT_CACHE_H
+
+#include <freerdp/api.h>
+#include <freerdp/types.h>
+
+/**
+ * The persistent cache file is a fixed layout of one header followed by one
+ * slot per cache entry, mapped into memory for the lifetime of the cache.
+ * Slots hold the bitmap exactly as received on the wire (possibly compressed)
+ * together with its 64-bit key, so a slot index always matches the bitmap
+ * cache index the server knows it by.
+ */
+
+#define PERSISTENT_CACHE_MAX_CELLS		5
+#define PERSISTENT_CACHE_MAX_DATA		16384
+
+#define PERSISTENT_CACHE_FLAG_VALID		0x01
+#define PERSISTENT_CACHE_FLAG_COMPRESSED	0x02
+
+typedef struct _PERSISTENT_CACHE_ENTRY PERSISTENT_CACHE_ENTRY;
+typedef struct rdp_persistent_cache rdpPersistentCache;
+
+struct _PERSISTENT_CACHE_ENTRY
+{
+	uint32 key1;
+	uint32 key2;
+	uint16 width;
+	uint16 height;
+	uint8 bpp;
+	uint8 flags;
+	uint16 reserved;
+	uint32 length;
+	uint8 data[PERSISTENT_CACHE_MAX_DATA];
+};
+
+FREERDP_API PERSISTENT_CACHE_ENTRY* persistent_cache_get(rdpPersistentCache* persistent, uint32 id, uint32 index);
+FREERDP_API tbool persistent_cache_put(rdpPersistentCache* persistent, uint32 id, uint32 index,
+		uint32 key1, uint32 key2, uint16 width, uint16 height, uint8 bpp,
+		tbool compressed, uint8* data, uint32 length);
+FREERDP_API void persistent_cache_invalidate(rdpPersistentCache* persistent, uint32 id, uint32 index);
+FREERDP_API uint32 persistent_cache_get_keys(rdpPersistentCache* persistent, uint32 id, uint64* keys, uint32 max);
+
+FREERDP_API rdpPersistentCache* persistent_cache_open(const char* filename, uint32* numEntries);
+FREERDP_API void persistent_cache_close(rdpPersistentCache* persistent);
+
+#endif /* __PERSISTENT_CACHE_H */
@@ -43,6 +43,8 @@ FREERDP_API int freerdp_channels_send_event(rdpChannels* channels, RDP_EVENT* ev
 FREERDP_API tbool freerdp_channels_get_fds(rdpChannels* channels, freerdp* instance, void** read_fds,
 	int* read_count, void** write_fds, int* write_count);
 FREERDP_API tbool freerdp_channels_check_fds(rdpChannels* channels, freerdp* instance);
+FREERDP_API tbool freerdp_channels_epoll_add(rdpChannels* channels, freerdp* instance, int epfd, void* data);
+FREERDP_API tbool freerdp_channels_epoll_del(rdpChannels* channels, freerdp* instance, int epfd);
 FREERDP_API RDP_EVENT* freerdp_channels_pop_event(rdpChannels* channels);
 FREERDP_API void freerdp_channels_close(rdpChannels* channels, freerdp* instance);
 
@@ -119,6 +119,8 @@ struct _RFX_CONTEXT
 	void (*quantization_encode)(sint16* buffer, const uint32* quantization_values);
 	void (*dwt_2d_decode)(sint16* buffer, sint16* dwt_buffer);
 	void (*dwt_2d_encode)(sint16* buffer, sint16* dwt_buffer);
+	int (*rlgr_decode)(RLGR_MODE mode, const uint8* data, int data_size, sint16* buffer, int buffer_size);
+	int (*rlgr_encode)(RLGR_MODE mode, const sint16* data, int data_size, uint8* buffer, int buffer_size);
 
 	/* private definitions */
 	RFX_CONTEXT_PRIV* priv;
@@ -130,8 +132,14 @@ FREERDP_API void rfx_context_free(RFX_CONTEXT* context);
 FREERDP_API void rfx_context_set_cpu_opt(RFX_CONTEXT* context, uint32 cpu_opt);
 FREERDP_API void rfx_context_set_pixel_format(RFX_CONTEXT* context, RFX_PIXEL_FORMAT pixel_format);
 FREERDP_API void rfx_context_reset(RFX_CONTEXT* context);
+FREERDP_API void rfx_context_set_threads(RFX_CONTEXT* context, int num_threads);
+FREERDP_API void rfx_context_set_tile_cache(RFX_CONTEXT* context, boolean enable);
+FREERDP_API void rfx_context_get_tile_stats(RFX_CONTEXT* context, uint32* encoded, uint32* skipped);
 
 FREERDP_API RFX_MESSAGE* rfx_process_message(RFX_CONTEXT* context, uint8* data, uint32 length);
+FREERDP_API RFX_MESSAGE* rfx_process_message_to_surface(RFX_CONTEXT* context, uint8* data, uint32 length,
+	uint8* dst, int dst_width, int dst_height, int dst_stride, RFX_PIXEL_FORMAT dst_format,
+	int left, int top);
 FREERDP_API uint16 rfx_message_get_tile_count(RFX_MESSAGE* message);
 FREERDP_API RFX_TILE* rfx_message_get_tile(RFX_MESSAGE* message, int index);
 FREERDP_API uint16 rfx_message_get_rect_count(RFX_MESSAGE* message);
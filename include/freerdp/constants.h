@@ -46,7 +46,10 @@ enum RDP_SVC_CHANNEL_FLAG
 	CHANNEL_FLAG_SHOW_PROTOCOL = 0x10,
 	CHANNEL_FLAG_SUSPEND = 0x20,
 	CHANNEL_FLAG_RESUME = 0x40,
-	CHANNEL_FLAG_FAIL = 0x100
+	CHANNEL_FLAG_FAIL = 0x100,
+	CHANNEL_FLAG_PACKET_COMPRESSED = 0x00200000,
+	CHANNEL_FLAG_PACKET_AT_FRONT = 0x00400000,
+	CHANNEL_FLAG_PACKET_FLUSHED = 0x00800000
 };
 
 /**
@@ -107,6 +110,7 @@ typedef enum RDP_PIXEL_FORMAT RDP_PIXEL_FORMAT;
  * CPU Optimization flags
  */
 #define CPU_SSE2			0x1
+#define CPU_AVX2			0x2
 
 /**
  * OSMajorType
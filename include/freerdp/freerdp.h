@@ -122,9 +122,15 @@ FREERDP_API boolean freerdp_disconnect(freerdp* instance);
 
 FREERDP_API boolean freerdp_get_fds(freerdp* instance, void** rfds, int* rcount, void** wfds, int* wcount);
 FREERDP_API boolean freerdp_check_fds(freerdp* instance);
+FREERDP_API boolean freerdp_check_fds_ex(freerdp* instance, int* count);
+FREERDP_API boolean freerdp_epoll_add(freerdp* instance, int epfd, void* data);
+FREERDP_API boolean freerdp_epoll_del(freerdp* instance, int epfd);
 
 FREERDP_API void freerdp_send_keep_alive(freerdp* instance);
 FREERDP_API uint32 freerdp_error_info(freerdp* instance);
+FREERDP_API void freerdp_get_reassembly_stats(freerdp* instance, uint64* bytes, uint32* reallocs, uint32* size);
+FREERDP_API void freerdp_get_send_stats(freerdp* instance, uint32* pdus, uint32* flushes,
+		uint32* peak, uint32* stall_count, uint32* stall_time);
 
 FREERDP_API void freerdp_get_version(int* major, int* minor, int* revision);
 
@@ -86,6 +86,12 @@
 #define GDI_PS_DASH			0x01
 #define GDI_PS_NULL			0x05
 
+/* Region Combine Modes */
+#define GDI_RGN_AND			0x01
+#define GDI_RGN_OR			0x02
+#define GDI_RGN_XOR			0x03
+#define GDI_RGN_DIFF			0x04
+
 /* Background Modes */
 #define GDI_OPAQUE			0x00000001
 #define GDI_TRANSPARENT			0x00000002
@@ -132,6 +138,24 @@ struct _GDI_RGN
 typedef struct _GDI_RGN GDI_RGN;
 typedef GDI_RGN* HGDI_RGN;
 
+/**
+ * Area made of disjoint rectangles, y-x banded as in X11: sorted by y then
+ * x, the rectangles of a band share y and h, and the bands are as tall as
+ * they can be, so that an area has only one representation.
+ */
+
+struct _GDI_REGION
+{
+	int count; /* rectangles in rects */
+	int size; /* rectangles allocated for rects */
+	int spareSize; /* rectangles allocated for spare */
+	HGDI_RGN rects;
+	HGDI_RGN spare; /* output of the next operation, swapped with rects */
+	GDI_RGN extents; /* bounding box, null if the region is empty */
+};
+typedef struct _GDI_REGION GDI_REGION;
+typedef GDI_REGION* HGDI_REGION;
+
 struct _GDI_BITMAP
 {
 	uint8 objectType;
@@ -193,10 +217,9 @@ typedef GDI_BRUSH* HGDI_BRUSH;
 
 struct _GDI_WND
 {
-	int count;
-	int ninvalid;
-	HGDI_RGN invalid;
-	HGDI_RGN cinvalid;
+	int count; /* most rectangles kept in region */
+	HGDI_RGN invalid; /* bounding box of region, null once drawn */
+	GDI_REGION region; /* invalid area, only valid while invalid is not null */
 };
 typedef struct _GDI_WND GDI_WND;
 typedef GDI_WND* HGDI_WND;
@@ -238,9 +261,23 @@ struct gdi_glyph
 	HGDI_DC hdc;
 	HGDI_BITMAP bitmap;
 	HGDI_BITMAP org_bitmap;
+	uint32* mask; /* 1bpp rows, leftmost pixel in the top bit of the first word */
+	int mask_stride; /* words per row */
 };
 typedef struct gdi_glyph gdiGlyph;
 
+struct gdi_glyph_pos
+{
+	gdiGlyph* glyph;
+	int x;
+	int y;
+};
+typedef struct gdi_glyph_pos gdiGlyphPos;
+
+/* bitmap update pool classes hold 64x64 << class pixels, the last one grows */
+#define GDI_BITMAP_POOL_CLASSES		8
+#define GDI_BITMAP_POOL_MIN_PIXELS	4096
+
 struct rdp_gdi
 {
 	rdpContext* context;
@@ -263,6 +300,17 @@ struct rdp_gdi
 	void* nsc_context;
 	gdiBitmap* tile;
 	gdiBitmap* image;
+	gdiBitmap* bitmap_pool[GDI_BITMAP_POOL_CLASSES];
+	int bitmap_pool_pixels[GDI_BITMAP_POOL_CLASSES];
+	uint8* bitmap_scratch;
+	int bitmap_scratch_size;
+	uint32 bitmap_rects_direct;
+	uint32 bitmap_rects_pooled;
+	uint32 bitmap_pool_allocs;
+	tbool glyph_batch;
+	gdiGlyphPos* glyph_run;
+	int glyph_run_count;
+	int glyph_run_size;
 };
 
 FREERDP_API uint32 gdi_rop3_code(uint8 code);
@@ -270,6 +318,8 @@ FREERDP_API uint8* gdi_get_bitmap_pointer(HGDI_DC hdcBmp, int x, int y);
 FREERDP_API uint8* gdi_get_brush_pointer(HGDI_DC hdcBrush, int x, int y);
 FREERDP_API int gdi_is_mono_pixel_set(uint8* data, int x, int y, int width);
 FREERDP_API void gdi_resize(rdpGdi* gdi, int width, int height);
+FREERDP_API void gdi_get_bitmap_update_stats(rdpGdi* gdi, uint32* direct, uint32* pooled, uint32* allocs);
+FREERDP_API void gdi_set_cpu_opt(rdpGdi* gdi, uint32 cpu_opt);
 
 FREERDP_API int gdi_init(freerdp* instance, uint32 flags, uint8* buffer);
 FREERDP_API void gdi_free(freerdp* instance);
@@ -40,6 +40,12 @@ FREERDP_API int gdi_SetRectRgn(HGDI_RGN hRgn, int nLeftRect, int nTopRect, int n
 FREERDP_API int gdi_EqualRgn(HGDI_RGN hSrcRgn1, HGDI_RGN hSrcRgn2);
 FREERDP_API int gdi_CopyRect(HGDI_RECT dst, HGDI_RECT src);
 FREERDP_API int gdi_PtInRect(HGDI_RECT rc, int x, int y);
+FREERDP_API void gdi_InitRegion(HGDI_REGION region);
+FREERDP_API void gdi_UninitRegion(HGDI_REGION region);
+FREERDP_API void gdi_EmptyRegion(HGDI_REGION region);
+FREERDP_API int gdi_CombineRegion(HGDI_REGION dst, HGDI_REGION src1, HGDI_REGION src2, int mode);
+FREERDP_API int gdi_UnionRectRegion(HGDI_REGION region, int x, int y, int w, int h);
+FREERDP_API int gdi_SimplifyRegion(HGDI_REGION region, int max);
 FREERDP_API int gdi_InvalidateRegion(HGDI_DC hdc, int x, int y, int w, int h);
 
 #endif /* __GDI_REGION_H */
@@ -57,6 +57,12 @@
 #define ENCRYPTION_LEVEL_HIGH               0x00000003
 #define ENCRYPTION_LEVEL_FIPS               0x00000004
 
+/* Bulk Compression Types */
+#define COMPRESSION_TYPE_8K                 0x00
+#define COMPRESSION_TYPE_64K                0x01
+#define COMPRESSION_TYPE_RDP6               0x02
+#define COMPRESSION_TYPE_RDP61              0x03
+
 /* Auto Reconnect Version */
 #define AUTO_RECONNECT_VERSION_1            0x00000001
 
@@ -207,6 +213,8 @@ struct _BITMAP_CACHE_V2_CELL_INFO
 {
 	uint32 numEntries;
 	boolean persistent;
+	uint32 numPersistentKeys;
+	uint64* persistentKeys;
 };
 typedef struct _BITMAP_CACHE_V2_CELL_INFO BITMAP_CACHE_V2_CELL_INFO;
 
@@ -270,7 +278,9 @@ struct rdp_settings
 	boolean compression; /* 59 */
 	uint32 performance_flags; /* 60 */
 	rdpBlob* password_cookie; /* 61 */
-	uint32 paddingC[80 - 62]; /* 62 */
+	uint32 compression_type; /* 62 */
+	boolean compress_outbound; /* 63 */
+	uint32 paddingC[80 - 64]; /* 64 */
 
 	/* User Interface Parameters */
 	boolean sw_gdi; /* 80 */
@@ -345,7 +355,7 @@ struct rdp_settings
 	boolean disable_theming; /* 244 */
 	uint32 connection_type; /* 245 */
 	uint32 multifrag_max_request_size; /* 246 */
-	uint32 paddingK[248 - 247]; /* 247 */
+	uint32 vc_flags; /* 247 */
 
 	/* Certificate */
 	char* cert_file; /* 248 */
@@ -402,7 +412,8 @@ struct rdp_settings
 	boolean persistent_bitmap_cache; /* 330 */
 	uint32 bitmapCacheV2NumCells; /* 331 */
 	BITMAP_CACHE_V2_CELL_INFO* bitmapCacheV2CellInfo; /* 332 */
-	uint32 paddingQ[344 - 333]; /* 333 */
+	char* persistent_bitmap_cache_file; /* 333 */
+	uint32 paddingQ[344 - 334]; /* 334 */
 
 	/* Offscreen Bitmap Cache */
 	boolean offscreen_bitmap_cache; /* 344 */
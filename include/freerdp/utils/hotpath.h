@@ -0,0 +1,76 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Hot Path Latency Profiler
+ *
+ * Copyright 2014 Jay Sorg <jay.sorg@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __UTILS_HOTPATH_H
+#define __UTILS_HOTPATH_H
+
+#include <freerdp/api.h>
+#include <freerdp/types.h>
+
+/**
+ * Wall clock latency of the main receive and drawing stages, always built
+ * in and switched on at run time by setting FREERDP_HOTPATH to a file name
+ * ("-" for stderr), or by hotpath_set_output, which takes NULL to switch it
+ * off again. Every thread counts into its own block, so the stages
+ * cost two clock reads and no locking. The data is written as JSON by
+ * hotpath_dump, at disconnect and, on unix, when SIGUSR2 is received.
+ */
+
+enum _HOTPATH_STAGE
+{
+	HOTPATH_TRANSPORT_READ,
+	HOTPATH_FASTPATH_UPDATE,
+	HOTPATH_ORDER_PARSE,
+	HOTPATH_BITMAP_DECOMPRESS,
+	HOTPATH_RFX_DECODE,
+	HOTPATH_NSC_DECODE,
+	HOTPATH_GDI_BLIT,
+	HOTPATH_NUM_STAGES
+};
+typedef enum _HOTPATH_STAGE HOTPATH_STAGE;
+
+/* bucket n counts the samples taking [2^n, 2^(n+1)) nanoseconds */
+#define HOTPATH_NUM_BUCKETS	40
+
+struct _HOTPATH_COUNTER
+{
+	uint64 count;
+	uint64 total_ns;
+	uint64 max_ns;
+	uint64 buckets[HOTPATH_NUM_BUCKETS];
+};
+typedef struct _HOTPATH_COUNTER HOTPATH_COUNTER;
+
+FREERDP_API void hotpath_init(void);
+FREERDP_API boolean hotpath_enabled(void);
+FREERDP_API void hotpath_set_output(const char* filename);
+
+FREERDP_API uint64 hotpath_enter(void);
+FREERDP_API void hotpath_exit(HOTPATH_STAGE stage, uint64 start);
+
+FREERDP_API void hotpath_get_counter(HOTPATH_STAGE stage, HOTPATH_COUNTER* counter);
+FREERDP_API void hotpath_reset(void);
+FREERDP_API void hotpath_dump(void);
+
+/* start is 0 when the profiler is off, the exit is skipped then */
+#define HOTPATH_DEFINE(start)		uint64 start
+#define HOTPATH_ENTER(start)		start = hotpath_enter()
+#define HOTPATH_EXIT(start, stage)	do { if (start != 0) hotpath_exit(stage, start); } while (0)
+
+#endif /* __UTILS_HOTPATH_H */
@@ -0,0 +1,48 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Single Producer Single Consumer Queue
+ *
+ * Copyright 2014 Jay Sorg <jay.sorg@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __UTILS_SPSC_H
+#define __UTILS_SPSC_H
+
+#include <freerdp/api.h>
+#include <freerdp/types.h>
+
+/**
+ * Bounded lock free ring of fixed size items, copied in and out of
+ * preallocated slots. Exactly one thread may push and one thread may pop.
+ * A push reports whether the consumer had drained the queue, so the
+ * producer only needs to wake the consumer once per batch: a consumer that
+ * pops until the queue is empty never misses an item pushed without a
+ * wakeup.
+ */
+
+typedef struct _SPSC_QUEUE SPSC_QUEUE;
+
+/* spsc_queue_push return values */
+#define SPSC_QUEUE_FULL		-1
+#define SPSC_QUEUE_PUSHED	0
+#define SPSC_QUEUE_WAKE		1
+
+FREERDP_API SPSC_QUEUE* spsc_queue_new(int count, int item_size);
+FREERDP_API void spsc_queue_free(SPSC_QUEUE* queue);
+FREERDP_API int spsc_queue_push(SPSC_QUEUE* queue, const void* item);
+FREERDP_API boolean spsc_queue_pop(SPSC_QUEUE* queue, void* item);
+FREERDP_API boolean spsc_queue_is_empty(SPSC_QUEUE* queue);
+
+#endif /* __UTILS_SPSC_H */
@@ -36,6 +36,15 @@ typedef struct _STREAM STREAM;
 FREERDP_API STREAM* stream_new(int size);
 FREERDP_API void stream_free(STREAM* stream);
 
+/* pool of reference counted STREAMs, buffers are recycled on the last release */
+typedef struct _STREAM_POOL STREAM_POOL;
+
+FREERDP_API STREAM_POOL* stream_pool_new(int size, int max_count);
+FREERDP_API void stream_pool_free(STREAM_POOL* pool);
+FREERDP_API STREAM* stream_pool_take(STREAM_POOL* pool, int size);
+FREERDP_API void stream_pool_add_ref(STREAM* stream);
+FREERDP_API void stream_pool_release(STREAM* stream);
+
 #define stream_attach(_s, _buf, _size) do { \
 	_s->size = _size; \
 	_s->data = _buf; \
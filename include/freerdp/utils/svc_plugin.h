@@ -51,6 +51,7 @@ struct rdp_svc_plugin
 FREERDP_API void svc_plugin_init(rdpSvcPlugin* plugin, CHANNEL_ENTRY_POINTS* pEntryPoints);
 FREERDP_API int svc_plugin_send(rdpSvcPlugin* plugin, STREAM* data_out);
 FREERDP_API int svc_plugin_send_event(rdpSvcPlugin* plugin, RDP_EVENT* event);
+FREERDP_API void svc_plugin_get_receive_stats(rdpSvcPlugin* plugin, uint64* messages, uint64* single_chunk, uint64* bytes_copied);
 
 #define svc_plugin_get_data(_p) (RDP_PLUGIN_DATA*)(((rdpSvcPlugin*)_p)->channel_entry_points.pExtendedData)
 
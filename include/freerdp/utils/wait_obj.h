@@ -31,4 +31,9 @@ FREERDP_API void wait_obj_clear(struct wait_obj* obj);
 FREERDP_API int wait_obj_select(struct wait_obj** listobj, int numobj, int timeout);
 FREERDP_API void wait_obj_get_fds(struct wait_obj* obj, void** fds, int* count);
 
+FREERDP_API int wait_obj_epoll_add_fds(int epfd, void** fds, int count, void* data);
+FREERDP_API int wait_obj_epoll_del_fds(int epfd, void** fds, int count);
+FREERDP_API int wait_obj_epoll_add(struct wait_obj* obj, int epfd, void* data);
+FREERDP_API int wait_obj_epoll_del(struct wait_obj* obj, int epfd);
+
 #endif
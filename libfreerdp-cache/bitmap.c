@@ -24,6 +24,97 @@
 
 #include <freerdp/cache/bitmap.h>
 
+static rdpBitmap** bitmap_cache_slot(rdpBitmapCache* bitmap_cache, uint32 id, uint32 index, const char* op)
+{
+	if (id > bitmap_cache->maxCells)
+	{
+		printf("%s invalid bitmap cell id: %d\n", op, id);
+		return NULL;
+	}
+
+	if (index == BITMAP_CACHE_WAITING_LIST_INDEX)
+	{
+		index = bitmap_cache->cells[id].number;
+	}
+	else if (index > bitmap_cache->cells[id].number)
+	{
+		printf("%s invalid bitmap index %d in cell id: %d\n", op, index, id);
+		return NULL;
+	}
+
+	return &bitmap_cache->cells[id].entries[index];
+}
+
+static void bitmap_cache_replace(rdpBitmapCache* bitmap_cache, uint32 id, uint32 index, rdpBitmap* bitmap)
+{
+	rdpBitmap** slot;
+
+	slot = bitmap_cache_slot(bitmap_cache, id, index, "put");
+
+	if (slot == NULL)
+		return;
+
+	if (*slot != NULL)
+		Bitmap_Free(bitmap_cache->context, *slot);
+
+	*slot = bitmap;
+}
+
+/**
+ * Bitmaps advertised in the Persistent Key List are only decoded from the
+ * cache file the first time an order references them.
+ */
+
+static rdpBitmap* bitmap_cache_load_persistent(rdpBitmapCache* bitmap_cache, uint32 id, uint32 index)
+{
+	rdpBitmap* bitmap;
+	PERSISTENT_CACHE_ENTRY* entry;
+	rdpContext* context = bitmap_cache->context;
+
+	entry = persistent_cache_get(bitmap_cache->persistent, id, index);
+
+	if (entry == NULL)
+		return NULL;
+
+	bitmap = Bitmap_Alloc(context);
+
+	Bitmap_SetDimensions(context, bitmap, entry->width, entry->height);
+
+	bitmap->Decompress(context, bitmap,
+			entry->data, entry->width, entry->height, entry->bpp, entry->length,
+			(entry->flags & PERSISTENT_CACHE_FLAG_COMPRESSED) ? true : false, CODEC_ID_NONE);
+
+	bitmap->New(context, bitmap);
+
+	bitmap_cache->persistentHits++;
+
+	return bitmap;
+}
+
+static void bitmap_cache_update_persistent(rdpBitmapCache* bitmap_cache, CACHE_BITMAP_V2_ORDER* cache_bitmap_v2)
+{
+	uint32 id = cache_bitmap_v2->cacheId;
+
+	if (id >= bitmap_cache->settings->bitmapCacheV2NumCells ||
+			!bitmap_cache->settings->bitmapCacheV2CellInfo[id].persistent)
+		return;
+
+	bitmap_cache->persistentMisses++;
+
+	if (cache_bitmap_v2->flags & CBR2_PERSISTENT_KEY_PRESENT)
+	{
+		persistent_cache_put(bitmap_cache->persistent, id, cache_bitmap_v2->cacheIndex,
+				cache_bitmap_v2->key1, cache_bitmap_v2->key2,
+				cache_bitmap_v2->bitmapWidth, cache_bitmap_v2->bitmapHeight,
+				cache_bitmap_v2->bitmapBpp, cache_bitmap_v2->compressed,
+				cache_bitmap_v2->bitmapDataStream, cache_bitmap_v2->bitmapLength);
+	}
+	else
+	{
+		persistent_cache_invalidate(bitmap_cache->persistent, id, cache_bitmap_v2->cacheIndex);
+	}
+}
+
 void update_gdi_memblt(rdpContext* context, MEMBLT_ORDER* memblt)
 {
 	rdpBitmap* bitmap;
@@ -55,7 +146,6 @@ void update_gdi_mem3blt(rdpContext* context, MEM3BLT_ORDER* mem3blt)
 void update_gdi_cache_bitmap(rdpContext* context, CACHE_BITMAP_ORDER* cache_bitmap)
 {
 	rdpBitmap* bitmap;
-	rdpBitmap* prevBitmap;
 	rdpCache* cache = context->cache;
 
 	bitmap = Bitmap_Alloc(context);
@@ -69,18 +159,15 @@ void update_gdi_cache_bitmap(rdpContext* context, CACHE_BITMAP_ORDER* cache_bitm
 
 	bitmap->New(context, bitmap);
 
-	prevBitmap = bitmap_cache_get(cache->bitmap, cache_bitmap->cacheId, cache_bitmap->cacheIndex);
-
-	if (prevBitmap != NULL)
-		Bitmap_Free(context, prevBitmap);
+	if (cache->bitmap->persistent != NULL)
+		persistent_cache_invalidate(cache->bitmap->persistent, cache_bitmap->cacheId, cache_bitmap->cacheIndex);
 
-	bitmap_cache_put(cache->bitmap, cache_bitmap->cacheId, cache_bitmap->cacheIndex, bitmap);
+	bitmap_cache_replace(cache->bitmap, cache_bitmap->cacheId, cache_bitmap->cacheIndex, bitmap);
 }
 
 void update_gdi_cache_bitmap_v2(rdpContext* context, CACHE_BITMAP_V2_ORDER* cache_bitmap_v2)
 {
 	rdpBitmap* bitmap;
-	rdpBitmap* prevBitmap;
 	rdpCache* cache = context->cache;
 
 	bitmap = Bitmap_Alloc(context);
@@ -100,18 +187,15 @@ void update_gdi_cache_bitmap_v2(rdpContext* context, CACHE_BITMAP_V2_ORDER* cach
 
 	bitmap->New(context, bitmap);
 
-	prevBitmap = bitmap_cache_get(cache->bitmap, cache_bitmap_v2->cacheId, cache_bitmap_v2->cacheIndex);
+	if (cache->bitmap->persistent != NULL)
+		bitmap_cache_update_persistent(cache->bitmap, cache_bitmap_v2);
 
-	if (prevBitmap != NULL)
-		Bitmap_Free(context, prevBitmap);
-
-	bitmap_cache_put(cache->bitmap, cache_bitmap_v2->cacheId, cache_bitmap_v2->cacheIndex, bitmap);
+	bitmap_cache_replace(cache->bitmap, cache_bitmap_v2->cacheId, cache_bitmap_v2->cacheIndex, bitmap);
 }
 
 void update_gdi_cache_bitmap_v3(rdpContext* context, CACHE_BITMAP_V3_ORDER* cache_bitmap_v3)
 {
 	rdpBitmap* bitmap;
-	rdpBitmap* prevBitmap;
 	rdpCache* cache = context->cache;
 	BITMAP_DATA_EX* bitmapData = &cache_bitmap_v3->bitmapData;
 
@@ -132,12 +216,10 @@ void update_gdi_cache_bitmap_v3(rdpContext* context, CACHE_BITMAP_V3_ORDER* cach
 
 	bitmap->New(context, bitmap);
 
-	prevBitmap = bitmap_cache_get(cache->bitmap, cache_bitmap_v3->cacheId, cache_bitmap_v3->cacheIndex);
-
-	if (prevBitmap != NULL)
-		Bitmap_Free(context, prevBitmap);
+	if (cache->bitmap->persistent != NULL)
+		persistent_cache_invalidate(cache->bitmap->persistent, cache_bitmap_v3->cacheId, cache_bitmap_v3->cacheIndex);
 
-	bitmap_cache_put(cache->bitmap, cache_bitmap_v3->cacheId, cache_bitmap_v3->cacheIndex, bitmap);
+	bitmap_cache_replace(cache->bitmap, cache_bitmap_v3->cacheId, cache_bitmap_v3->cacheIndex, bitmap);
 }
 
 void update_gdi_bitmap_update(rdpContext* context, BITMAP_UPDATE* bitmap_update)
@@ -189,48 +271,34 @@ void update_gdi_bitmap_update(rdpContext* context, BITMAP_UPDATE* bitmap_update)
 
 rdpBitmap* bitmap_cache_get(rdpBitmapCache* bitmap_cache, uint32 id, uint32 index)
 {
-	rdpBitmap* bitmap;
+	rdpBitmap** slot;
 
-	if (id > bitmap_cache->maxCells)
-	{
-		printf("get invalid bitmap cell id: %d\n", id);
-		return NULL;
-	}
+	slot = bitmap_cache_slot(bitmap_cache, id, index, "get");
 
-	if (index == BITMAP_CACHE_WAITING_LIST_INDEX)
-	{
-		index = bitmap_cache->cells[id].number;
-	}
-	else if (index > bitmap_cache->cells[id].number)
-	{
-		printf("get invalid bitmap index %d in cell id: %d\n", index, id);
+	if (slot == NULL)
 		return NULL;
-	}
 
-	bitmap = bitmap_cache->cells[id].entries[index];
+	if (*slot == NULL && bitmap_cache->persistent != NULL)
+		*slot = bitmap_cache_load_persistent(bitmap_cache, id, index);
 
-	return bitmap;
+	return *slot;
 }
 
 void bitmap_cache_put(rdpBitmapCache* bitmap_cache, uint32 id, uint32 index, rdpBitmap* bitmap)
 {
-	if (id > bitmap_cache->maxCells)
-	{
-		printf("put invalid bitmap cell id: %d\n", id);
-		return;
-	}
+	rdpBitmap** slot;
 
-	if (index == BITMAP_CACHE_WAITING_LIST_INDEX)
-	{
-		index = bitmap_cache->cells[id].number;
-	}
-	else if (index > bitmap_cache->cells[id].number)
-	{
-		printf("put invalid bitmap index %d in cell id: %d\n", index, id);
-		return;
-	}
+	slot = bitmap_cache_slot(bitmap_cache, id, index, "put");
 
-	bitmap_cache->cells[id].entries[index] = bitmap;
+	if (slot != NULL)
+		*slot = bitmap;
+}
+
+void bitmap_cache_get_persistent_stats(rdpBitmapCache* bitmap_cache, uint32* loaded, uint32* hits, uint32* misses)
+{
+	*loaded = bitmap_cache->persistentLoaded;
+	*hits = bitmap_cache->persistentHits;
+	*misses = bitmap_cache->persistentMisses;
 }
 
 void bitmap_cache_register_callbacks(rdpUpdate* update)
@@ -250,6 +318,42 @@ void bitmap_cache_register_callbacks(rdpUpdate* update)
 	update->BitmapUpdate = update_gdi_bitmap_update;
 }
 
+/**
+ * Cells 2 to 4 hold the large tiles worth keeping across sessions, their
+ * keys are handed to the core through the cell info for the Persistent Key List.
+ */
+
+static void bitmap_cache_open_persistent(rdpBitmapCache* bitmap_cache)
+{
+	int i;
+	BITMAP_CACHE_V2_CELL_INFO* cellInfo;
+	rdpSettings* settings = bitmap_cache->settings;
+	uint32 numEntries[PERSISTENT_CACHE_MAX_CELLS] = { 0 };
+
+	for (i = 2; i < PERSISTENT_CACHE_MAX_CELLS; i++)
+		numEntries[i] = settings->bitmapCacheV2CellInfo[i].numEntries;
+
+	bitmap_cache->persistent = persistent_cache_open(settings->persistent_bitmap_cache_file, numEntries);
+
+	if (bitmap_cache->persistent == NULL)
+		return;
+
+	for (i = 2; i < PERSISTENT_CACHE_MAX_CELLS; i++)
+	{
+		cellInfo = &settings->bitmapCacheV2CellInfo[i];
+		cellInfo->persistent = true;
+
+		xfree(cellInfo->persistentKeys);
+		cellInfo->persistentKeys = (uint64*) xmalloc(sizeof(uint64) * numEntries[i]);
+		cellInfo->numPersistentKeys = persistent_cache_get_keys(bitmap_cache->persistent,
+				i, cellInfo->persistentKeys, numEntries[i]);
+
+		bitmap_cache->persistentLoaded += cellInfo->numPersistentKeys;
+	}
+
+	settings->persistent_bitmap_cache = true;
+}
+
 rdpBitmapCache* bitmap_cache_new(rdpSettings* settings)
 {
 	int i;
@@ -278,6 +382,9 @@ rdpBitmapCache* bitmap_cache_new(rdpSettings* settings)
 		settings->bitmapCacheV2CellInfo[4].numEntries = 2048;
 		settings->bitmapCacheV2CellInfo[4].persistent = false;
 
+		if (settings->persistent_bitmap_cache_file != NULL)
+			bitmap_cache_open_persistent(bitmap_cache);
+
 		bitmap_cache->cells = (BITMAP_V2_CELL*) xzalloc(sizeof(BITMAP_V2_CELL) * bitmap_cache->maxCells);
 
 		for (i = 0; i < (int) bitmap_cache->maxCells; i++)
@@ -315,6 +422,8 @@ void bitmap_cache_free(rdpBitmapCache* bitmap_cache)
 		if (bitmap_cache->bitmap != NULL)
 			Bitmap_Free(bitmap_cache->context, bitmap_cache->bitmap);
 
+		persistent_cache_close(bitmap_cache->persistent);
+
 		xfree(bitmap_cache->cells);
 		xfree(bitmap_cache);
 	}
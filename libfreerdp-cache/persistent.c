@@ -0,0 +1,428 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Persistent Bitmap Cache
+ *
+ * Copyright 2014 Jay Sorg <jay.sorg@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include <freerdp/utils/memory.h>
+
+#include <freerdp/cache/persistent.h>
+
+#define PERSISTENT_CACHE_MAGIC		0x43504452 /* "RDPC" */
+#define PERSISTENT_CACHE_VERSION	1
+
+/* the largest bitmap cache v2 cell holds bitmaps of up to 256x256 pixels */
+#define PERSISTENT_CACHE_MAX_SIDE	256
+
+struct _PERSISTENT_CACHE_HEADER
+{
+	uint32 magic;
+	uint32 version;
+	uint32 entrySize;
+	uint32 numEntries[PERSISTENT_CACHE_MAX_CELLS];
+	uint32 reserved[8];
+};
+typedef struct _PERSISTENT_CACHE_HEADER PERSISTENT_CACHE_HEADER;
+
+struct rdp_persistent_cache
+{
+	uint8* map;
+	size_t size;
+	uint32 numEntries[PERSISTENT_CACHE_MAX_CELLS];
+	PERSISTENT_CACHE_ENTRY* cells[PERSISTENT_CACHE_MAX_CELLS];
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#else
+	int fd;
+#endif
+};
+
+/**
+ * The file may have been truncated, written by another build or simply
+ * corrupted, so a slot is only trusted once its header describes a bitmap
+ * that fits the slot and that the decoders can handle.
+ */
+
+static tbool persistent_cache_entry_ok(PERSISTENT_CACHE_ENTRY* entry)
+{
+	uint32 size;
+
+	if (!(entry->flags & PERSISTENT_CACHE_FLAG_VALID))
+		return false;
+
+	if (entry->length > PERSISTENT_CACHE_MAX_DATA)
+		return false;
+
+	if (entry->width < 1 || entry->width > PERSISTENT_CACHE_MAX_SIDE ||
+			entry->height < 1 || entry->height > PERSISTENT_CACHE_MAX_SIDE)
+		return false;
+
+	if (entry->bpp != 8 && entry->bpp != 15 && entry->bpp != 16 &&
+			entry->bpp != 24 && entry->bpp != 32)
+		return false;
+
+	/* raw bitmaps are read back without any length check */
+	size = (uint32) entry->width * entry->height * ((entry->bpp + 7) / 8);
+
+	if (!(entry->flags & PERSISTENT_CACHE_FLAG_COMPRESSED) && entry->length < size)
+		return false;
+
+	return true;
+}
+
+PERSISTENT_CACHE_ENTRY* persistent_cache_get(rdpPersistentCache* persistent, uint32 id, uint32 index)
+{
+	PERSISTENT_CACHE_ENTRY* entry;
+
+	if (id >= PERSISTENT_CACHE_MAX_CELLS || index >= persistent->numEntries[id])
+		return NULL;
+
+	entry = &persistent->cells[id][index];
+
+	if (!persistent_cache_entry_ok(entry))
+		return NULL;
+
+	return entry;
+}
+
+tbool persistent_cache_put(rdpPersistentCache* persistent, uint32 id, uint32 index,
+		uint32 key1, uint32 key2, uint16 width, uint16 height, uint8 bpp,
+		tbool compressed, uint8* data, uint32 length)
+{
+	PERSISTENT_CACHE_ENTRY* entry;
+
+	if (id >= PERSISTENT_CACHE_MAX_CELLS || index >= persistent->numEntries[id])
+		return false;
+
+	entry = &persistent->cells[id][index];
+
+	if (length > PERSISTENT_CACHE_MAX_DATA)
+	{
+		/* too large to keep, make sure a stale bitmap is not advertised */
+		entry->flags = 0;
+		return false;
+	}
+
+	/* clear the valid flag first so an interrupted write is never trusted */
+	entry->flags = 0;
+	entry->key1 = key1;
+	entry->key2 = key2;
+	entry->width = width;
+	entry->height = height;
+	entry->bpp = bpp;
+	entry->length = length;
+	memcpy(entry->data, data, length);
+	entry->flags = PERSISTENT_CACHE_FLAG_VALID | (compressed ? PERSISTENT_CACHE_FLAG_COMPRESSED : 0);
+
+	/* do not keep what could not be loaded back */
+	if (!persistent_cache_entry_ok(entry))
+	{
+		entry->flags = 0;
+		return false;
+	}
+
+	return true;
+}
+
+void persistent_cache_invalidate(rdpPersistentCache* persistent, uint32 id, uint32 index)
+{
+	if (id >= PERSISTENT_CACHE_MAX_CELLS || index >= persistent->numEntries[id])
+		return;
+
+	persistent->cells[id][index].flags = 0;
+}
+
+/**
+ * Keys are reported in cache index order, stopping at the first empty slot:
+ * the Persistent Key List assigns indices sequentially from zero.
+ */
+
+uint32 persistent_cache_get_keys(rdpPersistentCache* persistent, uint32 id, uint64* keys, uint32 max)
+{
+	uint32 index;
+	PERSISTENT_CACHE_ENTRY* entry;
+
+	if (id >= PERSISTENT_CACHE_MAX_CELLS)
+		return 0;
+
+	for (index = 0; index < persistent->numEntries[id] && index < max; index++)
+	{
+		entry = &persistent->cells[id][index];
+
+		if (!(entry->flags & PERSISTENT_CACHE_FLAG_VALID))
+			break;
+
+		keys[index] = ((uint64) entry->key2 << 32) | entry->key1;
+	}
+
+	return index;
+}
+
+/**
+ * Move the valid slots of a cell to the front, so the keys we advertise
+ * map to cache indices 0 to n - 1 in the same order.
+ */
+
+static void persistent_cache_compact(PERSISTENT_CACHE_ENTRY* cell, uint32 numEntries)
+{
+	uint32 i;
+	uint32 j;
+
+	for (i = 0, j = 0; i < numEntries; i++)
+	{
+		if (!(cell[i].flags & PERSISTENT_CACHE_FLAG_VALID))
+			continue;
+
+		if (i != j)
+		{
+			memcpy(&cell[j], &cell[i], sizeof(PERSISTENT_CACHE_ENTRY) - PERSISTENT_CACHE_MAX_DATA + cell[i].length);
+			cell[i].flags = 0;
+		}
+
+		j++;
+	}
+}
+
+static void persistent_cache_unmap(rdpPersistentCache* persistent)
+{
+#ifdef _WIN32
+	if (persistent->map != NULL)
+		UnmapViewOfFile(persistent->map);
+	if (persistent->mapping != NULL)
+		CloseHandle(persistent->mapping);
+	if (persistent->file != INVALID_HANDLE_VALUE)
+		CloseHandle(persistent->file);
+#else
+	if (persistent->map != NULL)
+	{
+		msync(persistent->map, persistent->size, MS_ASYNC);
+		munmap(persistent->map, persistent->size);
+	}
+	if (persistent->fd != -1)
+		close(persistent->fd);
+#endif
+}
+
+/**
+ * Take the file for this session only. The lock is held until the file is
+ * closed, so a concurrent session never sees a slot being compacted or
+ * written; it gets no persistent cache instead of waiting.
+ */
+
+static tbool persistent_cache_lock(rdpPersistentCache* persistent, const char* filename)
+{
+#ifdef _WIN32
+	OVERLAPPED overlapped;
+
+	memset(&overlapped, 0, sizeof(OVERLAPPED));
+
+	if (LockFileEx(persistent->file, LOCKFILE_EXCLUSIVE_LOCK | LOCKFILE_FAIL_IMMEDIATELY,
+			0, MAXDWORD, MAXDWORD, &overlapped))
+		return true;
+#else
+	if (flock(persistent->fd, LOCK_EX | LOCK_NB) == 0)
+		return true;
+#endif
+
+	printf("persistent_cache_lock: %s is in use by another session\n", filename);
+
+	return false;
+}
+
+static tbool persistent_cache_map(rdpPersistentCache* persistent, const char* filename, tbool* fresh)
+{
+#ifdef _WIN32
+	LARGE_INTEGER size;
+
+	persistent->file = CreateFileA(filename, GENERIC_READ | GENERIC_WRITE,
+			FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+
+	if (persistent->file == INVALID_HANDLE_VALUE)
+		return false;
+
+	if (!persistent_cache_lock(persistent, filename))
+		return false;
+
+	if (!GetFileSizeEx(persistent->file, &size))
+		return false;
+
+	*fresh = ((uint64) size.QuadPart != (uint64) persistent->size);
+
+	if (*fresh)
+	{
+		size.QuadPart = 0;
+
+		if (!SetFilePointerEx(persistent->file, size, NULL, FILE_BEGIN) || !SetEndOfFile(persistent->file))
+			return false;
+
+		size.QuadPart = persistent->size;
+
+		if (!SetFilePointerEx(persistent->file, size, NULL, FILE_BEGIN) || !SetEndOfFile(persistent->file))
+			return false;
+	}
+
+	persistent->mapping = CreateFileMappingA(persistent->file, NULL, PAGE_READWRITE, 0, 0, NULL);
+
+	if (persistent->mapping == NULL)
+		return false;
+
+	persistent->map = (uint8*) MapViewOfFile(persistent->mapping, FILE_MAP_WRITE, 0, 0, persistent->size);
+
+	return (persistent->map != NULL);
+#else
+	void* map;
+	struct stat st;
+
+	persistent->fd = open(filename, O_RDWR | O_CREAT, 0600);
+
+	if (persistent->fd == -1)
+		return false;
+
+	if (!persistent_cache_lock(persistent, filename))
+		return false;
+
+	if (fstat(persistent->fd, &st) != 0)
+		return false;
+
+	*fresh = ((size_t) st.st_size != persistent->size);
+
+	/* truncating first drops every stale slot, the file stays sparse */
+	if (*fresh && (ftruncate(persistent->fd, 0) != 0 || ftruncate(persistent->fd, persistent->size) != 0))
+		return false;
+
+	map = mmap(NULL, persistent->size, PROT_READ | PROT_WRITE, MAP_SHARED, persistent->fd, 0);
+
+	if (map == MAP_FAILED)
+		return false;
+
+	persistent->map = (uint8*) map;
+
+	return true;
+#endif
+}
+
+rdpPersistentCache* persistent_cache_open(const char* filename, uint32* numEntries)
+{
+	int i;
+	tbool fresh;
+	uint8* cell;
+	uint32 index;
+	uint32 totalEntries;
+	PERSISTENT_CACHE_HEADER* header;
+	rdpPersistentCache* persistent;
+
+	persistent = (rdpPersistentCache*) xzalloc(sizeof(rdpPersistentCache));
+
+#ifdef _WIN32
+	persistent->file = INVALID_HANDLE_VALUE;
+#else
+	persistent->fd = -1;
+#endif
+
+	totalEntries = 0;
+
+	for (i = 0; i < PERSISTENT_CACHE_MAX_CELLS; i++)
+	{
+		persistent->numEntries[i] = numEntries[i];
+		totalEntries += numEntries[i];
+	}
+
+	persistent->size = sizeof(PERSISTENT_CACHE_HEADER) + (size_t) totalEntries * sizeof(PERSISTENT_CACHE_ENTRY);
+
+	if (!persistent_cache_map(persistent, filename, &fresh))
+	{
+		printf("persistent_cache_open: unable to use %s\n", filename);
+		persistent_cache_unmap(persistent);
+		xfree(persistent);
+		return NULL;
+	}
+
+	header = (PERSISTENT_CACHE_HEADER*) persistent->map;
+	cell = persistent->map + sizeof(PERSISTENT_CACHE_HEADER);
+
+	for (i = 0; i < PERSISTENT_CACHE_MAX_CELLS; i++)
+	{
+		persistent->cells[i] = (PERSISTENT_CACHE_ENTRY*) cell;
+		cell += (size_t) persistent->numEntries[i] * sizeof(PERSISTENT_CACHE_ENTRY);
+	}
+
+	/* a resized file is already all zeroes, otherwise the header must match */
+	if (!fresh && ((header->magic != PERSISTENT_CACHE_MAGIC) ||
+			(header->version != PERSISTENT_CACHE_VERSION) ||
+			(header->entrySize != sizeof(PERSISTENT_CACHE_ENTRY)) ||
+			(memcmp(header->numEntries, persistent->numEntries, sizeof(persistent->numEntries)) != 0)))
+	{
+		for (i = 0; i < PERSISTENT_CACHE_MAX_CELLS; i++)
+		{
+			for (index = 0; index < persistent->numEntries[i]; index++)
+			{
+				if (persistent->cells[i][index].flags != 0)
+					persistent->cells[i][index].flags = 0;
+			}
+		}
+
+		fresh = true;
+	}
+
+	if (fresh)
+	{
+		memset(header, 0, sizeof(PERSISTENT_CACHE_HEADER));
+		header->magic = PERSISTENT_CACHE_MAGIC;
+		header->version = PERSISTENT_CACHE_VERSION;
+		header->entrySize = sizeof(PERSISTENT_CACHE_ENTRY);
+		memcpy(header->numEntries, persistent->numEntries, sizeof(persistent->numEntries));
+	}
+	else
+	{
+		for (i = 0; i < PERSISTENT_CACHE_MAX_CELLS; i++)
+		{
+			/* compacting copies length bytes, drop bad slots first */
+			for (index = 0; index < persistent->numEntries[i]; index++)
+			{
+				if ((persistent->cells[i][index].flags != 0) &&
+						!persistent_cache_entry_ok(&persistent->cells[i][index]))
+					persistent->cells[i][index].flags = 0;
+			}
+
+			persistent_cache_compact(persistent->cells[i], persistent->numEntries[i]);
+		}
+	}
+
+	return persistent;
+}
+
+void persistent_cache_close(rdpPersistentCache* persistent)
+{
+	if (persistent != NULL)
+	{
+		persistent_cache_unmap(persistent);
+		xfree(persistent);
+	}
+}
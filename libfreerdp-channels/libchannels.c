@@ -36,6 +36,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
 #include <freerdp/freerdp.h>
 #include <freerdp/constants.h>
 #include <freerdp/channels/channels.h>
@@ -44,6 +49,7 @@
 #include <freerdp/utils/list.h>
 #include <freerdp/utils/semaphore.h>
 #include <freerdp/utils/mutex.h>
+#include <freerdp/utils/spsc.h>
 #include <freerdp/utils/wait_obj.h>
 #include <freerdp/utils/load_plugin.h>
 #include <freerdp/utils/event.h>
@@ -76,6 +82,24 @@ struct sync_data
 	int index;
 };
 
+#define CHANNEL_SYNC_QUEUE_SIZE 256
+
+/**
+ * Every thread that writes gets its own queue to the main thread, so a
+ * write is lock free. When the queue is full, writes spill into the
+ * overflow list and keep spilling until the main thread has taken it, so
+ * the data of one thread is always sent in order.
+ */
+struct sync_producer
+{
+	rdpChannels* channels;
+	SPSC_QUEUE* queue;
+	LIST* overflow;
+	volatile int spilling;
+	int exited; /* the thread is gone, free once drained */
+	struct sync_producer* next;
+};
+
 typedef struct rdp_init_handle rdpInitHandle;
 struct rdp_init_handle
 {
@@ -112,12 +136,22 @@ struct rdp_channels
 	/* used for locating the channels for a given instance */
 	freerdp* instance;
 
+	/* entry in the open handle table, see freerdp_channels_find_by_open_handle */
+	int handle_slot;
+	int handle_generation;
+
 	/* signal for incoming data or event */
 	struct wait_obj* signal;
 
-	/* used for sync write */
+	/* used for sync write, the mutex only guards the producer list and overflow */
 	freerdp_mutex sync_data_mutex;
-	LIST* sync_data_list;
+	struct sync_producer* sync_producers;
+	int sync_producers_exited;
+#ifdef _WIN32
+	DWORD sync_producer_key;
+#else
+	pthread_key_t sync_producer_key;
+#endif
 
 	/* used for sync event */
 	freerdp_sem event_sem;
@@ -140,8 +174,28 @@ struct rdp_channels_list
 
 static rdpChannelsList* g_channels_list;
 
-/* To generate unique sequence for all open handles */
-static int g_open_handle_sequence;
+/**
+ * Open handles index a global table of channel managers, so finding the
+ * channels of a handle takes two array reads and no lock:
+ * bits 0-7 channel index, bits 8-23 table slot, bits 24-30 slot generation.
+ * Pages of the table are never freed and a reused slot gets the next
+ * generation, so a stale handle never matches a newer channel manager.
+ */
+#define CHANNELS_SLOT_PAGE_BITS		8
+#define CHANNELS_SLOT_PAGE_SIZE		(1 << CHANNELS_SLOT_PAGE_BITS)
+#define CHANNELS_SLOT_MAX_PAGES		256
+
+struct channels_slot
+{
+	rdpChannels* channels;
+	int generation;
+};
+
+static struct channels_slot* g_channels_slots[CHANNELS_SLOT_MAX_PAGES];
+static int g_channels_slots_used;
+
+#define CHANNELS_OPEN_HANDLE(_channels, _index) \
+	(((_channels)->handle_generation << 24) | ((_channels)->handle_slot << 8) | (_index))
 
 /* For locking the global resources */
 static freerdp_mutex g_mutex_init;
@@ -150,30 +204,70 @@ static freerdp_mutex g_mutex_list;
 /* returns the channels for the open handle passed in */
 static rdpChannels* freerdp_channels_find_by_open_handle(int open_handle, int* pindex)
 {
-	int lindex;
+	int slot;
+	int index;
 	rdpChannels* channels;
-	rdpChannelsList* channels_list;
+	struct channels_slot* page;
 
-	freerdp_mutex_lock(g_mutex_list);
+	slot = (open_handle >> 8) & 0xFFFF;
+	index = open_handle & 0xFF;
+	page = g_channels_slots[slot >> CHANNELS_SLOT_PAGE_BITS];
 
-	for (channels_list = g_channels_list; channels_list; channels_list = channels_list->next)
+	if (page == NULL)
+		return NULL;
+
+	channels = page[slot & (CHANNELS_SLOT_PAGE_SIZE - 1)].channels;
+
+	if ((channels == NULL) || (index >= channels->num_channels_data) ||
+		(channels->channels_data[index].open_handle != open_handle))
+		return NULL;
+
+	*pindex = index;
+
+	return channels;
+}
+
+/* takes a free slot in the open handle table, called with g_mutex_list held */
+static tbool freerdp_channels_add_slot(rdpChannels* channels)
+{
+	int slot;
+	struct channels_slot* page;
+	struct channels_slot* entry;
+
+	for (slot = 0; slot < g_channels_slots_used; slot++)
 	{
-		channels = channels_list->channels;
+		entry = &g_channels_slots[slot >> CHANNELS_SLOT_PAGE_BITS][slot & (CHANNELS_SLOT_PAGE_SIZE - 1)];
 
-		for (lindex = 0; lindex < channels->num_channels_data; lindex++)
+		if (entry->channels == NULL)
+			break;
+	}
+
+	if (slot == g_channels_slots_used)
+	{
+		if (slot == CHANNELS_SLOT_MAX_PAGES * CHANNELS_SLOT_PAGE_SIZE)
+			return false;
+
+		page = g_channels_slots[slot >> CHANNELS_SLOT_PAGE_BITS];
+
+		if (page == NULL)
 		{
-			if (channels->channels_data[lindex].open_handle == open_handle)
-			{
-				freerdp_mutex_unlock(g_mutex_list);
-				*pindex = lindex;
-				return channels;
-			}
+			page = (struct channels_slot*) xzalloc(CHANNELS_SLOT_PAGE_SIZE * sizeof(struct channels_slot));
+			g_channels_slots[slot >> CHANNELS_SLOT_PAGE_BITS] = page;
 		}
+
+		g_channels_slots_used++;
 	}
 
-	freerdp_mutex_unlock(g_mutex_list);
+	entry = &g_channels_slots[slot >> CHANNELS_SLOT_PAGE_BITS][slot & (CHANNELS_SLOT_PAGE_SIZE - 1)];
 
-	return NULL;
+	/* generation 0 is skipped so no handle is ever 0 */
+	entry->generation = (entry->generation % 0x7F) + 1;
+	entry->channels = channels;
+
+	channels->handle_slot = slot;
+	channels->handle_generation = entry->generation;
+
+	return true;
 }
 
 /* returns the channels for the rdp instance passed in */
@@ -182,6 +276,15 @@ static rdpChannels* freerdp_channels_find_by_instance(freerdp* instance)
 	rdpChannels* channels;
 	rdpChannelsList* channels_list;
 
+	/* clients keep their channel manager in the context, no need to search */
+	if (instance->context != NULL)
+	{
+		channels = instance->context->channels;
+
+		if ((channels != NULL) && (channels->instance == instance))
+			return channels;
+	}
+
 	freerdp_mutex_lock(g_mutex_list);
 
 	for (channels_list = g_channels_list; channels_list; channels_list = channels_list->next)
@@ -349,9 +452,7 @@ static uint32 FREERDP_CC MyVirtualChannelInit(void** ppInitHandle, PCHANNEL_DEF
 		lchannel_def = pChannel + index;
 		lchannel_data = channels->channels_data + channels->num_channels_data;
 
-		freerdp_mutex_lock(g_mutex_list);
-		lchannel_data->open_handle = g_open_handle_sequence++;
-		freerdp_mutex_unlock(g_mutex_list);
+		lchannel_data->open_handle = CHANNELS_OPEN_HANDLE(channels, channels->num_channels_data);
 
 		lchannel_data->flags = 1; /* init */
 		strncpy(lchannel_data->name, lchannel_def->name, CHANNEL_NAME_LEN);
@@ -462,12 +563,70 @@ static uint32 FREERDP_CC MyVirtualChannelClose(uint32 openHandle)
 	return CHANNEL_RC_OK;
 }
 
+/* called from the exiting thread, the main thread frees the queue once drained */
+static void freerdp_channels_producer_exit(void* arg)
+{
+	struct sync_producer* producer = (struct sync_producer*) arg;
+	rdpChannels* channels = producer->channels;
+
+	freerdp_mutex_lock(channels->sync_data_mutex);
+	producer->exited = 1;
+	channels->sync_producers_exited++;
+	freerdp_mutex_unlock(channels->sync_data_mutex);
+}
+
+/* returns the queue of the calling thread, created on its first write */
+static struct sync_producer* freerdp_channels_get_producer(rdpChannels* channels)
+{
+	struct sync_producer* producer;
+
+#ifdef _WIN32
+	producer = (struct sync_producer*) TlsGetValue(channels->sync_producer_key);
+#else
+	producer = (struct sync_producer*) pthread_getspecific(channels->sync_producer_key);
+#endif
+
+	if (producer != NULL)
+		return producer;
+
+	producer = xnew(struct sync_producer);
+	producer->channels = channels;
+	producer->queue = spsc_queue_new(CHANNEL_SYNC_QUEUE_SIZE, sizeof(struct sync_data));
+	producer->overflow = list_new();
+
+	freerdp_mutex_lock(channels->sync_data_mutex);
+	producer->next = channels->sync_producers;
+	channels->sync_producers = producer;
+	freerdp_mutex_unlock(channels->sync_data_mutex);
+
+#ifdef _WIN32
+	TlsSetValue(channels->sync_producer_key, producer);
+#else
+	pthread_setspecific(channels->sync_producer_key, producer);
+#endif
+
+	return producer;
+}
+
+static void freerdp_channels_producer_free(struct sync_producer* producer)
+{
+	spsc_queue_free(producer->queue);
+
+	while (producer->overflow->head != NULL)
+		xfree(list_dequeue(producer->overflow));
+	list_free(producer->overflow);
+
+	xfree(producer);
+}
+
 /* can be called from any thread */
 static uint32 FREERDP_CC MyVirtualChannelWrite(uint32 openHandle, void* pData, uint32 dataLength, void* pUserData)
 {
 	int index;
 	rdpChannels* channels;
-	struct sync_data* item;
+	struct sync_data item;
+	struct sync_data* pitem;
+	struct sync_producer* producer;
 	struct channel_data* lchannel_data;
 
 	channels = freerdp_channels_find_by_open_handle(openHandle, &index);
@@ -504,24 +663,36 @@ static uint32 FREERDP_CC MyVirtualChannelWrite(uint32 openHandle, void* pData, u
 		return CHANNEL_RC_NOT_OPEN;
 	}
 
-	freerdp_mutex_lock(channels->sync_data_mutex); /* lock channels->sync* vars */
+	item.data = pData;
+	item.data_length = dataLength;
+	item.user_data = pUserData;
+	item.index = index;
 
-	if (!channels->is_connected)
+	producer = freerdp_channels_get_producer(channels);
+
+	if (!producer->spilling)
 	{
-		freerdp_mutex_unlock(channels->sync_data_mutex);
-		DEBUG_CHANNELS("error not connected");
-		return CHANNEL_RC_NOT_CONNECTED;
+		switch (spsc_queue_push(producer->queue, &item))
+		{
+			case SPSC_QUEUE_PUSHED:
+				return CHANNEL_RC_OK;
+
+			case SPSC_QUEUE_WAKE:
+				/* set the event, once for all the writes until the main thread runs */
+				wait_obj_set(channels->signal);
+				return CHANNEL_RC_OK;
+		}
 	}
 
-	item = xnew(struct sync_data);
-	item->data = pData;
-	item->data_length = dataLength;
-	item->user_data = pUserData;
-	item->index = index;
-	list_enqueue(channels->sync_data_list, item);
+	/* the queue is full or an earlier spill is not sent yet */
+	pitem = xnew(struct sync_data);
+	*pitem = item;
+
+	freerdp_mutex_lock(channels->sync_data_mutex);
+	producer->spilling = 1;
+	list_enqueue(producer->overflow, pitem);
 	freerdp_mutex_unlock(channels->sync_data_mutex);
 
-	/* set the event */
 	wait_obj_set(channels->signal);
 
 	return CHANNEL_RC_OK;
@@ -586,7 +757,7 @@ int freerdp_channels_global_init(void)
 {
 	g_init_channels = NULL;
 	g_channels_list = NULL;
-	g_open_handle_sequence = 1;
+	g_channels_slots_used = 0;
 	g_mutex_init = freerdp_mutex_new();
 	g_mutex_list = freerdp_mutex_new();
 
@@ -595,9 +766,17 @@ int freerdp_channels_global_init(void)
 
 int freerdp_channels_global_uninit(void)
 {
+	int page;
+
 	while (g_channels_list)
 		freerdp_channels_free(g_channels_list->channels);
 
+	for (page = 0; page < CHANNELS_SLOT_MAX_PAGES; page++)
+	{
+		xfree(g_channels_slots[page]);
+		g_channels_slots[page] = NULL;
+	}
+
 	freerdp_mutex_free(g_mutex_init);
 	freerdp_mutex_free(g_mutex_list);
 
@@ -612,7 +791,11 @@ rdpChannels* freerdp_channels_new(void)
 	channels = xnew(rdpChannels);
 
 	channels->sync_data_mutex = freerdp_mutex_new();
-	channels->sync_data_list = list_new();
+#ifdef _WIN32
+	channels->sync_producer_key = TlsAlloc();
+#else
+	pthread_key_create(&channels->sync_producer_key, freerdp_channels_producer_exit);
+#endif
 
 	channels->event_sem = freerdp_sem_new(1);
 	channels->signal = wait_obj_new();
@@ -624,6 +807,10 @@ rdpChannels* freerdp_channels_new(void)
 	freerdp_mutex_lock(g_mutex_list);
 	channels_list->next = g_channels_list;
 	g_channels_list = channels_list;
+
+	if (!freerdp_channels_add_slot(channels))
+		printf("freerdp_channels_new: open handle table full\n");
+
 	freerdp_mutex_unlock(g_mutex_list);
 
 	return channels;
@@ -633,9 +820,22 @@ void freerdp_channels_free(rdpChannels* channels)
 {
 	rdpChannelsList* list;
 	rdpChannelsList* prev;
+	struct sync_producer* producer;
 
+	/* queues of threads that never exited, windows has no exit callback */
+	while (channels->sync_producers != NULL)
+	{
+		producer = channels->sync_producers;
+		channels->sync_producers = producer->next;
+		freerdp_channels_producer_free(producer);
+	}
+
+#ifdef _WIN32
+	TlsFree(channels->sync_producer_key);
+#else
+	pthread_key_delete(channels->sync_producer_key);
+#endif
 	freerdp_mutex_free(channels->sync_data_mutex);
-	list_free(channels->sync_data_list);
 
 	freerdp_sem_free(channels->event_sem);
 	wait_obj_free(channels->signal);
@@ -659,6 +859,12 @@ void freerdp_channels_free(rdpChannels* channels)
 		xfree(list);
 	}
 
+	if (channels->handle_generation != 0)
+	{
+		g_channels_slots[channels->handle_slot >> CHANNELS_SLOT_PAGE_BITS]
+			[channels->handle_slot & (CHANNELS_SLOT_PAGE_SIZE - 1)].channels = NULL;
+	}
+
 	freerdp_mutex_unlock(g_mutex_list);
 
 	xfree(channels);
@@ -897,36 +1103,90 @@ FREERDP_API int freerdp_channels_send_event(rdpChannels* channels, RDP_EVENT* ev
 	return 0;
 }
 
+static void freerdp_channels_send_sync(rdpChannels* channels, freerdp* instance, struct sync_data* item)
+{
+	int index;
+	rdpChannel* lrdp_channel;
+	struct channel_data* lchannel_data;
+
+	lchannel_data = channels->channels_data + item->index;
+	lrdp_channel = freerdp_channels_find_channel_by_name(channels, instance->settings,
+		lchannel_data->name, &index);
+
+	if (lrdp_channel != NULL)
+		instance->SendChannelData(instance, lrdp_channel->channel_id, item->data, item->data_length);
+
+	if (lchannel_data->open_event_proc != 0)
+	{
+		lchannel_data->open_event_proc(lchannel_data->open_handle,
+			CHANNEL_EVENT_WRITE_COMPLETE,
+			item->user_data, sizeof(void *), sizeof(void *), 0);
+	}
+}
+
 /**
  * called only from main thread
  */
 static void freerdp_channels_process_sync(rdpChannels* channels, freerdp* instance)
 {
-	struct sync_data* item;
-	rdpChannel* lrdp_channel;
-	struct channel_data* lchannel_data;
+	LIST* overflow;
+	struct sync_data item;
+	struct sync_data* pitem;
+	struct sync_producer* producer;
+	struct sync_producer** link;
+
+	freerdp_mutex_lock(channels->sync_data_mutex);
+	producer = channels->sync_producers;
+	freerdp_mutex_unlock(channels->sync_data_mutex);
 
-	while (channels->sync_data_list->head != NULL)
+	/* new producers are only added in front of the head taken above */
+	for (; producer != NULL; producer = producer->next)
 	{
+		while (spsc_queue_pop(producer->queue, &item))
+			freerdp_channels_send_sync(channels, instance, &item);
+
+		if (!producer->spilling)
+			continue;
+
+		/* everything queued before the spill is sent, now the spill itself */
 		freerdp_mutex_lock(channels->sync_data_mutex);
-		item = (struct sync_data*)list_dequeue(channels->sync_data_list);
+		overflow = producer->overflow;
+		producer->overflow = list_new();
+		producer->spilling = 0;
 		freerdp_mutex_unlock(channels->sync_data_mutex);
 
-		lchannel_data = channels->channels_data + item->index;
-		lrdp_channel = freerdp_channels_find_channel_by_name(channels, instance->settings,
-			lchannel_data->name, &item->index);
+		while ((pitem = (struct sync_data*) list_dequeue(overflow)) != NULL)
+		{
+			freerdp_channels_send_sync(channels, instance, pitem);
+			xfree(pitem);
+		}
+
+		list_free(overflow);
+	}
+
+	if (channels->sync_producers_exited == 0)
+		return;
 
-		if (lrdp_channel != NULL)
-			instance->SendChannelData(instance, lrdp_channel->channel_id, item->data, item->data_length);
+	freerdp_mutex_lock(channels->sync_data_mutex);
 
-		if (lchannel_data->open_event_proc != 0)
+	for (link = &channels->sync_producers; *link != NULL; )
+	{
+		producer = *link;
+
+		if (producer->exited && spsc_queue_is_empty(producer->queue) &&
+			(producer->overflow->head == NULL))
+		{
+			*link = producer->next;
+			channels->sync_producers_exited--;
+			freerdp_channels_producer_free(producer);
+		}
+		else
 		{
-			lchannel_data->open_event_proc(lchannel_data->open_handle,
-				CHANNEL_EVENT_WRITE_COMPLETE,
-				item->user_data, sizeof(void *), sizeof(void *), 0);
+			link = &producer->next;
 		}
-		xfree(item);
 	}
+
+	freerdp_mutex_unlock(channels->sync_data_mutex);
 }
 
 /**
@@ -953,6 +1213,21 @@ tbool freerdp_channels_check_fds(rdpChannels* channels, freerdp* instance)
 	return true;
 }
 
+/**
+ * register the channel signal with a caller owned epoll instance,
+ * call freerdp_channels_check_fds when it is ready
+ * called only from main thread
+ */
+tbool freerdp_channels_epoll_add(rdpChannels* channels, freerdp* instance, int epfd, void* data)
+{
+	return (wait_obj_epoll_add(channels->signal, epfd, data) == 0);
+}
+
+tbool freerdp_channels_epoll_del(rdpChannels* channels, freerdp* instance, int epfd)
+{
+	return (wait_obj_epoll_del(channels->signal, epfd) == 0);
+}
+
 RDP_EVENT* freerdp_channels_pop_event(rdpChannels* channels)
 {
 	RDP_EVENT* event;
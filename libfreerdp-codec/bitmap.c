@@ -19,6 +19,7 @@
 
 #include <freerdp/utils/stream.h>
 #include <freerdp/utils/memory.h>
+#include <freerdp/utils/hotpath.h>
 #include <freerdp/codec/color.h>
 
 #include <freerdp/codec/bitmap.h>
@@ -574,7 +575,8 @@ int save_bitmap(uint8* data, int width, int height, int bpp)
 	dst32 = (int*)malloc(file_stride_bytes * 2);
 	for (j = 0; j < height; j++)
 	{
-		src16 = (short*)(data + j * width * 2);
+		/* the file is bottom-up, the decoded data top-down */
+		src16 = (short*)(data + (height - 1 - j) * width * 2);
 		for (i = 0; i < width; i++)
 		{
 			pixel = src16[i];
@@ -601,17 +603,20 @@ int save_bitmap(uint8* data, int width, int height, int bpp)
 
 #endif
 
-/**
- * bitmap decompression routine
- */
-tbool bitmap_decompress_ex(uint8* srcData, uint8* dstData, int width, int height, int size, int srcBpp, int dstBpp, bitmapExtra* be)
+/* the decoders write the bottom-up stream rows from the last row up, no flip needed */
+#define RLE_TOP_DOWN(_data, _width, _height, _Bpp) \
+	(_data) + ((_height) - 1) * (_width) * (_Bpp), -((_width) * (_Bpp)), (_width), (_height)
+
+static tbool bitmap_decompress_rle(uint8* srcData, uint8* dstData, int width, int height, int size, int srcBpp, int dstBpp, bitmapExtra* be)
 {
+	if (width < 1 || height < 1)
+		return false;
+
 	if (srcBpp == 16 && dstBpp == 16)
 	{
 		SAVE_FILE(srcData, size, width, height);
-		RleDecompress16to16(srcData, size, dstData, width * 2, width, height);
+		RleDecompress16to16(srcData, size, RLE_TOP_DOWN(dstData, width, height, 2));
 		SAVE_BITMAP(dstData, width, height, 16);
-		freerdp_bitmap_flip(dstData, dstData, width * 2, height);
 	}
 	else if (srcBpp == 32 && dstBpp == 32)
 	{
@@ -620,18 +625,15 @@ tbool bitmap_decompress_ex(uint8* srcData, uint8* dstData, int width, int height
 	}
 	else if (srcBpp == 15 && dstBpp == 15)
 	{
-		RleDecompress16to16(srcData, size, dstData, width * 2, width, height);
-		freerdp_bitmap_flip(dstData, dstData, width * 2, height);
+		RleDecompress16to16(srcData, size, RLE_TOP_DOWN(dstData, width, height, 2));
 	}
 	else if (srcBpp == 8 && dstBpp == 8)
 	{
-		RleDecompress8to8(srcData, size, dstData, width, width, height);
-		freerdp_bitmap_flip(dstData, dstData, width, height);
+		RleDecompress8to8(srcData, size, RLE_TOP_DOWN(dstData, width, height, 1));
 	}
 	else if (srcBpp == 24 && dstBpp == 24)
 	{
-		RleDecompress24to24(srcData, size, dstData, width * 3, width, height);
-		freerdp_bitmap_flip(dstData, dstData, width * 3, height);
+		RleDecompress24to24(srcData, size, RLE_TOP_DOWN(dstData, width, height, 3));
 	}
 	else
 	{
@@ -641,6 +643,21 @@ tbool bitmap_decompress_ex(uint8* srcData, uint8* dstData, int width, int height
 	return true;
 }
 
+/**
+ * bitmap decompression routine
+ */
+tbool bitmap_decompress_ex(uint8* srcData, uint8* dstData, int width, int height, int size, int srcBpp, int dstBpp, bitmapExtra* be)
+{
+	tbool rv;
+	HOTPATH_DEFINE(start);
+
+	HOTPATH_ENTER(start);
+	rv = bitmap_decompress_rle(srcData, dstData, width, height, size, srcBpp, dstBpp, be);
+	HOTPATH_EXIT(start, HOTPATH_BITMAP_DECOMPRESS);
+
+	return rv;
+}
+
 /**
  * bitmap decompression routine
  * do not use, for compatability
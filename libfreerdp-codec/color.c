@@ -22,9 +22,28 @@
 #include <stdlib.h>
 #include <freerdp/api.h>
 #include <freerdp/freerdp.h>
+#include <freerdp/constants.h>
 #include <freerdp/codec/color.h>
 #include <freerdp/utils/memory.h>
 
+#include "color_convert.h"
+
+#ifdef WITH_SSE2
+#include "color_sse2.h"
+#endif
+
+#ifdef WITH_AVX2
+#include "color_avx2.h"
+#endif
+
+#ifndef COLOR_INIT_SIMD
+#define COLOR_INIT_SIMD(_kernels) do { } while (0)
+#endif
+
+#ifndef COLOR_INIT_AVX2
+#define COLOR_INIT_AVX2(_kernels) do { } while (0)
+#endif
+
 int freerdp_get_pixel(uint8 * data, int x, int y, int width, int height, int bpp)
 {
 	int start;
@@ -350,378 +369,470 @@ uint32 freerdp_color_convert_var_bgr(uint32 srcColor, int srcBpp, int dstBpp, HC
 		return freerdp_color_convert_rgb_bgr(srcColor, srcBpp, 32, clrconv);
 }
 
-uint8* freerdp_image_convert_8bpp(uint8* srcData, uint8* dstData, int width, int height, int srcBpp, int dstBpp, HCLRCONV clrconv)
+/**
+ * 15 and 16bpp sources: every destination bit is a copy of one source
+ * bit, so a pixel converts as lut[low byte] | lut[256 + high byte].
+ */
+
+enum COLOR_LUT16
 {
-	int i;
-	uint8 red;
-	uint8 green;
-	uint8 blue;
-	uint32 pixel;
-	uint8 *src8;
-	uint16 *dst16;
-	uint32 *dst32;
+	COLOR_LUT_15_16,
+	COLOR_LUT_15_16_INVERT,
+	COLOR_LUT_16_15,
+	COLOR_LUT_16_15_INVERT,
+	COLOR_LUT_16_24,
+	COLOR_LUT_16_24_INVERT,
+	COLOR_LUT_15_32,
+	COLOR_LUT_15_32_INVERT,
+	COLOR_LUT_16_32,
+	COLOR_LUT_16_32_INVERT,
+	COLOR_LUT16_COUNT
+};
+
+static uint32 freerdp_color_lut16[COLOR_LUT16_COUNT][512];
+static pColorRow freerdp_color_kernels[COLOR_KERNEL_COUNT];
+static tbool freerdp_color_ready = false;
 
-	if (dstBpp == 8)
+/* one pixel the slow way, the tables are built from it */
+static uint32 freerdp_color_convert16(uint32 pixel, int lut)
+{
+	uint8 red, green, blue;
+
+	switch (lut)
 	{
-		if (dstData == NULL)
-			dstData = (uint8*) malloc(width * height);
+		case COLOR_LUT_15_16:
+		case COLOR_LUT_15_16_INVERT:
+			GetRGB_555(red, green, blue, pixel);
+			RGB_555_565(red, green, blue);
+			return (lut == COLOR_LUT_15_16_INVERT) ? BGR565(red, green, blue) : RGB565(red, green, blue);
 
-		memcpy(dstData, srcData, width * height);
-		return dstData;
+		case COLOR_LUT_16_15:
+		case COLOR_LUT_16_15_INVERT:
+			GetRGB_565(red, green, blue, pixel);
+			RGB_565_555(red, green, blue);
+			return (lut == COLOR_LUT_16_15_INVERT) ? BGR555(red, green, blue) : RGB555(red, green, blue);
+
+		case COLOR_LUT_16_24:
+		case COLOR_LUT_16_24_INVERT:
+			/* the three bytes in the order they are stored */
+			GetBGR16(red, green, blue, pixel);
+			return (lut == COLOR_LUT_16_24_INVERT) ? RGB24(red, green, blue) : RGB24(blue, green, red);
+
+		case COLOR_LUT_15_32:
+		case COLOR_LUT_15_32_INVERT:
+			GetBGR15(red, green, blue, pixel);
+			return (lut == COLOR_LUT_15_32_INVERT) ? RGB32(red, green, blue) : BGR32(red, green, blue);
+
+		default:
+			GetBGR16(red, green, blue, pixel);
+			return (lut == COLOR_LUT_16_32_INVERT) ? RGB32(red, green, blue) : BGR32(red, green, blue);
 	}
-	else if (dstBpp == 15 || (dstBpp == 16 && clrconv->rgb555))
+}
+
+static void freerdp_color_copy_8(const uint8* src, uint8* dst, int width, const uint32* lut)
+{
+	memcpy(dst, src, width);
+}
+
+static void freerdp_color_copy_16(const uint8* src, uint8* dst, int width, const uint32* lut)
+{
+	memcpy(dst, src, width * 2);
+}
+
+static void freerdp_color_copy_32(const uint8* src, uint8* dst, int width, const uint32* lut)
+{
+	memcpy(dst, src, width * 4);
+}
+
+static void freerdp_color_lut8_16(const uint8* src, uint8* dst, int width, const uint32* lut)
+{
+	int i;
+	uint16* dst16 = (uint16*) dst;
+
+	for (i = 0; i < width; i++)
+		dst16[i] = (uint16) lut[src[i]];
+}
+
+static void freerdp_color_lut8_32(const uint8* src, uint8* dst, int width, const uint32* lut)
+{
+	int i;
+	uint32* dst32 = (uint32*) dst;
+
+	for (i = 0; i < width; i++)
+		dst32[i] = lut[src[i]];
+}
+
+static void freerdp_color_lut16_16(const uint8* src, uint8* dst, int width, const uint32* lut)
+{
+	int i;
+	uint16 pixel;
+	uint16* src16 = (uint16*) src;
+	uint16* dst16 = (uint16*) dst;
+
+	for (i = 0; i < width; i++)
 	{
-		if (dstData == NULL)
-			dstData = (uint8*) malloc(width * height * 2);
-		
-		dst16 = (uint16 *) dstData;
-		for (i = width * height; i > 0; i--)
-		{
-			pixel = *srcData;
-			srcData++;
-			red = clrconv->palette->entries[pixel].red;
-			green = clrconv->palette->entries[pixel].green;
-			blue = clrconv->palette->entries[pixel].blue;
-			pixel = (clrconv->invert) ? BGR15(red, green, blue) : RGB15(red, green, blue);
-			*dst16 = pixel;
-			dst16++;
-		}
-		return dstData;
+		pixel = src16[i];
+		dst16[i] = (uint16) (lut[pixel & 0xFF] | lut[256 + (pixel >> 8)]);
 	}
-	else if (dstBpp == 16)
+}
+
+static void freerdp_color_lut16_24(const uint8* src, uint8* dst, int width, const uint32* lut)
+{
+	int i;
+	uint16 pixel;
+	uint32 color;
+	uint16* src16 = (uint16*) src;
+
+	for (i = 0; i < width; i++)
 	{
-		if (dstData == NULL)
-			dstData = (uint8*) malloc(width * height * 2);
-		
-		dst16 = (uint16 *) dstData;
-		for (i = width * height; i > 0; i--)
-		{
-			pixel = *srcData;
-			srcData++;
-			red = clrconv->palette->entries[pixel].red;
-			green = clrconv->palette->entries[pixel].green;
-			blue = clrconv->palette->entries[pixel].blue;
-			pixel = (clrconv->invert) ? BGR16(red, green, blue) : RGB16(red, green, blue);
-			*dst16 = pixel;
-			dst16++;
-		}
-		return dstData;
+		pixel = src16[i];
+		color = lut[pixel & 0xFF] | lut[256 + (pixel >> 8)];
+		*dst++ = color & 0xFF;
+		*dst++ = (color >> 8) & 0xFF;
+		*dst++ = (color >> 16) & 0xFF;
 	}
-	else if (dstBpp == 32)
+}
+
+void freerdp_color_lut16_32(const uint8* src, uint8* dst, int width, const uint32* lut)
+{
+	int i;
+	uint16 pixel;
+	uint16* src16 = (uint16*) src;
+	uint32* dst32 = (uint32*) dst;
+
+	for (i = 0; i < width; i++)
 	{
-		if (dstData == NULL)
-			dstData = (uint8*) malloc(width * height * 4);
-		
-		src8 = (uint8*) srcData;
-		dst32 = (uint32*) dstData;
-		for (i = width * height; i > 0; i--)
-		{
-			pixel = *src8;
-			src8++;
-			red = clrconv->palette->entries[pixel].red;
-			green = clrconv->palette->entries[pixel].green;
-			blue = clrconv->palette->entries[pixel].blue;
-			pixel = (clrconv->invert) ? RGB32(red, green, blue) : BGR32(red, green, blue);
-			*dst32 = pixel;
-			dst32++;
-		}
-		return dstData;
+		pixel = src16[i];
+		dst32[i] = lut[pixel & 0xFF] | lut[256 + (pixel >> 8)];
 	}
-
-	return srcData;
 }
 
-uint8* freerdp_image_convert_15bpp(uint8* srcData, uint8* dstData, int width, int height, int srcBpp, int dstBpp, HCLRCONV clrconv)
+/* masks keeping bytes 0 to 2 of a pixel and setting byte 3, whatever the byte order */
+static const uint8 freerdp_color_rgb_bytes[4] = { 0xFF, 0xFF, 0xFF, 0x00 };
+static const uint8 freerdp_color_alpha_bytes[4] = { 0x00, 0x00, 0x00, 0xFF };
+
+void freerdp_color_24_32(const uint8* src, uint8* dst, int width, const uint32* lut)
 {
 	int i;
-	uint8 red;
-	uint8 green;
-	uint8 blue;
+	uint32 rgb;
+	uint32 alpha;
 	uint32 pixel;
-	uint16 *src16;
-	uint16 *dst16;
-	uint32 *dst32;
+	uint32* dst32 = (uint32*) dst;
 
-	if (dstBpp == 15 || (dstBpp == 16 && clrconv->rgb555))
-	{
-		if (dstData == NULL)
-			dstData = (uint8*) malloc(width * height * 2);
+	if (width < 1)
+		return;
 
-		memcpy(dstData, srcData, width * height * 2);
+	memcpy(&rgb, freerdp_color_rgb_bytes, 4);
+	memcpy(&alpha, freerdp_color_alpha_bytes, 4);
 
-		return dstData;
-	}
-	else if (dstBpp == 32)
-	{
-		if (dstData == NULL)
-			dstData = (uint8*) malloc(width * height * 4);
-		
-		src16 = (uint16 *) srcData;
-		dst32 = (uint32 *) dstData;
-		for (i = width * height; i > 0; i--)
-		{
-			pixel = *src16;
-			src16++;
-			GetBGR15(red, green, blue, pixel);
-			pixel = (clrconv->invert) ? RGB32(red, green, blue) : BGR32(red, green, blue);
-			*dst32 = pixel;
-			dst32++;
-		}
-		return dstData;
-	}
-	else if (dstBpp == 16)
+	/* four bytes at a time, the last pixel has only three to read */
+	for (i = 0; i < width - 1; i++)
 	{
-		if (dstData == NULL)
-			dstData = (uint8*) malloc(width * height * 2);
-	
-		src16 = (uint16 *) srcData;
-		dst16 = (uint16 *) dstData;
-		for (i = width * height; i > 0; i--)
-		{
-			pixel = *src16;
-			src16++;
-			GetRGB_555(red, green, blue, pixel);
-			RGB_555_565(red, green, blue);
-			pixel = (clrconv->invert) ? BGR565(red, green, blue) : RGB565(red, green, blue);
-			*dst16 = pixel;
-			dst16++;
-		}
-		return dstData;
+		memcpy(&pixel, src + i * 3, 4);
+		dst32[i] = (pixel & rgb) | alpha;
 	}
 
-	return srcData;
+	pixel = 0;
+	memcpy(&pixel, src + i * 3, 3);
+	dst32[i] = (pixel & rgb) | alpha;
 }
 
-uint8* freerdp_image_convert_16bpp(uint8* srcData, uint8* dstData, int width, int height, int srcBpp, int dstBpp, HCLRCONV clrconv)
+static void freerdp_color_32_16(const uint8* src, uint8* dst, int width, const uint32* lut)
 {
-	if (srcBpp == 15)
-		return freerdp_image_convert_15bpp(srcData, dstData, width, height, srcBpp, dstBpp, clrconv);
+	int i;
+	uint8 red, green, blue;
+	uint32* src32 = (uint32*) src;
+	uint16* dst16 = (uint16*) dst;
 
-	if (dstBpp == 16)
+	for (i = 0; i < width; i++)
 	{
-		if (dstData == NULL)
-			dstData = (uint8*) malloc(width * height * 2);
-
-		if (clrconv->rgb555)
-		{
-			int i;
-			uint8 red, green, blue;
-			uint16* src16 = (uint16 *) srcData;
-			uint16* dst16 = (uint16 *) dstData;
+		GetBGR32(blue, green, red, src32[i]);
+		dst16[i] = RGB16(red, green, blue);
+	}
+}
 
-			for (i = width * height; i > 0; i--)
-			{
-				GetRGB_565(red, green, blue, (*src16));
-				RGB_565_555(red, green, blue);
-				(*dst16) = (clrconv->invert) ? BGR555(red, green, blue) : RGB555(red, green, blue);
-				src16++;
-				dst16++;
-			}
-		}
-		else
-		{
-			memcpy(dstData, srcData, width * height * 2);
-		}
+static void freerdp_color_32_16_invert(const uint8* src, uint8* dst, int width, const uint32* lut)
+{
+	int i;
+	uint8 red, green, blue;
+	uint32* src32 = (uint32*) src;
+	uint16* dst16 = (uint16*) dst;
 
-		return dstData;
-	}
-	else if (dstBpp == 24)
+	for (i = 0; i < width; i++)
 	{
-		int i;
-		uint8 *dst8;
-		uint16 *src16;
-		uint8 red, green, blue;
+		GetBGR32(blue, green, red, src32[i]);
+		dst16[i] = BGR16(red, green, blue);
+	}
+}
 
-		if (dstData == NULL)
-			dstData = (uint8*) malloc(width * height * 3);
+static void freerdp_color_32_24(const uint8* src, uint8* dst, int width, const uint32* lut)
+{
+	int i;
 
-		dst8 = (uint8*) dstData;
-		src16 = (uint16*) srcData;
+	for (i = 0; i < width; i++)
+	{
+		*dst++ = src[0];
+		*dst++ = src[1];
+		*dst++ = src[2];
+		src += 4;
+	}
+}
 
-		for (i = width * height; i > 0; i--)
-		{
-			GetBGR16(red, green, blue, *src16);
-			src16++;
+static void freerdp_color_32_24_invert(const uint8* src, uint8* dst, int width, const uint32* lut)
+{
+	int i;
 
-			if (clrconv->invert)
-			{
-				*dst8++ = blue;
-				*dst8++ = green;
-				*dst8++ = red;
-			}
-			else
-			{
-				*dst8++ = red;
-				*dst8++ = green;
-				*dst8++ = blue;
-			}
-		}
-		return dstData;
-	}
-	else if (dstBpp == 32)
+	for (i = 0; i < width; i++)
 	{
-		int i;
-		uint32 pixel;
-		uint16* src16;
-		uint32* dst32;
-		uint8 red, green, blue;
+		*dst++ = src[2];
+		*dst++ = src[1];
+		*dst++ = src[0];
+		src += 4;
+	}
+}
 
-		if (dstData == NULL)
-			dstData = (uint8*) malloc(width * height * 4);
+void freerdp_color_32_32_alpha(const uint8* src, uint8* dst, int width, const uint32* lut)
+{
+	int i;
+	uint32 alpha;
+	uint32 pixel;
+	uint32* dst32 = (uint32*) dst;
 
-		src16 = (uint16*) srcData;
-		dst32 = (uint32*) dstData;
+	memcpy(&alpha, freerdp_color_alpha_bytes, 4);
 
-		for (i = width * height; i > 0; i--)
-		{
-			pixel = *src16;
-			src16++;
-			GetBGR16(red, green, blue, pixel);
-			pixel = (clrconv->invert) ? RGB32(red, green, blue) : BGR32(red, green, blue);
-			*dst32 = pixel;
-			dst32++;
-		}
-		return dstData;
+	for (i = 0; i < width; i++)
+	{
+		memcpy(&pixel, src + i * 4, 4);
+		dst32[i] = pixel | alpha;
 	}
-
-	return srcData;
 }
 
-uint8* freerdp_image_convert_24bpp(uint8* srcData, uint8* dstData, int width, int height, int srcBpp, int dstBpp, HCLRCONV clrconv)
+static void freerdp_color_init(void)
 {
 	int i;
+	int lut;
 
-	if (dstBpp == 32)
+	for (lut = 0; lut < COLOR_LUT16_COUNT; lut++)
 	{
-		uint8 *dstp;
-		if (dstData == NULL)
-			dstData = (uint8*) malloc(width * height * 4);
-		
-		dstp = dstData;
-		for (i = width * height; i > 0; i--)
+		for (i = 0; i < 256; i++)
 		{
-			*(dstp++) = *(srcData++);
-			*(dstp++) = *(srcData++);
-			*(dstp++) = *(srcData++);
-			*(dstp++) = 0xFF;
+			freerdp_color_lut16[lut][i] = freerdp_color_convert16(i, lut);
+			freerdp_color_lut16[lut][256 + i] = freerdp_color_convert16(i << 8, lut);
 		}
-		return dstData;
 	}
 
-	return srcData;
+	freerdp_color_kernels[COLOR_COPY_8] = freerdp_color_copy_8;
+	freerdp_color_kernels[COLOR_COPY_16] = freerdp_color_copy_16;
+	freerdp_color_kernels[COLOR_COPY_32] = freerdp_color_copy_32;
+	freerdp_color_kernels[COLOR_8_16] = freerdp_color_lut8_16;
+	freerdp_color_kernels[COLOR_8_32] = freerdp_color_lut8_32;
+	freerdp_color_kernels[COLOR_16_16] = freerdp_color_lut16_16;
+	freerdp_color_kernels[COLOR_16_24] = freerdp_color_lut16_24;
+	freerdp_color_kernels[COLOR_15_32] = freerdp_color_lut16_32;
+	freerdp_color_kernels[COLOR_15_32_INVERT] = freerdp_color_lut16_32;
+	freerdp_color_kernels[COLOR_16_32] = freerdp_color_lut16_32;
+	freerdp_color_kernels[COLOR_16_32_INVERT] = freerdp_color_lut16_32;
+	freerdp_color_kernels[COLOR_24_32] = freerdp_color_24_32;
+	freerdp_color_kernels[COLOR_32_16] = freerdp_color_32_16;
+	freerdp_color_kernels[COLOR_32_16_INVERT] = freerdp_color_32_16_invert;
+	freerdp_color_kernels[COLOR_32_24] = freerdp_color_32_24;
+	freerdp_color_kernels[COLOR_32_24_INVERT] = freerdp_color_32_24_invert;
+	freerdp_color_kernels[COLOR_32_32_ALPHA] = freerdp_color_32_32_alpha;
 }
 
-uint8* freerdp_image_convert_32bpp(uint8* srcData, uint8* dstData, int width, int height, int srcBpp, int dstBpp, HCLRCONV clrconv)
+/**
+ * select the image conversion kernels, they are shared by every caller
+ *
+ * @param cpu_opt   CPU_SSE2 and CPU_AVX2 flags of the running CPU
+ */
+
+void freerdp_color_set_cpu_opt(uint32 cpu_opt)
 {
-	if (dstBpp == 16)
-	{
-		int index;
-		uint16 *dst16;
-		uint32 *src32;
-		uint8 red, green, blue;
+	freerdp_color_init();
 
-		if (dstData == NULL)
-			dstData = (uint8*) malloc(width * height * 2);
+	if (cpu_opt & CPU_SSE2)
+		COLOR_INIT_SIMD(freerdp_color_kernels);
 
-		dst16 = (uint16*) dstData;
-		src32 = (uint32*) srcData;
+	/* the AVX2 kernels replace the SSE2 ones where the CPU has both */
+	if (cpu_opt & CPU_AVX2)
+		COLOR_INIT_AVX2(freerdp_color_kernels);
 
-		for (index = 0; index < width * height; index++)
-		{
-			GetBGR32(blue, green, red, *src32);
-			*dst16 = (clrconv->invert) ? BGR16(red, green, blue) : RGB16(red, green, blue);
-			src32++;
-			dst16++;
-		}
-		return dstData;
+	freerdp_color_ready = true;
+}
+
+/* the palette as destination pixels */
+static void freerdp_color_palette_lut(uint32* lut, int dstBpp, HCLRCONV clrconv)
+{
+	int i;
+	int count;
+	uint8 red, green, blue;
+	PALETTE_ENTRY* entries;
+
+	entries = clrconv->palette->entries;
+	count = (entries != NULL) ? MIN((int) clrconv->palette->count, 256) : 0;
+
+	for (i = 0; i < count; i++)
+	{
+		red = entries[i].red;
+		green = entries[i].green;
+		blue = entries[i].blue;
+
+		if (dstBpp == 32)
+			lut[i] = (clrconv->invert) ? RGB32(red, green, blue) : BGR32(red, green, blue);
+		else if (dstBpp == 15)
+			lut[i] = (clrconv->invert) ? BGR15(red, green, blue) : RGB15(red, green, blue);
+		else
+			lut[i] = (clrconv->invert) ? BGR16(red, green, blue) : RGB16(red, green, blue);
 	}
-	else if (dstBpp == 24)
+
+	memset(&lut[count], 0, (256 - count) * sizeof(uint32));
+}
+
+/**
+ * Kernel and table for a conversion.
+ * @return kernel index, -1 if there is no conversion between the formats
+ */
+
+static int freerdp_color_select(int srcBpp, int dstBpp, HCLRCONV clrconv, const uint32** lut, uint32* palette)
+{
+	int invert = clrconv->invert ? 1 : 0;
+
+	*lut = NULL;
+
+	switch (srcBpp)
 	{
-		uint8 *dstp;
-		int index;
-		uint8 red, green, blue;
+		case 8:
+			if (dstBpp == 8)
+				return COLOR_COPY_8;
 
-		if (dstData == NULL)
-			dstData = (uint8*) malloc(width * height * 3);
+			if (dstBpp == 15 || dstBpp == 16 || dstBpp == 32)
+			{
+				freerdp_color_palette_lut(palette, (dstBpp == 16 && clrconv->rgb555) ? 15 : dstBpp, clrconv);
+				*lut = palette;
+				return (dstBpp == 32) ? COLOR_8_32 : COLOR_8_16;
+			}
+			break;
 
-		dstp = dstData;
-		for (index = 0; index < width * height; index++)
-		{
-			red = *(srcData++);
-			green = *(srcData++);
-			blue = *(srcData++);
+		case 15:
+			if (dstBpp == 15 || (dstBpp == 16 && clrconv->rgb555))
+				return COLOR_COPY_16;
 
-			if (clrconv->invert)
+			if (dstBpp == 16)
 			{
-				*dstp++ = blue;
-				*dstp++ = green;
-				*dstp++ = red;
+				*lut = freerdp_color_lut16[COLOR_LUT_15_16 + invert];
+				return COLOR_16_16;
 			}
-			else
+
+			if (dstBpp == 32)
 			{
-				*dstp++ = red;
-				*dstp++ = green;
-				*dstp++ = blue;
+				*lut = freerdp_color_lut16[COLOR_LUT_15_32 + invert];
+				return COLOR_15_32 + invert;
 			}
+			break;
 
-			srcData++;
-		}
-		return dstData;
-	}
-	else if (dstBpp == 32)
-	{
-		if (clrconv->alpha)
-		{
-			int x, y;
-			uint8 *dstp;
+		case 16:
+			if (dstBpp == 16 && !clrconv->rgb555)
+				return COLOR_COPY_16;
 
-			if (dstData == NULL)
-				dstData = (uint8*) malloc(width * height * 4);
+			if (dstBpp == 16)
+			{
+				*lut = freerdp_color_lut16[COLOR_LUT_16_15 + invert];
+				return COLOR_16_16;
+			}
 
-			memcpy(dstData, srcData, width * height * 4);
+			if (dstBpp == 24)
+			{
+				*lut = freerdp_color_lut16[COLOR_LUT_16_24 + invert];
+				return COLOR_16_24;
+			}
 
-			dstp = dstData;
-			for (y = 0; y < height; y++)
+			if (dstBpp == 32)
 			{
-				for (x = 0; x < width * 4; x += 4)
-				{
-					dstp += 3;
-					*dstp = 0xFF;
-					dstp++;
-				}
+				*lut = freerdp_color_lut16[COLOR_LUT_16_32 + invert];
+				return COLOR_16_32 + invert;
 			}
-		}
-		else
-		{
-			if (dstData == NULL)
-				dstData = (uint8*) malloc(width * height * 4);
+			break;
 
-			memcpy(dstData, srcData, width * height * 4);
-		}
-		
-		return dstData;
+		case 24:
+			if (dstBpp == 32)
+				return COLOR_24_32;
+			break;
+
+		case 32:
+			if (dstBpp == 16)
+				return COLOR_32_16 + invert;
+
+			if (dstBpp == 24)
+				return COLOR_32_24 + invert;
+
+			if (dstBpp == 32)
+				return (clrconv->alpha) ? COLOR_32_32_ALPHA : COLOR_COPY_32;
+			break;
 	}
 
-	return srcData;
+	return -1;
 }
 
-p_freerdp_image_convert freerdp_image_convert_[5] =
+/**
+ * Convert an image between color depths.
+ *
+ * Rows are srcStride and dstStride bytes apart, either may be negative to
+ * walk a bottom-up image from its last row. With no dstData, a packed image
+ * is allocated and dstStride is ignored.
+ *
+ * @return dstData, srcData if there is no conversion between the formats,
+ * NULL for an unsupported source depth
+ */
+
+uint8* freerdp_image_convert_ex(uint8* srcData, int srcStride, uint8* dstData, int dstStride,
+		int width, int height, int srcBpp, int dstBpp, HCLRCONV clrconv)
 {
-	NULL,
-	freerdp_image_convert_8bpp,
-	freerdp_image_convert_16bpp,
-	freerdp_image_convert_24bpp,
-	freerdp_image_convert_32bpp
-};
+	int y;
+	int kernel;
+	int srcSize;
+	int dstSize;
+	pColorRow row;
+	const uint32* lut;
+	uint32 palette[256];
+
+	if (srcBpp != 8 && srcBpp != 15 && srcBpp != 16 && srcBpp != 24 && srcBpp != 32)
+		return NULL;
+
+	if (!freerdp_color_ready)
+		freerdp_color_set_cpu_opt(0);
+
+	kernel = freerdp_color_select(srcBpp, dstBpp, clrconv, &lut, palette);
+
+	if (kernel < 0)
+		return srcData;
+
+	row = freerdp_color_kernels[kernel];
+	srcSize = width * ((srcBpp + 7) / 8);
+	dstSize = width * ((dstBpp + 7) / 8);
+
+	if (dstData == NULL)
+	{
+		dstData = (uint8*) xmalloc(dstSize * height);
+		dstStride = dstSize;
+	}
+
+	/* packed images are one long row */
+	if (srcStride == srcSize && dstStride == dstSize)
+	{
+		width *= height;
+		height = 1;
+	}
+
+	for (y = 0; y < height; y++)
+		row(srcData + y * srcStride, dstData + y * dstStride, width, lut);
+
+	return dstData;
+}
 
 uint8* freerdp_image_convert(uint8* srcData, uint8* dstData, int width, int height, int srcBpp, int dstBpp, HCLRCONV clrconv)
 {
-	p_freerdp_image_convert _p_freerdp_image_convert = freerdp_image_convert_[IBPP(srcBpp)];
-
-	if (_p_freerdp_image_convert != NULL)
-		return _p_freerdp_image_convert(srcData, dstData, width, height, srcBpp, dstBpp, clrconv);
-	else
-		return 0;
+	return freerdp_image_convert_ex(srcData, width * ((srcBpp + 7) / 8), dstData, width * ((dstBpp + 7) / 8),
+			width, height, srcBpp, dstBpp, clrconv);
 }
 
 void   freerdp_bitmap_flip(uint8 * src, uint8 * dst, int scanLineSz, int height)
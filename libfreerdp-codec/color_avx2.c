@@ -0,0 +1,79 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Image Color Conversion Kernels, AVX2
+ *
+ * Copyright 2014 Jay Sorg <jay.sorg@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <immintrin.h>
+
+#include "color_convert.h"
+#include "color_avx2.h"
+
+#define CLR_VEC			__m256i
+#define CLR_VEC_SIZE		32
+#define CLR_LOAD(_p)		_mm256_loadu_si256((const __m256i*) (_p))
+#define CLR_STORE(_p, _v)	_mm256_storeu_si256((__m256i*) (_p), _v)
+#define CLR_SET16(_v)		_mm256_set1_epi16(_v)
+#define CLR_SET32(_v)		_mm256_set1_epi32((int) (_v))
+#define CLR_AND(_a, _b)		_mm256_and_si256(_a, _b)
+#define CLR_OR(_a, _b)		_mm256_or_si256(_a, _b)
+#define CLR_SRL16(_a, _n)	_mm256_srli_epi16(_a, _n)
+#define CLR_SLL16(_a, _n)	_mm256_slli_epi16(_a, _n)
+/* the unpacks work within 128 bit lanes, put the lanes back in pixel order */
+#define CLR_INTERLEAVE16(_a, _b, _lo, _hi) \
+	_lo = _mm256_unpacklo_epi16(_a, _b); \
+	_hi = _mm256_unpackhi_epi16(_a, _b); \
+	_a = _lo; \
+	_lo = _mm256_permute2x128_si256(_a, _hi, 0x20); \
+	_hi = _mm256_permute2x128_si256(_a, _hi, 0x31);
+#define CLR_NAME(_op)		freerdp_color_##_op##_avx2
+
+#include "include/color.c"
+
+/**
+ * Eight pixels at a time: the low lane takes pixels 0 to 3 from the first
+ * 12 bytes, the high lane pixels 4 to 7 from the last 12 bytes of a load
+ * at byte 8, so nothing past the row is read.
+ */
+
+static void freerdp_color_24_32_avx2(const uint8* src, uint8* dst, int width, const uint32* lut)
+{
+	int i;
+	__m256i v;
+	__m256i alpha;
+	__m256i shuffle;
+
+	alpha = _mm256_set1_epi32((int) 0xFF000000);
+	shuffle = _mm256_setr_epi8(
+		0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+		4, 5, 6, -1, 7, 8, 9, -1, 10, 11, 12, -1, 13, 14, 15, -1);
+
+	for (i = 0; i + 8 <= width; i += 8)
+	{
+		v = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*) (src + i * 3)));
+		v = _mm256_inserti128_si256(v, _mm_loadu_si128((const __m128i*) (src + i * 3 + 8)), 1);
+		v = _mm256_or_si256(_mm256_shuffle_epi8(v, shuffle), alpha);
+		_mm256_storeu_si256((__m256i*) (dst + i * 4), v);
+	}
+
+	freerdp_color_24_32(src + i * 3, dst + i * 4, width - i, lut);
+}
+
+void freerdp_color_init_avx2(pColorRow* kernels)
+{
+	freerdp_color_init_kernels_avx2(kernels);
+	kernels[COLOR_24_32] = freerdp_color_24_32_avx2;
+}
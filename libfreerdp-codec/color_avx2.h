@@ -0,0 +1,31 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Image Color Conversion Kernels, AVX2
+ *
+ * Copyright 2014 Jay Sorg <jay.sorg@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __COLOR_AVX2_H
+#define __COLOR_AVX2_H
+
+#include "color_convert.h"
+
+void freerdp_color_init_avx2(pColorRow* kernels);
+
+#ifndef COLOR_INIT_AVX2
+#define COLOR_INIT_AVX2(_kernels) freerdp_color_init_avx2(_kernels)
+#endif
+
+#endif /* __COLOR_AVX2_H */
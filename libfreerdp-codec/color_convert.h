@@ -0,0 +1,67 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Image Color Conversion Kernels
+ *
+ * Copyright 2014 Jay Sorg <jay.sorg@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __COLOR_CONVERT_H
+#define __COLOR_CONVERT_H
+
+#include "config.h"
+
+#include <freerdp/api.h>
+#include <freerdp/freerdp.h>
+#include <freerdp/codec/color.h>
+
+/**
+ * A row kernel converts width pixels of one format pair. Everything that
+ * depends on the CLRCONV flags is settled when the kernel is picked, so the
+ * kernels do not branch per pixel. lut is the table the kernel was picked
+ * with: the 256 destination pixels of the palette for 8bpp sources, or for
+ * 15 and 16bpp sources 256 entries for the low byte followed by 256 for the
+ * high byte, or'ed together to make the destination pixel.
+ */
+
+typedef void (*pColorRow)(const uint8* src, uint8* dst, int width, const uint32* lut);
+
+enum COLOR_KERNEL
+{
+	COLOR_COPY_8,
+	COLOR_COPY_16,
+	COLOR_COPY_32,
+	COLOR_8_16,
+	COLOR_8_32,
+	COLOR_16_16,
+	COLOR_16_24,
+	COLOR_15_32,
+	COLOR_15_32_INVERT,
+	COLOR_16_32,
+	COLOR_16_32_INVERT,
+	COLOR_24_32,
+	COLOR_32_16,
+	COLOR_32_16_INVERT,
+	COLOR_32_24,
+	COLOR_32_24_INVERT,
+	COLOR_32_32_ALPHA,
+	COLOR_KERNEL_COUNT
+};
+
+/* portable kernels the SIMD ones finish their rows with */
+void freerdp_color_lut16_32(const uint8* src, uint8* dst, int width, const uint32* lut);
+void freerdp_color_24_32(const uint8* src, uint8* dst, int width, const uint32* lut);
+void freerdp_color_32_32_alpha(const uint8* src, uint8* dst, int width, const uint32* lut);
+
+#endif /* __COLOR_CONVERT_H */
@@ -0,0 +1,46 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Image Color Conversion Kernels, SSE2
+ *
+ * Copyright 2014 Jay Sorg <jay.sorg@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <emmintrin.h>
+
+#include "color_convert.h"
+#include "color_sse2.h"
+
+#define CLR_VEC			__m128i
+#define CLR_VEC_SIZE		16
+#define CLR_LOAD(_p)		_mm_loadu_si128((const __m128i*) (_p))
+#define CLR_STORE(_p, _v)	_mm_storeu_si128((__m128i*) (_p), _v)
+#define CLR_SET16(_v)		_mm_set1_epi16(_v)
+#define CLR_SET32(_v)		_mm_set1_epi32((int) (_v))
+#define CLR_AND(_a, _b)		_mm_and_si128(_a, _b)
+#define CLR_OR(_a, _b)		_mm_or_si128(_a, _b)
+#define CLR_SRL16(_a, _n)	_mm_srli_epi16(_a, _n)
+#define CLR_SLL16(_a, _n)	_mm_slli_epi16(_a, _n)
+#define CLR_INTERLEAVE16(_a, _b, _lo, _hi) \
+	_lo = _mm_unpacklo_epi16(_a, _b); \
+	_hi = _mm_unpackhi_epi16(_a, _b);
+#define CLR_NAME(_op)		freerdp_color_##_op##_sse2
+
+#include "include/color.c"
+
+/* 24 to 32bpp needs a byte shuffle, which SSE2 does not have */
+void freerdp_color_init_sse2(pColorRow* kernels)
+{
+	freerdp_color_init_kernels_sse2(kernels);
+}
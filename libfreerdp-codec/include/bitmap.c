@@ -22,7 +22,7 @@
 /**
  * Write a foreground/background image to a destination buffer.
  */
-static uint8* WRITEFGBGIMAGE(uint8* pbDest, uint32 rowDelta,
+static uint8* WRITEFGBGIMAGE(uint8* pbDest, int rowDelta,
 	uint8 bitmask, PIXEL fgPel, uint32 cBits)
 {
 	PIXEL xorPixel;
@@ -248,37 +248,83 @@ static uint8* WRITEFIRSTLINEFGBGIMAGE(uint8* pbDest, uint8 bitmask,
 	return pbDest;
 }
 
+/* a run may go past the end of the row, it is written one row piece at a time */
+#define RLE_PIECE(_n, _run) \
+	_n = MIN(_run, rowLeft); \
+	_run = _run - _n; \
+	rowLeft = rowLeft - _n
+
+/* go to the next row once this one is full, and stop after the last one */
+#define RLE_NEXT_ROW() \
+	if (rowLeft == 0) \
+	{ \
+		if (++row >= height) \
+			return; \
+		pbRow = pbRow + rowDelta; \
+		pbDest = pbRow; \
+		rowLeft = width; \
+	}
+
+/* up to eight pixels of a foreground/background bitmask */
+#define RLE_FGBG_BITS(_bitmask, _cBits) \
+	bitmask = _bitmask; \
+	cBits = _cBits; \
+	while (cBits > 0) \
+	{ \
+		RLE_PIECE(n, cBits); \
+		if (fFirstLine) \
+			pbDest = WRITEFIRSTLINEFGBGIMAGE(pbDest, bitmask, fgPel, n); \
+		else \
+			pbDest = WRITEFGBGIMAGE(pbDest, rowDelta, bitmask, fgPel, n); \
+		bitmask = bitmask >> n; \
+		RLE_NEXT_ROW(); \
+	}
+
 /**
  * Decompress an RLE compressed bitmap.
+ * Scanlines come bottom-up in the stream, the first one is written at
+ * pbDestBuffer and each next one rowDelta bytes further. A negative
+ * rowDelta, with pbDestBuffer pointing at the last row, gives a top-down
+ * bitmap; a rowDelta larger than a row decodes into a wider surface.
+ * Nothing is written past the height rows.
  */
 void RLEDECOMPRESS(uint8* pbSrcBuffer, uint32 cbSrcBuffer, uint8* pbDestBuffer,
-	uint32 rowDelta, uint32 width, uint32 height)
+	int rowDelta, uint32 width, uint32 height)
 {
 	uint8* pbSrc = pbSrcBuffer;
 	uint8* pbEnd = pbSrcBuffer + cbSrcBuffer;
 	uint8* pbDest = pbDestBuffer;
+	uint8* pbRow = pbDestBuffer;
 
 	PIXEL temp;
 	PIXEL fgPel = WHITE_PIXEL;
 	tbool fInsertFgPel = false;
 	tbool fFirstLine = true;
+	tbool fPixelB;
 
 	uint8 bitmask;
 	PIXEL pixelA, pixelB;
 
 	uint32 runLength;
 	uint32 code;
+	uint32 cBits;
+	uint32 n;
+	uint32 row = 0;
+	uint32 rowLeft = width;
 
 	uint32 advance;
 
 	RLEEXTRA
 
+	if (width < 1 || height < 1)
+		return;
+
 	while (pbSrc < pbEnd)
 	{
 		/* Watch out for the end of the first scanline. */
 		if (fFirstLine)
 		{
-			if ((uint32)(pbDest - pbDestBuffer) >= rowDelta)
+			if (row > 0)
 			{
 				fFirstLine = false;
 				fInsertFgPel = false;
@@ -296,52 +342,60 @@ void RLEDECOMPRESS(uint8* pbSrcBuffer, uint32 cbSrcBuffer, uint8* pbDestBuffer,
 		{
 			runLength = ExtractRunLength(code, pbSrc, &advance);
 			pbSrc = pbSrc + advance;
-			if (fFirstLine)
+			if (fInsertFgPel && runLength > 0)
 			{
-				if (fInsertFgPel)
+				if (fFirstLine)
 				{
 					DESTWRITEPIXEL(pbDest, fgPel);
-					DESTNEXTPIXEL(pbDest);
-					runLength = runLength - 1;
 				}
-				while (runLength >= UNROLL_COUNT)
-				{
-					UNROLL(
-						DESTWRITEPIXEL(pbDest, BLACK_PIXEL);
-						DESTNEXTPIXEL(pbDest); );
-					runLength = runLength - UNROLL_COUNT;
-				}
-				while (runLength > 0)
+				else
 				{
-					DESTWRITEPIXEL(pbDest, BLACK_PIXEL);
-					DESTNEXTPIXEL(pbDest);
-					runLength = runLength - 1;
+					DESTREADPIXEL(temp, pbDest - rowDelta);
+					DESTWRITEPIXEL(pbDest, temp ^ fgPel);
 				}
+				DESTNEXTPIXEL(pbDest);
+				runLength = runLength - 1;
+				rowLeft = rowLeft - 1;
+				RLE_NEXT_ROW();
 			}
-			else
+			while (runLength > 0)
 			{
-				if (fInsertFgPel)
+				RLE_PIECE(n, runLength);
+				if (fFirstLine)
 				{
-					DESTREADPIXEL(temp, pbDest - rowDelta);
-					DESTWRITEPIXEL(pbDest, temp ^ fgPel);
-					DESTNEXTPIXEL(pbDest);
-					runLength = runLength - 1;
+					while (n >= UNROLL_COUNT)
+					{
+						UNROLL(
+							DESTWRITEPIXEL(pbDest, BLACK_PIXEL);
+							DESTNEXTPIXEL(pbDest); );
+						n = n - UNROLL_COUNT;
+					}
+					while (n > 0)
+					{
+						DESTWRITEPIXEL(pbDest, BLACK_PIXEL);
+						DESTNEXTPIXEL(pbDest);
+						n = n - 1;
+					}
 				}
-				while (runLength >= UNROLL_COUNT)
+				else
 				{
-					UNROLL(
+					while (n >= UNROLL_COUNT)
+					{
+						UNROLL(
+							DESTREADPIXEL(temp, pbDest - rowDelta);
+							DESTWRITEPIXEL(pbDest, temp);
+							DESTNEXTPIXEL(pbDest); );
+						n = n - UNROLL_COUNT;
+					}
+					while (n > 0)
+					{
 						DESTREADPIXEL(temp, pbDest - rowDelta);
 						DESTWRITEPIXEL(pbDest, temp);
-						DESTNEXTPIXEL(pbDest); );
-					runLength = runLength - UNROLL_COUNT;
-				}
-				while (runLength > 0)
-				{
-					DESTREADPIXEL(temp, pbDest - rowDelta);
-					DESTWRITEPIXEL(pbDest, temp);
-					DESTNEXTPIXEL(pbDest);
-					runLength = runLength - 1;
+						DESTNEXTPIXEL(pbDest);
+						n = n - 1;
+					}
 				}
+				RLE_NEXT_ROW();
 			}
 			/* A follow-on background run order will need a foreground pel inserted. */
 			fInsertFgPel = true;
@@ -366,39 +420,44 @@ void RLEDECOMPRESS(uint8* pbSrcBuffer, uint32 cbSrcBuffer, uint8* pbDestBuffer,
 					SRCREADPIXEL(fgPel, pbSrc);
 					SRCNEXTPIXEL(pbSrc);
 				}
-				if (fFirstLine)
+				while (runLength > 0)
 				{
-					while (runLength >= UNROLL_COUNT)
+					RLE_PIECE(n, runLength);
+					if (fFirstLine)
 					{
-						UNROLL(
+						while (n >= UNROLL_COUNT)
+						{
+							UNROLL(
+								DESTWRITEPIXEL(pbDest, fgPel);
+								DESTNEXTPIXEL(pbDest); );
+							n = n - UNROLL_COUNT;
+						}
+						while (n > 0)
+						{
 							DESTWRITEPIXEL(pbDest, fgPel);
-							DESTNEXTPIXEL(pbDest); );
-						runLength = runLength - UNROLL_COUNT;
-					}
-					while (runLength > 0)
-					{
-						DESTWRITEPIXEL(pbDest, fgPel);
-						DESTNEXTPIXEL(pbDest);
-						runLength = runLength - 1;
+							DESTNEXTPIXEL(pbDest);
+							n = n - 1;
+						}
 					}
-				}
-				else
-				{
-					while (runLength >= UNROLL_COUNT)
+					else
 					{
-						UNROLL(
+						while (n >= UNROLL_COUNT)
+						{
+							UNROLL(
+								DESTREADPIXEL(temp, pbDest - rowDelta);
+								DESTWRITEPIXEL(pbDest, temp ^ fgPel);
+								DESTNEXTPIXEL(pbDest); );
+							n = n - UNROLL_COUNT;
+						}
+						while (n > 0)
+						{
 							DESTREADPIXEL(temp, pbDest - rowDelta);
 							DESTWRITEPIXEL(pbDest, temp ^ fgPel);
-							DESTNEXTPIXEL(pbDest); );
-						runLength = runLength - UNROLL_COUNT;
-					}
-					while (runLength > 0)
-					{
-						DESTREADPIXEL(temp, pbDest - rowDelta);
-						DESTWRITEPIXEL(pbDest, temp ^ fgPel);
-						DESTNEXTPIXEL(pbDest);
-						runLength = runLength - 1;
+							DESTNEXTPIXEL(pbDest);
+							n = n - 1;
+						}
 					}
+					RLE_NEXT_ROW();
 				}
 				break;
 
@@ -411,22 +470,33 @@ void RLEDECOMPRESS(uint8* pbSrcBuffer, uint32 cbSrcBuffer, uint8* pbDestBuffer,
 				SRCNEXTPIXEL(pbSrc);
 				SRCREADPIXEL(pixelB, pbSrc);
 				SRCNEXTPIXEL(pbSrc);
-				while (runLength >= UNROLL_COUNT)
+				/* runLength counts pairs, a row may end between the two pixels */
+				runLength = runLength * 2;
+				fPixelB = false;
+				while (runLength > 0)
 				{
-					UNROLL(
+					RLE_PIECE(n, runLength);
+					if (fPixelB)
+					{
+						DESTWRITEPIXEL(pbDest, pixelB);
+						DESTNEXTPIXEL(pbDest);
+						n = n - 1;
+					}
+					while (n >= 2)
+					{
 						DESTWRITEPIXEL(pbDest, pixelA);
 						DESTNEXTPIXEL(pbDest);
 						DESTWRITEPIXEL(pbDest, pixelB);
-						DESTNEXTPIXEL(pbDest); );
-					runLength = runLength - UNROLL_COUNT;
-				}
-				while (runLength > 0)
-				{
-					DESTWRITEPIXEL(pbDest, pixelA);
-					DESTNEXTPIXEL(pbDest);
-					DESTWRITEPIXEL(pbDest, pixelB);
-					DESTNEXTPIXEL(pbDest);
-					runLength = runLength - 1;
+						DESTNEXTPIXEL(pbDest);
+						n = n - 2;
+					}
+					fPixelB = (n > 0);
+					if (fPixelB)
+					{
+						DESTWRITEPIXEL(pbDest, pixelA);
+						DESTNEXTPIXEL(pbDest);
+					}
+					RLE_NEXT_ROW();
 				}
 				break;
 
@@ -437,18 +507,23 @@ void RLEDECOMPRESS(uint8* pbSrcBuffer, uint32 cbSrcBuffer, uint8* pbDestBuffer,
 				pbSrc = pbSrc + advance;
 				SRCREADPIXEL(pixelA, pbSrc);
 				SRCNEXTPIXEL(pbSrc);
-				while (runLength >= UNROLL_COUNT)
-				{
-					UNROLL(
-						DESTWRITEPIXEL(pbDest, pixelA);
-						DESTNEXTPIXEL(pbDest); );
-					runLength = runLength - UNROLL_COUNT;
-				}
 				while (runLength > 0)
 				{
-					DESTWRITEPIXEL(pbDest, pixelA);
-					DESTNEXTPIXEL(pbDest);
-					runLength = runLength - 1;
+					RLE_PIECE(n, runLength);
+					while (n >= UNROLL_COUNT)
+					{
+						UNROLL(
+							DESTWRITEPIXEL(pbDest, pixelA);
+							DESTNEXTPIXEL(pbDest); );
+						n = n - UNROLL_COUNT;
+					}
+					while (n > 0)
+					{
+						DESTWRITEPIXEL(pbDest, pixelA);
+						DESTNEXTPIXEL(pbDest);
+						n = n - 1;
+					}
+					RLE_NEXT_ROW();
 				}
 				break;
 
@@ -464,38 +539,29 @@ void RLEDECOMPRESS(uint8* pbSrcBuffer, uint32 cbSrcBuffer, uint8* pbDestBuffer,
 					SRCREADPIXEL(fgPel, pbSrc);
 					SRCNEXTPIXEL(pbSrc);
 				}
-				if (fFirstLine)
+				while (runLength > 8)
 				{
-					while (runLength > 8)
+					if (rowLeft >= 8)
 					{
-						bitmask = *pbSrc;
-						pbSrc = pbSrc + 1;
-						pbDest = WRITEFIRSTLINEFGBGIMAGE(pbDest, bitmask, fgPel, 8);
-						runLength = runLength - 8;
+						/* the whole byte fits in the row */
+						if (fFirstLine)
+							pbDest = WRITEFIRSTLINEFGBGIMAGE(pbDest, *pbSrc, fgPel, 8);
+						else
+							pbDest = WRITEFGBGIMAGE(pbDest, rowDelta, *pbSrc, fgPel, 8);
+						rowLeft = rowLeft - 8;
+						RLE_NEXT_ROW();
 					}
-				}
-				else
-				{
-					while (runLength > 8)
+					else
 					{
-						bitmask = *pbSrc;
-						pbSrc = pbSrc + 1;
-						pbDest = WRITEFGBGIMAGE(pbDest, rowDelta, bitmask, fgPel, 8);
-						runLength = runLength - 8;
+						RLE_FGBG_BITS(*pbSrc, 8);
 					}
+					pbSrc = pbSrc + 1;
+					runLength = runLength - 8;
 				}
 				if (runLength > 0)
 				{
-					bitmask = *pbSrc;
+					RLE_FGBG_BITS(*pbSrc, runLength);
 					pbSrc = pbSrc + 1;
-					if (fFirstLine)
-					{
-						pbDest = WRITEFIRSTLINEFGBGIMAGE(pbDest, bitmask, fgPel, runLength);
-					}
-					else
-					{
-						pbDest = WRITEFGBGIMAGE(pbDest, rowDelta, bitmask, fgPel, runLength);
-					}
 				}
 				break;
 
@@ -504,49 +570,40 @@ void RLEDECOMPRESS(uint8* pbSrcBuffer, uint32 cbSrcBuffer, uint8* pbDestBuffer,
 			case MEGA_MEGA_COLOR_IMAGE:
 				runLength = ExtractRunLength(code, pbSrc, &advance);
 				pbSrc = pbSrc + advance;
-				while (runLength >= UNROLL_COUNT)
+				while (runLength > 0)
 				{
-					UNROLL(
+					RLE_PIECE(n, runLength);
+					while (n >= UNROLL_COUNT)
+					{
+						UNROLL(
+							SRCREADPIXEL(temp, pbSrc);
+							SRCNEXTPIXEL(pbSrc);
+							DESTWRITEPIXEL(pbDest, temp);
+							DESTNEXTPIXEL(pbDest); );
+						n = n - UNROLL_COUNT;
+					}
+					while (n > 0)
+					{
 						SRCREADPIXEL(temp, pbSrc);
 						SRCNEXTPIXEL(pbSrc);
 						DESTWRITEPIXEL(pbDest, temp);
-						DESTNEXTPIXEL(pbDest); );
-					runLength = runLength - UNROLL_COUNT;
-				}
-				while (runLength > 0)
-				{
-					SRCREADPIXEL(temp, pbSrc);
-					SRCNEXTPIXEL(pbSrc);
-					DESTWRITEPIXEL(pbDest, temp);
-					DESTNEXTPIXEL(pbDest);
-					runLength = runLength - 1;
+						DESTNEXTPIXEL(pbDest);
+						n = n - 1;
+					}
+					RLE_NEXT_ROW();
 				}
 				break;
 
 			/* Handle Special Order 1. */
 			case SPECIAL_FGBG_1:
 				pbSrc = pbSrc + 1;
-				if (fFirstLine)
-				{
-					pbDest = WRITEFIRSTLINEFGBGIMAGE(pbDest, g_MaskSpecialFgBg1, fgPel, 8);
-				}
-				else
-				{
-					pbDest = WRITEFGBGIMAGE(pbDest, rowDelta, g_MaskSpecialFgBg1, fgPel, 8);
-				}
+				RLE_FGBG_BITS(g_MaskSpecialFgBg1, 8);
 				break;
 
 			/* Handle Special Order 2. */
 			case SPECIAL_FGBG_2:
 				pbSrc = pbSrc + 1;
-				if (fFirstLine)
-				{
-					pbDest = WRITEFIRSTLINEFGBGIMAGE(pbDest, g_MaskSpecialFgBg2, fgPel, 8);
-				}
-				else
-				{
-					pbDest = WRITEFGBGIMAGE(pbDest, rowDelta, g_MaskSpecialFgBg2, fgPel, 8);
-				}
+				RLE_FGBG_BITS(g_MaskSpecialFgBg2, 8);
 				break;
 
 				/* Handle White Order. */
@@ -554,6 +611,8 @@ void RLEDECOMPRESS(uint8* pbSrcBuffer, uint32 cbSrcBuffer, uint8* pbDestBuffer,
 				pbSrc = pbSrc + 1;
 				DESTWRITEPIXEL(pbDest, WHITE_PIXEL);
 				DESTNEXTPIXEL(pbDest);
+				rowLeft = rowLeft - 1;
+				RLE_NEXT_ROW();
 				break;
 
 			/* Handle Black Order. */
@@ -561,7 +620,17 @@ void RLEDECOMPRESS(uint8* pbSrcBuffer, uint32 cbSrcBuffer, uint8* pbDestBuffer,
 				pbSrc = pbSrc + 1;
 				DESTWRITEPIXEL(pbDest, BLACK_PIXEL);
 				DESTNEXTPIXEL(pbDest);
+				rowLeft = rowLeft - 1;
+				RLE_NEXT_ROW();
 				break;
+
+			/* An unknown order would never advance, the stream is corrupt. */
+			default:
+				return;
 		}
 	}
 }
+
+#undef RLE_PIECE
+#undef RLE_NEXT_ROW
+#undef RLE_FGBG_BITS
@@ -0,0 +1,96 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Image Color Conversion Kernels
+ *
+ * Copyright 2014 Jay Sorg <jay.sorg@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* do not include this file directly! */
+
+/**
+ * The including file defines the vector type and operations:
+ * CLR_VEC, CLR_VEC_SIZE (bytes), CLR_LOAD, CLR_STORE (unaligned),
+ * CLR_SET16, CLR_SET32, CLR_AND, CLR_OR, CLR_SRL16, CLR_SLL16,
+ * CLR_INTERLEAVE16 (16 bit lanes of two vectors into two vectors of
+ * 32 bit lanes, in pixel order), plus CLR_NAME for the kernel names.
+ */
+
+/* 5 and 6 bit fields widened to 8 bits, as RGB_555_888 and RGB_565_888 do */
+#define CLR_HIGH_555(_p)	CLR_OR(CLR_AND(CLR_SRL16(_p, 7), CLR_SET16(0xF8)), CLR_AND(CLR_SRL16(_p, 12), CLR_SET16(0x07)))
+#define CLR_MID_555(_p)		CLR_OR(CLR_AND(CLR_SRL16(_p, 2), CLR_SET16(0xF8)), CLR_AND(CLR_SRL16(_p, 7), CLR_SET16(0x07)))
+#define CLR_HIGH_565(_p)	CLR_OR(CLR_AND(CLR_SRL16(_p, 8), CLR_SET16(0xF8)), CLR_SRL16(_p, 13))
+#define CLR_MID_565(_p)		CLR_OR(CLR_AND(CLR_SRL16(_p, 3), CLR_SET16(0xFC)), CLR_AND(CLR_SRL16(_p, 9), CLR_SET16(0x03)))
+#define CLR_LOW_5(_p)		CLR_OR(CLR_AND(CLR_SLL16(_p, 3), CLR_SET16(0xF8)), CLR_AND(CLR_SRL16(_p, 2), CLR_SET16(0x07)))
+
+/**
+ * 15 or 16bpp to 32bpp: _byte0 and _byte2 name the field (h or l) that
+ * goes to byte 0 and byte 2 of the pixel, byte 3 is left at zero.
+ */
+
+#define CLR_KERNEL_16_32(_name, _HIGH, _MID, _byte0, _byte2) \
+static void CLR_NAME(_name)(const uint8* src, uint8* dst, int width, const uint32* lut) \
+{ \
+	int i; \
+	CLR_VEC p, h, m, l, a, b, lo, hi; \
+\
+	for (i = 0; i + CLR_VEC_SIZE / 2 <= width; i += CLR_VEC_SIZE / 2) \
+	{ \
+		p = CLR_LOAD(src + i * 2); \
+		h = _HIGH(p); \
+		m = _MID(p); \
+		l = CLR_LOW_5(p); \
+		a = CLR_OR(_byte0, CLR_SLL16(m, 8)); \
+		b = _byte2; \
+		CLR_INTERLEAVE16(a, b, lo, hi); \
+		CLR_STORE(dst + i * 4, lo); \
+		CLR_STORE(dst + i * 4 + CLR_VEC_SIZE, hi); \
+	} \
+\
+	freerdp_color_lut16_32(src + i * 2, dst + i * 4, width - i, lut); \
+}
+
+CLR_KERNEL_16_32(15_32, CLR_HIGH_555, CLR_MID_555, l, h)
+CLR_KERNEL_16_32(15_32_invert, CLR_HIGH_555, CLR_MID_555, h, l)
+CLR_KERNEL_16_32(16_32, CLR_HIGH_565, CLR_MID_565, l, h)
+CLR_KERNEL_16_32(16_32_invert, CLR_HIGH_565, CLR_MID_565, h, l)
+
+static void CLR_NAME(32_32_alpha)(const uint8* src, uint8* dst, int width, const uint32* lut)
+{
+	int i;
+	CLR_VEC alpha;
+
+	alpha = CLR_SET32(0xFF000000);
+
+	for (i = 0; i + CLR_VEC_SIZE / 4 <= width; i += CLR_VEC_SIZE / 4)
+		CLR_STORE(dst + i * 4, CLR_OR(CLR_LOAD(src + i * 4), alpha));
+
+	freerdp_color_32_32_alpha(src + i * 4, dst + i * 4, width - i, lut);
+}
+
+static void CLR_NAME(init_kernels)(pColorRow* kernels)
+{
+	kernels[COLOR_15_32] = CLR_NAME(15_32);
+	kernels[COLOR_15_32_INVERT] = CLR_NAME(15_32_invert);
+	kernels[COLOR_16_32] = CLR_NAME(16_32);
+	kernels[COLOR_16_32_INVERT] = CLR_NAME(16_32_invert);
+	kernels[COLOR_32_32_ALPHA] = CLR_NAME(32_32_alpha);
+}
+
+#undef CLR_HIGH_555
+#undef CLR_MID_555
+#undef CLR_HIGH_565
+#undef CLR_MID_565
+#undef CLR_LOW_5
+#undef CLR_KERNEL_16_32
@@ -23,6 +23,7 @@
 #include <stdint.h>
 #include <freerdp/codec/nsc.h>
 #include <freerdp/utils/memory.h>
+#include <freerdp/utils/hotpath.h>
 
 /* we store the 9th bits at the end of stream as bitstream */
 void nsc_cl_expand(STREAM* stream, uint8 shiftcount, uint32 origsz)
@@ -358,6 +359,9 @@ NSC_CONTEXT* nsc_context_new(void)
 void nsc_process_message(NSC_CONTEXT* context, uint8* data, uint32 length)
 {
 	STREAM* s;
+	HOTPATH_DEFINE(start);
+
+	HOTPATH_ENTER(start);
 	s = stream_new(0);
 	stream_attach(s, data, length);
 	nsc_context_initialize(context, s);
@@ -377,4 +381,5 @@ void nsc_process_message(NSC_CONTEXT* context, uint8* data, uint32 length)
 
 	/* Combine ARGB planes */
 	nsc_combine_argb(context);
+	HOTPATH_EXIT(start, HOTPATH_NSC_DECODE);
 }
@@ -23,20 +23,27 @@
 #include <stdint.h>
 #include <freerdp/codec/rfx.h>
 #include <freerdp/utils/memory.h>
+#include <freerdp/utils/hotpath.h>
 #include <freerdp/constants.h>
 
 #include "rfx_constants.h"
 #include "rfx_types.h"
 #include "rfx_pool.h"
+#include "rfx_workers.h"
 #include "rfx_decode.h"
 #include "rfx_encode.h"
 #include "rfx_quantization.h"
 #include "rfx_dwt.h"
+#include "rfx_rlgr.h"
 
 #ifdef WITH_SSE2
 #include "rfx_sse2.h"
 #endif
 
+#ifdef WITH_AVX2
+#include "rfx_avx2.h"
+#endif
+
 #ifdef WITH_NEON
 #include "rfx_neon.h"
 #endif
@@ -45,6 +52,10 @@
 #define RFX_INIT_SIMD(_rfx_context) do { } while (0)
 #endif
 
+#ifndef RFX_INIT_AVX2
+#define RFX_INIT_AVX2(_rfx_context) do { } while (0)
+#endif
+
 /**
  * The quantization values control the compression rate and quality. The value
  * range is between 6 and 15. The higher value, the higher compression rate
@@ -140,12 +151,7 @@ RFX_CONTEXT* rfx_context_new(void)
 	/* initialize the default pixel format */
 	rfx_context_set_pixel_format(context, RFX_PIXEL_FORMAT_BGRA);
 
-	/* align buffers to 16 byte boundary (needed for SSE/SSE2 instructions) */
-	context->priv->y_r_buffer = (sint16*)(((uintptr_t)context->priv->y_r_mem + 16) & ~ 0x0F);
-	context->priv->cb_g_buffer = (sint16*)(((uintptr_t)context->priv->cb_g_mem + 16) & ~ 0x0F);
-	context->priv->cr_b_buffer = (sint16*)(((uintptr_t)context->priv->cr_b_mem + 16) & ~ 0x0F);
-
-	context->priv->dwt_buffer = (sint16*)(((uintptr_t)context->priv->dwt_mem + 16) & ~ 0x0F);
+	context->priv->scratch = rfx_scratch_new();
 
 	/* create profilers for default decoding routines */
 	rfx_profiler_create(context);
@@ -157,6 +163,8 @@ RFX_CONTEXT* rfx_context_new(void)
 	context->quantization_encode = rfx_quantization_encode;	
 	context->dwt_2d_decode = rfx_dwt_2d_decode;
 	context->dwt_2d_encode = rfx_dwt_2d_encode;
+	context->rlgr_decode = rfx_rlgr_decode_fast;
+	context->rlgr_encode = rfx_rlgr_encode_fast;
 
 	return context;
 }
@@ -166,6 +174,10 @@ void rfx_context_set_cpu_opt(RFX_CONTEXT* context, uint32 cpu_opt)
 	/* enable SIMD CPU acceleration if detected */
 	if (cpu_opt & CPU_SSE2)
 		RFX_INIT_SIMD(context);
+
+	/* the AVX2 kernels replace the SSE2 ones where the CPU has both */
+	if (cpu_opt & CPU_AVX2)
+		RFX_INIT_AVX2(context);
 }
 
 void rfx_context_free(RFX_CONTEXT* context)
@@ -174,6 +186,13 @@ void rfx_context_free(RFX_CONTEXT* context)
 
 	rfx_pool_free(context->priv->pool);
 
+	rfx_context_set_threads(context, 0);
+	rfx_scratch_free(context->priv->scratch);
+
+	xfree(context->priv->tile_hashes);
+	xfree(context->priv->tile_list);
+	xfree(context->priv->tile_rects);
+
 	rfx_profiler_print(context);
 	rfx_profiler_free(context);
 
@@ -210,10 +229,83 @@ void rfx_context_set_pixel_format(RFX_CONTEXT* context, RFX_PIXEL_FORMAT pixel_f
 	}
 }
 
+/**
+ * Encode and decode tiles on a pool of worker threads. Encoded tiles are
+ * still written to the stream in order, so the output is the same as in
+ * serial mode.
+ * @param context RemoteFX context
+ * @param num_threads number of worker threads, 0 to encode serially
+ */
+
+void rfx_context_set_threads(RFX_CONTEXT* context, int num_threads)
+{
+	int i;
+
+	if (context->priv->workers != NULL)
+	{
+		rfx_workers_free(context->priv->workers);
+		context->priv->workers = NULL;
+	}
+
+	for (i = 0; i < context->priv->num_tile_streams; i++)
+		stream_free(context->priv->tile_streams[i]);
+
+	xfree(context->priv->tile_streams);
+	context->priv->tile_streams = NULL;
+	context->priv->num_tile_streams = 0;
+
+	xfree(context->priv->tile_info);
+	context->priv->tile_info = NULL;
+	context->priv->tile_info_size = 0;
+
+	if (num_threads > 0)
+		context->priv->workers = rfx_workers_new(num_threads);
+}
+
+/**
+ * Remember a hash of every tile sent and only encode the tiles that changed.
+ * The region of each message then covers just the changed tiles, so every
+ * tile of image_data must hold valid pixels, and successive frames must be
+ * passed with the same origin, usually the whole screen.
+ * @param context RemoteFX context
+ * @param enable true to enable the tile cache
+ */
+
+void rfx_context_set_tile_cache(RFX_CONTEXT* context, boolean enable)
+{
+	RFX_CONTEXT_PRIV* priv = context->priv;
+
+	xfree(priv->tile_hashes);
+	priv->tile_hashes = NULL;
+	priv->tile_hash_cols = 0;
+	priv->tile_hash_rows = 0;
+	priv->tile_cache = enable;
+
+	if (enable)
+	{
+		priv->tile_hash_cols = (context->width + 63) / 64;
+		priv->tile_hash_rows = (context->height + 63) / 64;
+		priv->tile_hashes = (uint64*) xzalloc(sizeof(uint64) * priv->tile_hash_cols * priv->tile_hash_rows);
+	}
+}
+
+void rfx_context_get_tile_stats(RFX_CONTEXT* context, uint32* encoded, uint32* skipped)
+{
+	*encoded = context->priv->tiles_encoded;
+	*skipped = context->priv->tiles_skipped;
+}
+
 void rfx_context_reset(RFX_CONTEXT* context)
 {
 	context->header_processed = false;
 	context->frame_idx = 0;
+
+	/* the peer starts over with an empty surface */
+	if (context->priv->tile_hashes != NULL)
+	{
+		memset(context->priv->tile_hashes, 0,
+			sizeof(uint64) * context->priv->tile_hash_cols * context->priv->tile_hash_rows);
+	}
 }
 
 static void rfx_process_message_sync(RFX_CONTEXT* context, STREAM* s)
@@ -373,37 +465,68 @@ static void rfx_process_message_region(RFX_CONTEXT* context, RFX_MESSAGE* messag
 	}
 }
 
-static void rfx_process_message_tile(RFX_CONTEXT* context, RFX_TILE* tile, STREAM* s)
+static void rfx_process_message_tile_header(RFX_TILE_INFO* info, RFX_TILE* tile, STREAM* s)
 {
-	uint8 quantIdxY;
-	uint8 quantIdxCb;
-	uint8 quantIdxCr;
 	uint16 xIdx, yIdx;
-	uint16 YLen, CbLen, CrLen;
 
 	/* RFX_TILE */
-	stream_read_uint8(s, quantIdxY); /* quantIdxY (1 byte) */
-	stream_read_uint8(s, quantIdxCb); /* quantIdxCb (1 byte) */
-	stream_read_uint8(s, quantIdxCr); /* quantIdxCr (1 byte) */
+	stream_read_uint8(s, info->quantIdxY); /* quantIdxY (1 byte) */
+	stream_read_uint8(s, info->quantIdxCb); /* quantIdxCb (1 byte) */
+	stream_read_uint8(s, info->quantIdxCr); /* quantIdxCr (1 byte) */
 	stream_read_uint16(s, xIdx); /* xIdx (2 bytes) */
 	stream_read_uint16(s, yIdx); /* yIdx (2 bytes) */
-	stream_read_uint16(s, YLen); /* YLen (2 bytes) */
-	stream_read_uint16(s, CbLen); /* CbLen (2 bytes) */
-	stream_read_uint16(s, CrLen); /* CrLen (2 bytes) */
+	stream_read_uint16(s, info->YLen); /* YLen (2 bytes) */
+	stream_read_uint16(s, info->CbLen); /* CbLen (2 bytes) */
+	stream_read_uint16(s, info->CrLen); /* CrLen (2 bytes) */
 
 	DEBUG_RFX("quantIdxY:%d quantIdxCb:%d quantIdxCr:%d xIdx:%d yIdx:%d YLen:%d CbLen:%d CrLen:%d",
-		quantIdxY, quantIdxCb, quantIdxCr, xIdx, yIdx, YLen, CbLen, CrLen);
+		info->quantIdxY, info->quantIdxCb, info->quantIdxCr, xIdx, yIdx,
+		info->YLen, info->CbLen, info->CrLen);
+
+	info->data = stream_get_tail(s);
 
 	tile->x = xIdx * 64;
 	tile->y = yIdx * 64;
+}
+
+static void rfx_process_message_tile_data(RFX_CONTEXT* context, RFX_SCRATCH* scratch,
+	RFX_TILE_INFO* info, RFX_TILE* tile)
+{
+	STREAM s;
 
-	rfx_decode_rgb(context, s,
-		YLen, context->quants + (quantIdxY * 10),
-		CbLen, context->quants + (quantIdxCb * 10),
-		CrLen, context->quants + (quantIdxCr * 10),
+	s.data = s.p = info->data;
+	s.size = info->YLen + info->CbLen + info->CrLen;
+
+	rfx_decode_rgb_ex(context, scratch, &s,
+		info->YLen, context->quants + (info->quantIdxY * 10),
+		info->CbLen, context->quants + (info->quantIdxCb * 10),
+		info->CrLen, context->quants + (info->quantIdxCr * 10),
 		tile->data);
 }
 
+static void rfx_process_message_tile(RFX_CONTEXT* context, RFX_TILE* tile, STREAM* s)
+{
+	RFX_TILE_INFO info;
+
+	rfx_process_message_tile_header(&info, tile, s);
+	rfx_process_message_tile_data(context, context->priv->scratch, &info, tile);
+}
+
+struct _RFX_DECODE_JOB
+{
+	RFX_CONTEXT* context;
+	RFX_MESSAGE* message;
+};
+typedef struct _RFX_DECODE_JOB RFX_DECODE_JOB;
+
+static void rfx_process_message_tile_job(void* arg, int index, RFX_SCRATCH* scratch)
+{
+	RFX_DECODE_JOB* job = (RFX_DECODE_JOB*) arg;
+
+	rfx_process_message_tile_data(job->context, scratch,
+		&job->context->priv->tile_info[index], job->message->tiles[index]);
+}
+
 static void rfx_process_message_tileset(RFX_CONTEXT* context, RFX_MESSAGE* message, STREAM* s)
 {
 	int i;
@@ -414,6 +537,9 @@ static void rfx_process_message_tileset(RFX_CONTEXT* context, RFX_MESSAGE* messa
 	uint32* quants;
 	uint8 quant;
 	int pos;
+	int num_parsed;
+	RFX_DECODE_JOB job;
+	RFX_CONTEXT_PRIV* priv = context->priv;
 
 	stream_read_uint16(s, subtype); /* subtype (2 bytes) must be set to CBT_TILESET (0xCAC2) */
 
@@ -481,7 +607,15 @@ static void rfx_process_message_tileset(RFX_CONTEXT* context, RFX_MESSAGE* messa
 
 	message->tiles = rfx_pool_get_tiles(context->priv->pool, message->num_tiles);
 
+	if ((priv->workers != NULL || priv->surface != NULL) && priv->tile_info_size < message->num_tiles)
+	{
+		xfree(priv->tile_info);
+		priv->tile_info = (RFX_TILE_INFO*) xmalloc(sizeof(RFX_TILE_INFO) * message->num_tiles);
+		priv->tile_info_size = message->num_tiles;
+	}
+
 	/* tiles */
+	num_parsed = 0;
 	for (i = 0; i < message->num_tiles; i++)
 	{
 		/* RFX_TILE */
@@ -496,10 +630,112 @@ static void rfx_process_message_tileset(RFX_CONTEXT* context, RFX_MESSAGE* messa
 			break;
 		}
 
-		rfx_process_message_tile(context, message->tiles[i], s);
+		/* with workers or a surface, only collect the tile headers here and decode later */
+		if (priv->workers != NULL || priv->surface != NULL)
+			rfx_process_message_tile_header(&priv->tile_info[i], message->tiles[i], s);
+		else
+			rfx_process_message_tile(context, message->tiles[i], s);
+		num_parsed++;
 
 		stream_set_pos(s, pos);
 	}
+
+	if (priv->surface != NULL)
+	{
+		/* the region may come after the tileset, see rfx_process_message_surface_tiles */
+		priv->num_surface_tiles = num_parsed;
+	}
+	else if (priv->workers != NULL && num_parsed > 0)
+	{
+		job.context = context;
+		job.message = message;
+		rfx_workers_run(priv->workers, rfx_process_message_tile_job, &job, num_parsed, priv->scratch);
+	}
+}
+
+/* decode one tile and write the parts of it inside the region to the surface */
+static void rfx_process_message_surface_tile(RFX_CONTEXT* context, RFX_SCRATCH* scratch,
+	RFX_MESSAGE* message, RFX_TILE_INFO* info, RFX_TILE* tile)
+{
+	int i;
+	int x1, y1, x2, y2;
+	int tx, ty;
+	int bpp;
+	boolean decoded;
+	STREAM s;
+	RFX_RECT* rect;
+	RFX_SURFACE* surface = context->priv->surface;
+
+	tx = surface->left + tile->x;
+	ty = surface->top + tile->y;
+	bpp = (surface->format == RFX_PIXEL_FORMAT_BGRA || surface->format == RFX_PIXEL_FORMAT_RGBA) ? 4 : 3;
+	decoded = false;
+
+	for (i = 0; i < message->num_rects; i++)
+	{
+		rect = &message->rects[i];
+
+		/* clip against the tile, the rect and the surface */
+		x1 = MAX(tx, surface->left + rect->x);
+		y1 = MAX(ty, surface->top + rect->y);
+		x2 = MIN(tx + 64, surface->left + rect->x + rect->width);
+		y2 = MIN(ty + 64, surface->top + rect->y + rect->height);
+		x1 = MAX(x1, 0);
+		y1 = MAX(y1, 0);
+		x2 = MIN(x2, surface->width);
+		y2 = MIN(y2, surface->height);
+
+		if (x1 >= x2 || y1 >= y2)
+			continue;
+
+		/* tiles outside of the region are never decoded */
+		if (!decoded)
+		{
+			s.data = s.p = info->data;
+			s.size = info->YLen + info->CbLen + info->CrLen;
+
+			rfx_decode_planes_ex(context, scratch, &s,
+				info->YLen, context->quants + (info->quantIdxY * 10),
+				info->CbLen, context->quants + (info->quantIdxCb * 10),
+				info->CrLen, context->quants + (info->quantIdxCr * 10));
+			decoded = true;
+		}
+
+		rfx_decode_format_rect(scratch->y_r_buffer, scratch->cb_g_buffer, scratch->cr_b_buffer,
+			x1 - tx, y1 - ty, x2 - x1, y2 - y1, surface->format,
+			surface->data + y1 * surface->stride + x1 * bpp, surface->stride);
+	}
+}
+
+static void rfx_process_message_surface_job(void* arg, int index, RFX_SCRATCH* scratch)
+{
+	RFX_DECODE_JOB* job = (RFX_DECODE_JOB*) arg;
+
+	rfx_process_message_surface_tile(job->context, scratch, job->message,
+		&job->context->priv->tile_info[index], job->message->tiles[index]);
+}
+
+static void rfx_process_message_surface_tiles(RFX_CONTEXT* context, RFX_MESSAGE* message)
+{
+	int i;
+	RFX_DECODE_JOB job;
+	RFX_CONTEXT_PRIV* priv = context->priv;
+
+	if (priv->workers != NULL)
+	{
+		job.context = context;
+		job.message = message;
+		rfx_workers_run(priv->workers, rfx_process_message_surface_job, &job,
+			priv->num_surface_tiles, priv->scratch);
+	}
+	else
+	{
+		for (i = 0; i < priv->num_surface_tiles; i++)
+		{
+			rfx_process_message_surface_tile(context, priv->scratch, message,
+				&priv->tile_info[i], message->tiles[i]);
+		}
+	}
 }
 
 RFX_MESSAGE* rfx_process_message(RFX_CONTEXT* context, uint8* data, uint32 length)
@@ -509,7 +745,9 @@ RFX_MESSAGE* rfx_process_message(RFX_CONTEXT* context, uint8* data, uint32 lengt
 	uint32 blockLen;
 	uint32 blockType;
 	RFX_MESSAGE* message;
+	HOTPATH_DEFINE(start);
 
+	HOTPATH_ENTER(start);
 	s = stream_new(0);
 	message = xnew(RFX_MESSAGE);
 	stream_attach(s, data, length);
@@ -583,6 +821,50 @@ RFX_MESSAGE* rfx_process_message(RFX_CONTEXT* context, uint8* data, uint32 lengt
 	stream_detach(s);
 	stream_free(s);
 
+	if (context->priv->surface != NULL && context->priv->num_surface_tiles > 0)
+		rfx_process_message_surface_tiles(context, message);
+
+	HOTPATH_EXIT(start, HOTPATH_RFX_DECODE);
+
+	return message;
+}
+
+/**
+ * Decodes a message straight into the surface at dst, in one of the 24 or
+ * 32 bpp pixel formats. Only the pixels inside the region of the message
+ * are written. The returned message carries the region and the tile
+ * positions, the tile data is left undefined.
+ */
+RFX_MESSAGE* rfx_process_message_to_surface(RFX_CONTEXT* context, uint8* data, uint32 length,
+	uint8* dst, int dst_width, int dst_height, int dst_stride, RFX_PIXEL_FORMAT dst_format,
+	int left, int top)
+{
+	RFX_SURFACE surface;
+	RFX_MESSAGE* message;
+
+	if (dst_format != RFX_PIXEL_FORMAT_BGRA && dst_format != RFX_PIXEL_FORMAT_RGBA &&
+		dst_format != RFX_PIXEL_FORMAT_BGR && dst_format != RFX_PIXEL_FORMAT_RGB)
+	{
+		DEBUG_WARN("unsupported surface format %d", dst_format);
+		return NULL;
+	}
+
+	surface.data = dst;
+	surface.width = dst_width;
+	surface.height = dst_height;
+	surface.stride = dst_stride;
+	surface.format = dst_format;
+	surface.left = left;
+	surface.top = top;
+
+	context->priv->surface = &surface;
+	context->priv->num_surface_tiles = 0;
+
+	message = rfx_process_message(context, data, length);
+
+	context->priv->surface = NULL;
+	context->priv->num_surface_tiles = 0;
+
 	return message;
 }
 
@@ -732,7 +1014,7 @@ static void rfx_compose_message_region(RFX_CONTEXT* context, STREAM* s,
 	stream_write_uint16(s, 1); /* numTilesets */
 }
 
-static void rfx_compose_message_tile(RFX_CONTEXT* context, STREAM* s,
+static void rfx_compose_message_tile(RFX_CONTEXT* context, RFX_SCRATCH* scratch, STREAM* s,
 	uint8* tile_data, int tile_width, int tile_height, int rowstride,
 	const uint32* quantVals, int quantIdxY, int quantIdxCb, int quantIdxCr,
 	int xIdx, int yIdx)
@@ -755,7 +1037,7 @@ static void rfx_compose_message_tile(RFX_CONTEXT* context, STREAM* s,
 
 	stream_seek(s, 6); /* YLen, CbLen, CrLen */
 
-	rfx_encode_rgb(context, tile_data, tile_width, tile_height, rowstride,
+	rfx_encode_rgb_ex(context, scratch, tile_data, tile_width, tile_height, rowstride,
 		quantVals + quantIdxY * 10, quantVals + quantIdxCb * 10, quantVals + quantIdxCr * 10,
 		s, &YLen, &CbLen, &CrLen);
 
@@ -774,9 +1056,100 @@ static void rfx_compose_message_tile(RFX_CONTEXT* context, STREAM* s,
 	stream_set_pos(s, end_pos);
 }
 
+/* a list of tiles to encode, shared by the workers */
+struct _RFX_TILESET_JOB
+{
+	RFX_CONTEXT* context;
+	uint8* image_data;
+	int width;
+	int height;
+	int rowstride;
+	int numTilesX;
+	int numTilesY;
+	const uint32* quantVals;
+	int quantIdxY;
+	int quantIdxCb;
+	int quantIdxCr;
+	const int* tiles; /* yIdx * numTilesX + xIdx */
+	int num_tiles;
+};
+typedef struct _RFX_TILESET_JOB RFX_TILESET_JOB;
+
+/* tiles per parallel encode job */
+#define RFX_TILES_PER_JOB 8
+
+static void rfx_compose_message_tile_range(RFX_TILESET_JOB* job, RFX_SCRATCH* scratch, STREAM* s,
+	int first, int count)
+{
+	int i;
+	int xIdx;
+	int yIdx;
+	RFX_CONTEXT* context = job->context;
+
+	for (i = first; i < first + count; i++)
+	{
+		xIdx = job->tiles[i] % job->numTilesX;
+		yIdx = job->tiles[i] / job->numTilesX;
+
+		rfx_compose_message_tile(context, scratch, s,
+			job->image_data + yIdx * 64 * job->rowstride + xIdx * 8 * context->bits_per_pixel,
+			(xIdx < job->numTilesX - 1) ? 64 : job->width - xIdx * 64,
+			(yIdx < job->numTilesY - 1) ? 64 : job->height - yIdx * 64,
+			job->rowstride, job->quantVals, job->quantIdxY, job->quantIdxCb, job->quantIdxCr,
+			xIdx, yIdx);
+	}
+}
+
+static void rfx_compose_message_tile_job(void* arg, int index, RFX_SCRATCH* scratch)
+{
+	int first;
+	int count;
+	RFX_TILESET_JOB* job = (RFX_TILESET_JOB*) arg;
+	STREAM* s = job->context->priv->tile_streams[index];
+
+	first = index * RFX_TILES_PER_JOB;
+	count = MIN(RFX_TILES_PER_JOB, job->num_tiles - first);
+
+	stream_set_pos(s, 0);
+	rfx_compose_message_tile_range(job, scratch, s, first, count);
+}
+
+static void rfx_compose_message_tiles_parallel(RFX_TILESET_JOB* job, STREAM* s)
+{
+	int i;
+	int size;
+	int num_jobs;
+	RFX_CONTEXT_PRIV* priv = job->context->priv;
+
+	num_jobs = (job->num_tiles + RFX_TILES_PER_JOB - 1) / RFX_TILES_PER_JOB;
+
+	if (priv->num_tile_streams < num_jobs)
+	{
+		if (priv->tile_streams == NULL)
+			priv->tile_streams = (STREAM**) xmalloc(sizeof(STREAM*) * num_jobs);
+		else
+			priv->tile_streams = (STREAM**) xrealloc(priv->tile_streams, sizeof(STREAM*) * num_jobs);
+
+		for (i = priv->num_tile_streams; i < num_jobs; i++)
+			priv->tile_streams[i] = stream_new(RFX_TILES_PER_JOB * 4096);
+
+		priv->num_tile_streams = num_jobs;
+	}
+
+	rfx_workers_run(priv->workers, rfx_compose_message_tile_job, job, num_jobs, priv->scratch);
+
+	for (i = 0; i < num_jobs; i++)
+	{
+		size = stream_get_pos(priv->tile_streams[i]);
+		stream_check_size(s, size);
+		stream_write(s, stream_get_head(priv->tile_streams[i]), size);
+	}
+}
+
 static void rfx_compose_message_tileset(RFX_CONTEXT* context, STREAM* s,
-	uint8* image_data, int width, int height, int rowstride)
+	uint8* image_data, int width, int height, int rowstride, const int* tiles, int numTiles)
 {
+	RFX_TILESET_JOB job;
 	int size;
 	int start_pos, end_pos;
 	int i;
@@ -786,11 +1159,8 @@ static void rfx_compose_message_tileset(RFX_CONTEXT* context, STREAM* s,
 	int quantIdxY;
 	int quantIdxCb;
 	int quantIdxCr;
-	int numTiles;
 	int numTilesX;
 	int numTilesY;
-	int xIdx;
-	int yIdx;
 	int tilesDataSize;
 
 	if (context->num_quants == 0)
@@ -812,7 +1182,6 @@ static void rfx_compose_message_tileset(RFX_CONTEXT* context, STREAM* s,
 
 	numTilesX = (width + 63) / 64;
 	numTilesY = (height + 63) / 64;
-	numTiles = numTilesX * numTilesY;
 
 	size = 22 + numQuants * 5;
 	stream_check_size(s, size);
@@ -839,18 +1208,25 @@ static void rfx_compose_message_tileset(RFX_CONTEXT* context, STREAM* s,
 
 	DEBUG_RFX("width:%d height:%d rowstride:%d", width, height, rowstride);
 
+	job.context = context;
+	job.image_data = image_data;
+	job.width = width;
+	job.height = height;
+	job.rowstride = rowstride;
+	job.numTilesX = numTilesX;
+	job.numTilesY = numTilesY;
+	job.quantVals = quantVals;
+	job.quantIdxY = quantIdxY;
+	job.quantIdxCb = quantIdxCb;
+	job.quantIdxCr = quantIdxCr;
+	job.tiles = tiles;
+	job.num_tiles = numTiles;
+
 	end_pos = stream_get_pos(s);
-	for (yIdx = 0; yIdx < numTilesY; yIdx++)
-	{
-		for (xIdx = 0; xIdx < numTilesX; xIdx++)
-		{
-			rfx_compose_message_tile(context, s,
-				image_data + yIdx * 64 * rowstride + xIdx * 8 * context->bits_per_pixel,
-				(xIdx < numTilesX - 1) ? 64 : width - xIdx * 64,
-				(yIdx < numTilesY - 1) ? 64 : height - yIdx * 64,
-				rowstride, quantVals, quantIdxY, quantIdxCb, quantIdxCr, xIdx, yIdx);
-		}
-	}
+	if (context->priv->workers != NULL && numTiles > RFX_TILES_PER_JOB)
+		rfx_compose_message_tiles_parallel(&job, s);
+	else
+		rfx_compose_message_tile_range(&job, context->priv->scratch, s, 0, numTiles);
 	tilesDataSize = stream_get_pos(s) - end_pos;
 	size += tilesDataSize;
 	end_pos = stream_get_pos(s);
@@ -873,22 +1249,190 @@ static void rfx_compose_message_frame_end(RFX_CONTEXT* context, STREAM* s)
 	stream_write_uint8(s, 0); /* CodecChannelT.channelId */
 }
 
+static uint64 rfx_tile_hash(const uint8* data, int width, int height, int rowstride, int bpp)
+{
+	int x, y;
+	int words;
+	uint32 word;
+	const uint8* row;
+	uint64 h1 = 0xCBF29CE484222325ULL;
+	uint64 h2 = 0x84222325CBF29CE4ULL;
+
+	/* two independent FNV style lanes over 32 bit words */
+	words = (width * bpp / 8) / 4;
+
+	for (y = 0; y < height; y++)
+	{
+		row = data + y * rowstride;
+
+		for (x = 0; x + 1 < words; x += 2)
+		{
+			memcpy(&word, row + x * 4, 4);
+			h1 = (h1 ^ word) * 0x100000001B3ULL;
+			memcpy(&word, row + x * 4 + 4, 4);
+			h2 = (h2 ^ word) * 0x100000001B3ULL;
+		}
+
+		for (x = x * 4; x < width * bpp / 8; x++)
+			h1 = (h1 ^ row[x]) * 0x100000001B3ULL;
+	}
+
+	h1 ^= (h2 >> 29) ^ (h2 << 35);
+
+	/* zero marks an unknown tile */
+	return (h1 == 0) ? 1 : h1;
+}
+
+/**
+ * Pick the tiles of the image to encode. Without the tile cache that is
+ * every tile. With it, only the tiles touching rects whose hash differs
+ * from the last frame, and one region rectangle per run of changed tiles
+ * in a row.
+ * @return number of tiles in priv->tile_list
+ */
+
+static boolean rfx_tile_in_rects(const RFX_RECT* rects, int num_rects, int xIdx, int yIdx)
+{
+	int i;
+
+	for (i = 0; i < num_rects; i++)
+	{
+		if (rects[i].x < (xIdx + 1) * 64 && rects[i].x + rects[i].width > xIdx * 64 &&
+			rects[i].y < (yIdx + 1) * 64 && rects[i].y + rects[i].height > yIdx * 64)
+			return true;
+	}
+
+	return false;
+}
+
+static int rfx_compose_message_select_tiles(RFX_CONTEXT* context, const RFX_RECT* rects, int num_rects,
+	uint8* image_data, int width, int height, int rowstride)
+{
+	int xIdx, yIdx;
+	int index;
+	int numTiles;
+	int numTilesX;
+	int numTilesY;
+	int tile_width;
+	int tile_height;
+	int run_start;
+	uint64 hash;
+	boolean changed;
+	RFX_RECT* rect;
+	RFX_CONTEXT_PRIV* priv = context->priv;
+
+	numTilesX = (width + 63) / 64;
+	numTilesY = (height + 63) / 64;
+	numTiles = numTilesX * numTilesY;
+
+	if (priv->tile_list_size < numTiles)
+	{
+		xfree(priv->tile_list);
+		priv->tile_list = (int*) xmalloc(sizeof(int) * numTiles);
+		xfree(priv->tile_rects);
+		priv->tile_rects = (RFX_RECT*) xmalloc(sizeof(RFX_RECT) * numTiles);
+		priv->tile_list_size = numTiles;
+	}
+
+	priv->num_tile_rects = 0;
+
+	if (!priv->tile_cache)
+	{
+		for (index = 0; index < numTiles; index++)
+			priv->tile_list[index] = index;
+
+		return numTiles;
+	}
+
+	index = 0;
+
+	for (yIdx = 0; yIdx < numTilesY; yIdx++)
+	{
+		tile_height = (yIdx < numTilesY - 1) ? 64 : height - yIdx * 64;
+		run_start = -1;
+
+		for (xIdx = 0; xIdx <= numTilesX; xIdx++)
+		{
+			changed = false;
+
+			if (xIdx < numTilesX && rfx_tile_in_rects(rects, num_rects, xIdx, yIdx))
+			{
+				tile_width = (xIdx < numTilesX - 1) ? 64 : width - xIdx * 64;
+				hash = rfx_tile_hash(image_data + yIdx * 64 * rowstride + xIdx * 8 * context->bits_per_pixel,
+					tile_width, tile_height, rowstride, context->bits_per_pixel);
+
+				/* tiles outside the cache grid are always sent */
+				if (xIdx >= priv->tile_hash_cols || yIdx >= priv->tile_hash_rows)
+				{
+					changed = true;
+				}
+				else if (priv->tile_hashes[yIdx * priv->tile_hash_cols + xIdx] != hash)
+				{
+					priv->tile_hashes[yIdx * priv->tile_hash_cols + xIdx] = hash;
+					changed = true;
+				}
+			}
+
+			if (changed)
+			{
+				priv->tile_list[index++] = yIdx * numTilesX + xIdx;
+
+				if (run_start < 0)
+					run_start = xIdx;
+			}
+			else if (run_start >= 0)
+			{
+				rect = &priv->tile_rects[priv->num_tile_rects++];
+				rect->x = run_start * 64;
+				rect->y = yIdx * 64;
+				rect->width = MIN(xIdx * 64, width) - rect->x;
+				rect->height = tile_height;
+				run_start = -1;
+			}
+		}
+	}
+
+	priv->tiles_encoded += index;
+	priv->tiles_skipped += numTiles - index;
+
+	DEBUG_RFX("tile cache: %d of %d tiles changed", index, numTiles);
+
+	return index;
+}
+
 static void rfx_compose_message_data(RFX_CONTEXT* context, STREAM* s,
-	const RFX_RECT* rects, int num_rects, uint8* image_data, int width, int height, int rowstride)
+	const RFX_RECT* rects, int num_rects, uint8* image_data, int width, int height, int rowstride,
+	int numTiles)
 {
 	rfx_compose_message_frame_begin(context, s);
 	rfx_compose_message_region(context, s, rects, num_rects);
-	rfx_compose_message_tileset(context, s, image_data, width, height, rowstride);
+	rfx_compose_message_tileset(context, s, image_data, width, height, rowstride,
+		context->priv->tile_list, numTiles);
 	rfx_compose_message_frame_end(context, s);
 }
 
 FREERDP_API void rfx_compose_message(RFX_CONTEXT* context, STREAM* s,
 	const RFX_RECT* rects, int num_rects, uint8* image_data, int width, int height, int rowstride)
 {
+	int numTiles;
+
+	numTiles = rfx_compose_message_select_tiles(context, rects, num_rects,
+		image_data, width, height, rowstride);
+
+	/* nothing changed since the last frame, send nothing */
+	if (numTiles == 0)
+		return;
+
 	/* Only the first frame should send the RemoteFX header */
 	if (context->frame_idx == 0 && !context->header_processed)
 		rfx_compose_message_header(context, s);
 
-	rfx_compose_message_data(context, s, rects, num_rects, image_data, width, height, rowstride);
-}
+	if (context->priv->tile_cache)
+	{
+		rects = context->priv->tile_rects;
+		num_rects = context->priv->num_tile_rects;
+	}
 
+	rfx_compose_message_data(context, s, rects, num_rects, image_data, width, height, rowstride,
+		numTiles);
+}
@@ -0,0 +1,682 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol client.
+ * RemoteFX Codec Library - AVX2 Optimizations
+ *
+ * Copyright 2014 Jay Sorg <jay.sorg@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * 16 lane versions of the SSE2 kernels in rfx_sse2.c. The arithmetic is
+ * the same, so the results match the SSE2 code exactly. Sub-bands that are
+ * only 8 coefficients wide are done 8 lanes at a time.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <immintrin.h>
+
+#include "rfx_types.h"
+#include "rfx_avx2.h"
+
+#ifdef _MSC_VER
+#define	__attribute__(...)
+#endif
+
+#define _mm256_between_epi16(_val, _min, _max) \
+	do { _val = _mm256_min_epi16(_max, _mm256_max_epi16(_val, _min)); } while (0)
+
+/* [a1 .. a15, 0], 16 bit elements across the two lanes */
+#define _mm256_shift_down_epi16(_a) \
+	_mm256_alignr_epi8(_mm256_permute2x128_si256(_a, _a, 0x81), _a, 2)
+
+/* [0, a0 .. a14] */
+#define _mm256_shift_up_epi16(_a) \
+	_mm256_alignr_epi8(_a, _mm256_permute2x128_si256(_a, _a, 0x08), 14)
+
+static void rfx_decode_ycbcr_to_rgb_avx2(sint16* y_r_buffer, sint16* cb_g_buffer, sint16* cr_b_buffer)
+{
+	__m256i zero = _mm256_setzero_si256();
+	__m256i max = _mm256_set1_epi16(255);
+
+	__m256i* y_r_buf = (__m256i*) y_r_buffer;
+	__m256i* cb_g_buf = (__m256i*) cb_g_buffer;
+	__m256i* cr_b_buf = (__m256i*) cr_b_buffer;
+
+	__m256i y;
+	__m256i cr;
+	__m256i cb;
+	__m256i r;
+	__m256i g;
+	__m256i b;
+
+	int i;
+
+	__m256i r_cr = _mm256_set1_epi16(22986);	//  1.403 << 14
+	__m256i g_cb = _mm256_set1_epi16(-5636);	// -0.344 << 14
+	__m256i g_cr = _mm256_set1_epi16(-11698);	// -0.714 << 14
+	__m256i b_cb = _mm256_set1_epi16(28999);	//  1.770 << 14
+	__m256i c4096 = _mm256_set1_epi16(4096);
+
+	for (i = 0; i < (4096 * sizeof(sint16) / sizeof(__m256i)); i++)
+	{
+		/* see rfx_decode_ycbcr_to_rgb_sse2 for the fixed point math */
+
+		/* y = (y_r_buf[i] + 4096) >> 2 */
+		y = _mm256_loadu_si256(&y_r_buf[i]);
+		y = _mm256_add_epi16(y, c4096);
+		y = _mm256_srai_epi16(y, 2);
+		cb = _mm256_loadu_si256(&cb_g_buf[i]);
+		cr = _mm256_loadu_si256(&cr_b_buf[i]);
+
+		/* (y + HIWORD(cr*22986)) >> 3 */
+		r = _mm256_add_epi16(y, _mm256_mulhi_epi16(cr, r_cr));
+		r = _mm256_srai_epi16(r, 3);
+		_mm256_between_epi16(r, zero, max);
+		_mm256_storeu_si256(&y_r_buf[i], r);
+
+		/* (y + HIWORD(cb*-5636) + HIWORD(cr*-11698)) >> 3 */
+		g = _mm256_add_epi16(y, _mm256_mulhi_epi16(cb, g_cb));
+		g = _mm256_add_epi16(g, _mm256_mulhi_epi16(cr, g_cr));
+		g = _mm256_srai_epi16(g, 3);
+		_mm256_between_epi16(g, zero, max);
+		_mm256_storeu_si256(&cb_g_buf[i], g);
+
+		/* (y + HIWORD(cb*28999)) >> 3 */
+		b = _mm256_add_epi16(y, _mm256_mulhi_epi16(cb, b_cb));
+		b = _mm256_srai_epi16(b, 3);
+		_mm256_between_epi16(b, zero, max);
+		_mm256_storeu_si256(&cr_b_buf[i], b);
+	}
+}
+
+static void rfx_encode_rgb_to_ycbcr_avx2(sint16* y_r_buffer, sint16* cb_g_buffer, sint16* cr_b_buffer)
+{
+	__m256i min = _mm256_set1_epi16(-128 << 5);
+	__m256i max = _mm256_set1_epi16(127 << 5);
+
+	__m256i* y_r_buf = (__m256i*) y_r_buffer;
+	__m256i* cb_g_buf = (__m256i*) cb_g_buffer;
+	__m256i* cr_b_buf = (__m256i*) cr_b_buffer;
+
+	__m256i y;
+	__m256i cr;
+	__m256i cb;
+	__m256i r;
+	__m256i g;
+	__m256i b;
+
+	__m256i y_r  = _mm256_set1_epi16(9798);   //  0.299000 << 15
+	__m256i y_g  = _mm256_set1_epi16(19235);  //  0.587000 << 15
+	__m256i y_b  = _mm256_set1_epi16(3735);   //  0.114000 << 15
+	__m256i cb_r = _mm256_set1_epi16(-5535);  // -0.168935 << 15
+	__m256i cb_g = _mm256_set1_epi16(-10868); // -0.331665 << 15
+	__m256i cb_b = _mm256_set1_epi16(16403);  //  0.500590 << 15
+	__m256i cr_r = _mm256_set1_epi16(16377);  //  0.499813 << 15
+	__m256i cr_g = _mm256_set1_epi16(-13714); // -0.418531 << 15
+	__m256i cr_b = _mm256_set1_epi16(-2663);  // -0.081282 << 15
+
+	int i;
+
+	for (i = 0; i < (4096 * sizeof(sint16) / sizeof(__m256i)); i++)
+	{
+		/* see rfx_encode_rgb_to_ycbcr_sse2 for the fixed point math */
+
+		r = _mm256_loadu_si256(&y_r_buf[i]);
+		g = _mm256_loadu_si256(&cb_g_buf[i]);
+		b = _mm256_loadu_si256(&cr_b_buf[i]);
+
+		/* r<<6; g<<6; b<<6 */
+		r = _mm256_slli_epi16(r, 6);
+		g = _mm256_slli_epi16(g, 6);
+		b = _mm256_slli_epi16(b, 6);
+
+		/* y = HIWORD(r*y_r) + HIWORD(g*y_g) + HIWORD(b*y_b) + min */
+		y = _mm256_mulhi_epi16(r, y_r);
+		y = _mm256_add_epi16(y, _mm256_mulhi_epi16(g, y_g));
+		y = _mm256_add_epi16(y, _mm256_mulhi_epi16(b, y_b));
+		y = _mm256_add_epi16(y, min);
+		_mm256_between_epi16(y, min, max);
+		_mm256_storeu_si256(&y_r_buf[i], y);
+
+		/* cb = HIWORD(r*cb_r) + HIWORD(g*cb_g) + HIWORD(b*cb_b) */
+		cb = _mm256_mulhi_epi16(r, cb_r);
+		cb = _mm256_add_epi16(cb, _mm256_mulhi_epi16(g, cb_g));
+		cb = _mm256_add_epi16(cb, _mm256_mulhi_epi16(b, cb_b));
+		_mm256_between_epi16(cb, min, max);
+		_mm256_storeu_si256(&cb_g_buf[i], cb);
+
+		/* cr = HIWORD(r*cr_r) + HIWORD(g*cr_g) + HIWORD(b*cr_b) */
+		cr = _mm256_mulhi_epi16(r, cr_r);
+		cr = _mm256_add_epi16(cr, _mm256_mulhi_epi16(g, cr_g));
+		cr = _mm256_add_epi16(cr, _mm256_mulhi_epi16(b, cr_b));
+		_mm256_between_epi16(cr, min, max);
+		_mm256_storeu_si256(&cr_b_buf[i], cr);
+	}
+}
+
+static __inline void __attribute__((__gnu_inline__, __always_inline__, __artificial__))
+rfx_quantization_decode_block_avx2(sint16* buffer, const int buffer_size, const uint32 factor)
+{
+	__m256i a;
+	__m256i* ptr = (__m256i*) buffer;
+	__m256i* buf_end = (__m256i*) (buffer + buffer_size);
+
+	if (factor == 0)
+		return;
+
+	do
+	{
+		a = _mm256_loadu_si256(ptr);
+		a = _mm256_slli_epi16(a, factor);
+		_mm256_storeu_si256(ptr, a);
+
+		ptr++;
+	} while(ptr < buf_end);
+}
+
+static void rfx_quantization_decode_avx2(sint16* buffer, const uint32* quantization_values)
+{
+	rfx_quantization_decode_block_avx2(buffer, 4096, 5);
+
+	rfx_quantization_decode_block_avx2(buffer, 1024, quantization_values[8] - 6); /* HL1 */
+	rfx_quantization_decode_block_avx2(buffer + 1024, 1024, quantization_values[7] - 6); /* LH1 */
+	rfx_quantization_decode_block_avx2(buffer + 2048, 1024, quantization_values[9] - 6); /* HH1 */
+	rfx_quantization_decode_block_avx2(buffer + 3072, 256, quantization_values[5] - 6); /* HL2 */
+	rfx_quantization_decode_block_avx2(buffer + 3328, 256, quantization_values[4] - 6); /* LH2 */
+	rfx_quantization_decode_block_avx2(buffer + 3584, 256, quantization_values[6] - 6); /* HH2 */
+	rfx_quantization_decode_block_avx2(buffer + 3840, 64, quantization_values[2] - 6); /* HL3 */
+	rfx_quantization_decode_block_avx2(buffer + 3904, 64, quantization_values[1] - 6); /* LH3 */
+	rfx_quantization_decode_block_avx2(buffer + 3968, 64, quantization_values[3] - 6); /* HH3 */
+	rfx_quantization_decode_block_avx2(buffer + 4032, 64, quantization_values[0] - 6); /* LL3 */
+}
+
+static __inline void __attribute__((__gnu_inline__, __always_inline__, __artificial__))
+rfx_quantization_encode_block_avx2(sint16* buffer, const int buffer_size, const uint32 factor)
+{
+	__m256i a;
+	__m256i* ptr = (__m256i*) buffer;
+	__m256i* buf_end = (__m256i*) (buffer + buffer_size);
+	__m256i half;
+
+	if (factor == 0)
+		return;
+
+	half = _mm256_set1_epi16(1 << (factor - 1));
+	do
+	{
+		a = _mm256_loadu_si256(ptr);
+		a = _mm256_add_epi16(a, half);
+		a = _mm256_srai_epi16(a, factor);
+		_mm256_storeu_si256(ptr, a);
+
+		ptr++;
+	} while(ptr < buf_end);
+}
+
+static void rfx_quantization_encode_avx2(sint16* buffer, const uint32* quantization_values)
+{
+	rfx_quantization_encode_block_avx2(buffer, 1024, quantization_values[8] - 6); /* HL1 */
+	rfx_quantization_encode_block_avx2(buffer + 1024, 1024, quantization_values[7] - 6); /* LH1 */
+	rfx_quantization_encode_block_avx2(buffer + 2048, 1024, quantization_values[9] - 6); /* HH1 */
+	rfx_quantization_encode_block_avx2(buffer + 3072, 256, quantization_values[5] - 6); /* HL2 */
+	rfx_quantization_encode_block_avx2(buffer + 3328, 256, quantization_values[4] - 6); /* LH2 */
+	rfx_quantization_encode_block_avx2(buffer + 3584, 256, quantization_values[6] - 6); /* HH2 */
+	rfx_quantization_encode_block_avx2(buffer + 3840, 64, quantization_values[2] - 6); /* HL3 */
+	rfx_quantization_encode_block_avx2(buffer + 3904, 64, quantization_values[1] - 6); /* LH3 */
+	rfx_quantization_encode_block_avx2(buffer + 3968, 64, quantization_values[3] - 6); /* HH3 */
+	rfx_quantization_encode_block_avx2(buffer + 4032, 64, quantization_values[0] - 6); /* LL3 */
+
+	rfx_quantization_encode_block_avx2(buffer, 4096, 5);
+}
+
+/* one row of an 8 coefficient wide sub-band */
+static __inline void __attribute__((__gnu_inline__, __always_inline__, __artificial__))
+rfx_dwt_2d_decode_row_horiz_8(sint16* l_ptr, sint16* h_ptr, sint16* dst_ptr)
+{
+	__m128i l_n;
+	__m128i h_n;
+	__m128i h_n_m;
+	__m128i tmp_n;
+	__m128i dst_n;
+	__m128i dst_n_p;
+
+	/* dst[2n] = l[n] - ((h[n-1] + h[n] + 1) >> 1); */
+	l_n = _mm_loadu_si128((__m128i*) l_ptr);
+	h_n = _mm_loadu_si128((__m128i*) h_ptr);
+	h_n_m = _mm_insert_epi16(_mm_slli_si128(h_n, 2), h_ptr[0], 0);
+
+	tmp_n = _mm_add_epi16(h_n, h_n_m);
+	tmp_n = _mm_add_epi16(tmp_n, _mm_set1_epi16(1));
+	tmp_n = _mm_srai_epi16(tmp_n, 1);
+	dst_n = _mm_sub_epi16(l_n, tmp_n);
+
+	/* dst[2n + 1] = (h[n] << 1) + ((dst[2n] + dst[2n + 2]) >> 1); */
+	h_n = _mm_slli_epi16(h_n, 1);
+	dst_n_p = _mm_insert_epi16(_mm_srli_si128(dst_n, 2), _mm_extract_epi16(dst_n, 7), 7);
+
+	tmp_n = _mm_add_epi16(dst_n_p, dst_n);
+	tmp_n = _mm_srai_epi16(tmp_n, 1);
+	tmp_n = _mm_add_epi16(tmp_n, h_n);
+
+	_mm_storeu_si128((__m128i*) dst_ptr, _mm_unpacklo_epi16(dst_n, tmp_n));
+	_mm_storeu_si128((__m128i*) (dst_ptr + 8), _mm_unpackhi_epi16(dst_n, tmp_n));
+}
+
+static __inline void __attribute__((__gnu_inline__, __always_inline__, __artificial__))
+rfx_dwt_2d_decode_block_horiz_avx2(sint16* l, sint16* h, sint16* dst, int subband_width)
+{
+	int y, n;
+	sint16* l_ptr = l;
+	sint16* h_ptr = h;
+	sint16* dst_ptr = dst;
+	__m256i l_n;
+	__m256i h_n;
+	__m256i h_n_m;
+	__m256i tmp_n;
+	__m256i dst_n;
+	__m256i dst_n_p;
+	__m256i dst1;
+	__m256i dst2;
+
+	if (subband_width == 8)
+	{
+		for (y = 0; y < subband_width; y++)
+			rfx_dwt_2d_decode_row_horiz_8(l + y * 8, h + y * 8, dst + y * 16);
+		return;
+	}
+
+	for (y = 0; y < subband_width; y++)
+	{
+		/* Even coefficients */
+		for (n = 0; n < subband_width; n += 16)
+		{
+			/* dst[2n] = l[n] - ((h[n-1] + h[n] + 1) >> 1); */
+
+			l_n = _mm256_loadu_si256((__m256i*) l_ptr);
+			h_n = _mm256_loadu_si256((__m256i*) h_ptr);
+
+			if (n == 0)
+				h_n_m = _mm256_insert_epi16(_mm256_shift_up_epi16(h_n), h_ptr[0], 0);
+			else
+				h_n_m = _mm256_loadu_si256((__m256i*) (h_ptr - 1));
+
+			tmp_n = _mm256_add_epi16(h_n, h_n_m);
+			tmp_n = _mm256_add_epi16(tmp_n, _mm256_set1_epi16(1));
+			tmp_n = _mm256_srai_epi16(tmp_n, 1);
+
+			dst_n = _mm256_sub_epi16(l_n, tmp_n);
+
+			_mm256_storeu_si256((__m256i*) l_ptr, dst_n);
+
+			l_ptr += 16;
+			h_ptr += 16;
+		}
+		l_ptr -= subband_width;
+		h_ptr -= subband_width;
+
+		/* Odd coefficients */
+		for (n = 0; n < subband_width; n += 16)
+		{
+			/* dst[2n + 1] = (h[n] << 1) + ((dst[2n] + dst[2n + 2]) >> 1); */
+
+			h_n = _mm256_loadu_si256((__m256i*) h_ptr);
+			h_n = _mm256_slli_epi16(h_n, 1);
+
+			dst_n = _mm256_loadu_si256((__m256i*) l_ptr);
+
+			if (n == subband_width - 16)
+				dst_n_p = _mm256_insert_epi16(_mm256_shift_down_epi16(dst_n), l_ptr[15], 15);
+			else
+				dst_n_p = _mm256_loadu_si256((__m256i*) (l_ptr + 1));
+
+			tmp_n = _mm256_add_epi16(dst_n_p, dst_n);
+			tmp_n = _mm256_srai_epi16(tmp_n, 1);
+			tmp_n = _mm256_add_epi16(tmp_n, h_n);
+
+			/* interleave, unpack works within each 128 bit lane */
+			dst1 = _mm256_unpacklo_epi16(dst_n, tmp_n);
+			dst2 = _mm256_unpackhi_epi16(dst_n, tmp_n);
+
+			_mm256_storeu_si256((__m256i*) dst_ptr, _mm256_permute2x128_si256(dst1, dst2, 0x20));
+			_mm256_storeu_si256((__m256i*) (dst_ptr + 16), _mm256_permute2x128_si256(dst1, dst2, 0x31));
+
+			l_ptr += 16;
+			h_ptr += 16;
+			dst_ptr += 32;
+		}
+	}
+}
+
+static __inline void __attribute__((__gnu_inline__, __always_inline__, __artificial__))
+rfx_dwt_2d_decode_block_vert_avx2(sint16* l, sint16* h, sint16* dst, int subband_width)
+{
+	int x, n;
+	sint16* l_ptr = l;
+	sint16* h_ptr = h;
+	sint16* dst_ptr = dst;
+	__m256i l_n;
+	__m256i h_n;
+	__m256i tmp_n;
+	__m256i h_n_m;
+	__m256i dst_n;
+	__m256i dst_n_m;
+	__m256i dst_n_p;
+
+	int total_width = subband_width + subband_width;
+
+	/* Even coefficients */
+	for (n = 0; n < subband_width; n++)
+	{
+		for (x = 0; x < total_width; x += 16)
+		{
+			/* dst[2n] = l[n] - ((h[n-1] + h[n] + 1) >> 1); */
+
+			l_n = _mm256_loadu_si256((__m256i*) l_ptr);
+			h_n = _mm256_loadu_si256((__m256i*) h_ptr);
+
+			tmp_n = _mm256_add_epi16(h_n, _mm256_set1_epi16(1));
+			if (n == 0)
+				tmp_n = _mm256_add_epi16(tmp_n, h_n);
+			else
+			{
+				h_n_m = _mm256_loadu_si256((__m256i*) (h_ptr - total_width));
+				tmp_n = _mm256_add_epi16(tmp_n, h_n_m);
+			}
+			tmp_n = _mm256_srai_epi16(tmp_n, 1);
+
+			dst_n = _mm256_sub_epi16(l_n, tmp_n);
+			_mm256_storeu_si256((__m256i*) dst_ptr, dst_n);
+
+			l_ptr += 16;
+			h_ptr += 16;
+			dst_ptr += 16;
+		}
+		dst_ptr += total_width;
+	}
+
+	h_ptr = h;
+	dst_ptr = dst + total_width;
+
+	/* Odd coefficients */
+	for (n = 0; n < subband_width; n++)
+	{
+		for (x = 0; x < total_width; x += 16)
+		{
+			/* dst[2n + 1] = (h[n] << 1) + ((dst[2n] + dst[2n + 2]) >> 1); */
+
+			h_n = _mm256_loadu_si256((__m256i*) h_ptr);
+			dst_n_m = _mm256_loadu_si256((__m256i*) (dst_ptr - total_width));
+			h_n = _mm256_slli_epi16(h_n, 1);
+
+			tmp_n = dst_n_m;
+			if (n == subband_width - 1)
+				tmp_n = _mm256_add_epi16(tmp_n, dst_n_m);
+			else
+			{
+				dst_n_p = _mm256_loadu_si256((__m256i*) (dst_ptr + total_width));
+				tmp_n = _mm256_add_epi16(tmp_n, dst_n_p);
+			}
+			tmp_n = _mm256_srai_epi16(tmp_n, 1);
+
+			dst_n = _mm256_add_epi16(tmp_n, h_n);
+			_mm256_storeu_si256((__m256i*) dst_ptr, dst_n);
+
+			h_ptr += 16;
+			dst_ptr += 16;
+		}
+		dst_ptr += total_width;
+	}
+}
+
+static __inline void __attribute__((__gnu_inline__, __always_inline__, __artificial__))
+rfx_dwt_2d_decode_block_avx2(sint16* buffer, sint16* idwt, int subband_width)
+{
+	sint16 *hl, *lh, *hh, *ll;
+	sint16 *l_dst, *h_dst;
+
+	/* see rfx_dwt_2d_decode_block_sse2 for the sub-band layout */
+
+	ll = buffer + subband_width * subband_width * 3;
+	hl = buffer;
+	l_dst = idwt;
+
+	rfx_dwt_2d_decode_block_horiz_avx2(ll, hl, l_dst, subband_width);
+
+	lh = buffer + subband_width * subband_width;
+	hh = buffer + subband_width * subband_width * 2;
+	h_dst = idwt + subband_width * subband_width * 2;
+
+	rfx_dwt_2d_decode_block_horiz_avx2(lh, hh, h_dst, subband_width);
+
+	rfx_dwt_2d_decode_block_vert_avx2(l_dst, h_dst, buffer, subband_width);
+}
+
+static void rfx_dwt_2d_decode_avx2(sint16* buffer, sint16* dwt_buffer)
+{
+	rfx_dwt_2d_decode_block_avx2(buffer + 3840, dwt_buffer, 8);
+	rfx_dwt_2d_decode_block_avx2(buffer + 3072, dwt_buffer, 16);
+	rfx_dwt_2d_decode_block_avx2(buffer, dwt_buffer, 32);
+}
+
+static __inline void __attribute__((__gnu_inline__, __always_inline__, __artificial__))
+rfx_dwt_2d_encode_block_vert_avx2(sint16* src, sint16* l, sint16* h, int subband_width)
+{
+	int total_width;
+	int x;
+	int n;
+	__m256i src_2n;
+	__m256i src_2n_1;
+	__m256i src_2n_2;
+	__m256i h_n;
+	__m256i h_n_m;
+	__m256i l_n;
+
+	total_width = subband_width << 1;
+
+	for (n = 0; n < subband_width; n++)
+	{
+		for (x = 0; x < total_width; x += 16)
+		{
+			src_2n = _mm256_loadu_si256((__m256i*) src);
+			src_2n_1 = _mm256_loadu_si256((__m256i*) (src + total_width));
+			if (n < subband_width - 1)
+				src_2n_2 = _mm256_loadu_si256((__m256i*) (src + 2 * total_width));
+			else
+				src_2n_2 = src_2n;
+
+			/* h[n] = (src[2n + 1] - ((src[2n] + src[2n + 2]) >> 1)) >> 1 */
+
+			h_n = _mm256_add_epi16(src_2n, src_2n_2);
+			h_n = _mm256_srai_epi16(h_n, 1);
+			h_n = _mm256_sub_epi16(src_2n_1, h_n);
+			h_n = _mm256_srai_epi16(h_n, 1);
+
+			_mm256_storeu_si256((__m256i*) h, h_n);
+
+			if (n == 0)
+				h_n_m = h_n;
+			else
+				h_n_m = _mm256_loadu_si256((__m256i*) (h - total_width));
+
+			/* l[n] = src[2n] + ((h[n - 1] + h[n]) >> 1) */
+
+			l_n = _mm256_add_epi16(h_n_m, h_n);
+			l_n = _mm256_srai_epi16(l_n, 1);
+			l_n = _mm256_add_epi16(l_n, src_2n);
+
+			_mm256_storeu_si256((__m256i*) l, l_n);
+
+			src += 16;
+			l += 16;
+			h += 16;
+		}
+		src += total_width;
+	}
+}
+
+/* one row of an 8 coefficient wide sub-band */
+static __inline void __attribute__((__gnu_inline__, __always_inline__, __artificial__))
+rfx_dwt_2d_encode_row_horiz_8(sint16* src, sint16* l, sint16* h)
+{
+	__m128i a;
+	__m128i b;
+	__m128i src_2n;
+	__m128i src_2n_1;
+	__m128i src_2n_2;
+	__m128i h_n;
+	__m128i h_n_m;
+	__m128i l_n;
+	__m128i even_odd = _mm_setr_epi8(0, 1, 4, 5, 8, 9, 12, 13, 2, 3, 6, 7, 10, 11, 14, 15);
+
+	/* split the 16 source coefficients in even and odd ones */
+	a = _mm_shuffle_epi8(_mm_loadu_si128((__m128i*) src), even_odd);
+	b = _mm_shuffle_epi8(_mm_loadu_si128((__m128i*) (src + 8)), even_odd);
+	src_2n = _mm_unpacklo_epi64(a, b);
+	src_2n_1 = _mm_unpackhi_epi64(a, b);
+	src_2n_2 = _mm_insert_epi16(_mm_srli_si128(src_2n, 2), src[14], 7);
+
+	/* h[n] = (src[2n + 1] - ((src[2n] + src[2n + 2]) >> 1)) >> 1 */
+	h_n = _mm_add_epi16(src_2n, src_2n_2);
+	h_n = _mm_srai_epi16(h_n, 1);
+	h_n = _mm_sub_epi16(src_2n_1, h_n);
+	h_n = _mm_srai_epi16(h_n, 1);
+
+	_mm_storeu_si128((__m128i*) h, h_n);
+
+	/* l[n] = src[2n] + ((h[n - 1] + h[n]) >> 1) */
+	h_n_m = _mm_insert_epi16(_mm_slli_si128(h_n, 2), _mm_extract_epi16(h_n, 0), 0);
+	l_n = _mm_add_epi16(h_n_m, h_n);
+	l_n = _mm_srai_epi16(l_n, 1);
+	l_n = _mm_add_epi16(l_n, src_2n);
+
+	_mm_storeu_si128((__m128i*) l, l_n);
+}
+
+static __inline void __attribute__((__gnu_inline__, __always_inline__, __artificial__))
+rfx_dwt_2d_encode_block_horiz_avx2(sint16* src, sint16* l, sint16* h, int subband_width)
+{
+	int y;
+	int n;
+	__m256i a;
+	__m256i b;
+	__m256i src_2n;
+	__m256i src_2n_1;
+	__m256i src_2n_2;
+	__m256i h_n;
+	__m256i h_n_m;
+	__m256i l_n;
+	__m256i even_odd = _mm256_setr_epi8(0, 1, 4, 5, 8, 9, 12, 13, 2, 3, 6, 7, 10, 11, 14, 15,
+		0, 1, 4, 5, 8, 9, 12, 13, 2, 3, 6, 7, 10, 11, 14, 15);
+
+	if (subband_width == 8)
+	{
+		for (y = 0; y < subband_width; y++)
+			rfx_dwt_2d_encode_row_horiz_8(src + y * 16, l + y * 8, h + y * 8);
+		return;
+	}
+
+	for (y = 0; y < subband_width; y++)
+	{
+		for (n = 0; n < subband_width; n += 16)
+		{
+			/* split the 32 source coefficients in even and odd ones */
+			a = _mm256_shuffle_epi8(_mm256_loadu_si256((__m256i*) src), even_odd);
+			a = _mm256_permute4x64_epi64(a, 0xD8);
+			b = _mm256_shuffle_epi8(_mm256_loadu_si256((__m256i*) (src + 16)), even_odd);
+			b = _mm256_permute4x64_epi64(b, 0xD8);
+
+			src_2n = _mm256_permute2x128_si256(a, b, 0x20);
+			src_2n_1 = _mm256_permute2x128_si256(a, b, 0x31);
+			src_2n_2 = _mm256_insert_epi16(_mm256_shift_down_epi16(src_2n),
+				(n == subband_width - 16) ? src[30] : src[32], 15);
+
+			/* h[n] = (src[2n + 1] - ((src[2n] + src[2n + 2]) >> 1)) >> 1 */
+
+			h_n = _mm256_add_epi16(src_2n, src_2n_2);
+			h_n = _mm256_srai_epi16(h_n, 1);
+			h_n = _mm256_sub_epi16(src_2n_1, h_n);
+			h_n = _mm256_srai_epi16(h_n, 1);
+
+			_mm256_storeu_si256((__m256i*) h, h_n);
+
+			if (n == 0)
+				h_n_m = _mm256_insert_epi16(_mm256_shift_up_epi16(h_n), h[0], 0);
+			else
+				h_n_m = _mm256_loadu_si256((__m256i*) (h - 1));
+
+			/* l[n] = src[2n] + ((h[n - 1] + h[n]) >> 1) */
+
+			l_n = _mm256_add_epi16(h_n_m, h_n);
+			l_n = _mm256_srai_epi16(l_n, 1);
+			l_n = _mm256_add_epi16(l_n, src_2n);
+
+			_mm256_storeu_si256((__m256i*) l, l_n);
+
+			src += 32;
+			l += 16;
+			h += 16;
+		}
+	}
+}
+
+static __inline void __attribute__((__gnu_inline__, __always_inline__, __artificial__))
+rfx_dwt_2d_encode_block_avx2(sint16* buffer, sint16* dwt, int subband_width)
+{
+	sint16 *hl, *lh, *hh, *ll;
+	sint16 *l_src, *h_src;
+
+	/* see rfx_dwt_2d_encode_block_sse2 for the sub-band layout */
+
+	l_src = dwt;
+	h_src = dwt + subband_width * subband_width * 2;
+
+	rfx_dwt_2d_encode_block_vert_avx2(buffer, l_src, h_src, subband_width);
+
+	ll = buffer + subband_width * subband_width * 3;
+	hl = buffer;
+
+	lh = buffer + subband_width * subband_width;
+	hh = buffer + subband_width * subband_width * 2;
+
+	rfx_dwt_2d_encode_block_horiz_avx2(l_src, ll, hl, subband_width);
+	rfx_dwt_2d_encode_block_horiz_avx2(h_src, lh, hh, subband_width);
+}
+
+static void rfx_dwt_2d_encode_avx2(sint16* buffer, sint16* dwt_buffer)
+{
+	rfx_dwt_2d_encode_block_avx2(buffer, dwt_buffer, 32);
+	rfx_dwt_2d_encode_block_avx2(buffer + 3072, dwt_buffer, 16);
+	rfx_dwt_2d_encode_block_avx2(buffer + 3840, dwt_buffer, 8);
+}
+
+void rfx_init_avx2(RFX_CONTEXT* context)
+{
+	DEBUG_RFX("Using AVX2 optimizations");
+
+	IF_PROFILER(context->priv->prof_rfx_decode_ycbcr_to_rgb->name = "rfx_decode_ycbcr_to_rgb_avx2");
+	IF_PROFILER(context->priv->prof_rfx_encode_rgb_to_ycbcr->name = "rfx_encode_rgb_to_ycbcr_avx2");
+	IF_PROFILER(context->priv->prof_rfx_quantization_decode->name = "rfx_quantization_decode_avx2");
+	IF_PROFILER(context->priv->prof_rfx_quantization_encode->name = "rfx_quantization_encode_avx2");
+	IF_PROFILER(context->priv->prof_rfx_dwt_2d_decode->name = "rfx_dwt_2d_decode_avx2");
+	IF_PROFILER(context->priv->prof_rfx_dwt_2d_encode->name = "rfx_dwt_2d_encode_avx2");
+
+	context->decode_ycbcr_to_rgb = rfx_decode_ycbcr_to_rgb_avx2;
+	context->encode_rgb_to_ycbcr = rfx_encode_rgb_to_ycbcr_avx2;
+	context->quantization_decode = rfx_quantization_decode_avx2;
+	context->quantization_encode = rfx_quantization_encode_avx2;
+	context->dwt_2d_decode = rfx_dwt_2d_decode_avx2;
+	context->dwt_2d_encode = rfx_dwt_2d_encode_avx2;
+}
@@ -80,6 +80,66 @@ static void rfx_decode_format_rgb(sint16* r_buf, sint16* g_buf, sint16* b_buf,
 	}
 }
 
+void rfx_decode_format_rect(sint16* r_buf, sint16* g_buf, sint16* b_buf,
+	int x, int y, int width, int height, RFX_PIXEL_FORMAT pixel_format, uint8* dst_buf, int dst_stride)
+{
+	sint16* r;
+	sint16* g;
+	sint16* b;
+	uint8* dst;
+	int i, j;
+
+	for (j = y; j < y + height; j++)
+	{
+		r = r_buf + j * 64 + x;
+		g = g_buf + j * 64 + x;
+		b = b_buf + j * 64 + x;
+		dst = dst_buf;
+
+		switch (pixel_format)
+		{
+			case RFX_PIXEL_FORMAT_BGRA:
+				for (i = 0; i < width; i++)
+				{
+					*dst++ = (uint8) (*b++);
+					*dst++ = (uint8) (*g++);
+					*dst++ = (uint8) (*r++);
+					*dst++ = 0xFF;
+				}
+				break;
+			case RFX_PIXEL_FORMAT_RGBA:
+				for (i = 0; i < width; i++)
+				{
+					*dst++ = (uint8) (*r++);
+					*dst++ = (uint8) (*g++);
+					*dst++ = (uint8) (*b++);
+					*dst++ = 0xFF;
+				}
+				break;
+			case RFX_PIXEL_FORMAT_BGR:
+				for (i = 0; i < width; i++)
+				{
+					*dst++ = (uint8) (*b++);
+					*dst++ = (uint8) (*g++);
+					*dst++ = (uint8) (*r++);
+				}
+				break;
+			case RFX_PIXEL_FORMAT_RGB:
+				for (i = 0; i < width; i++)
+				{
+					*dst++ = (uint8) (*r++);
+					*dst++ = (uint8) (*g++);
+					*dst++ = (uint8) (*b++);
+				}
+				break;
+			default:
+				break;
+		}
+
+		dst_buf += dst_stride;
+	}
+}
+
 #define MINMAX(_v,_l,_h) ((_v) < (_l) ? (_l) : ((_v) > (_h) ? (_h) : (_v)))
 
 void rfx_decode_ycbcr_to_rgb(sint16* y_r_buf, sint16* cb_g_buf, sint16* cr_b_buf)
@@ -143,52 +203,70 @@ void rfx_decode_ycbcr_to_rgb(sint16* y_r_buf, sint16* cb_g_buf, sint16* cr_b_buf
 	}
 }
 
-static void rfx_decode_component(RFX_CONTEXT* context, const uint32* quantization_values,
-	const uint8* data, int size, sint16* buffer)
+static void rfx_decode_component(RFX_CONTEXT* context, RFX_SCRATCH* scratch,
+	const uint32* quantization_values, const uint8* data, int size, sint16* buffer)
 {
-	PROFILER_ENTER(context->priv->prof_rfx_decode_component);
+	RFX_PROFILER_ENTER(context, scratch, prof_rfx_decode_component);
 
-	PROFILER_ENTER(context->priv->prof_rfx_rlgr_decode);
-		rfx_rlgr_decode(context->mode, data, size, buffer, 4096);
-	PROFILER_EXIT(context->priv->prof_rfx_rlgr_decode);
+	RFX_PROFILER_ENTER(context, scratch, prof_rfx_rlgr_decode);
+		context->rlgr_decode(context->mode, data, size, buffer, 4096);
+	RFX_PROFILER_EXIT(context, scratch, prof_rfx_rlgr_decode);
 
-	PROFILER_ENTER(context->priv->prof_rfx_differential_decode);
+	RFX_PROFILER_ENTER(context, scratch, prof_rfx_differential_decode);
 		rfx_differential_decode(buffer + 4032, 64);
-	PROFILER_EXIT(context->priv->prof_rfx_differential_decode);
+	RFX_PROFILER_EXIT(context, scratch, prof_rfx_differential_decode);
 
-	PROFILER_ENTER(context->priv->prof_rfx_quantization_decode);
+	RFX_PROFILER_ENTER(context, scratch, prof_rfx_quantization_decode);
 		context->quantization_decode(buffer, quantization_values);
-	PROFILER_EXIT(context->priv->prof_rfx_quantization_decode);
+	RFX_PROFILER_EXIT(context, scratch, prof_rfx_quantization_decode);
 
-	PROFILER_ENTER(context->priv->prof_rfx_dwt_2d_decode);
-		context->dwt_2d_decode(buffer, context->priv->dwt_buffer);
-	PROFILER_EXIT(context->priv->prof_rfx_dwt_2d_decode);
+	RFX_PROFILER_ENTER(context, scratch, prof_rfx_dwt_2d_decode);
+		context->dwt_2d_decode(buffer, scratch->dwt_buffer);
+	RFX_PROFILER_EXIT(context, scratch, prof_rfx_dwt_2d_decode);
 
-	PROFILER_EXIT(context->priv->prof_rfx_decode_component);
+	RFX_PROFILER_EXIT(context, scratch, prof_rfx_decode_component);
 }
 
-void rfx_decode_rgb(RFX_CONTEXT* context, STREAM* data_in,
+void rfx_decode_planes_ex(RFX_CONTEXT* context, RFX_SCRATCH* scratch, STREAM* data_in,
 	int y_size, const uint32 * y_quants,
 	int cb_size, const uint32 * cb_quants,
-	int cr_size, const uint32 * cr_quants, uint8* rgb_buffer)
+	int cr_size, const uint32 * cr_quants)
 {
-	PROFILER_ENTER(context->priv->prof_rfx_decode_rgb);
-
-	rfx_decode_component(context, y_quants, stream_get_tail(data_in), y_size, context->priv->y_r_buffer); /* YData */
+	rfx_decode_component(context, scratch, y_quants, stream_get_tail(data_in), y_size, scratch->y_r_buffer); /* YData */
 	stream_seek(data_in, y_size);
-	rfx_decode_component(context, cb_quants, stream_get_tail(data_in), cb_size, context->priv->cb_g_buffer); /* CbData */
+	rfx_decode_component(context, scratch, cb_quants, stream_get_tail(data_in), cb_size, scratch->cb_g_buffer); /* CbData */
 	stream_seek(data_in, cb_size);
-	rfx_decode_component(context, cr_quants, stream_get_tail(data_in), cr_size, context->priv->cr_b_buffer); /* CrData */
+	rfx_decode_component(context, scratch, cr_quants, stream_get_tail(data_in), cr_size, scratch->cr_b_buffer); /* CrData */
 	stream_seek(data_in, cr_size);
 
-	PROFILER_ENTER(context->priv->prof_rfx_decode_ycbcr_to_rgb);
-		context->decode_ycbcr_to_rgb(context->priv->y_r_buffer, context->priv->cb_g_buffer, context->priv->cr_b_buffer);
-	PROFILER_EXIT(context->priv->prof_rfx_decode_ycbcr_to_rgb);
+	RFX_PROFILER_ENTER(context, scratch, prof_rfx_decode_ycbcr_to_rgb);
+		context->decode_ycbcr_to_rgb(scratch->y_r_buffer, scratch->cb_g_buffer, scratch->cr_b_buffer);
+	RFX_PROFILER_EXIT(context, scratch, prof_rfx_decode_ycbcr_to_rgb);
+}
 
-	PROFILER_ENTER(context->priv->prof_rfx_decode_format_rgb);
-		rfx_decode_format_rgb(context->priv->y_r_buffer, context->priv->cb_g_buffer, context->priv->cr_b_buffer,
+void rfx_decode_rgb_ex(RFX_CONTEXT* context, RFX_SCRATCH* scratch, STREAM* data_in,
+	int y_size, const uint32 * y_quants,
+	int cb_size, const uint32 * cb_quants,
+	int cr_size, const uint32 * cr_quants, uint8* rgb_buffer)
+{
+	RFX_PROFILER_ENTER(context, scratch, prof_rfx_decode_rgb);
+
+	rfx_decode_planes_ex(context, scratch, data_in,
+		y_size, y_quants, cb_size, cb_quants, cr_size, cr_quants);
+
+	RFX_PROFILER_ENTER(context, scratch, prof_rfx_decode_format_rgb);
+		rfx_decode_format_rgb(scratch->y_r_buffer, scratch->cb_g_buffer, scratch->cr_b_buffer,
 			context->pixel_format, rgb_buffer);
-	PROFILER_EXIT(context->priv->prof_rfx_decode_format_rgb);
+	RFX_PROFILER_EXIT(context, scratch, prof_rfx_decode_format_rgb);
 	
-	PROFILER_EXIT(context->priv->prof_rfx_decode_rgb);
+	RFX_PROFILER_EXIT(context, scratch, prof_rfx_decode_rgb);
+}
+
+void rfx_decode_rgb(RFX_CONTEXT* context, STREAM* data_in,
+	int y_size, const uint32 * y_quants,
+	int cb_size, const uint32 * cb_quants,
+	int cr_size, const uint32 * cr_quants, uint8* rgb_buffer)
+{
+	rfx_decode_rgb_ex(context, context->priv->scratch, data_in,
+		y_size, y_quants, cb_size, cb_quants, cr_size, cr_quants, rgb_buffer);
 }
@@ -22,8 +22,25 @@
 
 #include <freerdp/codec/rfx.h>
 
+#include "rfx_types.h"
+
 void rfx_decode_ycbcr_to_rgb(sint16* y_r_buf, sint16* cb_g_buf, sint16* cr_b_buf);
 
+/* leaves the R, G and B planes of the tile in the scratch buffers */
+void rfx_decode_planes_ex(RFX_CONTEXT* context, RFX_SCRATCH* scratch, STREAM* data_in,
+	int y_size, const uint32 * y_quants,
+	int cb_size, const uint32 * cb_quants,
+	int cr_size, const uint32 * cr_quants);
+
+/* writes the (x, y, width, height) part of decoded planes to dst_buf, which points at pixel (x, y) */
+void rfx_decode_format_rect(sint16* r_buf, sint16* g_buf, sint16* b_buf,
+	int x, int y, int width, int height, RFX_PIXEL_FORMAT pixel_format, uint8* dst_buf, int dst_stride);
+
+void rfx_decode_rgb_ex(RFX_CONTEXT* context, RFX_SCRATCH* scratch, STREAM* data_in,
+	int y_size, const uint32 * y_quants,
+	int cb_size, const uint32 * cb_quants,
+	int cr_size, const uint32 * cr_quants, uint8* rgb_buffer);
+
 void rfx_decode_rgb(RFX_CONTEXT* context, STREAM* data_in,
 	int y_size, const uint32 * y_quants,
 	int cb_size, const uint32 * cb_quants,
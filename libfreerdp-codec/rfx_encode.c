@@ -217,64 +217,73 @@ void rfx_encode_rgb_to_ycbcr(sint16* y_r_buf, sint16* cb_g_buf, sint16* cr_b_buf
 	}
 }
 
-static void rfx_encode_component(RFX_CONTEXT* context, const uint32* quantization_values,
-	sint16* data, uint8* buffer, int buffer_size, int* size)
+static void rfx_encode_component(RFX_CONTEXT* context, RFX_SCRATCH* scratch,
+	const uint32* quantization_values, sint16* data, uint8* buffer, int buffer_size, int* size)
 {
-	PROFILER_ENTER(context->priv->prof_rfx_encode_component);
+	RFX_PROFILER_ENTER(context, scratch, prof_rfx_encode_component);
 
-	PROFILER_ENTER(context->priv->prof_rfx_dwt_2d_encode);
-		context->dwt_2d_encode(data, context->priv->dwt_buffer);
-	PROFILER_EXIT(context->priv->prof_rfx_dwt_2d_encode);
+	RFX_PROFILER_ENTER(context, scratch, prof_rfx_dwt_2d_encode);
+		context->dwt_2d_encode(data, scratch->dwt_buffer);
+	RFX_PROFILER_EXIT(context, scratch, prof_rfx_dwt_2d_encode);
 
-	PROFILER_ENTER(context->priv->prof_rfx_quantization_encode);
+	RFX_PROFILER_ENTER(context, scratch, prof_rfx_quantization_encode);
 		context->quantization_encode(data, quantization_values);
-	PROFILER_EXIT(context->priv->prof_rfx_quantization_encode);
+	RFX_PROFILER_EXIT(context, scratch, prof_rfx_quantization_encode);
 
-	PROFILER_ENTER(context->priv->prof_rfx_differential_encode);
+	RFX_PROFILER_ENTER(context, scratch, prof_rfx_differential_encode);
 		rfx_differential_encode(data + 4032, 64);
-	PROFILER_EXIT(context->priv->prof_rfx_differential_encode);
+	RFX_PROFILER_EXIT(context, scratch, prof_rfx_differential_encode);
 
-	PROFILER_ENTER(context->priv->prof_rfx_rlgr_encode);
-		*size = rfx_rlgr_encode(context->mode, data, 4096, buffer, buffer_size);
-	PROFILER_EXIT(context->priv->prof_rfx_rlgr_encode);
+	RFX_PROFILER_ENTER(context, scratch, prof_rfx_rlgr_encode);
+		*size = context->rlgr_encode(context->mode, data, 4096, buffer, buffer_size);
+	RFX_PROFILER_EXIT(context, scratch, prof_rfx_rlgr_encode);
 
-	PROFILER_EXIT(context->priv->prof_rfx_encode_component);
+	RFX_PROFILER_EXIT(context, scratch, prof_rfx_encode_component);
 }
 
-void rfx_encode_rgb(RFX_CONTEXT* context, const uint8* rgb_data, int width, int height, int rowstride,
+void rfx_encode_rgb_ex(RFX_CONTEXT* context, RFX_SCRATCH* scratch,
+	const uint8* rgb_data, int width, int height, int rowstride,
 	const uint32* y_quants, const uint32* cb_quants, const uint32* cr_quants,
 	STREAM* data_out, int* y_size, int* cb_size, int* cr_size)
 {
-	sint16* y_r_buffer = context->priv->y_r_buffer;
-	sint16* cb_g_buffer = context->priv->cb_g_buffer;
-	sint16* cr_b_buffer = context->priv->cr_b_buffer;
+	sint16* y_r_buffer = scratch->y_r_buffer;
+	sint16* cb_g_buffer = scratch->cb_g_buffer;
+	sint16* cr_b_buffer = scratch->cr_b_buffer;
 
-	PROFILER_ENTER(context->priv->prof_rfx_encode_rgb);
+	RFX_PROFILER_ENTER(context, scratch, prof_rfx_encode_rgb);
 
-	PROFILER_ENTER(context->priv->prof_rfx_encode_format_rgb);
+	RFX_PROFILER_ENTER(context, scratch, prof_rfx_encode_format_rgb);
 		rfx_encode_format_rgb(rgb_data, width, height, rowstride,
 			context->pixel_format, context->palette, y_r_buffer, cb_g_buffer, cr_b_buffer);
-	PROFILER_EXIT(context->priv->prof_rfx_encode_format_rgb);
+	RFX_PROFILER_EXIT(context, scratch, prof_rfx_encode_format_rgb);
 
-	PROFILER_ENTER(context->priv->prof_rfx_encode_rgb_to_ycbcr);
-		context->encode_rgb_to_ycbcr(context->priv->y_r_buffer, context->priv->cb_g_buffer, context->priv->cr_b_buffer);
-	PROFILER_EXIT(context->priv->prof_rfx_encode_rgb_to_ycbcr);
+	RFX_PROFILER_ENTER(context, scratch, prof_rfx_encode_rgb_to_ycbcr);
+		context->encode_rgb_to_ycbcr(y_r_buffer, cb_g_buffer, cr_b_buffer);
+	RFX_PROFILER_EXIT(context, scratch, prof_rfx_encode_rgb_to_ycbcr);
 
 	/* Ensure the buffer is reasonably large enough */
 	stream_check_size(data_out, 4096);
-	rfx_encode_component(context, y_quants, context->priv->y_r_buffer,
+	rfx_encode_component(context, scratch, y_quants, y_r_buffer,
 		stream_get_tail(data_out), stream_get_left(data_out), y_size);
 	stream_seek(data_out, *y_size);
 
 	stream_check_size(data_out, 4096);
-	rfx_encode_component(context, cb_quants, context->priv->cb_g_buffer,
+	rfx_encode_component(context, scratch, cb_quants, cb_g_buffer,
 		stream_get_tail(data_out), stream_get_left(data_out), cb_size);
 	stream_seek(data_out, *cb_size);
 
 	stream_check_size(data_out, 4096);
-	rfx_encode_component(context, cr_quants, context->priv->cr_b_buffer,
+	rfx_encode_component(context, scratch, cr_quants, cr_b_buffer,
 		stream_get_tail(data_out), stream_get_left(data_out), cr_size);
 	stream_seek(data_out, *cr_size);
 
-	PROFILER_EXIT(context->priv->prof_rfx_encode_rgb);
+	RFX_PROFILER_EXIT(context, scratch, prof_rfx_encode_rgb);
+}
+
+void rfx_encode_rgb(RFX_CONTEXT* context, const uint8* rgb_data, int width, int height, int rowstride,
+	const uint32* y_quants, const uint32* cb_quants, const uint32* cr_quants,
+	STREAM* data_out, int* y_size, int* cb_size, int* cr_size)
+{
+	rfx_encode_rgb_ex(context, context->priv->scratch, rgb_data, width, height, rowstride,
+		y_quants, cb_quants, cr_quants, data_out, y_size, cb_size, cr_size);
 }
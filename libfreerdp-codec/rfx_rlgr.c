@@ -429,3 +429,524 @@ int rfx_rlgr_encode(RLGR_MODE mode, const sint16* data, int data_size, uint8* bu
 
 	return processed_size;
 }
+
+/**
+ * Faster RLGR1/RLGR3 coder. The algorithm and its parameter updates are the
+ * same as above, but bits are read and written through a 64 bit bit buffer,
+ * runs of 0s and 1s are found with count leading zeros and a whole
+ * Golomb-Rice code is emitted with a single write. The output matches
+ * rfx_rlgr_encode and rfx_rlgr_decode bit for bit, including truncated
+ * input and a too small output buffer.
+ */
+
+#if defined(__GNUC__)
+#define rfx_clz64(_x) __builtin_clzll(_x)
+#define rfx_clz32(_x) __builtin_clz(_x)
+#else
+static int rfx_clz64(uint64 x)
+{
+	int n = 0;
+
+	while (!(x & 0x8000000000000000ULL))
+	{
+		x <<= 1;
+		n++;
+	}
+
+	return n;
+}
+
+static int rfx_clz32(uint32 x)
+{
+	return rfx_clz64(((uint64) x) << 32);
+}
+#endif
+
+/* bits are kept MSB first in acc, nacc of them are valid */
+struct _RFX_BITREADER
+{
+	const uint8* src;
+	const uint8* end;
+	uint64 acc;
+	int nacc;
+};
+typedef struct _RFX_BITREADER RFX_BITREADER;
+
+static void rfx_bitreader_fill(RFX_BITREADER* br)
+{
+	int nbytes;
+	uint64 bits;
+
+	/**
+	 * Load 8 bytes at once while there are enough. The bits past the
+	 * nacc valid ones are the following data, so loading them again on
+	 * the next fill does not change acc.
+	 */
+	if (br->end - br->src >= 8)
+	{
+		bits = ((uint64) br->src[0] << 56) | ((uint64) br->src[1] << 48) |
+			((uint64) br->src[2] << 40) | ((uint64) br->src[3] << 32) |
+			((uint64) br->src[4] << 24) | ((uint64) br->src[5] << 16) |
+			((uint64) br->src[6] << 8) | ((uint64) br->src[7]);
+		nbytes = (63 - br->nacc) >> 3;
+		br->acc |= bits >> br->nacc;
+		br->src += nbytes;
+		br->nacc += nbytes << 3;
+		return;
+	}
+
+	while (br->nacc <= 56 && br->src < br->end)
+	{
+		br->acc |= ((uint64) *br->src++) << (56 - br->nacc);
+		br->nacc += 8;
+	}
+}
+
+static void rfx_bitreader_skip(RFX_BITREADER* br, int nbits)
+{
+	br->acc = (nbits < 64) ? br->acc << nbits : 0;
+	br->nacc -= nbits;
+}
+
+#define rfx_bitreader_eos(_br) ((_br)->nacc == 0 && (_br)->src >= (_br)->end)
+
+/* like rfx_bitstream_get_bits, returns whatever is left at the end of data */
+static uint32 rfx_bitreader_get_bits(RFX_BITREADER* br, int nbits)
+{
+	uint32 r;
+
+	if (nbits <= 0)
+		return 0;
+
+	if (br->nacc < nbits)
+	{
+		rfx_bitreader_fill(br);
+
+		if (br->nacc < nbits)
+		{
+			r = (br->nacc > 0) ? (uint32) (br->acc >> (64 - br->nacc)) : 0;
+			br->acc = 0;
+			br->nacc = 0;
+			return r;
+		}
+	}
+
+	r = (uint32) (br->acc >> (64 - nbits));
+	rfx_bitreader_skip(br, nbits);
+
+	return r;
+}
+
+/* counts and consumes leading 1s and the terminating 0 */
+static uint32 rfx_bitreader_get_ones(RFX_BITREADER* br)
+{
+	int n;
+	uint64 x;
+	uint32 vk = 0;
+
+	while (1)
+	{
+		if (br->nacc < 32)
+			rfx_bitreader_fill(br);
+
+		if (br->nacc == 0)
+			break;
+
+		x = ~br->acc;
+		n = (x == 0) ? 64 : rfx_clz64(x);
+
+		if (n < br->nacc)
+		{
+			vk += n;
+			rfx_bitreader_skip(br, n + 1);
+			break;
+		}
+
+		vk += br->nacc;
+		rfx_bitreader_skip(br, br->nacc);
+	}
+
+	return vk;
+}
+
+#define GetGRCodeFast(krp, kr, vk, _mag) \
+	vk = rfx_bitreader_get_ones(br); \
+	_mag = (uint16) (rfx_bitreader_get_bits(br, *kr) | ((uint32) vk << *kr)); \
+	if (!vk) { \
+		UpdateParam(*krp, -2, *kr); \
+	} \
+	else if (vk != 1) { \
+		UpdateParam(*krp, vk, *kr); \
+	}
+
+int rfx_rlgr_decode_fast(RLGR_MODE mode, const uint8* data, int data_size, sint16* buffer, int buffer_size)
+{
+	int i;
+	int n;
+	int k;
+	int kp;
+	int kr;
+	int krp;
+	sint16* dst;
+	RFX_BITREADER bitreader;
+	RFX_BITREADER* br = &bitreader;
+
+	int vk;
+	uint16 mag16;
+
+	br->src = data;
+	br->end = data + data_size;
+	br->acc = 0;
+	br->nacc = 0;
+	dst = buffer;
+
+	/* initialize the parameters */
+	k = 1;
+	kp = k << LSGR;
+	kr = 1;
+	krp = kr << LSGR;
+
+	while (!rfx_bitreader_eos(br) && buffer_size > 0)
+	{
+		int run;
+		if (k)
+		{
+			int mag;
+			uint32 sign;
+
+			/* RL MODE */
+			while (1)
+			{
+				if (br->nacc < 32)
+					rfx_bitreader_fill(br);
+
+				if (br->nacc == 0)
+					break;
+
+				/* every "0" is a run (1<<k) of zeros */
+				n = (br->acc == 0) ? 64 : rfx_clz64(br->acc);
+				if (n > br->nacc)
+					n = br->nacc;
+
+				for (i = 0; i < n; i++)
+				{
+					WriteZeroes(1 << k);
+					UpdateParam(kp, UP_GR, k); /* raise k and kp up because of zero run */
+				}
+
+				if (n < br->nacc)
+				{
+					rfx_bitreader_skip(br, n + 1);
+					break;
+				}
+
+				rfx_bitreader_skip(br, n);
+			}
+
+			/* next k bits will contain remaining run or zeros */
+			run = rfx_bitreader_get_bits(br, k);
+			WriteZeroes(run);
+
+			/* get nonzero value, starting with sign bit and then GRCode for magnitude -1 */
+			sign = rfx_bitreader_get_bits(br, 1);
+
+			/* magnitude - 1 was coded (because it was nonzero) */
+			GetGRCodeFast(&krp, &kr, vk, mag16)
+			mag = (int) (mag16 + 1);
+
+			WriteValue(sign ? -mag : mag);
+			UpdateParam(kp, -DN_GR, k); /* lower k and kp because of nonzero term */
+		}
+		else
+		{
+			uint32 mag;
+			uint32 nIdx;
+			uint32 val1;
+			uint32 val2;
+
+			/* GR (GOLOMB-RICE) MODE */
+			GetGRCodeFast(&krp, &kr, vk, mag16) /* values coded are 2 * magnitude - sign */
+			mag = (uint32) mag16;
+
+			if (mode == RLGR1)
+			{
+				if (!mag)
+				{
+					WriteValue(0);
+					UpdateParam(kp, UQ_GR, k); /* raise k and kp due to zero */
+				}
+				else
+				{
+					WriteValue(GetIntFrom2MagSign(mag));
+					UpdateParam(kp, -DQ_GR, k); /* lower k and kp due to nonzero */
+				}
+			}
+			else /* mode == RLGR3 */
+			{
+				/* maximum possible bits for first term */
+				nIdx = mag ? 32 - rfx_clz32(mag) : 0;
+
+				/* decode val1 is first term's (2 * mag - sign) value */
+				val1 = rfx_bitreader_get_bits(br, nIdx);
+
+				/* val2 is second term's (2 * mag - sign) value */
+				val2 = mag - val1;
+
+				if (val1 && val2)
+				{
+					/* raise k and kp if both terms nonzero */
+					UpdateParam(kp, -2 * DQ_GR, k);
+				}
+				else if (!val1 && !val2)
+				{
+					/* lower k and kp if both terms zero */
+					UpdateParam(kp, 2 * UQ_GR, k);
+				}
+
+				WriteValue(GetIntFrom2MagSign(val1));
+				WriteValue(GetIntFrom2MagSign(val2));
+			}
+		}
+	}
+
+	return (dst - buffer);
+}
+
+/* bits are kept LSB aligned in acc, nacc of them are pending */
+struct _RFX_BITWRITER
+{
+	uint8* buffer;
+	int size;
+	int pos; /* may run past size, the extra bytes are dropped */
+	uint64 acc;
+	int nacc;
+};
+typedef struct _RFX_BITWRITER RFX_BITWRITER;
+
+static void rfx_bitwriter_put_byte(RFX_BITWRITER* bw, uint8 b)
+{
+	if (bw->pos < bw->size)
+		bw->buffer[bw->pos] = b;
+	bw->pos++;
+}
+
+/* writes the low nbits (at most 32) of value */
+static void rfx_bitwriter_put_bits(RFX_BITWRITER* bw, uint32 value, int nbits)
+{
+	uint32 word;
+
+	if (nbits <= 0)
+		return;
+
+	bw->acc = (bw->acc << nbits) | (value & (0xFFFFFFFFU >> (32 - nbits)));
+	bw->nacc += nbits;
+
+	if (bw->nacc >= 32)
+	{
+		bw->nacc -= 32;
+		word = (uint32) (bw->acc >> bw->nacc);
+
+		if (bw->pos + 4 <= bw->size)
+		{
+			bw->buffer[bw->pos] = (uint8) (word >> 24);
+			bw->buffer[bw->pos + 1] = (uint8) (word >> 16);
+			bw->buffer[bw->pos + 2] = (uint8) (word >> 8);
+			bw->buffer[bw->pos + 3] = (uint8) word;
+			bw->pos += 4;
+		}
+		else
+		{
+			rfx_bitwriter_put_byte(bw, (uint8) (word >> 24));
+			rfx_bitwriter_put_byte(bw, (uint8) (word >> 16));
+			rfx_bitwriter_put_byte(bw, (uint8) (word >> 8));
+			rfx_bitwriter_put_byte(bw, (uint8) word);
+		}
+	}
+}
+
+static void rfx_bitwriter_put_ones(RFX_BITWRITER* bw, uint32 count)
+{
+	while (count >= 32)
+	{
+		rfx_bitwriter_put_bits(bw, 0xFFFFFFFF, 32);
+		count -= 32;
+	}
+
+	rfx_bitwriter_put_bits(bw, 0xFFFFFFFF, count);
+}
+
+/**
+ * Writes out the pending bits. Like rfx_bitstream_put_bits, the unused low
+ * bits of a last partial byte keep what the buffer held before.
+ * @return number of bytes used in the buffer
+ */
+
+static int rfx_bitwriter_flush(RFX_BITWRITER* bw)
+{
+	uint8 b;
+	int unused;
+
+	while (bw->nacc >= 8)
+	{
+		bw->nacc -= 8;
+		rfx_bitwriter_put_byte(bw, (uint8) (bw->acc >> bw->nacc));
+	}
+
+	if (bw->nacc > 0)
+	{
+		unused = 8 - bw->nacc;
+		b = (uint8) (bw->acc << unused);
+
+		if (bw->pos < bw->size)
+			bw->buffer[bw->pos] = (bw->buffer[bw->pos] & ((1 << unused) - 1)) | b;
+
+		bw->pos++;
+		bw->nacc = 0;
+	}
+
+	return (bw->pos < bw->size) ? bw->pos : bw->size;
+}
+
+static void rfx_rlgr_code_gr_fast(RFX_BITWRITER* bw, int* krp, uint32 val)
+{
+	int kr = *krp >> LSGR;
+	uint32 vk = val >> kr;
+
+	/* unary part, terminating 0 and remainder in one write if they fit */
+	if (vk + 1 + kr <= 32)
+	{
+		rfx_bitwriter_put_bits(bw, (((1U << vk) - 1) << (kr + 1)) | (val & ((1U << kr) - 1)), vk + 1 + kr);
+	}
+	else
+	{
+		rfx_bitwriter_put_ones(bw, vk);
+		rfx_bitwriter_put_bits(bw, 0, 1);
+		rfx_bitwriter_put_bits(bw, val & ((1U << kr) - 1), kr);
+	}
+
+	/* update krp, only if it is not equal to 1 */
+	if (vk == 0)
+	{
+		UpdateParam(*krp, -2, kr);
+	}
+	else if (vk > 1)
+	{
+		UpdateParam(*krp, vk, kr);
+	}
+}
+
+int rfx_rlgr_encode_fast(RLGR_MODE mode, const sint16* data, int data_size, uint8* buffer, int buffer_size)
+{
+	int k;
+	int kp;
+	int krp;
+	RFX_BITWRITER bitwriter;
+	RFX_BITWRITER* bw = &bitwriter;
+
+	bw->buffer = buffer;
+	bw->size = buffer_size;
+	bw->pos = 0;
+	bw->acc = 0;
+	bw->nacc = 0;
+
+	/* initialize the parameters */
+	k = 1;
+	kp = 1 << LSGR;
+	krp = 1 << LSGR;
+
+	/* process all the input coefficients */
+	while (data_size > 0)
+	{
+		int input;
+
+		if (k)
+		{
+			int numZeros;
+			int runmax;
+			int mag;
+			int sign;
+
+			/* RUN-LENGTH MODE */
+
+			/* collect the run of zeros in the input stream */
+			numZeros = 0;
+			GetNextInput(input);
+			while (input == 0 && data_size > 0)
+			{
+				numZeros++;
+				GetNextInput(input);
+			}
+
+			/* emit output zeros */
+			runmax = 1 << k;
+			while (numZeros >= runmax)
+			{
+				rfx_bitwriter_put_bits(bw, 0, 1);
+				numZeros -= runmax;
+				UpdateParam(kp, UP_GR, k); /* update kp, k */
+				runmax = 1 << k;
+			}
+
+			/* a 1 to terminate runs, the remaining run length in k bits and the sign bit */
+			mag = (input < 0 ? -input : input);
+			sign = (input < 0 ? 1 : 0);
+			rfx_bitwriter_put_bits(bw, (1U << (k + 1)) | ((uint32) numZeros << 1) | sign, k + 2);
+
+			rfx_rlgr_code_gr_fast(bw, &krp, mag ? mag - 1 : 0); /* output GR code for (mag - 1) */
+
+			UpdateParam(kp, -DN_GR, k);
+		}
+		else
+		{
+			/* GOLOMB-RICE MODE */
+
+			if (mode == RLGR1)
+			{
+				uint32 twoMs;
+
+				GetNextInput(input);
+				twoMs = Get2MagSign(input);
+				rfx_rlgr_code_gr_fast(bw, &krp, twoMs);
+
+				if (twoMs)
+				{
+					UpdateParam(kp, -DQ_GR, k);
+				}
+				else
+				{
+					UpdateParam(kp, UQ_GR, k);
+				}
+			}
+			else /* mode == RLGR3 */
+			{
+				uint32 twoMs1;
+				uint32 twoMs2;
+				uint32 sum2Ms;
+				uint32 nIdx;
+
+				GetNextInput(input);
+				twoMs1 = Get2MagSign(input);
+				GetNextInput(input);
+				twoMs2 = Get2MagSign(input);
+				sum2Ms = twoMs1 + twoMs2;
+
+				rfx_rlgr_code_gr_fast(bw, &krp, sum2Ms);
+
+				/* encode binary representation of the first input (twoMs1). */
+				nIdx = sum2Ms ? 32 - rfx_clz32(sum2Ms) : 0;
+				rfx_bitwriter_put_bits(bw, twoMs1, nIdx);
+
+				if (twoMs1 && twoMs2)
+				{
+					UpdateParam(kp, -2 * DQ_GR, k);
+				}
+				else if (!twoMs1 && !twoMs2)
+				{
+					UpdateParam(kp, 2 * UQ_GR, k);
+				}
+			}
+		}
+	}
+
+	return rfx_bitwriter_flush(bw);
+}
@@ -23,6 +23,7 @@
 #include "config.h"
 #include <freerdp/utils/debug.h>
 #include <freerdp/utils/profiler.h>
+#include <freerdp/utils/stream.h>
 
 #ifdef WITH_DEBUG_RFX
 #define DEBUG_RFX(fmt, ...) DEBUG_CLASS(RFX, fmt, ## __VA_ARGS__)
@@ -32,23 +33,82 @@
 
 #include "rfx_pool.h"
 
-struct _RFX_CONTEXT_PRIV
+/* per-thread scratch buffers for transforming one tile */
+struct _RFX_SCRATCH
 {
-	/* pre-allocated buffers */
-
-	RFX_POOL* pool; /* memory pool */
-
 	sint16 y_r_mem[4096 + 8]; /* 4096 = 64x64 (+ 8x2 = 16 for mem align) */
 	sint16 cb_g_mem[4096 + 8]; /* 4096 = 64x64 (+ 8x2 = 16 for mem align) */
 	sint16 cr_b_mem[4096 + 8]; /* 4096 = 64x64 (+ 8x2 = 16 for mem align) */
- 
- 	sint16* y_r_buffer;
+
+	sint16* y_r_buffer;
 	sint16* cb_g_buffer;
 	sint16* cr_b_buffer;
- 
+
 	sint16 dwt_mem[32 * 32 * 2 * 2 + 8]; /* maximum sub-band width is 32 */
 
 	sint16* dwt_buffer;
+};
+typedef struct _RFX_SCRATCH RFX_SCRATCH;
+
+/* tile header parsed ahead of a parallel decode */
+struct _RFX_TILE_INFO
+{
+	uint8 quantIdxY;
+	uint8 quantIdxCb;
+	uint8 quantIdxCr;
+	uint16 YLen;
+	uint16 CbLen;
+	uint16 CrLen;
+	uint8* data; /* YData, followed by CbData and CrData */
+};
+typedef struct _RFX_TILE_INFO RFX_TILE_INFO;
+
+/* destination of rfx_process_message_to_surface */
+struct _RFX_SURFACE
+{
+	uint8* data;
+	int width;
+	int height;
+	int stride;
+	RFX_PIXEL_FORMAT format;
+	int left; /* position of the message origin on the surface */
+	int top;
+};
+typedef struct _RFX_SURFACE RFX_SURFACE;
+
+struct _RFX_WORKERS;
+
+struct _RFX_CONTEXT_PRIV
+{
+	/* pre-allocated buffers */
+
+	RFX_POOL* pool; /* memory pool */
+
+	RFX_SCRATCH* scratch; /* buffers used by the calling thread */
+
+	/* parallel encode and decode, see rfx_context_set_threads */
+	struct _RFX_WORKERS* workers;
+	STREAM** tile_streams; /* one output stream per encode job */
+	int num_tile_streams;
+	RFX_TILE_INFO* tile_info; /* one entry per tile to decode */
+	int tile_info_size;
+
+	/* set while decoding straight into a surface, tiles are decoded after the region is known */
+	RFX_SURFACE* surface;
+	int num_surface_tiles;
+
+	/* encoder tile cache, see rfx_context_set_tile_cache */
+	boolean tile_cache;
+	uint64* tile_hashes; /* hash of the last tile sent, 0 if unknown */
+	int tile_hash_cols;
+	int tile_hash_rows;
+	uint32 tiles_encoded;
+	uint32 tiles_skipped;
+
+	int* tile_list; /* tiles to encode in the current frame */
+	RFX_RECT* tile_rects; /* region of the current frame with the tile cache */
+	int tile_list_size;
+	int num_tile_rects;
 
 	/* profilers */
 	PROFILER_DEFINE(prof_rfx_decode_rgb);
@@ -70,4 +130,15 @@ struct _RFX_CONTEXT_PRIV
 	PROFILER_DEFINE(prof_rfx_encode_format_rgb);
 };
 
+/**
+ * The profilers are not thread safe, so tiles transformed on a worker
+ * thread are not profiled. Only the calling thread, which transforms
+ * with the context scratch, enters them.
+ */
+
+#define RFX_PROFILER_ENTER(context, scratch, prof) \
+	do { if ((scratch) == (context)->priv->scratch) PROFILER_ENTER((context)->priv->prof); } while (0)
+#define RFX_PROFILER_EXIT(context, scratch, prof) \
+	do { if ((scratch) == (context)->priv->scratch) PROFILER_EXIT((context)->priv->prof); } while (0)
+
 #endif /* __RFX_TYPES_H */
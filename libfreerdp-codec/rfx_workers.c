@@ -0,0 +1,178 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol client.
+ * RemoteFX Codec Library - Worker Threads
+ *
+ * Copyright 2014 Jay Sorg <jay.sorg@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <freerdp/utils/memory.h>
+
+#include "rfx_workers.h"
+
+RFX_SCRATCH* rfx_scratch_new(void)
+{
+	RFX_SCRATCH* scratch;
+
+	scratch = xnew(RFX_SCRATCH);
+
+	/* align buffers to 16 byte boundary (needed for SSE/SSE2 instructions) */
+	scratch->y_r_buffer = (sint16*)(((uintptr_t)scratch->y_r_mem + 16) & ~ 0x0F);
+	scratch->cb_g_buffer = (sint16*)(((uintptr_t)scratch->cb_g_mem + 16) & ~ 0x0F);
+	scratch->cr_b_buffer = (sint16*)(((uintptr_t)scratch->cr_b_mem + 16) & ~ 0x0F);
+
+	scratch->dwt_buffer = (sint16*)(((uintptr_t)scratch->dwt_mem + 16) & ~ 0x0F);
+
+	return scratch;
+}
+
+void rfx_scratch_free(RFX_SCRATCH* scratch)
+{
+	xfree(scratch);
+}
+
+/* claims jobs of the current batch until there are none left */
+static void rfx_workers_process(RFX_WORKERS* workers, RFX_SCRATCH* scratch)
+{
+	int job;
+
+	while (1)
+	{
+		freerdp_mutex_lock(workers->mutex);
+		job = workers->next_job++;
+		freerdp_mutex_unlock(workers->mutex);
+
+		if (job >= workers->num_jobs)
+			break;
+
+		workers->func(workers->arg, job, scratch);
+	}
+}
+
+static void* rfx_worker_thread_func(void* arg)
+{
+	RFX_WORKER* worker = (RFX_WORKER*) arg;
+	RFX_WORKERS* workers = worker->workers;
+
+	while (1)
+	{
+		freerdp_thread_wait(worker->thread);
+
+		if (freerdp_thread_is_stopped(worker->thread))
+			break;
+
+		freerdp_thread_reset(worker->thread);
+
+		rfx_workers_process(workers, worker->scratch);
+
+		freerdp_mutex_lock(workers->mutex);
+		workers->active--;
+		if (workers->active == 0)
+			wait_obj_set(workers->done);
+		freerdp_mutex_unlock(workers->mutex);
+	}
+
+	freerdp_thread_quit(worker->thread);
+
+	return NULL;
+}
+
+/**
+ * Start a pool of worker threads, each with its own scratch buffers.
+ * @param count number of threads, the thread calling rfx_workers_run
+ * also takes jobs
+ * @return new pool
+ */
+
+RFX_WORKERS* rfx_workers_new(int count)
+{
+	int i;
+	RFX_WORKERS* workers;
+
+	workers = xnew(RFX_WORKERS);
+	workers->count = count;
+	workers->worker = (RFX_WORKER*) xzalloc(sizeof(RFX_WORKER) * count);
+	workers->mutex = freerdp_mutex_new();
+	workers->done = wait_obj_new();
+
+	for (i = 0; i < count; i++)
+	{
+		workers->worker[i].workers = workers;
+		workers->worker[i].scratch = rfx_scratch_new();
+		workers->worker[i].thread = freerdp_thread_new();
+		freerdp_thread_start(workers->worker[i].thread, rfx_worker_thread_func, &workers->worker[i]);
+	}
+
+	return workers;
+}
+
+void rfx_workers_free(RFX_WORKERS* workers)
+{
+	int i;
+
+	if (workers == NULL)
+		return;
+
+	/* ask every thread to stop first so they wind down together */
+	for (i = 0; i < workers->count; i++)
+		wait_obj_set(workers->worker[i].thread->signals[0]);
+
+	for (i = 0; i < workers->count; i++)
+	{
+		freerdp_thread_stop(workers->worker[i].thread);
+		freerdp_thread_free(workers->worker[i].thread);
+		rfx_scratch_free(workers->worker[i].scratch);
+	}
+
+	wait_obj_free(workers->done);
+	freerdp_mutex_free(workers->mutex);
+	xfree(workers->worker);
+	xfree(workers);
+}
+
+/**
+ * Run func for every job in [0, num_jobs) spread over the pool, and wait
+ * for all of them to finish.
+ * @param workers pool
+ * @param func job function
+ * @param arg passed to every func call
+ * @param num_jobs number of jobs
+ * @param scratch scratch buffers of the calling thread
+ */
+
+void rfx_workers_run(RFX_WORKERS* workers, RFX_WORKER_FUNC func, void* arg,
+	int num_jobs, RFX_SCRATCH* scratch)
+{
+	int i;
+
+	workers->func = func;
+	workers->arg = arg;
+	workers->num_jobs = num_jobs;
+	workers->next_job = 0;
+	workers->active = workers->count;
+
+	wait_obj_clear(workers->done);
+
+	for (i = 0; i < workers->count; i++)
+		freerdp_thread_signal(workers->worker[i].thread);
+
+	rfx_workers_process(workers, scratch);
+
+	if (workers->count > 0)
+		wait_obj_select(&workers->done, 1, -1);
+}
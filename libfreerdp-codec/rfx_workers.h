@@ -0,0 +1,65 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol client.
+ * RemoteFX Codec Library - Worker Threads
+ *
+ * Copyright 2014 Jay Sorg <jay.sorg@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __RFX_WORKERS_H
+#define __RFX_WORKERS_H
+
+#include <freerdp/utils/mutex.h>
+#include <freerdp/utils/thread.h>
+#include <freerdp/utils/wait_obj.h>
+
+#include "rfx_types.h"
+
+typedef void (*RFX_WORKER_FUNC)(void* arg, int job, RFX_SCRATCH* scratch);
+
+typedef struct _RFX_WORKERS RFX_WORKERS;
+
+struct _RFX_WORKER
+{
+	RFX_WORKERS* workers;
+	freerdp_thread* thread;
+	RFX_SCRATCH* scratch;
+};
+typedef struct _RFX_WORKER RFX_WORKER;
+
+struct _RFX_WORKERS
+{
+	int count;
+	RFX_WORKER* worker;
+
+	freerdp_mutex mutex;
+	struct wait_obj* done;
+	int active;
+
+	/* current batch */
+	RFX_WORKER_FUNC func;
+	void* arg;
+	int num_jobs;
+	int next_job;
+};
+
+RFX_SCRATCH* rfx_scratch_new(void);
+void rfx_scratch_free(RFX_SCRATCH* scratch);
+
+RFX_WORKERS* rfx_workers_new(int count);
+void rfx_workers_free(RFX_WORKERS* workers);
+void rfx_workers_run(RFX_WORKERS* workers, RFX_WORKER_FUNC func, void* arg,
+	int num_jobs, RFX_SCRATCH* scratch);
+
+#endif /* __RFX_WORKERS_H */
@@ -178,33 +178,107 @@ void rdp_write_persistent_list_entry(STREAM* s, uint32 key1, uint32 key2)
 	stream_write_uint32(s, key2); /* key2 (4 bytes) */
 }
 
-void rdp_write_client_persistent_key_list_pdu(STREAM* s, rdpSettings* settings)
+void rdp_write_client_persistent_key_list_pdu(STREAM* s, uint16* numEntries, uint16* totalEntries, uint8 bBitMask)
 {
-	stream_write_uint16(s, 0); /* numEntriesCache0 (2 bytes) */
-	stream_write_uint16(s, 0); /* numEntriesCache1 (2 bytes) */
-	stream_write_uint16(s, 0); /* numEntriesCache2 (2 bytes) */
-	stream_write_uint16(s, 0); /* numEntriesCache3 (2 bytes) */
-	stream_write_uint16(s, 0); /* numEntriesCache4 (2 bytes) */
-	stream_write_uint16(s, 0); /* totalEntriesCache0 (2 bytes) */
-	stream_write_uint16(s, 0); /* totalEntriesCache1 (2 bytes) */
-	stream_write_uint16(s, 0); /* totalEntriesCache2 (2 bytes) */
-	stream_write_uint16(s, 0); /* totalEntriesCache3 (2 bytes) */
-	stream_write_uint16(s, 0); /* totalEntriesCache4 (2 bytes) */
-	stream_write_uint8(s, PERSIST_FIRST_PDU | PERSIST_LAST_PDU); /* bBitMask (1 byte) */
+	int i;
+
+	for (i = 0; i < 5; i++)
+		stream_write_uint16(s, numEntries[i]); /* numEntriesCacheX (2 bytes) */
+
+	for (i = 0; i < 5; i++)
+		stream_write_uint16(s, totalEntries[i]); /* totalEntriesCacheX (2 bytes) */
+
+	stream_write_uint8(s, bBitMask); /* bBitMask (1 byte) */
 	stream_write_uint8(s, 0); /* pad1 (1 byte) */
 	stream_write_uint16(s, 0); /* pad3 (2 bytes) */
 
-	/* entries */
+	/* entries follow, written by the caller */
 }
 
+/**
+ * Send the keys of every persistent cell, split in as many PDUs as needed.
+ * Keys are consumed in cell order, each PDU carrying at most
+ * PERSIST_MAX_KEYS_PER_PDU entries; the server assigns them cache indices
+ * sequentially from zero in each cell.
+ */
+
 tbool rdp_send_client_persistent_key_list_pdu(rdpRdp* rdp)
 {
+	int i;
 	STREAM* s;
+	uint32 j;
+	uint32 count;
+	uint32 total;
+	uint32 sent;
+	uint8 bBitMask;
+	uint64* keys[5];
+	uint32 offset[5];
+	uint16 numEntries[5];
+	uint16 totalEntries[5];
+	rdpSettings* settings = rdp->settings;
+	BITMAP_CACHE_V2_CELL_INFO* cellInfo;
+
+	total = 0;
+
+	for (i = 0; i < 5; i++)
+	{
+		totalEntries[i] = 0;
+		keys[i] = NULL;
+		offset[i] = 0;
 
-	s = rdp_data_pdu_init(rdp);
-	rdp_write_client_persistent_key_list_pdu(s, rdp->settings);
+		if (!settings->persistent_bitmap_cache || i >= (int) settings->bitmapCacheV2NumCells)
+			continue;
+
+		cellInfo = &settings->bitmapCacheV2CellInfo[i];
+
+		if (cellInfo->persistent && cellInfo->persistentKeys != NULL)
+		{
+			totalEntries[i] = (uint16) MIN(cellInfo->numPersistentKeys, cellInfo->numEntries);
+			keys[i] = cellInfo->persistentKeys;
+			total += totalEntries[i];
+		}
+	}
+
+	sent = 0;
+	bBitMask = PERSIST_FIRST_PDU;
 
-	return rdp_send_data_pdu(rdp, s, DATA_PDU_TYPE_BITMAP_CACHE_PERSISTENT_LIST, rdp->mcs->user_id);
+	do
+	{
+		count = 0;
+
+		for (i = 0; i < 5; i++)
+		{
+			numEntries[i] = (uint16) MIN(totalEntries[i] - offset[i], PERSIST_MAX_KEYS_PER_PDU - count);
+			count += numEntries[i];
+		}
+
+		if (sent + count == total)
+			bBitMask |= PERSIST_LAST_PDU;
+
+		s = rdp_data_pdu_init(rdp);
+		stream_check_size(s, 24 + count * 8);
+		rdp_write_client_persistent_key_list_pdu(s, numEntries, totalEntries, bBitMask);
+
+		for (i = 0; i < 5; i++)
+		{
+			for (j = 0; j < numEntries[i]; j++)
+			{
+				rdp_write_persistent_list_entry(s, (uint32) (keys[i][offset[i] + j] & 0xFFFFFFFF),
+						(uint32) (keys[i][offset[i] + j] >> 32));
+			}
+
+			offset[i] += numEntries[i];
+		}
+
+		if (!rdp_send_data_pdu(rdp, s, DATA_PDU_TYPE_BITMAP_CACHE_PERSISTENT_LIST, rdp->mcs->user_id))
+			return false;
+
+		sent += count;
+		bBitMask = 0;
+	}
+	while (sent < total);
+
+	return true;
 }
 
 tbool rdp_recv_client_font_list_pdu(STREAM* s)
@@ -293,7 +367,7 @@ tbool rdp_recv_deactivate_all(rdpRdp* rdp, STREAM* s)
 #if 0
 	while (rdp->state != CONNECTION_STATE_ACTIVE)
 	{
-		if (rdp_check_fds(rdp) < 0)
+		if (rdp_check_fds(rdp, NULL) < 0)
 			return false;
 		if (rdp->disconnect)
 			break;
@@ -35,6 +35,8 @@
 #define PERSIST_FIRST_PDU		0x01
 #define PERSIST_LAST_PDU		0x02
 
+#define PERSIST_MAX_KEYS_PER_PDU	169
+
 #define FONTLIST_FIRST			0x0001
 #define FONTLIST_LAST			0x0002
 
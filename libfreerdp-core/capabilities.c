@@ -1049,6 +1049,9 @@ void rdp_read_virtual_channel_capability_set(STREAM* s, uint16 length, rdpSettin
 	else
 		VCChunkSize = 1600;
 
+	/* the peer's flags, they say which way channel data may be compressed */
+	settings->vc_flags = flags;
+
 	if (settings->server_mode == false)
 		settings->vc_chunk_size = VCChunkSize;
 }
@@ -36,6 +36,7 @@ tbool freerdp_channel_send(rdpRdp* rdp, uint16 channel_id, uint8* data, int size
 	int i, left;
 	int chunk_size;
 	rdpChannel* channel = NULL;
+	struct rdp_mppc_enc* enc = NULL;
 
 	for (i = 0; i < rdp->settings->num_channels; i++)
 	{
@@ -52,6 +53,9 @@ tbool freerdp_channel_send(rdpRdp* rdp, uint16 channel_id, uint8* data, int size
 		return false;
 	}
 
+	if (channel->options & CHANNEL_OPTION_COMPRESS_RDP)
+		enc = rdp_get_bulk_compressor(rdp, true);
+
 	flags = CHANNEL_FLAG_FIRST;
 	left = size;
 	while (left > 0)
@@ -73,9 +77,20 @@ tbool freerdp_channel_send(rdpRdp* rdp, uint16 channel_id, uint8* data, int size
 		}
 
 		stream_write_uint32(s, size);
-		stream_write_uint32(s, flags);
-		stream_check_size(s, chunk_size);
-		stream_write(s, data, chunk_size);
+
+		if ((enc != NULL) && compress_rdp(enc, data, chunk_size))
+		{
+			/* the compression flags go in bits 16 to 23, CHANNEL_FLAG_PACKET_* */
+			stream_write_uint32(s, flags | ((uint32) enc->flags << 16));
+			stream_check_size(s, enc->bytes_in_opb);
+			stream_write(s, enc->output_buf, enc->bytes_in_opb);
+		}
+		else
+		{
+			stream_write_uint32(s, flags);
+			stream_check_size(s, chunk_size);
+			stream_write(s, data, chunk_size);
+		}
 
 		rdp_send(rdp, s, channel_id);
 
@@ -87,30 +102,69 @@ tbool freerdp_channel_send(rdpRdp* rdp, uint16 channel_id, uint8* data, int size
 	return true;
 }
 
+/**
+ * Decompress a channel chunk in place of the stream data, the compression
+ * flags are stripped from the channel flags handed to the channel.
+ * @return false if the chunk cannot be decompressed
+ */
+
+static tbool freerdp_channel_decompress(rdpRdp* rdp, STREAM* s, uint32* flags, uint8** data, int* chunk_length)
+{
+	int ctype;
+	uint32 roff;
+	uint32 rlen;
+
+	*data = stream_get_tail(s);
+	*chunk_length = stream_get_left(s);
+
+	if (!(*flags & (CHANNEL_FLAG_PACKET_COMPRESSED | CHANNEL_FLAG_PACKET_AT_FRONT | CHANNEL_FLAG_PACKET_FLUSHED)))
+		return true;
+
+	ctype = (*flags >> 16) & 0xFF;
+	*flags &= ~0x00FF0000;
+
+	if (!decompress_rdp_vc(rdp, *data, *chunk_length, ctype, &roff, &rlen))
+	{
+		printf("freerdp_channel_decompress: decompression failed\n");
+		return false;
+	}
+
+	*data = rdp->mppc_vc->history_buf + roff;
+	*chunk_length = rlen;
+
+	return true;
+}
+
 void freerdp_channel_process(freerdp* instance, STREAM* s, uint16 channel_id)
 {
 	uint32 length;
 	uint32 flags;
+	uint8* data;
 	int chunk_length;
 
 	stream_read_uint32(s, length);
 	stream_read_uint32(s, flags);
-	chunk_length = stream_get_left(s);
+
+	if (!freerdp_channel_decompress(instance->context->rdp, s, &flags, &data, &chunk_length))
+		return;
 
 	IFCALL(instance->ReceiveChannelData, instance,
-		channel_id, stream_get_tail(s), chunk_length, flags, length);
+		channel_id, data, chunk_length, flags, length);
 }
 
 void freerdp_channel_peer_process(freerdp_peer* client, STREAM* s, uint16 channel_id)
 {
 	uint32 length;
 	uint32 flags;
+	uint8* data;
 	int chunk_length;
 
 	stream_read_uint32(s, length);
 	stream_read_uint32(s, flags);
-	chunk_length = stream_get_left(s);
+
+	if (!freerdp_channel_decompress(client->context->rdp, s, &flags, &data, &chunk_length))
+		return;
 
 	IFCALL(client->ReceiveChannelData, client,
-		channel_id, stream_get_tail(s), chunk_length, flags, length);
+		channel_id, data, chunk_length, flags, length);
 }
@@ -131,7 +131,7 @@ tbool rdp_client_connect(rdpRdp* rdp)
 	{
 		/* TODO: don't use sleep here */
 		freerdp_usleep(1000 * 100);
-		if (rdp_check_fds(rdp) < 0)
+		if (rdp_check_fds(rdp, NULL) < 0)
 		{
 			LLOGLN(0, ("rdp_client_connect: error rdp_check_fds failed"));
 			return false;
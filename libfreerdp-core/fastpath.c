@@ -22,6 +22,7 @@
 #include <string.h>
 #include <freerdp/api.h>
 #include <freerdp/utils/stream.h>
+#include <freerdp/utils/hotpath.h>
 
 #include "orders.h"
 #include "per.h"
@@ -188,8 +189,10 @@ static void fastpath_recv_update(rdpFastPath* fastpath, uint8 updateCode, uint32
 	rdpUpdate* update = fastpath->rdp->update;
 	rdpContext* context = fastpath->rdp->update->context;
 	rdpPointerUpdate* pointer = update->pointer;
+	HOTPATH_DEFINE(start);
 
 	LLOGLN(10, ("fastpath_recv_update: %d", updateCode));
+	HOTPATH_ENTER(start);
 	switch (updateCode)
 	{
 		case FASTPATH_UPDATETYPE_ORDERS:
@@ -244,6 +247,69 @@ static void fastpath_recv_update(rdpFastPath* fastpath, uint8 updateCode, uint32
 			DEBUG_WARN("unknown updateCode 0x%X", updateCode);
 			break;
 	}
+	HOTPATH_EXIT(start, HOTPATH_FASTPATH_UPDATE);
+}
+
+/**
+ * Make room for size more bytes of a fragmented update. The buffer is never
+ * shrunk, so once it reached the largest update seen it is just reused.
+ */
+
+static void fastpath_reserve_update_data(rdpFastPath* fastpath, uint32 size)
+{
+	uint32 pos;
+	uint32 needed;
+	STREAM* updateData;
+
+	updateData = fastpath->updateData;
+	pos = stream_get_pos(updateData);
+	needed = pos + size;
+
+	if (needed <= (uint32) updateData->size)
+		return;
+
+	/* grow geometrically when the total size was not known up front */
+	needed = MAX(needed, (uint32) updateData->size * 2);
+
+	updateData->data = (uint8*) xrealloc(updateData->data, needed);
+	updateData->size = needed;
+	stream_set_pos(updateData, pos);
+	fastpath->reassemblyReallocs++;
+
+	LLOGLN(10, ("fastpath_reserve_update_data: %d bytes, %d reallocs, %lld bytes reassembled",
+		needed, fastpath->reassemblyReallocs, (long long) fastpath->reassemblyBytes));
+}
+
+/**
+ * Fast-path fragments do not carry the size of the whole update, but a
+ * fragmented surface bits command does: it is the command header plus
+ * bitmapDataLength, which the first fragment always holds. It is trusted
+ * up to the MaxRequestSize we advertised. Other updates return the size of
+ * the first fragment.
+ */
+
+static uint32 fastpath_get_update_size_hint(rdpFastPath* fastpath, uint8 updateCode, uint8* data, uint32 size)
+{
+	uint16 cmdType;
+	uint32 maxSize;
+	uint32 bitmapDataLength;
+
+	if ((updateCode != FASTPATH_UPDATETYPE_SURFCMDS) || (size < SURFCMD_SURFACE_BITS_HEADER_LENGTH))
+		return size;
+
+	cmdType = data[0] | (data[1] << 8);
+
+	if ((cmdType != CMDTYPE_SET_SURFACE_BITS) && (cmdType != CMDTYPE_STREAM_SURFACE_BITS))
+		return size;
+
+	bitmapDataLength = data[18] | (data[19] << 8) | (data[20] << 16) | ((uint32) data[21] << 24);
+	maxSize = fastpath->rdp->settings->multifrag_max_request_size;
+
+	/* room for a frame marker following the command */
+	if (bitmapDataLength > maxSize - MIN(maxSize, SURFCMD_SURFACE_BITS_HEADER_LENGTH + SURFCMD_FRAME_MARKER_LENGTH))
+		return size;
+
+	return MAX(size, SURFCMD_SURFACE_BITS_HEADER_LENGTH + bitmapDataLength + SURFCMD_FRAME_MARKER_LENGTH);
 }
 
 static void fastpath_recv_update_data(rdpFastPath* fastpath, STREAM* s)
@@ -287,8 +353,10 @@ static void fastpath_recv_update_data(rdpFastPath* fastpath, STREAM* s)
 		}
 		else
 		{
+			/* drop the update, its data can not be trusted */
 			printf("decompress_rdp() failed\n");
-			stream_seek(s, size);
+			stream_set_pos(s, next_pos);
+			return;
 		}
 	}
 
@@ -301,10 +369,14 @@ static void fastpath_recv_update_data(rdpFastPath* fastpath, STREAM* s)
 	else
 	{
 		if (fragmentation == FASTPATH_FRAGMENT_FIRST)
+		{
 			stream_set_pos(fastpath->updateData, 0);
+			fastpath_reserve_update_data(fastpath, fastpath_get_update_size_hint(fastpath, updateCode, comp_stream->p, size));
+		}
 
-		stream_check_size(fastpath->updateData, size);
+		fastpath_reserve_update_data(fastpath, size);
 		stream_copy(fastpath->updateData, comp_stream, size);
+		fastpath->reassemblyBytes += size;
 
 		if (fragmentation == FASTPATH_FRAGMENT_LAST)
 		{
@@ -637,20 +709,25 @@ tbool fastpath_send_update_pdu(rdpFastPath* fastpath, uint8 updateCode, STREAM*
 	rdpRdp *rdp;
 	uint8* bm;
 	uint8* ptr;
+	uint8* data;
 	int fragment;
 	int sec_bytes;
+	uint16 size;
 	uint16 length;
 	tbool result;
 	uint16 pduLength;
 	uint16 maxLength;
 	uint32 totalLength;
 	uint8 fragmentation;
+	uint8 compression;
 	uint8 header;
 	STREAM* update;
+	struct rdp_mppc_enc* enc;
 
 	result = true;
 
 	rdp = fastpath->rdp;
+	enc = rdp_get_bulk_compressor(rdp, false);
 	sec_bytes = fastpath_get_sec_bytes(rdp);
 	maxLength = FASTPATH_MAX_PACKET_SIZE - 6 - sec_bytes;
 	totalLength = stream_get_length(s) - 6 - sec_bytes;
@@ -661,7 +738,6 @@ tbool fastpath_send_update_pdu(rdpFastPath* fastpath, uint8 updateCode, STREAM*
 	{
 		length = MIN(maxLength, totalLength);
 		totalLength -= length;
-		pduLength = length + 6 + sec_bytes;
 
 		if (totalLength == 0)
 			fragmentation = (fragment == 0) ? FASTPATH_FRAGMENT_SINGLE : FASTPATH_FRAGMENT_LAST;
@@ -669,6 +745,19 @@ tbool fastpath_send_update_pdu(rdpFastPath* fastpath, uint8 updateCode, STREAM*
 			fragmentation = (fragment == 0) ? FASTPATH_FRAGMENT_FIRST : FASTPATH_FRAGMENT_NEXT;
 
 		stream_get_mark(s, bm);
+		data = bm + 6 + sec_bytes;
+		size = length;
+		compression = 0;
+
+		/* each fragment is compressed on its own, the compressionFlags byte is made up by the savings */
+		if ((enc != NULL) && compress_rdp(enc, data, length))
+		{
+			memcpy(data + 1, enc->output_buf, enc->bytes_in_opb);
+			size = enc->bytes_in_opb;
+			compression = FASTPATH_OUTPUT_COMPRESSION_USED;
+		}
+
+		pduLength = size + 6 + sec_bytes + (compression ? 1 : 0);
 		header = 0;
 		if (sec_bytes > 0)
 			header |= (FASTPATH_OUTPUT_ENCRYPTED << 6);
@@ -677,8 +766,10 @@ tbool fastpath_send_update_pdu(rdpFastPath* fastpath, uint8 updateCode, STREAM*
 		stream_write_uint8(s, pduLength & 0xFF); /* length2 */
 		if (sec_bytes > 0)
 			stream_seek(s, sec_bytes);
-		fastpath_write_update_header(s, updateCode, fragmentation, 0);
-		stream_write_uint16(s, length);
+		fastpath_write_update_header(s, updateCode, fragmentation, compression);
+		if (compression)
+			stream_write_uint8(s, enc->flags); /* compressionFlags (1 byte) */
+		stream_write_uint16(s, size);
 
 		stream_attach(update, bm, pduLength);
 		stream_seek(update, pduLength);
@@ -686,10 +777,10 @@ tbool fastpath_send_update_pdu(rdpFastPath* fastpath, uint8 updateCode, STREAM*
 		{
 			ptr = bm + 3 + sec_bytes;
 			if (rdp->sec_flags & SEC_SECURE_CHECKSUM)
-				security_salted_mac_signature(rdp, ptr, length + 3, true, bm + 3);
+				security_salted_mac_signature(rdp, ptr, pduLength - 3 - sec_bytes, true, bm + 3);
 			else
-				security_mac_signature(rdp, ptr, length + 3, bm + 3);
-			security_encrypt(ptr, length + 3, rdp);
+				security_mac_signature(rdp, ptr, pduLength - 3 - sec_bytes, bm + 3);
+			security_encrypt(ptr, pduLength - 3 - sec_bytes, rdp);
 		}
 		if (transport_write(fastpath->rdp->transport, update) < 0)
 		{
@@ -700,7 +791,7 @@ tbool fastpath_send_update_pdu(rdpFastPath* fastpath, uint8 updateCode, STREAM*
 		stream_detach(update);
 
 		/* Reserve 6+sec_bytes bytes for the next fragment header, if any. */
-		stream_seek(s, length - 6 - sec_bytes);
+		stream_set_mark(s, bm + length);
 	}
 
 	stream_free(update);
@@ -708,6 +799,13 @@ tbool fastpath_send_update_pdu(rdpFastPath* fastpath, uint8 updateCode, STREAM*
 	return result;
 }
 
+void fastpath_get_reassembly_stats(rdpFastPath* fastpath, uint64* bytes, uint32* reallocs, uint32* size)
+{
+	*bytes = fastpath->reassemblyBytes;
+	*reallocs = fastpath->reassemblyReallocs;
+	*size = fastpath->updateData->size;
+}
+
 rdpFastPath* fastpath_new(rdpRdp* rdp)
 {
 	rdpFastPath* fastpath;
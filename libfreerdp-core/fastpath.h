@@ -100,6 +100,10 @@ struct rdp_fastpath
 	uint8 encryptionFlags;
 	uint8 numberEvents;
 	STREAM* updateData;
+
+	/* fragment reassembly, updateData keeps its high-water mark size */
+	uint64 reassemblyBytes;
+	uint32 reassemblyReallocs;
 };
 
 uint16 fastpath_header_length(STREAM* s);
@@ -114,6 +118,8 @@ boolean fastpath_send_input_pdu(rdpFastPath* fastpath, STREAM* s);
 STREAM* fastpath_update_pdu_init(rdpFastPath* fastpath);
 boolean fastpath_send_update_pdu(rdpFastPath* fastpath, uint8 updateCode, STREAM* s);
 
+void fastpath_get_reassembly_stats(rdpFastPath* fastpath, uint64* bytes, uint32* reallocs, uint32* size);
+
 boolean fastpath_send_surfcmd_frame_marker(rdpFastPath* fastpath, uint16 frameAction, uint32 frameId);
 
 rdpFastPath* fastpath_new(rdpRdp* rdp);
@@ -27,6 +27,8 @@
 
 #include <freerdp/freerdp.h>
 #include <freerdp/utils/memory.h>
+#include <freerdp/utils/hotpath.h>
+#include <freerdp/utils/wait_obj.h>
 
 tbool freerdp_connect(freerdp* instance)
 {
@@ -35,6 +37,8 @@ tbool freerdp_connect(freerdp* instance)
 
 	rdp = instance->context->rdp;
 
+	hotpath_init();
+
 	extension_pre_connect(rdp->extension);
 
 	IFCALLRET(instance->PreConnect, status, instance);
@@ -112,14 +116,62 @@ tbool freerdp_get_fds(freerdp* instance, void** rfds, int* rcount, void** wfds,
 	return true;
 }
 
+/**
+ * Register the transport descriptors for read readiness with a caller owned
+ * epoll instance, call freerdp_check_fds when one is ready. The transport
+ * descriptors change on connect and redirection, register after those.
+ * @param instance instance
+ * @param epfd epoll instance
+ * @param data returned in epoll_event.data.ptr
+ * @return False on error or when epoll is not available
+ */
+
+tbool freerdp_epoll_add(freerdp* instance, int epfd, void* data)
+{
+	int rcount = 0;
+	int wcount = 0;
+	void* rfds[32];
+	void* wfds[32];
+
+	if (!freerdp_get_fds(instance, rfds, &rcount, wfds, &wcount))
+		return false;
+
+	return (wait_obj_epoll_add_fds(epfd, rfds, rcount, data) == 0);
+}
+
+tbool freerdp_epoll_del(freerdp* instance, int epfd)
+{
+	int rcount = 0;
+	int wcount = 0;
+	void* rfds[32];
+	void* wfds[32];
+
+	if (!freerdp_get_fds(instance, rfds, &rcount, wfds, &wcount))
+		return false;
+
+	return (wait_obj_epoll_del_fds(epfd, rfds, rcount) == 0);
+}
+
 tbool freerdp_check_fds(freerdp* instance)
+{
+	return freerdp_check_fds_ex(instance, NULL);
+}
+
+/**
+ * Process what the transport has ready, as freerdp_check_fds.
+ * @param instance instance
+ * @param count PDUs dispatched by this call, may be NULL
+ * @return False on error
+ */
+
+tbool freerdp_check_fds_ex(freerdp* instance, int* count)
 {
 	int status;
 	rdpRdp* rdp;
 
 	rdp = instance->context->rdp;
 
-	status = rdp_check_fds(rdp);
+	status = rdp_check_fds(rdp, count);
 
 	if (status < 0)
 		return false;
@@ -159,6 +211,8 @@ tbool freerdp_disconnect(freerdp* instance)
 	rdp = instance->context->rdp;
 	transport_disconnect(rdp->transport);
 
+	hotpath_dump();
+
 	return true;
 }
 
@@ -219,6 +273,37 @@ uint32 freerdp_error_info(freerdp* instance)
 	return instance->context->rdp->errorInfo;
 }
 
+/**
+ * Get the fast-path fragment reassembly counters.
+ * @param instance instance
+ * @param bytes bytes copied into the reassembly buffer
+ * @param reallocs times the reassembly buffer was grown
+ * @param size current size of the reassembly buffer
+ */
+
+void freerdp_get_reassembly_stats(freerdp* instance, uint64* bytes, uint32* reallocs, uint32* size)
+{
+	fastpath_get_reassembly_stats(instance->context->rdp->fastpath, bytes, reallocs, size);
+}
+
+/**
+ * Get the output queue counters, PDUs written while the transport is corked
+ * go out together in one write of the queue.
+ * @param instance instance
+ * @param pdus PDUs that went through the queue
+ * @param flushes writes of the queue
+ * @param peak most PDUs held in the queue at once
+ * @param stall_count times a write had to wait for the socket
+ * @param stall_time milliseconds spent waiting for the socket
+ */
+
+void freerdp_get_send_stats(freerdp* instance, uint32* pdus, uint32* flushes,
+		uint32* peak, uint32* stall_count, uint32* stall_time)
+{
+	transport_get_send_stats(instance->context->rdp->transport, pdus, flushes,
+			peak, stall_count, stall_time);
+}
+
 freerdp* freerdp_new()
 {
 	freerdp* instance;
@@ -398,6 +398,7 @@ tbool rdp_read_info_packet(STREAM* s, rdpSettings* settings)
 	settings->remote_app = ((flags & INFO_RAIL) ? true : false);
 	settings->console_audio = ((flags & INFO_REMOTECONSOLEAUDIO) ? true : false);
 	settings->compression = ((flags & INFO_COMPRESSION) ? true : false);
+	settings->compression_type = (flags & INFO_CompressionTypeMask) >> 9;
 
 	stream_read_uint16(s, cbDomain); /* cbDomain */
 	stream_read_uint16(s, cbUserName); /* cbUserName */
@@ -499,7 +500,7 @@ void rdp_write_info_packet(STREAM* s, rdpSettings* settings)
 		flags |= INFO_REMOTECONSOLEAUDIO;
 
 	if (settings->compression)
-		flags |= INFO_COMPRESSION | INFO_PACKET_COMPR_TYPE_64K;
+		flags |= INFO_COMPRESSION | ((settings->compression_type << 9) & INFO_CompressionTypeMask);
 
 	domain = (uint8*)freerdp_uniconv_out(settings->uniconv, settings->domain, &length);
 	cbDomain = length;
@@ -201,70 +201,188 @@ int decompress_rdp(rdpRdp* rdp, uint8* cbuf, int len, int ctype, uint32* roff, u
 }
 
 /**
- * decompress RDP 4 data
+ * MPPC bit stream decoding
  *
- * @param rdp     per session information
+ * Tokens are decoded from a 64-bit bit buffer holding the next stream bits
+ * MSB first, refilled a word at a time. The literal / copy offset prefix is
+ * resolved with one lookup on the top 5 bits, and the length of match prefix
+ * (a run of 1s terminated by a 0) with one or two lookups of a leading-ones
+ * table. A token never needs more than 19 + 30 bits, so one refill per token
+ * is enough.
+ */
+
+#define MPPC_LITERAL		0
+#define MPPC_LITERAL_ENCODED	1
+#define MPPC_COPY_OFFSET	2
+
+struct _MPPC_PREFIX_CODE
+{
+	uint8 type;     /* literal, encoded literal or copy offset */
+	uint8 length;   /* copy offset prefix length in bits */
+	uint8 bits;     /* copy offset bits following the prefix */
+	uint16 base;    /* copy offset base */
+};
+typedef struct _MPPC_PREFIX_CODE MPPC_PREFIX_CODE;
+
+/* RDP 5 (64K), indexed by the top 5 bits */
+static const MPPC_PREFIX_CODE mppc_prefix_64k[32] =
+{
+	{ MPPC_LITERAL, 0, 0, 0 }, { MPPC_LITERAL, 0, 0, 0 }, { MPPC_LITERAL, 0, 0, 0 }, { MPPC_LITERAL, 0, 0, 0 },
+	{ MPPC_LITERAL, 0, 0, 0 }, { MPPC_LITERAL, 0, 0, 0 }, { MPPC_LITERAL, 0, 0, 0 }, { MPPC_LITERAL, 0, 0, 0 },
+	{ MPPC_LITERAL, 0, 0, 0 }, { MPPC_LITERAL, 0, 0, 0 }, { MPPC_LITERAL, 0, 0, 0 }, { MPPC_LITERAL, 0, 0, 0 },
+	{ MPPC_LITERAL, 0, 0, 0 }, { MPPC_LITERAL, 0, 0, 0 }, { MPPC_LITERAL, 0, 0, 0 }, { MPPC_LITERAL, 0, 0, 0 },
+	{ MPPC_LITERAL_ENCODED, 0, 0, 0 }, { MPPC_LITERAL_ENCODED, 0, 0, 0 },
+	{ MPPC_LITERAL_ENCODED, 0, 0, 0 }, { MPPC_LITERAL_ENCODED, 0, 0, 0 },
+	{ MPPC_LITERAL_ENCODED, 0, 0, 0 }, { MPPC_LITERAL_ENCODED, 0, 0, 0 },
+	{ MPPC_LITERAL_ENCODED, 0, 0, 0 }, { MPPC_LITERAL_ENCODED, 0, 0, 0 },
+	{ MPPC_COPY_OFFSET, 3, 16, 2368 }, { MPPC_COPY_OFFSET, 3, 16, 2368 },
+	{ MPPC_COPY_OFFSET, 3, 16, 2368 }, { MPPC_COPY_OFFSET, 3, 16, 2368 },
+	{ MPPC_COPY_OFFSET, 4, 11, 320 }, { MPPC_COPY_OFFSET, 4, 11, 320 },
+	{ MPPC_COPY_OFFSET, 5, 8, 64 }, { MPPC_COPY_OFFSET, 5, 6, 0 }
+};
+
+/* RDP 4 (8K), indexed by the top 5 bits */
+static const MPPC_PREFIX_CODE mppc_prefix_8k[32] =
+{
+	{ MPPC_LITERAL, 0, 0, 0 }, { MPPC_LITERAL, 0, 0, 0 }, { MPPC_LITERAL, 0, 0, 0 }, { MPPC_LITERAL, 0, 0, 0 },
+	{ MPPC_LITERAL, 0, 0, 0 }, { MPPC_LITERAL, 0, 0, 0 }, { MPPC_LITERAL, 0, 0, 0 }, { MPPC_LITERAL, 0, 0, 0 },
+	{ MPPC_LITERAL, 0, 0, 0 }, { MPPC_LITERAL, 0, 0, 0 }, { MPPC_LITERAL, 0, 0, 0 }, { MPPC_LITERAL, 0, 0, 0 },
+	{ MPPC_LITERAL, 0, 0, 0 }, { MPPC_LITERAL, 0, 0, 0 }, { MPPC_LITERAL, 0, 0, 0 }, { MPPC_LITERAL, 0, 0, 0 },
+	{ MPPC_LITERAL_ENCODED, 0, 0, 0 }, { MPPC_LITERAL_ENCODED, 0, 0, 0 },
+	{ MPPC_LITERAL_ENCODED, 0, 0, 0 }, { MPPC_LITERAL_ENCODED, 0, 0, 0 },
+	{ MPPC_LITERAL_ENCODED, 0, 0, 0 }, { MPPC_LITERAL_ENCODED, 0, 0, 0 },
+	{ MPPC_LITERAL_ENCODED, 0, 0, 0 }, { MPPC_LITERAL_ENCODED, 0, 0, 0 },
+	{ MPPC_COPY_OFFSET, 3, 13, 320 }, { MPPC_COPY_OFFSET, 3, 13, 320 },
+	{ MPPC_COPY_OFFSET, 3, 13, 320 }, { MPPC_COPY_OFFSET, 3, 13, 320 },
+	{ MPPC_COPY_OFFSET, 4, 8, 64 }, { MPPC_COPY_OFFSET, 4, 8, 64 },
+	{ MPPC_COPY_OFFSET, 4, 6, 0 }, { MPPC_COPY_OFFSET, 4, 6, 0 }
+};
+
+/* number of leading 1 bits in a byte */
+static const uint8 mppc_leading_ones[256] =
+{
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+	3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+	4, 4, 4, 4, 4, 4, 4, 4, 5, 5, 5, 5, 6, 6, 7, 8
+};
+
+static INLINE uint64 mppc_load_be64(uint8* p)
+{
+	return ((uint64) p[0] << 56) | ((uint64) p[1] << 48) | ((uint64) p[2] << 40) | ((uint64) p[3] << 32) |
+		((uint64) p[4] << 24) | ((uint64) p[5] << 16) | ((uint64) p[6] << 8) | (uint64) p[7];
+}
+
+/**
+ * copy a match whose source starts dist bytes before its destination,
+ * using the widest moves that never read bytes the copy has not written
+ * yet and never write past the end of the match
+ */
+
+static INLINE void mppc_copy_match_bytes(uint8* dst, uint8* src, uint32 len, uint32 dist)
+{
+	if (dist >= 16)
+	{
+		while (len >= 16)
+		{
+			memcpy(dst, src, 16);
+			dst += 16;
+			src += 16;
+			len -= 16;
+		}
+	}
+
+	if (dist >= 8)
+	{
+		while (len >= 8)
+		{
+			memcpy(dst, src, 8);
+			dst += 8;
+			src += 8;
+			len -= 8;
+		}
+
+		if (len >= 4)
+		{
+			memcpy(dst, src, 4);
+			dst += 4;
+			src += 4;
+			len -= 4;
+		}
+	}
+
+	while (len-- > 0)
+		*dst++ = *src++;
+}
+
+/**
+ * decompress 8K or 64K MPPC data into the history of an MPPC context
+ *
+ * @param mppc    MPPC context holding the history buffer
  * @param cbuf    compressed data
  * @param len     length of compressed data
  * @param ctype   compression flags
  * @param roff    starting offset of uncompressed data
  * @param rlen    length of uncompressed data
+ * @param codes   literal / copy offset prefix codes (8K or 64K)
+ * @param max_lom maximum length of match prefix (number of leading 1s)
  *
  * @return        True on success, False on failure
  */
 
-int decompress_rdp_4(rdpRdp* rdp, uint8* cbuf, int len, int ctype, uint32* roff, uint32* rlen)
+static int mppc_decompress_bits(struct rdp_mppc* mppc, uint8* cbuf, int len, int ctype,
+		uint32* roff, uint32* rlen, const MPPC_PREFIX_CODE* codes, int max_lom)
 {
-	uint8*    history_buf;    /* uncompressed data goes here */
-	uint8*    history_ptr;    /* points to next free slot in history_buf */
-	uint32    d32;            /* we process 4 compressed bytes at a time */
-	uint16    copy_offset;    /* location to copy data from */
-	uint16    lom;            /* length of match */
-	uint8*    src_ptr;        /* used while copying compressed data */
-	uint8*    cptr;           /* points to next byte in cbuf */
-	uint8     cur_byte;       /* last byte fetched from cbuf */
-	int       bits_left;      /* bits left in d34 for processing */
-	int       cur_bits_left;  /* bits left in cur_byte for processing */
-	int       tmp;
-	uint32    i32;
-
-	printf("decompress_rdp_4:\n");
+	uint8* history_buf;     /* uncompressed data goes here */
+	uint8* history_ptr;     /* points to next free slot in history_buf */
+	uint8* history_end;
+	uint8* src_ptr;
+	uint8* cptr;            /* points to next byte in cbuf */
+	uint8* cend;
+	uint64 bitbuf;          /* next stream bits, MSB first */
+	int nbits;              /* bits loaded in bitbuf */
+	int bits_left;          /* stream bits not consumed yet */
+	uint32 copy_offset;
+	uint32 lom;
+	uint32 count;
+	int ones;
+	const MPPC_PREFIX_CODE* code;
 
-	if ((rdp->mppc == NULL) || (rdp->mppc->history_buf == NULL))
-	{
-		printf("decompress_rdp_4: null\n");
-		return false;
-	}
-
-	src_ptr = 0;
-	cptr = cbuf;
-	copy_offset = 0;
-	lom = 0;
-	bits_left = 0;
-	cur_bits_left = 0;
-	d32 = 0;
-	cur_byte = 0;
 	*rlen = 0;
 
 	/* get start of history buffer */
-	history_buf = rdp->mppc->history_buf;
+	history_buf = mppc->history_buf;
+	history_end = history_buf + RDP6_HISTORY_BUF_SIZE;
 
 	/* get next free slot in history buffer */
-	history_ptr = rdp->mppc->history_ptr;
+	history_ptr = mppc->history_ptr;
 	*roff = history_ptr - history_buf;
 
 	if (ctype & PACKET_AT_FRONT)
 	{
 		/* place compressed data at start of history buffer */
-		history_ptr = rdp->mppc->history_buf;
-		rdp->mppc->history_ptr = rdp->mppc->history_buf;
+		history_ptr = mppc->history_buf;
+		mppc->history_ptr = mppc->history_buf;
 		*roff = 0;
 	}
 
 	if (ctype & PACKET_FLUSHED)
 	{
 		/* re-init history buffer */
-		history_ptr = rdp->mppc->history_buf;
+		history_ptr = mppc->history_buf;
+		mppc->history_ptr = mppc->history_buf;
 		memset(history_buf, 0, RDP6_HISTORY_BUF_SIZE);
 		*roff = 0;
 	}
@@ -272,362 +390,176 @@ int decompress_rdp_4(rdpRdp* rdp, uint8* cbuf, int len, int ctype, uint32* roff,
 	if ((ctype & PACKET_COMPRESSED) != PACKET_COMPRESSED)
 	{
 		/* data in cbuf is not compressed - copy to history buf as is */
+		if (len > history_end - history_ptr)
+			return false;
+
 		memcpy(history_ptr, cbuf, len);
 		history_ptr += len;
-		*rlen = history_ptr - rdp->mppc->history_ptr;
-		rdp->mppc->history_ptr = history_ptr;
+		*rlen = history_ptr - mppc->history_ptr;
+		mppc->history_ptr = history_ptr;
 		return true;
 	}
 
-	/* load initial data */
-	tmp = 24;
-	while (cptr < cbuf + len)
-	{
-		i32 = *cptr++;
-		d32  |= i32 << tmp;
-		bits_left += 8;
-		tmp -= 8;
-		if (tmp < 0)
-		{
-			break;
-		}
-	}
-
-	if (cptr < cbuf + len)
-	{
-		cur_byte = *cptr++;
-		cur_bits_left = 8;
-	}
-	else
-	{
-		cur_bits_left = 0;
-	}
-
-	/*
-	** start uncompressing data in cbuf
-	*/
+	cptr = cbuf;
+	cend = cbuf + len;
+	bitbuf = 0;
+	nbits = 0;
+	bits_left = len * 8;
 
+	/* anything shorter than a literal is padding */
 	while (bits_left >= 8)
 	{
-		/*
-		   value 0xxxxxxx  = literal, not encoded
-		   value 10xxxxxx  = literal, encoded
-		   value 1111xxxx  = copy offset   0 - 63
-		   value 1110xxxx  = copy offset  64 - 319
-		   value 110xxxxx  = copy offset 320 - 8191
-		*/
-
-		/*
-		   at this point, we are guaranteed that d32 has 32 bits to
-		   be processed, unless we have reached end of cbuf
-		*/
-
-		copy_offset = 0;
-
-		if ((d32 & 0x80000000) == 0)
+		/* refill to at least 56 bits, zeroes past the end of the stream */
+		if (cend - cptr >= 8)
 		{
-			/* got a literal */
-			*history_ptr++ = d32 >> 24;
-			d32 <<= 8;
-			bits_left -= 8;
+			bitbuf |= mppc_load_be64(cptr) >> nbits;
+			cptr += (63 - nbits) >> 3;
+			nbits |= 56;
 		}
-		else if ((d32 & 0xc0000000) == 0x80000000)
-		{
-			/* got encoded literal */
-			d32 <<= 2;
-			*history_ptr++ = (d32 >> 25) | 0x80;
-			d32 <<= 7;
-			bits_left -= 9;
-		}
-		else if ((d32 & 0xf0000000) == 0xf0000000)
-		{
-			/* got copy offset in range 0 - 63, */
-			/* with 6 bit copy offset */
-			d32 <<= 4;
-			copy_offset = d32 >> 26;
-			d32 <<= 6;
-			bits_left -= 10;
-		}
-		else if ((d32 & 0xf0000000) == 0xe0000000)
-		{
-			/* got copy offset in range 64 - 319, */
-			/* with 8 bit copy offset */
-			d32 <<= 4;
-			copy_offset = d32 >> 24;
-			copy_offset += 64;
-			d32 <<= 8;
-			bits_left -= 12;
-		}
-		else if ((d32 & 0xe0000000) == 0xc0000000)
+		else
 		{
-			/* got copy offset in range 320 - 8191, */
-			/* with 13 bits copy offset */
-			d32 <<= 3;
-			copy_offset = d32 >> 19;
-			copy_offset += 320;
-			d32 <<= 13;
-			bits_left -= 16;
-		}
+			while (nbits <= 56)
+			{
+				if (cptr < cend)
+					bitbuf |= (uint64) *cptr++ << (56 - nbits);
 
-		/*
-		** get more bits before we process length of match
-		*/
+				nbits += 8;
+			}
+		}
 
-		/* how may bits do we need to get? */
-		tmp = 32 - bits_left;
+		code = &codes[bitbuf >> 59];
 
-		while (tmp)
+		if (code->type == MPPC_LITERAL)
 		{
-			if (cur_bits_left < tmp)
-			{
-				/* we have less bits than we need */
-				i32 = cur_byte >> (8 - cur_bits_left);
-				d32 |= i32 << ((32 - bits_left) - cur_bits_left);
-				bits_left += cur_bits_left;
-				tmp -= cur_bits_left;
-				if (cptr < cbuf + len)
-				{
-					/* more compressed data available */
-					cur_byte = *cptr++;
-					cur_bits_left = 8;
-				}
-				else
-				{
-					/* no more compressed data available */
-					tmp = 0;
-					cur_bits_left = 0;
-				}
-			}
-			else if (cur_bits_left > tmp)
-			{
-				/* we have more bits than we need */
-				d32 |= cur_byte >> (8 - tmp);
-				cur_byte <<= tmp;
-				cur_bits_left -= tmp;
-				bits_left = 32;
-				break;
-			}
-			else
-			{
-				/* we have just the right amount of bits */
-				d32 |= cur_byte >> (8 - tmp);
-				bits_left = 32;
-				if (cptr < cbuf + len)
-				{
-					cur_byte = *cptr++;
-					cur_bits_left = 8;
-				}
-				else
-				{
-					cur_bits_left = 0;
-				}
-				break;
-			}
+			/* 0xxxxxxx */
+			if (history_ptr >= history_end)
+				return false;
+
+			*history_ptr++ = (uint8) (bitbuf >> 56);
+			bitbuf <<= 8;
+			nbits -= 8;
+			bits_left -= 8;
+			continue;
 		}
 
-		if (!copy_offset)
+		if (code->type == MPPC_LITERAL_ENCODED)
 		{
+			/* 10xxxxxxx */
+			if (history_ptr >= history_end)
+				return false;
+
+			*history_ptr++ = (uint8) (((bitbuf >> 55) & 0x7f) | 0x80);
+			bitbuf <<= 9;
+			nbits -= 9;
+			bits_left -= 9;
 			continue;
 		}
 
-		/*
-		** compute Length of Match
-		*/
-
-		/*
-		   lengh of match  Encoding (binary header + LoM bits
-		   --------------  ----------------------------------
-		   3               0
-		   4...7           10 + 2 lower bits of L-o-M
-		   8...15          110 + 3 lower bits of L-o-M
-		   16...31         1110 + 4 lower bits of L-o-M
-		   32...63         11110 + 5 lower bits of L-o-M
-		   64...127        111110 + 6 lower bits of L-o-M
-		   128...255       1111110 + 7 lower bits of L-o-M
-		   256...511       11111110 + 8 lower bits of L-o-M
-		   512...1023      111111110 + 9 lower bits of L-o-M
-		   1024...2047     1111111110 + 10 lower bits of L-o-M
-		   2048...4095     11111111110 + 11 lower bits of L-o-M
-		   4096...8191     111111111110 + 12 lower bits of L-o-M
-		*/
-
-		if ((d32 & 0x80000000) == 0)
+		/* copy offset */
+		bitbuf <<= code->length;
+		copy_offset = (uint32) (bitbuf >> (64 - code->bits)) + code->base;
+		bitbuf <<= code->bits;
+		nbits -= code->length + code->bits;
+		bits_left -= code->length + code->bits;
+
+		/* length of match: n leading 1s, a 0, then n + 1 bits */
+		ones = mppc_leading_ones[bitbuf >> 56];
+
+		if (ones == 8)
+			ones += mppc_leading_ones[(bitbuf >> 48) & 0xff];
+
+		if (ones == 0)
 		{
-			/* lom is fixed to 3 */
 			lom = 3;
-			d32 <<= 1;
+			bitbuf <<= 1;
+			nbits -= 1;
 			bits_left -= 1;
 		}
-		else if ((d32 & 0xc0000000) == 0x80000000)
-		{
-			/* 2 lower bits of LoM */
-			lom = ((d32 >> 28) & 0x03) + 4;
-			d32 <<= 4;
-			bits_left -= 4;
-		}
-		else if ((d32 & 0xe0000000) == 0xc0000000)
-		{
-			/* 3 lower bits of LoM */
-			lom = ((d32 >> 26) & 0x07) + 8;
-			d32 <<= 6;
-			bits_left -= 6;
-		}
-		else if ((d32 & 0xf0000000) == 0xe0000000)
-		{
-			/* 4 lower bits of LoM */
-			lom = ((d32 >> 24) & 0x0f) + 16;
-			d32 <<= 8;
-			bits_left -= 8;
-		}
-		else if ((d32 & 0xf8000000) == 0xf0000000)
-		{
-			/* 5 lower bits of LoM */
-			lom = ((d32 >> 22) & 0x1f) + 32;
-			d32 <<= 10;
-			bits_left -= 10;
-		}
-		else if ((d32 & 0xfc000000) == 0xf8000000)
-		{
-			/* 6 lower bits of LoM */
-			lom = ((d32 >> 20) & 0x3f) + 64;
-			d32 <<= 12;
-			bits_left -= 12;
-		}
-		else if ((d32 & 0xfe000000) == 0xfc000000)
-		{
-			/* 7 lower bits of LoM */
-			lom = ((d32 >> 18) & 0x7f) + 128;
-			d32 <<= 14;
-			bits_left -= 14;
-		}
-		else if ((d32 & 0xff000000) == 0xfe000000)
-		{
-			/* 8 lower bits of LoM */
-			lom = ((d32 >> 16) & 0xff) + 256;
-			d32 <<= 16;
-			bits_left -= 16;
-		}
-		else if ((d32 & 0xff800000) == 0xff000000)
-		{
-			/* 9 lower bits of LoM */
-			lom = ((d32 >> 14) & 0x1ff) + 512;
-			d32 <<= 18;
-			bits_left -= 18;
-		}
-		else if ((d32 & 0xffc00000) == 0xff800000)
-		{
-			/* 10 lower bits of LoM */
-			lom = ((d32 >> 12) & 0x3ff) + 1024;
-			d32 <<= 20;
-			bits_left -= 20;
-		}
-		else if ((d32 & 0xffe00000) == 0xffc00000)
-		{
-			/* 11 lower bits of LoM */
-			lom = ((d32 >> 10) & 0x7ff) + 2048;
-			d32 <<= 22;
-			bits_left -= 22;
-		}
-		else if ((d32 & 0xfff00000) == 0xffe00000)
+		else
 		{
-			/* 12 lower bits of LoM */
-			lom = ((d32 >> 8) & 0xfff) + 4096;
-			d32 <<= 24;
-			bits_left -= 24;
+			if (ones > max_lom)
+				return false;
+
+			bitbuf <<= ones + 1;
+			lom = (uint32) (bitbuf >> (63 - ones)) + (1 << (ones + 1));
+			bitbuf <<= ones + 1;
+			nbits -= 2 * (ones + 1);
+			bits_left -= 2 * (ones + 1);
 		}
 
-		/* now that we have copy_offset and LoM, process them */
+		if ((copy_offset == 0) || (copy_offset >= RDP6_HISTORY_BUF_SIZE) ||
+				(lom > (uint32) (history_end - history_ptr)))
+			return false;
 
-		src_ptr = history_ptr - copy_offset;
-		if (src_ptr >= rdp->mppc->history_buf)
+		/* now that we have copy_offset and LoM, process them */
+		if (copy_offset <= (uint32) (history_ptr - history_buf))
 		{
 			/* data does not wrap around */
-			while (lom > 0)
-			{
-				*history_ptr++ = *src_ptr++;
-				lom--;
-			}
+			mppc_copy_match_bytes(history_ptr, history_ptr - copy_offset, lom, copy_offset);
+			history_ptr += lom;
 		}
 		else
 		{
-			src_ptr = rdp->mppc->history_buf_end - (copy_offset - (history_ptr - rdp->mppc->history_buf));
-			src_ptr++;
-			while (lom && (src_ptr <= rdp->mppc->history_buf_end))
-			{
-				*history_ptr++ = *src_ptr++;
-				lom--;
-			}
+			/* copy from the end of the history left by the previous pass */
+			src_ptr = history_end - (copy_offset - (history_ptr - history_buf));
+			count = MIN(lom, (uint32) (history_end - src_ptr));
+			memmove(history_ptr, src_ptr, count);
+			history_ptr += count;
+			lom -= count;
 
-			src_ptr = rdp->mppc->history_buf;
-			while (lom > 0)
-			{
-				*history_ptr++ = *src_ptr++;
-				lom--;
-			}
+			mppc_copy_match_bytes(history_ptr, history_buf, lom, history_ptr - history_buf);
+			history_ptr += lom;
 		}
+	}
 
-		/*
-		** get more bits before we restart the loop
-		*/
+	*rlen = history_ptr - mppc->history_ptr;
 
-		/* how may bits do we need to get? */
-		tmp = 32 - bits_left;
+	mppc->history_ptr = history_ptr;
 
-		while (tmp)
-		{
-			if (cur_bits_left < tmp)
-			{
-				/* we have less bits than we need */
-				i32 = cur_byte >> (8 - cur_bits_left);
-				d32 |= i32 << ((32 - bits_left) - cur_bits_left);
-				bits_left += cur_bits_left;
-				tmp -= cur_bits_left;
-				if (cptr < cbuf + len)
-				{
-					/* more compressed data available */
-					cur_byte = *cptr++;
-					cur_bits_left = 8;
-				}
-				else
-				{
-					/* no more compressed data available */
-					tmp = 0;
-					cur_bits_left = 0;
-				}
-			}
-			else if (cur_bits_left > tmp)
-			{
-				/* we have more bits than we need */
-				d32 |= cur_byte >> (8 - tmp);
-				cur_byte <<= tmp;
-				cur_bits_left -= tmp;
-				bits_left = 32;
-				break;
-			}
-			else
-			{
-				/* we have just the right amount of bits */
-				d32 |= cur_byte >> (8 - tmp);
-				bits_left = 32;
-				if (cptr < cbuf + len)
-				{
-					cur_byte = *cptr++;
-					cur_bits_left = 8;
-				}
-				else
-				{
-					cur_bits_left = 0;
-				}
-				break;
-			}
-		}
-	} /* end while (bits_left >= 8) */
+	return true;
+}
+
+/**
+ * decompress RDP 4 data
+ *
+ * @param rdp     per session information
+ * @param cbuf    compressed data
+ * @param len     length of compressed data
+ * @param ctype   compression flags
+ * @param roff    starting offset of uncompressed data
+ * @param rlen    length of uncompressed data
+ *
+ * @return        True on success, False on failure
+ */
 
-	*rlen = history_ptr - rdp->mppc->history_ptr;
+int decompress_rdp_4(rdpRdp* rdp, uint8* cbuf, int len, int ctype, uint32* roff, uint32* rlen)
+{
+	if ((rdp->mppc == NULL) || (rdp->mppc->history_buf == NULL))
+	{
+		printf("decompress_rdp_4: null\n");
+		return false;
+	}
 
-	rdp->mppc->history_ptr = history_ptr;
+	return mppc_decompress_bits(rdp->mppc, cbuf, len, ctype, roff, rlen, mppc_prefix_8k, 11);
+}
 
-	return true;
+/**
+ * decompress 64K MPPC data into the history of an MPPC context, this is
+ * shared by RDP 5 and by level-2 of RDP 6.1
+ *
+ * @param mppc    MPPC context holding the history buffer
+ * @param cbuf    compressed data
+ * @param len     length of compressed data
+ * @param ctype   compression flags
+ * @param roff    starting offset of uncompressed data
+ * @param rlen    length of uncompressed data
+ *
+ * @return        True on success, False on failure
+ */
+
+static int mppc_decompress_64k(struct rdp_mppc* mppc, uint8* cbuf, int len, int ctype, uint32* roff, uint32* rlen)
+{
+	return mppc_decompress_bits(mppc, cbuf, len, ctype, roff, rlen, mppc_prefix_64k, 14);
 }
 
 /**
@@ -645,457 +577,211 @@ int decompress_rdp_4(rdpRdp* rdp, uint8* cbuf, int len, int ctype, uint32* roff,
 
 int decompress_rdp_5(rdpRdp* rdp, uint8* cbuf, int len, int ctype, uint32* roff, uint32* rlen)
 {
-	uint8*    history_buf;    /* uncompressed data goes here */
-	uint8*    history_ptr;    /* points to next free slot in bistory_buf */
-	uint32    d32;            /* we process 4 compressed bytes at a time */
-	uint16    copy_offset;    /* location to copy data from */
-	uint16    lom;            /* length of match */
-	uint8*    src_ptr;        /* used while copying compressed data */
-	uint8*    cptr;           /* points to next byte in cbuf */
-	uint8     cur_byte;       /* last byte fetched from cbuf */
-	int       bits_left;      /* bits left in d32 for processing */
-	int       cur_bits_left;  /* bits left in cur_byte for processing */
-	int       tmp;
-	uint32    i32;
-
 	if ((rdp->mppc == NULL) || (rdp->mppc->history_buf == NULL))
 	{
 		printf("decompress_rdp_5: null\n");
 		return false;
 	}
 
-	src_ptr = 0;
-	cptr = cbuf;
-	copy_offset = 0;
-	lom = 0;
-	bits_left = 0;
-	cur_bits_left = 0;
-	d32 = 0;
-	cur_byte = 0;
+	return mppc_decompress_64k(rdp->mppc, cbuf, len, ctype, roff, rlen);
+}
+
+/**
+ * decompress RDP 6 data
+ *
+ * There is no RDP 6.0 decoder. A server may still pick it when RDP 6.1 is
+ * offered, so fail every packet rather than hand on empty or stale data.
+ *
+ * @param rdp     per session information
+ * @param cbuf    compressed data
+ * @param len     length of compressed data
+ * @param ctype   compression flags
+ * @param roff    starting offset of uncompressed data
+ * @param rlen    length of uncompressed data
+ *
+ * @return        False, always
+ */
+
+int decompress_rdp_6(rdpRdp* rdp, uint8* cbuf, int len, int ctype, uint32* roff, uint32* rlen)
+{
+	*roff = 0;
 	*rlen = 0;
 
-	/* get start of history buffer */
-	history_buf = rdp->mppc->history_buf;
+	printf("decompress_rdp_6: RDP 6.0 bulk compression is not supported\n");
 
-	/* get next free slot in history buffer */
-	history_ptr = rdp->mppc->history_ptr;
-	*roff = history_ptr - history_buf;
+	return false;
+}
 
-	if (ctype & PACKET_AT_FRONT)
-	{
-		/* place compressed data at start of history buffer */
-		history_ptr = rdp->mppc->history_buf;
-		rdp->mppc->history_ptr = rdp->mppc->history_buf;
-		*roff = 0;
-	}
+static struct rdp_mppc* mppc_context_new(void);
 
-	if (ctype & PACKET_FLUSHED)
-	{
-		/* re-init history buffer */
-		history_ptr = rdp->mppc->history_buf;
-		memset(history_buf, 0, RDP6_HISTORY_BUF_SIZE);
-		*roff = 0;
-	}
+/**
+ * switch an MPPC context to RDP 6.1, the level-1 history is much larger
+ * than the 64K one and is followed by a scratch area for packets that
+ * bypass level-1 compression
+ *
+ * @param mppc    MPPC context
+ *
+ * @return        True on success, False on failure
+ */
 
-	if ((ctype & PACKET_COMPRESSED) != PACKET_COMPRESSED)
-	{
-		/* data in cbuf is not compressed - copy to history buf as is */
-		memcpy(history_ptr, cbuf, len);
-		history_ptr += len;
-		*rlen = history_ptr - rdp->mppc->history_ptr;
-		rdp->mppc->history_ptr = history_ptr;
-		return true;
-	}
+static int mppc_init_rdp61(struct rdp_mppc* mppc)
+{
+	uint8* history_buf;
+
+	history_buf = (uint8*) xzalloc(RDP61_HISTORY_BUF_SIZE + RDP61_MAX_PACKET_SIZE);
+
+	if (history_buf == NULL)
+		return false;
 
-	/* load initial data */
-	tmp = 24;
-	while (cptr < cbuf + len)
+	mppc->level2 = mppc_context_new();
+
+	if (mppc->level2 == NULL)
 	{
-		i32 = *cptr++;
-		d32  |= i32 << tmp;
-		bits_left += 8;
-		tmp -= 8;
-		if (tmp < 0)
-		{
-			break;
-		}
+		xfree(history_buf);
+		return false;
 	}
 
-	if (cptr < cbuf + len)
+	xfree(mppc->history_buf);
+	mppc->history_buf = history_buf;
+	mppc->history_ptr = history_buf;
+	mppc->history_buf_end = history_buf + RDP61_HISTORY_BUF_SIZE - 1;
+
+	return true;
+}
+
+/**
+ * copy a level-1 match, byte by byte when source and destination overlap
+ * so that short distances repeat the same pattern
+ */
+
+static INLINE void mppc_copy_match(uint8* dst, uint8* src, uint32 len)
+{
+	if ((src < dst) && (src + len > dst))
 	{
-		cur_byte = *cptr++;
-		cur_bits_left = 8;
+		while (len-- > 0)
+			*dst++ = *src++;
 	}
 	else
 	{
-		cur_bits_left = 0;
+		memmove(dst, src, len);
 	}
+}
 
-	/*
-	** start uncompressing data in cbuf
-	*/
+/**
+ * decompress RDP 6.1 level-1 data: a list of matches into the level-1
+ * history followed by the literals that fill the gaps between them
+ *
+ * @param mppc    MPPC context holding the level-1 history
+ * @param data    level-1 data (after the two compression flag bytes)
+ * @param len     length of level-1 data
+ * @param flags   level-1 compression flags
+ * @param roff    starting offset of uncompressed data
+ * @param rlen    length of uncompressed data
+ *
+ * @return        True on success, False on failure
+ */
 
-	while (bits_left >= 8)
+static int mppc_decompress_l1(struct rdp_mppc* mppc, uint8* data, int len, int flags, uint32* roff, uint32* rlen)
+{
+	int i;
+	uint32 count;
+	uint8* details;
+	uint8* literals;
+	uint8* data_end;
+	uint8* history_buf;
+	uint8* history_ptr;
+	uint8* history_end;
+	uint16 match_count;
+	uint16 match_length;
+	uint16 match_output_offset;
+	uint32 match_history_offset;
+	uint32 output_offset;
+
+	history_buf = mppc->history_buf;
+	history_end = history_buf + RDP61_HISTORY_BUF_SIZE;
+	data_end = data + len;
+
+	if (flags & L1_PACKET_AT_FRONT)
+		mppc->history_ptr = history_buf;
+
+	if (flags & L1_NO_COMPRESSION)
 	{
-		/*
-		   value 0xxxxxxx  = literal, not encoded
-		   value 10xxxxxx  = literal, encoded
-		   value 11111xxx  = copy offset     0 - 63
-		   value 11110xxx  = copy offset    64 - 319
-		   value 1110xxxx  = copy offset   320 - 2367
-		   value 110xxxxx  = copy offset  2368+
-		*/
-
-		/*
-		   at this point, we are guaranteed that d32 has 32 bits to
-		   be processed, unless we have reached end of cbuf
-		*/
-
-		copy_offset = 0;
-
-		if ((d32 & 0x80000000) == 0)
-		{
-			/* got a literal */
-			*history_ptr++ = d32 >> 24;
-			d32 <<= 8;
-			bits_left -= 8;
-		}
-		else if ((d32 & 0xc0000000) == 0x80000000)
-		{
-			/* got encoded literal */
-			d32 <<= 2;
-			*history_ptr++ = (d32 >> 25) | 0x80;
-			d32 <<= 7;
-			bits_left -= 9;
-		}
-		else if ((d32 & 0xf8000000) == 0xf8000000)
-		{
-			/* got copy offset in range 0 - 63, */
-			/* with 6 bit copy offset */
-			d32 <<= 5;
-			copy_offset = d32 >> 26;
-			d32 <<= 6;
-			bits_left -= 11;
-		}
-		else if ((d32 & 0xf8000000) == 0xf0000000)
-		{
-			/* got copy offset in range 64 - 319, */
-			/* with 8 bit copy offset */
-			d32 <<= 5;
-			copy_offset = d32 >> 24;
-			copy_offset += 64;
-			d32 <<= 8;
-			bits_left -= 13;
-		}
-		else if ((d32 & 0xf0000000) == 0xe0000000)
-		{
-			/* got copy offset in range 320 - 2367, */
-			/* with 11 bits copy offset */
-			d32 <<= 4;
-			copy_offset = d32 >> 21;
-			copy_offset += 320;
-			d32 <<= 11;
-			bits_left -= 15;
-		}
-		else if ((d32 & 0xe0000000) == 0xc0000000)
-		{
-			/* got copy offset in range 2368+, */
-			/* with 16 bits copy offset */
-			d32 <<= 3;
-			copy_offset = d32 >> 16;
-			copy_offset += 2368;
-			d32 <<= 16;
-			bits_left -= 19;
-		}
+		/* not part of the level-1 history, hand it back from the scratch area */
+		if (len > RDP61_MAX_PACKET_SIZE)
+			return false;
 
-		/*
-		** get more bits before we process length of match
-		*/
+		memcpy(history_end, data, len);
+		*roff = RDP61_HISTORY_BUF_SIZE;
+		*rlen = len;
+		return true;
+	}
 
-		/* how may bits do we need to get? */
-		tmp = 32 - bits_left;
+	if (!(flags & L1_COMPRESSED) || (len < 2))
+	{
+		printf("decompress_rdp_61: invalid level-1 flags 0x%02X\n", flags);
+		return false;
+	}
 
-		while (tmp)
-		{
-			if (cur_bits_left < tmp)
-			{
-				/* we have less bits than we need */
-				i32 = cur_byte >> (8 - cur_bits_left);
-				d32 |= i32 << ((32 - bits_left) - cur_bits_left);
-				bits_left += cur_bits_left;
-				tmp -= cur_bits_left;
-				if (cptr < cbuf + len)
-				{
-					/* more compressed data available */
-					cur_byte = *cptr++;
-					cur_bits_left = 8;
-				}
-				else
-				{
-					/* no more compressed data available */
-					tmp = 0;
-					cur_bits_left = 0;
-				}
-			}
-			else if (cur_bits_left > tmp)
-			{
-				/* we have more bits than we need */
-				d32 |= cur_byte >> (8 - tmp);
-				cur_byte <<= tmp;
-				cur_bits_left -= tmp;
-				bits_left = 32;
-				break;
-			}
-			else
-			{
-				/* we have just the right amount of bits */
-				d32 |= cur_byte >> (8 - tmp);
-				bits_left = 32;
-				if (cptr < cbuf + len)
-				{
-					cur_byte = *cptr++;
-					cur_bits_left = 8;
-				}
-				else
-				{
-					cur_bits_left = 0;
-				}
-				break;
-			}
-		}
+	match_count = data[0] | (data[1] << 8); /* MatchCount (2 bytes) */
+	details = data + 2;
+	literals = details + match_count * 8;
 
-		if (!copy_offset)
-		{
-			continue;
-		}
+	if (literals > data_end)
+		return false;
 
-		/*
-		** compute Length of Match
-		*/
-
-		/*
-		   lengh of match  Encoding (binary header + LoM bits
-		   --------------  ----------------------------------
-		   3               0
-		   4..7            10 + 2 lower bits of LoM
-		   8..15           110 + 3 lower bits of LoM
-		   16..31          1110 + 4 lower bits of LoM
-		   32..63          1111-0 + 5 lower bits of LoM
-		   64..127         1111-10 + 6 lower bits of LoM
-		   128..255        1111-110 + 7 lower bits of LoM
-		   256..511        1111-1110 + 8 lower bits of LoM
-		   512..1023       1111-1111-0 + 9 lower bits of LoM
-		   1024..2047      1111-1111-10 + 10 lower bits of LoM
-		   2048..4095      1111-1111-110 + 11 lower bits of LoM
-		   4096..8191      1111-1111-1110 + 12 lower bits of LoM
-		   8192..16383     1111-1111-1111-0 + 13 lower bits of LoM
-		   16384..32767    1111-1111-1111-10 + 14 lower bits of LoM
-		   32768..65535    1111-1111-1111-110 + 15 lower bits of LoM
-		*/
-
-		if ((d32 & 0x80000000) == 0)
-		{
-			/* lom is fixed to 3 */
-			lom = 3;
-			d32 <<= 1;
-			bits_left -= 1;
-		}
-		else if ((d32 & 0xc0000000) == 0x80000000)
-		{
-			/* 2 lower bits of LoM */
-			lom = ((d32 >> 28) & 0x03) + 4;
-			d32 <<= 4;
-			bits_left -= 4;
-		}
-		else if ((d32 & 0xe0000000) == 0xc0000000)
-		{
-			/* 3 lower bits of LoM */
-			lom = ((d32 >> 26) & 0x07) + 8;
-			d32 <<= 6;
-			bits_left -= 6;
-		}
-		else if ((d32 & 0xf0000000) == 0xe0000000)
-		{
-			/* 4 lower bits of LoM */
-			lom = ((d32 >> 24) & 0x0f) + 16;
-			d32 <<= 8;
-			bits_left -= 8;
-		}
-		else if ((d32 & 0xf8000000) == 0xf0000000)
-		{
-			/* 5 lower bits of LoM */
-			lom = ((d32 >> 22) & 0x1f) + 32;
-			d32 <<= 10;
-			bits_left -= 10;
-		}
-		else if ((d32 & 0xfc000000) == 0xf8000000)
-		{
-			/* 6 lower bits of LoM */
-			lom = ((d32 >> 20) & 0x3f) + 64;
-			d32 <<= 12;
-			bits_left -= 12;
-		}
-		else if ((d32 & 0xfe000000) == 0xfc000000)
-		{
-			/* 7 lower bits of LoM */
-			lom = ((d32 >> 18) & 0x7f) + 128;
-			d32 <<= 14;
-			bits_left -= 14;
-		}
-		else if ((d32 & 0xff000000) == 0xfe000000)
-		{
-			/* 8 lower bits of LoM */
-			lom = ((d32 >> 16) & 0xff) + 256;
-			d32 <<= 16;
-			bits_left -= 16;
-		}
-		else if ((d32 & 0xff800000) == 0xff000000)
-		{
-			/* 9 lower bits of LoM */
-			lom = ((d32 >> 14) & 0x1ff) + 512;
-			d32 <<= 18;
-			bits_left -= 18;
-		}
-		else if ((d32 & 0xffc00000) == 0xff800000)
-		{
-			/* 10 lower bits of LoM */
-			lom = ((d32 >> 12) & 0x3ff) + 1024;
-			d32 <<= 20;
-			bits_left -= 20;
-		}
-		else if ((d32 & 0xffe00000) == 0xffc00000)
-		{
-			/* 11 lower bits of LoM */
-			lom = ((d32 >> 10) & 0x7ff) + 2048;
-			d32 <<= 22;
-			bits_left -= 22;
-		}
-		else if ((d32 & 0xfff00000) == 0xffe00000)
-		{
-			/* 12 lower bits of LoM */
-			lom = ((d32 >> 8) & 0xfff) + 4096;
-			d32 <<= 24;
-			bits_left -= 24;
-		}
-		else if ((d32 & 0xfff80000) == 0xfff00000)
-		{
-			/* 13 lower bits of LoM */
-			lom = ((d32 >> 6) & 0x1fff) + 8192;
-			d32 <<= 26;
-			bits_left -= 26;
-		}
-		else if ((d32 & 0xfffc0000) == 0xfff80000)
-		{
-			/* 14 lower bits of LoM */
-			lom = ((d32 >> 4) & 0x3fff) + 16384;
-			d32 <<= 28;
-			bits_left -= 28;
-		}
-		else if ((d32 & 0xfffe0000) == 0xfffc0000)
-		{
-			/* 15 lower bits of LoM */
-			lom = ((d32 >> 2) & 0x7fff) + 32768;
-			d32 <<= 30;
-			bits_left -= 30;
-		}
+	history_ptr = mppc->history_ptr;
+	output_offset = 0;
 
-		/* now that we have copy_offset and LoM, process them */
+	for (i = 0; i < match_count; i++)
+	{
+		match_length = details[0] | (details[1] << 8); /* MatchLength (2 bytes) */
+		match_output_offset = details[2] | (details[3] << 8); /* MatchOutputOffset (2 bytes) */
+		match_history_offset = details[4] | (details[5] << 8) |
+			(details[6] << 16) | ((uint32) details[7] << 24); /* MatchHistoryOffset (4 bytes) */
+		details += 8;
 
-		src_ptr = history_ptr - copy_offset;
-		if (src_ptr >= rdp->mppc->history_buf)
-		{
-			/* data does not wrap around */
-			while (lom > 0)
-			{
-				*history_ptr++ = *src_ptr++;
-				lom--;
-			}
-		}
-		else
-		{
-			src_ptr = rdp->mppc->history_buf_end - (copy_offset - (history_ptr - rdp->mppc->history_buf));
-			src_ptr++;
-			while (lom && (src_ptr <= rdp->mppc->history_buf_end))
-			{
-				*history_ptr++ = *src_ptr++;
-				lom--;
-			}
+		if (match_output_offset < output_offset)
+			return false;
 
-			src_ptr = rdp->mppc->history_buf;
-			while (lom > 0)
-			{
-				*history_ptr++ = *src_ptr++;
-				lom--;
-			}
-		}
+		/* literals up to the match */
+		count = match_output_offset - output_offset;
 
-		/*
-		** get more bits before we restart the loop
-		*/
+		if ((count > (uint32) (data_end - literals)) || (count > (uint32) (history_end - history_ptr)))
+			return false;
 
-		/* how may bits do we need to get? */
-		tmp = 32 - bits_left;
+		memcpy(history_ptr, literals, count);
+		history_ptr += count;
+		literals += count;
+		output_offset += count;
 
-		while (tmp)
-		{
-			if (cur_bits_left < tmp)
-			{
-				/* we have less bits than we need */
-				i32 = cur_byte >> (8 - cur_bits_left);
-				d32 |= i32 << ((32 - bits_left) - cur_bits_left);
-				bits_left += cur_bits_left;
-				tmp -= cur_bits_left;
-				if (cptr < cbuf + len)
-				{
-					/* more compressed data available */
-					cur_byte = *cptr++;
-					cur_bits_left = 8;
-				}
-				else
-				{
-					/* no more compressed data available */
-					tmp = 0;
-					cur_bits_left = 0;
-				}
-			}
-			else if (cur_bits_left > tmp)
-			{
-				/* we have more bits than we need */
-				d32 |= cur_byte >> (8 - tmp);
-				cur_byte <<= tmp;
-				cur_bits_left -= tmp;
-				bits_left = 32;
-				break;
-			}
-			else
-			{
-				/* we have just the right amount of bits */
-				d32 |= cur_byte >> (8 - tmp);
-				bits_left = 32;
-				if (cptr < cbuf + len)
-				{
-					cur_byte = *cptr++;
-					cur_bits_left = 8;
-				}
-				else
-				{
-					cur_bits_left = 0;
-				}
-				break;
-			}
-		}
+		if ((match_history_offset >= RDP61_HISTORY_BUF_SIZE) ||
+				(match_length > RDP61_HISTORY_BUF_SIZE - match_history_offset) ||
+				(match_length > (uint32) (history_end - history_ptr)))
+			return false;
 
-	} /* end while (cptr < cbuf + len) */
+		mppc_copy_match(history_ptr, history_buf + match_history_offset, match_length);
+		history_ptr += match_length;
+		output_offset += match_length;
+	}
+
+	/* trailing literals */
+	count = data_end - literals;
+
+	if (count > (uint32) (history_end - history_ptr))
+		return false;
 
-	*rlen = history_ptr - rdp->mppc->history_ptr;
+	memcpy(history_ptr, literals, count);
+	history_ptr += count;
 
-	rdp->mppc->history_ptr = history_ptr;
+	*roff = mppc->history_ptr - history_buf;
+	*rlen = history_ptr - mppc->history_ptr;
+	mppc->history_ptr = history_ptr;
 
 	return true;
 }
 
 /**
- * decompress RDP 6 data
+ * decompress RDP 6.1 data
  *
  * @param rdp     per session information
  * @param cbuf    compressed data
@@ -1107,139 +793,109 @@ int decompress_rdp_5(rdpRdp* rdp, uint8* cbuf, int len, int ctype, uint32* roff,
  * @return        True on success, False on failure
  */
 
-int decompress_rdp_6(rdpRdp* rdp, uint8* cbuf, int len, int ctype, uint32* roff, uint32* rlen)
+int decompress_rdp_61(rdpRdp* rdp, uint8* cbuf, int len, int ctype, uint32* roff, uint32* rlen)
 {
-	uint8*    history_buf;    /* uncompressed data goes here */
-	uint16*   offset_cache;	  /* Copy Offset cache */
-	uint8*    history_ptr;    /* points to next free slot in bistory_buf */
-	uint32    d32;            /* we process 4 compressed bytes at a time */
-	uint16    copy_offset;    /* location to copy data from */
-	uint16    lom;            /* length of match */
-	uint8*    src_ptr;        /* used while copying compressed data */
-	uint8*    cptr;           /* points to next byte in cbuf */
-	uint8     cur_byte;       /* last byte fetched from cbuf */
-	int       bits_left;      /* bits left in d32 for processing */
-	int       cur_bits_left;  /* bits left in cur_byte for processing */
-	int       tmp;
-	uint32    i32;
-
-	if ((rdp->mppc == NULL) || (rdp->mppc->history_buf == NULL))
+	uint8* l1_buf;
+	uint32 l1_len;
+	uint8 l1_flags;
+	uint8 l2_flags;
+	uint32 l2_off;
+	struct rdp_mppc* mppc = rdp->mppc;
+
+	if ((mppc == NULL) || (mppc->history_buf == NULL))
 	{
-		printf("decompress_rdp_6: null\n");
+		printf("decompress_rdp_61: null\n");
 		return false;
 	}
 
-	src_ptr = 0;
-	cptr = cbuf;
-	copy_offset = 0;
-	lom = 0;
-	bits_left = 0;
-	cur_bits_left = 0;
-	d32 = 0;
-	cur_byte = 0;
-	*rlen = 0;
-
-	/* get start of history buffer */
-	history_buf = rdp->mppc->history_buf;
-
-	/* get start of offset_cache */
-	offset_cache = rdp->mppc->offset_cache;
-
-	/* get next free slot in history buffer */
-	history_ptr = rdp->mppc->history_ptr;
-	*roff = history_ptr - history_buf;
+	if (len < 2)
+		return false;
 
-	if (ctype & PACKET_AT_FRONT)
+	if ((mppc->level2 == NULL) && !mppc_init_rdp61(mppc))
 	{
-		printf("need to look later\n");
-		/* slid history_buf and reset history_buf to middle */
-		memcpy(history_buf, (history_buf + 32768), (history_ptr -history_buf - 32768));
-		memcpy((history_buf + (history_ptr - history_buf - 32768)), cbuf, len);
-		history_ptr = history_buf + 32768;
-		*roff = 32768;
+		printf("decompress_rdp_61: system out of memory\n");
+		return false;
 	}
 
-	if (ctype & PACKET_FLUSHED)
-	{
-		/* re-init history buffer */
-		history_ptr = rdp->mppc->history_buf;
-		memset(history_buf, 0, RDP6_HISTORY_BUF_SIZE);
-		memset(offset_cache, 0, RDP6_OFFSET_CACHE_SIZE);
-		*roff = 0;
-	}
+	*rlen = 0;
 
-	if ((ctype & PACKET_COMPRESSED) != PACKET_COMPRESSED)
-	{
-		/* data in cbuf is not compressed - copy to history buf as is */
-		memcpy(history_ptr, cbuf, len);
-		history_ptr += len;
-		*rlen = history_ptr - rdp->mppc->history_ptr;
-		rdp->mppc->history_ptr = history_ptr;
-		return true;
-	}
+	l1_flags = cbuf[0]; /* Level1ComprFlags (1 byte) */
+	l2_flags = cbuf[1]; /* Level2ComprFlags (1 byte) */
+	cbuf += 2;
+	len -= 2;
 
-	/* load initial data */
-	tmp = 24;
-	while (cptr < cbuf + len)
+	if (ctype & PACKET_FLUSHED)
 	{
-		i32 = *cptr++;
-		d32  |= i32 << tmp;
-		bits_left += 8;
-		tmp -= 8;
-		if (tmp < 0)
-		{
-			break;
-		}
+		/* re-init level-1 history buffer */
+		memset(mppc->history_buf, 0, RDP61_HISTORY_BUF_SIZE);
+		mppc->history_ptr = mppc->history_buf;
 	}
 
-	if (cptr < cbuf + len)
+	if (l1_flags & L1_INNER_COMPRESSION)
 	{
-		cur_byte = *cptr++;
-		cur_bits_left = 8;
+		/* level-2 is plain 64K MPPC with its own history, which takes the
+		   flush and at front flags also when the data is not compressed */
+		if (!mppc_decompress_64k(mppc->level2, cbuf, len, l2_flags, &l2_off, &l1_len))
+			return false;
+
+		l1_buf = mppc->level2->history_buf + l2_off;
 	}
 	else
 	{
-		cur_bits_left = 0;
+		l1_buf = cbuf;
+		l1_len = len;
 	}
 
-	/*
-	** start uncompressing data in cbuf
-	*/
-
-
-	return true;
+	return mppc_decompress_l1(mppc, l1_buf, l1_len, l1_flags, roff, rlen);
 }
 
 /**
- * decompress RDP 6.1 data
+ * decompress virtual channel data, it is 8K or 64K MPPC with a history
+ * of its own, created on first use
  *
  * @param rdp     per session information
  * @param cbuf    compressed data
  * @param len     length of compressed data
- * @param ctype   compression flags
- * @param roff    starting offset of uncompressed data
+ * @param ctype   compression flags (bits 16 to 23 of the channel flags)
+ * @param roff    starting offset of uncompressed data in rdp->mppc_vc
  * @param rlen    length of uncompressed data
  *
  * @return        True on success, False on failure
  */
 
-int decompress_rdp_61(rdpRdp* rdp, uint8* cbuf, int len, int ctype, uint32* roff, uint32* rlen)
+int decompress_rdp_vc(rdpRdp* rdp, uint8* cbuf, int len, int ctype, uint32* roff, uint32* rlen)
 {
-	return false;
+	if (rdp->mppc_vc == NULL)
+		rdp->mppc_vc = mppc_context_new();
+
+	if (rdp->mppc_vc == NULL)
+		return false;
+
+	switch (ctype & 0x0f)
+	{
+		case PACKET_COMPR_TYPE_8K:
+			return mppc_decompress_bits(rdp->mppc_vc, cbuf, len, ctype, roff, rlen, mppc_prefix_8k, 11);
+
+		case PACKET_COMPR_TYPE_64K:
+			return mppc_decompress_64k(rdp->mppc_vc, cbuf, len, ctype, roff, rlen);
+
+		default:
+			printf("decompress_rdp_vc: invalid channel compression type 0x%2.2x\n", ctype & 0x0f);
+			return false;
+	}
 }
 
 /**
- * allocate space to store history buffer
+ * allocate an MPPC context with a 64K history buffer
  *
- * @param rdp rdp struct that contains rdp_mppc struct
  * @return pointer to new struct, or NULL on failure
  */
 
-struct rdp_mppc* mppc_new(rdpRdp* rdp)
+static struct rdp_mppc* mppc_context_new(void)
 {
 	struct rdp_mppc* ptr;
 
-	ptr = (struct rdp_mppc*) xmalloc(sizeof(struct rdp_mppc));
+	ptr = (struct rdp_mppc*) xzalloc(sizeof(struct rdp_mppc));
 
 	if (!ptr)
 	{
@@ -1263,6 +919,38 @@ struct rdp_mppc* mppc_new(rdpRdp* rdp)
 	return ptr;
 }
 
+static void mppc_context_free(struct rdp_mppc* mppc)
+{
+	if (mppc->level2)
+		mppc_context_free(mppc->level2);
+
+	if (mppc->history_buf)
+	{
+		xfree(mppc->history_buf);
+		mppc->history_buf = NULL;
+		mppc->history_ptr = NULL;
+	}
+
+	if (mppc->offset_cache)
+	{
+		xfree(mppc->offset_cache);
+	}
+
+	xfree(mppc);
+}
+
+/**
+ * allocate space to store history buffer
+ *
+ * @param rdp rdp struct that contains rdp_mppc struct
+ * @return pointer to new struct, or NULL on failure
+ */
+
+struct rdp_mppc* mppc_new(rdpRdp* rdp)
+{
+	return mppc_context_new();
+}
+
 /**
  * free history buffer
  *
@@ -1271,22 +959,16 @@ struct rdp_mppc* mppc_new(rdpRdp* rdp)
 
 void mppc_free(rdpRdp* rdp)
 {
-	if (!rdp->mppc)
+	if (rdp->mppc_vc)
 	{
-		return;
-	}
-
-	if (rdp->mppc->history_buf)
-	{
-		xfree(rdp->mppc->history_buf);
-		rdp->mppc->history_buf = NULL;
-		rdp->mppc->history_ptr = NULL;
+		mppc_context_free(rdp->mppc_vc);
+		rdp->mppc_vc = NULL;
 	}
 
-	if (rdp->mppc->offset_cache)
+	if (!rdp->mppc)
 	{
-		xfree(rdp->mppc->offset_cache);
+		return;
 	}
 
-	xfree(rdp->mppc);
+	mppc_context_free(rdp->mppc);
 }
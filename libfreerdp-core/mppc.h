@@ -22,15 +22,42 @@
 
 #include <stdint.h>
 
+#define RDP4_HISTORY_BUF_SIZE     8192
 #define RDP6_HISTORY_BUF_SIZE     65536
 #define RDP6_OFFSET_CACHE_SIZE     4
 
+#define RDP61_HISTORY_BUF_SIZE    2000000
+#define RDP61_MAX_PACKET_SIZE     65536
+
+/* RDP 6.1 level-1 compression flags */
+#define L1_COMPRESSED             0x01
+#define L1_NO_COMPRESSION         0x02
+#define L1_PACKET_AT_FRONT        0x04
+#define L1_INNER_COMPRESSION      0x10
+
 struct rdp_mppc
 {
 	uint8 *history_buf;
 	uint16 *offset_cache;
 	uint8 *history_buf_end;
 	uint8 *history_ptr;
+
+	/* RDP 6.1: history_buf becomes the level-1 history, level-2 is 64K MPPC */
+	struct rdp_mppc *level2;
+};
+
+struct rdp_mppc_enc
+{
+	int protocol_type;      /* PACKET_COMPR_TYPE_8K, 64K or RDP61 */
+	int buf_size;           /* history size, 8K or 64K */
+	uint8 *history_buf;
+	uint32 history_offset;  /* next free slot in history_buf */
+	uint8 *output_buf;      /* compressed data */
+	uint32 bytes_in_opb;    /* length of compressed data */
+	uint8 flags;            /* compression flags of the compressed data */
+	uint8 flags_hold;       /* flags carried over to the next compressed packet */
+	uint32 *hash_table;     /* most recent history offset per hash */
+	uint32 *hash_chain;     /* previous history offset with the same hash */
 };
 
 // forward declarations
@@ -39,7 +66,12 @@ int decompress_rdp_4(rdpRdp *, uint8 *, int, int, uint32 *, uint32 *);
 int decompress_rdp_5(rdpRdp *, uint8 *, int, int, uint32 *, uint32 *);
 int decompress_rdp_6(rdpRdp *, uint8 *, int, int, uint32 *, uint32 *);
 int decompress_rdp_61(rdpRdp *, uint8 *, int, int, uint32 *, uint32 *);
+int decompress_rdp_vc(rdpRdp *, uint8 *, int, int, uint32 *, uint32 *);
 struct rdp_mppc *mppc_new(rdpRdp *rdp);
 void mppc_free(rdpRdp *rdp);
 
+tbool compress_rdp(struct rdp_mppc_enc *enc, uint8 *src, int len);
+struct rdp_mppc_enc *mppc_enc_new(int protocol_type);
+void mppc_enc_free(struct rdp_mppc_enc *enc);
+
 #endif
@@ -0,0 +1,358 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Implements Microsoft Point to Point Compression (MPPC) protocol, encoder
+ *
+ * Copyright 2014 Jay Sorg <jay.sorg@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <freerdp/utils/memory.h>
+
+#include "rdp.h"
+
+/**
+ * Matches are found with hash chains over the history window: hash_table
+ * holds the most recent history offset for each hash of three bytes and
+ * hash_chain links every offset to the previous one with the same hash.
+ * Matching is greedy, following at most MPPC_ENC_MAX_CHAIN links.
+ */
+
+#define MPPC_ENC_HASH_BITS	15
+#define MPPC_ENC_HASH_SIZE	(1 << MPPC_ENC_HASH_BITS)
+#define MPPC_ENC_MAX_CHAIN	16
+#define MPPC_ENC_NIL		0xFFFFFFFF
+
+#define MPPC_ENC_HASH(_p) \
+	((((uint32) (_p)[0] << 16) | ((uint32) (_p)[1] << 8) | (_p)[2]) * 2654435761U >> (32 - MPPC_ENC_HASH_BITS))
+
+/* MSB first bit writer, the output buffer is always large enough for a token */
+struct mppc_enc_bits
+{
+	uint8* ptr;
+	uint32 acc;
+	int nbits;
+};
+
+static INLINE void mppc_enc_put_bits(struct mppc_enc_bits* bits, uint32 value, int n)
+{
+	/* n <= 19, so at most 26 bits are ever pending */
+	bits->acc = (bits->acc << n) | value;
+	bits->nbits += n;
+
+	while (bits->nbits >= 8)
+	{
+		bits->nbits -= 8;
+		*bits->ptr++ = (uint8) (bits->acc >> bits->nbits);
+	}
+}
+
+static INLINE void mppc_enc_put_literal(struct mppc_enc_bits* bits, uint8 c)
+{
+	if (c < 0x80)
+		mppc_enc_put_bits(bits, c, 8);
+	else
+		mppc_enc_put_bits(bits, 0x100 | (c & 0x7F), 9);
+}
+
+static INLINE void mppc_enc_put_copy_offset(struct mppc_enc_bits* bits, uint32 offset, tbool big)
+{
+	if (big)
+	{
+		if (offset < 64)
+			mppc_enc_put_bits(bits, 0x7C0 | offset, 11);
+		else if (offset < 320)
+			mppc_enc_put_bits(bits, 0x1E00 | (offset - 64), 13);
+		else if (offset < 2368)
+			mppc_enc_put_bits(bits, 0x7000 | (offset - 320), 15);
+		else
+			mppc_enc_put_bits(bits, 0x60000 | (offset - 2368), 19);
+	}
+	else
+	{
+		if (offset < 64)
+			mppc_enc_put_bits(bits, 0x3C0 | offset, 10);
+		else if (offset < 320)
+			mppc_enc_put_bits(bits, 0xE00 | (offset - 64), 12);
+		else
+			mppc_enc_put_bits(bits, 0xC000 | (offset - 320), 16);
+	}
+}
+
+static INLINE void mppc_enc_put_lom(struct mppc_enc_bits* bits, uint32 lom)
+{
+	int k;
+
+	if (lom == 3)
+	{
+		mppc_enc_put_bits(bits, 0, 1);
+		return;
+	}
+
+	/* k leading 1s and a 0, then k + 1 bits of (lom - 2^(k + 1)) */
+	for (k = 1; lom >= (1U << (k + 2)); k++)
+		;
+
+	mppc_enc_put_bits(bits, ((1 << k) - 1) << 1, k + 1);
+	mppc_enc_put_bits(bits, lom - (1 << (k + 1)), k + 1);
+}
+
+/* length of the common prefix of a and b, at most max */
+static INLINE uint32 mppc_enc_match_length(uint8* a, uint8* b, uint32 max)
+{
+	uint64 wa;
+	uint64 wb;
+	uint32 len;
+
+	for (len = 0; len + 8 <= max; len += 8)
+	{
+		memcpy(&wa, a + len, 8);
+		memcpy(&wb, b + len, 8);
+
+		if (wa != wb)
+			break;
+	}
+
+	while (len < max && a[len] == b[len])
+		len++;
+
+	return len;
+}
+
+static void mppc_enc_reset(struct rdp_mppc_enc* enc)
+{
+	enc->history_offset = 0;
+	memset(enc->hash_table, 0xFF, MPPC_ENC_HASH_SIZE * sizeof(uint32));
+}
+
+/**
+ * compress data into the history of an encoder as 8K or 64K MPPC
+ *
+ * @param enc     encoder context
+ * @param src     data to compress
+ * @param len     length of data, at most the history size
+ * @param dst     compressed data goes here, at least len bytes
+ *
+ * @return        length of compressed data, or 0 if it would not be smaller than len
+ */
+
+static uint32 mppc_enc_compress(struct rdp_mppc_enc* enc, uint8* src, uint32 len, uint8* dst)
+{
+	uint8* history;
+	uint32 start;
+	uint32 pos;
+	uint32 end;
+	uint32 max_offset;
+	uint32 max_lom;
+	uint32 candidate;
+	uint32 best_offset;
+	uint32 best_lom;
+	uint32 lom;
+	uint32 hash;
+	int chain;
+	tbool big;
+	struct mppc_enc_bits bits;
+
+	history = enc->history_buf;
+	start = enc->history_offset;
+	end = start + len;
+	big = (enc->buf_size == RDP6_HISTORY_BUF_SIZE);
+	max_offset = enc->buf_size - 1;
+	max_lom = big ? 65535 : 8191;
+
+	memcpy(history + start, src, len);
+
+	bits.ptr = dst;
+	bits.acc = 0;
+	bits.nbits = 0;
+
+	for (pos = start; pos < end; )
+	{
+		/* the largest token is 19 + 30 bits, give up once one might not fit */
+		if ((uint32) (bits.ptr - dst) + 7 >= len)
+			return 0;
+
+		best_lom = 0;
+		best_offset = 0;
+
+		if (end - pos >= 3)
+		{
+			hash = MPPC_ENC_HASH(history + pos);
+			candidate = enc->hash_table[hash];
+
+			for (chain = 0; chain < MPPC_ENC_MAX_CHAIN && candidate != MPPC_ENC_NIL; chain++)
+			{
+				if (pos - candidate > max_offset)
+					break;
+
+				if (history[candidate + best_lom] == history[pos + best_lom])
+				{
+					lom = mppc_enc_match_length(history + candidate, history + pos, MIN(end - pos, max_lom));
+
+					if (lom > best_lom)
+					{
+						best_lom = lom;
+						best_offset = pos - candidate;
+
+						if (pos + lom == end || lom == max_lom)
+							break;
+					}
+				}
+
+				candidate = enc->hash_chain[candidate];
+			}
+
+			enc->hash_chain[pos] = enc->hash_table[hash];
+			enc->hash_table[hash] = pos;
+		}
+
+		if (best_lom < 3)
+		{
+			mppc_enc_put_literal(&bits, history[pos]);
+			pos++;
+			continue;
+		}
+
+		mppc_enc_put_copy_offset(&bits, best_offset, big);
+		mppc_enc_put_lom(&bits, best_lom);
+
+		/* index the positions covered by the match */
+		for (pos++, best_lom--; best_lom > 0; pos++, best_lom--)
+		{
+			if (end - pos >= 3)
+			{
+				hash = MPPC_ENC_HASH(history + pos);
+				enc->hash_chain[pos] = enc->hash_table[hash];
+				enc->hash_table[hash] = pos;
+			}
+		}
+	}
+
+	/* pad the last byte with 0s, which the decoder ignores */
+	if (bits.nbits > 0)
+		mppc_enc_put_bits(&bits, 0, 8 - bits.nbits);
+
+	enc->history_offset = end;
+
+	return bits.ptr - dst;
+}
+
+/**
+ * compress data for sending
+ *
+ * On success, the compressed data is in enc->output_buf (enc->bytes_in_opb
+ * bytes) and the compression flags to send with it are in enc->flags. When
+ * the data does not compress, it must be sent as is, the history is reset
+ * and the next compressed packet carries PACKET_FLUSHED.
+ *
+ * @param enc     encoder context
+ * @param src     data to compress
+ * @param len     length of data
+ *
+ * @return        True if the data was compressed, False if it must be sent as is
+ */
+
+tbool compress_rdp(struct rdp_mppc_enc* enc, uint8* src, int len)
+{
+	uint8 flags;
+	uint8* dst;
+	uint32 bytes;
+
+	enc->flags = 0;
+	enc->bytes_in_opb = 0;
+
+	if ((len <= 0) || (len > enc->buf_size))
+		return false;
+
+	flags = enc->flags_hold;
+
+	if (enc->history_offset + len > enc->buf_size)
+	{
+		/* start over at the front, the wrapped tail is never referenced */
+		mppc_enc_reset(enc);
+		flags |= PACKET_AT_FRONT;
+	}
+
+	/* level-1 of RDP 6.1 is not used, its two flag bytes precede the level-2 data */
+	dst = enc->output_buf;
+	if (enc->protocol_type == PACKET_COMPR_TYPE_RDP61)
+		dst += 2;
+
+	bytes = mppc_enc_compress(enc, src, len, dst);
+
+	if (bytes == 0)
+	{
+		mppc_enc_reset(enc);
+		enc->flags_hold = PACKET_FLUSHED;
+		return false;
+	}
+
+	enc->flags_hold = 0;
+	flags |= PACKET_COMPRESSED;
+
+	if (enc->protocol_type == PACKET_COMPR_TYPE_RDP61)
+	{
+		enc->output_buf[0] = L1_NO_COMPRESSION | L1_INNER_COMPRESSION;
+		enc->output_buf[1] = flags | PACKET_COMPR_TYPE_64K;
+		enc->flags = PACKET_COMPRESSED | PACKET_COMPR_TYPE_RDP61;
+		enc->bytes_in_opb = bytes + 2;
+	}
+	else
+	{
+		enc->flags = flags | enc->protocol_type;
+		enc->bytes_in_opb = bytes;
+	}
+
+	return true;
+}
+
+/**
+ * create an encoder context
+ *
+ * @param protocol_type   PACKET_COMPR_TYPE_8K, PACKET_COMPR_TYPE_64K or PACKET_COMPR_TYPE_RDP61
+ *
+ * @return                encoder context, NULL if the type has no encoder
+ */
+
+struct rdp_mppc_enc* mppc_enc_new(int protocol_type)
+{
+	struct rdp_mppc_enc* enc;
+
+	if ((protocol_type != PACKET_COMPR_TYPE_8K) && (protocol_type != PACKET_COMPR_TYPE_64K) &&
+			(protocol_type != PACKET_COMPR_TYPE_RDP61))
+		return NULL;
+
+	enc = (struct rdp_mppc_enc*) xzalloc(sizeof(struct rdp_mppc_enc));
+	enc->protocol_type = protocol_type;
+	enc->buf_size = (protocol_type == PACKET_COMPR_TYPE_8K) ? RDP4_HISTORY_BUF_SIZE : RDP6_HISTORY_BUF_SIZE;
+	enc->history_buf = (uint8*) xzalloc(enc->buf_size);
+	enc->output_buf = (uint8*) xzalloc(enc->buf_size + 2);
+	enc->hash_table = (uint32*) xmalloc(MPPC_ENC_HASH_SIZE * sizeof(uint32));
+	enc->hash_chain = (uint32*) xmalloc(enc->buf_size * sizeof(uint32));
+	enc->flags_hold = PACKET_FLUSHED;
+	mppc_enc_reset(enc);
+
+	return enc;
+}
+
+void mppc_enc_free(struct rdp_mppc_enc* enc)
+{
+	if (enc == NULL)
+		return;
+
+	xfree(enc->history_buf);
+	xfree(enc->output_buf);
+	xfree(enc->hash_table);
+	xfree(enc->hash_chain);
+	xfree(enc);
+}
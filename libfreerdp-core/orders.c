@@ -21,6 +21,7 @@
 #include <freerdp/api.h>
 #include <freerdp/graphics.h>
 #include <freerdp/codec/bitmap.h>
+#include <freerdp/utils/hotpath.h>
 
 #include "orders.h"
 
@@ -2041,8 +2042,10 @@ void update_recv_altsec_order(rdpUpdate* update, STREAM* s, uint8 flags)
 void update_recv_order(rdpUpdate* update, STREAM* s)
 {
 	uint8 controlFlags;
+	HOTPATH_DEFINE(start);
 
 	LLOGLN(10, ("update_recv_order:"));
+	HOTPATH_ENTER(start);
 	stream_read_uint8(s, controlFlags); /* controlFlags (1 byte) */
 
 	if (!(controlFlags & ORDER_STANDARD))
@@ -2060,4 +2063,5 @@ void update_recv_order(rdpUpdate* update, STREAM* s)
 		LLOGLN(10, ("update_recv_order: calling update_recv_primary_order"));
 		update_recv_primary_order(update, s, controlFlags);
 	}
+	HOTPATH_EXIT(start, HOTPATH_ORDER_PARSE);
 }
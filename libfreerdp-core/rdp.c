@@ -143,7 +143,8 @@ tbool rdp_read_share_data_header(STREAM* s, uint16* length, uint8* type, uint32*
 	return true;
 }
 
-void rdp_write_share_data_header(STREAM* s, uint16 length, uint8 type, uint32 share_id)
+void rdp_write_share_data_header(STREAM* s, uint16 length, uint8 type, uint32 share_id,
+		uint8 compressed_type, uint16 compressed_len)
 {
 	length -= RDP_PACKET_HEADER_MAX_LENGTH;
 	length -= RDP_SHARE_CONTROL_HEADER_LENGTH;
@@ -155,8 +156,8 @@ void rdp_write_share_data_header(STREAM* s, uint16 length, uint8 type, uint32 sh
 	stream_write_uint8(s, STREAM_LOW); /* streamId (1 byte) */
 	stream_write_uint16(s, length); /* uncompressedLength (2 bytes) */
 	stream_write_uint8(s, type); /* pduType2, Data PDU Type (1 byte) */
-	stream_write_uint8(s, 0); /* compressedType (1 byte) */
-	stream_write_uint16(s, 0); /* compressedLength (2 bytes) */
+	stream_write_uint8(s, compressed_type); /* compressedType (1 byte) */
+	stream_write_uint16(s, compressed_len); /* compressedLength (2 bytes) */
 }
 
 static int rdp_security_stream_init(rdpRdp* rdp, STREAM* s)
@@ -446,21 +447,48 @@ tbool rdp_send_pdu(rdpRdp* rdp, STREAM* s, uint16 type, uint16 channel_id)
 
 tbool rdp_send_data_pdu(rdpRdp* rdp, STREAM* s, uint8 type, uint16 channel_id)
 {
+	uint8* data;
 	uint16 length;
+	uint16 uncompressed_length;
 	uint32 sec_bytes;
 	uint8* sec_hold;
+	uint8 compressed_type;
+	uint16 compressed_len;
+	struct rdp_mppc_enc* enc;
 
 	length = stream_get_length(s);
+	uncompressed_length = length;
+	sec_bytes = rdp_get_sec_bytes(rdp);
+	compressed_type = 0;
+	compressed_len = 0;
+
+	enc = rdp_get_bulk_compressor(rdp, false);
+
+	if (enc != NULL)
+	{
+		data = s->data + RDP_PACKET_HEADER_MAX_LENGTH + sec_bytes +
+				RDP_SHARE_CONTROL_HEADER_LENGTH + RDP_SHARE_DATA_HEADER_LENGTH;
+
+		/* the compressed data is always shorter, it replaces the payload in place */
+		if (compress_rdp(enc, data, s->data + length - data))
+		{
+			memcpy(data, enc->output_buf, enc->bytes_in_opb);
+			compressed_type = enc->flags;
+			compressed_len = enc->bytes_in_opb + RDP_SHARE_CONTROL_HEADER_LENGTH + RDP_SHARE_DATA_HEADER_LENGTH;
+			length = (data - s->data) + enc->bytes_in_opb;
+		}
+	}
+
 	stream_set_pos(s, 0);
 
 	rdp_write_header(rdp, s, length, MCS_GLOBAL_CHANNEL_ID);
 
-	sec_bytes = rdp_get_sec_bytes(rdp);
 	sec_hold = s->p;
 	stream_seek(s, sec_bytes);
 
 	rdp_write_share_control_header(s, length - sec_bytes, PDU_TYPE_DATA, channel_id);
-	rdp_write_share_data_header(s, length - sec_bytes, type, rdp->settings->share_id);
+	rdp_write_share_data_header(s, uncompressed_length - sec_bytes, type, rdp->settings->share_id,
+			compressed_type, compressed_len);
 
 	s->p = sec_hold;
 	length += rdp_security_stream_out(rdp, s, length);
@@ -992,10 +1020,58 @@ void rdp_set_blocking_mode(rdpRdp* rdp, tbool blocking)
 	transport_set_blocking_mode(rdp->transport, blocking);
 }
 
-int rdp_check_fds(rdpRdp* rdp)
+int rdp_check_fds(rdpRdp* rdp, int* count)
 {
 	LLOGLN(10, ("rdp_check_fds:"));
-	return transport_check_fds(rdp->transport);
+	return transport_check_fds(rdp->transport, count);
+}
+
+/**
+ * Get the bulk compressor for outbound data, created on first use from the
+ * negotiated compression type. Virtual channel data has its own history and
+ * is only compressed when the peer's Virtual Channel capability allows it:
+ * server to client as RDP 5 at most, client to server always as 8K.\n
+ * @param rdp RDP module
+ * @param channel true for virtual channel data
+ * @return compressor, NULL when outbound data is sent uncompressed
+ */
+
+struct rdp_mppc_enc* rdp_get_bulk_compressor(rdpRdp* rdp, boolean channel)
+{
+	int type;
+	rdpSettings* settings;
+	struct rdp_mppc_enc** enc;
+
+	settings = rdp->settings;
+
+	if (!settings->compression || (!settings->server_mode && !settings->compress_outbound))
+		return NULL;
+
+	if (channel)
+	{
+		if (settings->server_mode && !(settings->vc_flags & VCCAPS_COMPR_SC))
+			return NULL;
+
+		if (!settings->server_mode && !(settings->vc_flags & VCCAPS_COMPR_CS_8K))
+			return NULL;
+	}
+
+	enc = channel ? &rdp->mppc_enc_vc : &rdp->mppc_enc;
+
+	if (*enc == NULL)
+	{
+		type = settings->compression_type;
+
+		if (channel && !settings->server_mode)
+			type = PACKET_COMPR_TYPE_8K;
+		else if (channel && type > PACKET_COMPR_TYPE_64K)
+			type = PACKET_COMPR_TYPE_64K;
+
+		/* there is no RDP 6.0 encoder */
+		*enc = mppc_enc_new(type);
+	}
+
+	return *enc;
 }
 
 /**
@@ -1050,6 +1126,8 @@ void rdp_free(rdpRdp* rdp)
 		mcs_free(rdp->mcs);
 		redirection_free(rdp->redirection);
 		mppc_free(rdp);
+		mppc_enc_free(rdp->mppc_enc);
+		mppc_enc_free(rdp->mppc_enc_vc);
 		xfree(rdp);
 	}
 }
@@ -136,6 +136,9 @@ struct rdp_rdp
 	struct rdp_transport* transport;
 	struct rdp_extension* extension;
 	struct rdp_mppc* mppc;
+	struct rdp_mppc* mppc_vc;
+	struct rdp_mppc_enc* mppc_enc;
+	struct rdp_mppc_enc* mppc_enc_vc;
 	struct crypto_rc4_struct* rc4_decrypt_key;
 	int decrypt_use_count;
 	struct crypto_rc4_struct* rc4_encrypt_key;
@@ -172,7 +175,9 @@ boolean rdp_read_share_data_header(STREAM* s, uint16* length, uint8* type,
 		uint32* share_id, uint8 *compressed_type, uint16 *compressed_len);
 
 void rdp_write_share_data_header(STREAM* s, uint16 length, uint8 type,
-		uint32 share_id);
+		uint32 share_id, uint8 compressed_type, uint16 compressed_len);
+
+struct rdp_mppc_enc* rdp_get_bulk_compressor(rdpRdp* rdp, boolean channel);
 
 STREAM* rdp_send_stream_init(rdpRdp* rdp);
 
@@ -199,7 +204,7 @@ int rdp_send_suppress_output(rdpRdp* rdp, int code, int left, int top, int right
 boolean rdp_recv_out_of_sequence_pdu(rdpRdp* rdp, STREAM* s);
 
 void rdp_set_blocking_mode(rdpRdp* rdp, boolean blocking);
-int rdp_check_fds(rdpRdp* rdp);
+int rdp_check_fds(rdpRdp* rdp, int* count);
 
 rdpRdp* rdp_new(freerdp* instance);
 void rdp_free(rdpRdp* rdp);
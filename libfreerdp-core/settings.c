@@ -66,6 +66,8 @@ rdpSettings* settings_new(void* instance)
 				PERF_DISABLE_MENUANIMATIONS |
 				PERF_DISABLE_WALLPAPER;
 
+		settings->compression_type = COMPRESSION_TYPE_64K;
+
 		settings->auto_reconnection = true;
 
 		settings->encryption_method = ENCRYPTION_METHOD_NONE;
@@ -183,6 +185,8 @@ rdpSettings* settings_new(void* instance)
 
 void settings_free(rdpSettings* settings)
 {
+	int i;
+
 	if (settings != NULL)
 	{
 		freerdp_uniconv_free(settings->uniconv);
@@ -205,7 +209,10 @@ void settings_free(rdpSettings* settings)
 		xfree(settings->client_auto_reconnect_cookie);
 		xfree(settings->server_auto_reconnect_cookie);
 		xfree(settings->client_time_zone);
+		for (i = 0; i < 6; i++)
+			xfree(settings->bitmapCacheV2CellInfo[i].persistentKeys);
 		xfree(settings->bitmapCacheV2CellInfo);
+		xfree(settings->persistent_bitmap_cache_file);
 		xfree(settings->glyphCache);
 		xfree(settings->fragCache);
 		key_free(settings->server_key);
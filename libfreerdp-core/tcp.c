@@ -28,6 +28,7 @@
 
 #ifndef _WIN32
 #include <netdb.h>
+#include <poll.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
@@ -211,25 +212,55 @@ tbool tcp_connect(rdpTcp* tcp, const char* hostname, uint16 port)
 	return true;
 }
 
-tbool tcp_can_recv(int sck, int millis)
+static tbool tcp_can_poll(int sck, int millis, tbool write)
 {
-	fd_set rfds;
+#ifndef _WIN32
+	struct pollfd pfd;
+	int rv;
+
+	if (sck < 0)
+		return false;
+	pfd.fd = sck;
+	pfd.events = write ? POLLOUT : POLLIN;
+	pfd.revents = 0;
+	rv = poll(&pfd, 1, millis);
+	if (rv > 0)
+	{
+		return true;
+	}
+	return false;
+#else
+	fd_set fds;
 	struct timeval time;
 	int rv;
 
 	time.tv_sec = millis / 1000;
 	time.tv_usec = (millis * 1000) % 1000000;
-	FD_ZERO(&rfds);
+	FD_ZERO(&fds);
 	if (sck > 0)
 	{
-		FD_SET(((unsigned int)sck), &rfds);
-		rv = select(sck + 1, &rfds, 0, 0, &time);
+		FD_SET(((unsigned int)sck), &fds);
+		if (write)
+			rv = select(sck + 1, 0, &fds, 0, &time);
+		else
+			rv = select(sck + 1, &fds, 0, 0, &time);
 		if (rv > 0)
 		{
 			return true;
 		}
 	}
 	return false;
+#endif
+}
+
+tbool tcp_can_recv(int sck, int millis)
+{
+	return tcp_can_poll(sck, millis, false);
+}
+
+tbool tcp_can_send(int sck, int millis)
+{
+	return tcp_can_poll(sck, millis, true);
 }
 
 int tcp_read(rdpTcp* tcp, uint8* data, int length)
@@ -25,6 +25,7 @@
 #include <freerdp/utils/stream.h>
 #include <freerdp/utils/memory.h>
 #include <freerdp/utils/hexdump.h>
+#include <freerdp/utils/hotpath.h>
 
 #include <time.h>
 #include <errno.h>
@@ -42,6 +43,9 @@
 
 #define BUFFER_SIZE (16384 * 2)
 
+/* queued output is flushed once it reaches this size */
+#define SEND_QUEUE_SIZE (16384 * 4)
+
 #define LLOG_LEVEL 1
 #define LLOGLN(_level, _args) \
   do { if (_level < LLOG_LEVEL) { printf _args ; printf("\n"); } } while (0)
@@ -266,7 +270,7 @@ tbool transport_accept_nla(rdpTransport* transport)
 
 /* will not return until all data is read if transport->blocking is set */
 /* else returns 0 if call would block */
-int transport_read_layer(rdpTransport* transport, uint8* data, int bytes)
+static int transport_read_layer_loop(rdpTransport* transport, uint8* data, int bytes)
 {
 	int read = 0;
 	int status = -1;
@@ -323,6 +327,18 @@ int transport_read_layer(rdpTransport* transport, uint8* data, int bytes)
 	return read;
 }
 
+int transport_read_layer(rdpTransport* transport, uint8* data, int bytes)
+{
+	int status;
+	HOTPATH_DEFINE(start);
+
+	HOTPATH_ENTER(start);
+	status = transport_read_layer_loop(transport, data, bytes);
+	HOTPATH_EXIT(start, HOTPATH_TRANSPORT_READ);
+
+	return status;
+}
+
 int transport_read(rdpTransport* transport, STREAM* s)
 {
 	int status;
@@ -335,6 +351,10 @@ int transport_read(rdpTransport* transport, STREAM* s)
 	LLOGLN(10, ("transport_read: blocking %d", transport->blocking));
 	transport_status = 0;
 
+	/* a blocking read may be waiting on a reply to queued output */
+	if (transport->blocking)
+		transport_flush(transport);
+
 	/* first check if we have header */
 	stream_bytes = stream_get_length(s);
 
@@ -472,21 +492,38 @@ static int transport_read_nonblocking(rdpTransport* transport)
 	return status;
 }
 
-int transport_write(rdpTransport* transport, STREAM* s)
+/* waits for the socket to drain after a write that would block */
+static void transport_wait_write(rdpTransport* transport)
 {
-	int status = -1;
-	int length;
+	uint32 start;
 
-	LLOGLN(10, ("transport_write:"));
+	start = freerdp_get_mstime();
+	switch (transport->layer)
+	{
+		case TRANSPORT_LAYER_TLS:
+			tcp_can_send(transport->tls_in->sockfd, 100);
+			break;
+		case TRANSPORT_LAYER_TCP:
+		case TRANSPORT_LAYER_TSG:
+			tcp_can_send(transport->tcp_in->sockfd, 100);
+			break;
+		default:
+			freerdp_usleep(transport->usleep_interval);
+			break;
+	}
+	transport->send_stall_count++;
+	transport->send_stall_time += freerdp_get_mstime() - start;
+}
 
-	length = stream_get_length(s);
-	stream_set_pos(s, 0);
+static int transport_write_layer(rdpTransport* transport, uint8* data, int length)
+{
+	int status = -1;
 
 #ifdef WITH_DEBUG_TRANSPORT
 	if (length > 0)
 	{
 		printf("Local > Remote\n");
-		freerdp_hexdump(s->data, length);
+		freerdp_hexdump(data, length);
 	}
 #endif
 
@@ -495,13 +532,13 @@ int transport_write(rdpTransport* transport, STREAM* s)
 		switch (transport->layer)
 		{
 			case TRANSPORT_LAYER_TLS:
-				status = tls_write(transport->tls_in, stream_get_tail(s), length);
+				status = tls_write(transport->tls_in, data, length);
 				break;
 			case TRANSPORT_LAYER_TCP:
-				status = tcp_write(transport->tcp_in, stream_get_tail(s), length);
+				status = tcp_write(transport->tcp_in, data, length);
 				break;
 			case TRANSPORT_LAYER_TSG:
-				status = tsg_write(transport->tsg, stream_get_tail(s), length);
+				status = tsg_write(transport->tsg, data, length);
 				break;
 			default:
 				LLOGLN(0, ("transport_write: unknown transport->layer %d", transport->layer));
@@ -513,12 +550,13 @@ int transport_write(rdpTransport* transport, STREAM* s)
 
 		if (status == 0)
 		{
-			/* blocking while sending */
-			freerdp_usleep(transport->usleep_interval);
+			/* blocking while sending, the same buffer must be retried for TLS */
+			transport_wait_write(transport);
+			continue;
 		}
 
 		length -= status;
-		stream_seek(s, status);
+		data += status;
 	}
 
 	if (status < 0)
@@ -530,6 +568,77 @@ int transport_write(rdpTransport* transport, STREAM* s)
 	return status;
 }
 
+/* writes out every queued PDU in one go */
+int transport_flush(rdpTransport* transport)
+{
+	int status;
+	int length;
+	STREAM* q;
+
+	q = transport->send_queue;
+	length = stream_get_length(q);
+
+	if (length < 1)
+		return 0;
+
+	LLOGLN(10, ("transport_flush: %d pdus %d bytes", transport->send_queue_depth, length));
+
+	status = transport_write_layer(transport, stream_get_head(q), length);
+
+	stream_set_pos(q, 0);
+	transport->send_queue_depth = 0;
+	transport->send_queue_flushes++;
+
+	return status;
+}
+
+void transport_get_send_stats(rdpTransport* transport, uint32* pdus, uint32* flushes,
+		uint32* peak, uint32* stall_count, uint32* stall_time)
+{
+	*pdus = transport->send_queue_pdus;
+	*flushes = transport->send_queue_flushes;
+	*peak = transport->send_queue_peak;
+	*stall_count = transport->send_stall_count;
+	*stall_time = transport->send_stall_time;
+}
+
+int transport_write(rdpTransport* transport, STREAM* s)
+{
+	int length;
+	STREAM* q;
+
+	LLOGLN(10, ("transport_write:"));
+
+	length = stream_get_length(s);
+	stream_set_pos(s, 0);
+
+	if ((transport->send_cork > 0) && (transport->layer == TRANSPORT_LAYER_TCP ||
+			transport->layer == TRANSPORT_LAYER_TLS))
+	{
+		/* coalesce, written by transport_flush */
+		q = transport->send_queue;
+		stream_check_size(q, length);
+		stream_write(q, stream_get_head(s), length);
+		stream_seek(s, length);
+
+		transport->send_queue_pdus++;
+		transport->send_queue_depth++;
+		if (transport->send_queue_depth > transport->send_queue_peak)
+			transport->send_queue_peak = transport->send_queue_depth;
+
+		if (stream_get_length(q) >= SEND_QUEUE_SIZE)
+			return transport_flush(transport) < 0 ? -1 : length;
+
+		return length;
+	}
+
+	if (transport_flush(transport) < 0)
+		return -1;
+
+	stream_seek(s, length);
+	return transport_write_layer(transport, stream_get_head(s), length);
+}
+
 void transport_get_fds(rdpTransport* transport, void** rfds, int* rcount)
 {
 	LLOGLN(10, ("transport_get_fds:"));
@@ -583,18 +692,262 @@ static int do_callback(rdpTransport* transport, STREAM* s)
 		rv = -1;
 	}
 	transport->level--;
+	/* only PDUs the callback accepted are counted */
+	if (rv == 0)
+		transport->recv_pdu_count++;
 	return rv;
 }
 
-int transport_check_fds(rdpTransport* transport)
+/* reads whatever the socket has ready into recv_buffer, without growing it
+   past what is needed for the pending PDU
+   returns the number of bytes read, 0 if the call would block */
+static int transport_read_batch(rdpTransport* transport)
+{
+	int room;
+	int total;
+	int status;
+	STREAM* s;
+	HOTPATH_DEFINE(start);
+
+	s = transport->recv_buffer;
+	total = 0;
+
+	while (true)
+	{
+		room = stream_get_left(s);
+		if (room < 1)
+			break;
+
+		HOTPATH_ENTER(start);
+		switch (transport->layer)
+		{
+			case TRANSPORT_LAYER_TLS:
+				status = tls_read(transport->tls_in, s->p, room);
+				break;
+			case TRANSPORT_LAYER_TCP:
+				status = tcp_read(transport->tcp_in, s->p, room);
+				break;
+			default:
+				LLOGLN(0, ("transport_read_batch: unknown layer %d", transport->layer));
+				status = -1;
+				break;
+		}
+		HOTPATH_EXIT(start, HOTPATH_TRANSPORT_READ);
+
+		if (status < 0)
+			return status;
+
+		if (status == 0)
+			break;
+
+		stream_seek(s, status);
+		total += status;
+
+		if (status < room)
+			break; /* socket is drained */
+	}
+
+	LLOGLN(10, ("transport_read_batch: read %d bytes", total));
+	return total;
+}
+
+/* dispatches every complete TPKT / fast-path PDU in recv_buffer, then moves
+   any trailing partial PDU to the front of the buffer */
+static int transport_process_batch(rdpTransport* transport)
+{
+	int pos;
+	int offset;
+	int length;
+	int pending;
+	STREAM* s;
+	STREAM pdu;
+
+	s = transport->recv_buffer;
+	pos = stream_get_pos(s);
+	offset = 0;
+	pending = 0;
+
+	while (pos - offset >= 4)
+	{
+		stream_attach((&pdu), s->data + offset, pos - offset);
+
+		if (tpkt_verify_header(&pdu)) /* TPKT */
+			length = tpkt_read_header(&pdu);
+		else /* Fast Path */
+			length = fastpath_read_header(NULL, &pdu);
+
+		if (length == 0)
+		{
+			printf("transport_check_fds: protocol error, not a TPKT or Fast Path header.\n");
+			freerdp_hexdump(s->data + offset, pos - offset);
+			return -1;
+		}
+
+		if (pos - offset < length)
+		{
+			/* Packet is not yet completely received. */
+			pending = length;
+			break;
+		}
+
+		stream_attach((&pdu), s->data + offset, length);
+		offset += length;
+
+		if (do_callback(transport, &pdu) != 0)
+		{
+			LLOGLN(0, ("transport_check_fds: do_callback failed"));
+			return -1;
+		}
+
+		if (transport->free_pending || transport->layer == TRANSPORT_LAYER_CLOSED)
+			return 0;
+	}
+
+	if (offset > 0)
+	{
+		memmove(s->data, s->data + offset, pos - offset);
+		stream_set_pos(s, pos - offset);
+	}
+
+	/* make sure the whole pending PDU fits, it is read on the next call */
+	stream_check_size(s, pending - stream_get_pos(s));
+
+	return 0;
+}
+
+static int transport_check_fds_batch(rdpTransport* transport)
+{
+	int round;
+	int status;
+	tbool full;
+
+	/* a full buffer means more may be waiting in the socket or in the TLS
+	   layer, which select() would not report, so go round again a few times */
+	for (round = 0; round < 8; round++)
+	{
+		status = transport_read_batch(transport);
+
+		if (status < 0)
+		{
+			LLOGLN(0, ("transport_check_fds: transport_read_batch failed"));
+			return status;
+		}
+
+		full = stream_get_left(transport->recv_buffer) < 1;
+
+		if (transport_process_batch(transport) != 0)
+			return -1;
+
+		if (transport->free_pending || transport->layer == TRANSPORT_LAYER_CLOSED)
+			break;
+
+		if (!full)
+			break;
+	}
+
+	return 0;
+}
+
+/* dispatches the RDP PDUs carried in one TSG fragment straight from the
+   receive buffer, only a PDU that straddles two fragments is copied */
+static int transport_process_tsg_data(rdpTransport* transport, uint8* data, int length)
 {
 	int pos;
+	int bytes;
 	int status;
 	int rdp_pdu_length;
-	int extra_bytes;
+	STREAM* s;
+	STREAM pdu;
+
+	s = transport->proc_buffer;
+
+	if (s != NULL)
+	{
+		/* finish the PDU started in an earlier fragment */
+		pos = stream_get_pos(s);
+		if (pos < 4)
+		{
+			bytes = MIN(4 - pos, length);
+			stream_write(s, data, bytes);
+			data += bytes;
+			length -= bytes;
+			pos += bytes;
+			if (pos < 4)
+				return 0;
+		}
+
+		rdp_pdu_length = get_rdp_pdu_length(s->data);
+		if (rdp_pdu_length < 4 || rdp_pdu_length > stream_get_size(s))
+		{
+			LLOGLN(0, ("transport_process_tsg_data: bad rdp_pdu_length %d", rdp_pdu_length));
+			return -1;
+		}
+
+		bytes = MIN(rdp_pdu_length - pos, length);
+		stream_write(s, data, bytes);
+		data += bytes;
+		length -= bytes;
+		if (stream_get_pos(s) < rdp_pdu_length)
+			return 0;
+
+		LLOGLN(10, ("transport_process_tsg_data: got whole reassembled rdp pdu"));
+		transport->proc_buffer = NULL;
+		stream_seal(s);
+		stream_set_pos(s, 0);
+		status = do_callback(transport, s);
+		stream_pool_release(s);
+		if (status != 0)
+		{
+			LLOGLN(0, ("transport_process_tsg_data: do_callback failed"));
+			return -1;
+		}
+		if (transport->free_pending)
+			return 0;
+	}
+
+	while (length > 3) /* can be more than one RDP PDU in one TSG PDU */
+	{
+		rdp_pdu_length = get_rdp_pdu_length(data);
+		LLOGLN(10, ("transport_process_tsg_data: rdp_pdu_length %d length %d", rdp_pdu_length, length));
+		if (rdp_pdu_length < 4)
+		{
+			LLOGLN(0, ("transport_process_tsg_data: bad rdp_pdu_length %d", rdp_pdu_length));
+			return -1;
+		}
+		if (rdp_pdu_length > length)
+			break;
+
+		stream_attach((&pdu), data, rdp_pdu_length);
+		if (do_callback(transport, &pdu) != 0)
+		{
+			LLOGLN(0, ("transport_process_tsg_data: do_callback failed"));
+			return -1;
+		}
+		if (transport->free_pending)
+			return 0;
+
+		data += rdp_pdu_length;
+		length -= rdp_pdu_length;
+	}
+
+	if (length > 0)
+	{
+		/* partial PDU, keep it until the next fragment */
+		LLOGLN(10, ("transport_process_tsg_data: extra_bytes %d", length));
+		s = stream_pool_take(transport->stream_pool, 0);
+		stream_write(s, data, length);
+		transport->proc_buffer = s;
+	}
+
+	return 0;
+}
+
+static int transport_check_fds_single(rdpTransport* transport)
+{
+	int pos;
+	int status;
 	uint16 length;
 	STREAM* proc_s;
-	STREAM* s;
 
 	int ptype;
 	int pfc_flags;
@@ -604,15 +957,6 @@ int transport_check_fds(rdpTransport* transport)
 	int alloc_hint;
 	int auth_pad_length;
 
-	LLOGLN(10, ("transport_check_fds:"));
-
-	/* test for nested calls */
-	if (transport->level != 0)
-	{
-		LLOGLN(0, ("transport_check_fds: error, nested calls"));
-		return -1;
-	}
-
 	status = transport_read_nonblocking(transport);
 
 	if (status < 0)
@@ -701,39 +1045,11 @@ int transport_check_fds(rdpTransport* transport)
 					"frag_length %d auth_length %d call_id %d alloc_hint %d auth_pad_length %d length %d",
 					ptype, pfc_flags, frag_length, auth_length, call_id, alloc_hint, auth_pad_length, length));
 
-			s = transport->proc_buffer;
-			memcpy(s->p, transport->recv_buffer->data + 24, length);
-			stream_seek(s, length);
+			if (transport_process_tsg_data(transport, transport->recv_buffer->data + 24, length) != 0)
+				return -1;
 
-			while (true) /* can be more than one RDP PDU in one TSG PDU */
-			{
-				pos = stream_get_pos(s);
-				if (pos > 3)
-				{
-					rdp_pdu_length = get_rdp_pdu_length(s->data);
-					LLOGLN(10, ("transport_check_fds: rdp_pdu_length %d pos %d", rdp_pdu_length, pos));
-					if (pos >= rdp_pdu_length)
-					{
-						LLOGLN(10, ("transport_check_fds: got whole rdp pdu"));
-						stream_set_pos(s, rdp_pdu_length);
-						stream_seal(s);
-						stream_set_pos(s, 0);
-						if (do_callback(transport, s) != 0)
-						{
-							LLOGLN(0, ("transport_check_fds: do_callback failed"));
-							return -1;
-						}
-						stream_set_pos(s, 0);
-						extra_bytes = pos - rdp_pdu_length;
-						LLOGLN(10, ("transport_check_fds: extra_bytes %d", extra_bytes));
-						LHEXDUMP(10, (s->data + rdp_pdu_length - extra_bytes, extra_bytes));
-						memmove(s->p, s->data + rdp_pdu_length, extra_bytes);
-						stream_seek(s, extra_bytes);
-						continue;
-					}
-				}
-				break;
-			}
+			if (transport->free_pending)
+				return 0;
 		}
 		else
 		{
@@ -764,8 +1080,64 @@ int transport_check_fds(rdpTransport* transport)
 	return 0;
 }
 
+/* returns 0 or a negative value on error, count (if not NULL) is set to
+   the number of PDUs dispatched successfully, also on error */
+int transport_check_fds(rdpTransport* transport, int* count)
+{
+	int status;
+
+	LLOGLN(10, ("transport_check_fds:"));
+
+	if (count != NULL)
+		*count = 0;
+
+	/* test for nested calls */
+	if (transport->level != 0)
+	{
+		LLOGLN(0, ("transport_check_fds: error, nested calls"));
+		return -1;
+	}
+
+	transport->recv_pdu_count = 0;
+
+	/* replies sent by the callbacks go out together */
+	transport->send_cork++;
+
+	if (transport->recv_batch && !transport->blocking &&
+			transport->layer != TRANSPORT_LAYER_TSG)
+		status = transport_check_fds_batch(transport);
+	else
+		status = transport_check_fds_single(transport);
+
+	transport->send_cork--;
+
+	if (count != NULL)
+		*count = transport->recv_pdu_count;
+
+	if (transport->free_pending)
+	{
+		/* transport_free was called from the receive callback */
+		transport->free_pending = false;
+		transport_free(transport);
+		return status < 0 ? status : 0;
+	}
+
+	if (status < 0)
+		return status;
+
+	if (transport->send_cork == 0)
+	{
+		if (transport_flush(transport) < 0)
+			return -1;
+	}
+
+	LLOGLN(10, ("transport_check_fds: dispatched %d pdus", transport->recv_pdu_count));
+	return 0;
+}
+
 tbool transport_set_blocking_mode(rdpTransport* transport, tbool blocking)
 {
+	transport_flush(transport);
 	transport->blocking = blocking;
 	if (transport->settings->tsg)
 		tcp_set_blocking_mode(transport->tcp_in, blocking);
@@ -789,15 +1161,21 @@ rdpTransport* transport_new(rdpSettings* settings)
 		/* receive buffer for non-blocking read. */
 		transport->recv_buffer = stream_new(BUFFER_SIZE);
 
-		/* for tsg fragmenting */
-		transport->proc_buffer = stream_new(BUFFER_SIZE);
+		/* for tsg fragmenting, big enough for any RDP PDU */
+		transport->stream_pool = stream_pool_new(0x10000, 4);
 
 		/* buffers for blocking read/write */
 		transport->recv_stream = stream_new(BUFFER_SIZE);
 		transport->send_stream = stream_new(BUFFER_SIZE);
 
+		/* coalesced output while receive callbacks run */
+		transport->send_queue = stream_new(SEND_QUEUE_SIZE);
+
 		transport->blocking = true;
 
+		/* dispatch every complete PDU per transport_check_fds call */
+		transport->recv_batch = true;
+
 		transport->layer = TRANSPORT_LAYER_TCP;
 	}
 
@@ -808,10 +1186,18 @@ void transport_free(rdpTransport* transport)
 {
 	if (transport != NULL)
 	{
+		if (transport->level > 0)
+		{
+			/* inside a receive callback, freed once it returns */
+			transport->free_pending = true;
+			return;
+		}
 		stream_free(transport->recv_buffer);
 		stream_free(transport->recv_stream);
 		stream_free(transport->send_stream);
-		stream_free(transport->proc_buffer);
+		stream_free(transport->send_queue);
+		stream_pool_release(transport->proc_buffer);
+		stream_pool_free(transport->stream_pool);
 		if (transport->tls_in)
 		{
 			tls_free(transport->tls_in);
@@ -62,7 +62,19 @@ struct rdp_transport
 	boolean blocking;
 	int level;
 	STREAM* proc_buffer;
+	STREAM_POOL* stream_pool;
 	int tsg_frag_state;
+	boolean recv_batch;
+	int recv_pdu_count;
+	boolean free_pending;
+	STREAM* send_queue;
+	int send_cork;
+	int send_queue_depth;
+	int send_queue_peak;
+	uint32 send_queue_pdus;
+	uint32 send_queue_flushes;
+	uint32 send_stall_count;
+	uint32 send_stall_time;
 };
 
 STREAM* transport_recv_stream_init(rdpTransport* transport, int size);
@@ -78,8 +90,11 @@ boolean transport_accept_tls(rdpTransport* transport);
 boolean transport_accept_nla(rdpTransport* transport);
 int transport_read(rdpTransport* transport, STREAM* s);
 int transport_write(rdpTransport* transport, STREAM* s);
+int transport_flush(rdpTransport* transport);
+void transport_get_send_stats(rdpTransport* transport, uint32* pdus, uint32* flushes,
+		uint32* peak, uint32* stall_count, uint32* stall_time);
 void transport_get_fds(rdpTransport* transport, void** rfds, int* rcount);
-int transport_check_fds(rdpTransport* transport);
+int transport_check_fds(rdpTransport* transport, int* count);
 boolean transport_set_blocking_mode(rdpTransport* transport, boolean blocking);
 rdpTransport* transport_new(rdpSettings* settings);
 void transport_free(rdpTransport* transport);
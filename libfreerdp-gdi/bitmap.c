@@ -24,6 +24,7 @@
 #include <freerdp/freerdp.h>
 #include <freerdp/gdi/gdi.h>
 #include <freerdp/codec/color.h>
+#include <freerdp/utils/hotpath.h>
 
 #include <freerdp/gdi/32bpp.h>
 #include <freerdp/gdi/16bpp.h>
@@ -180,10 +181,16 @@ HGDI_BITMAP gdi_CreateCompatibleBitmap(HGDI_DC hdc, int nWidth, int nHeight)
 
 int gdi_BitBlt(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc, int rop)
 {
+	int rv;
 	p_BitBlt _BitBlt = BitBlt_[IBPP(hdcDest->bitsPerPixel)];
+	HOTPATH_DEFINE(start);
 
-	if (_BitBlt != NULL)
-		return _BitBlt(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc, rop);
-	else
+	if (_BitBlt == NULL)
 		return 0;
+
+	HOTPATH_ENTER(start);
+	rv = _BitBlt(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc, rop);
+	HOTPATH_EXIT(start, HOTPATH_GDI_BLIT);
+
+	return rv;
 }
@@ -75,8 +75,7 @@ HGDI_DC gdi_CreateDC(HCLRCONV clrconv, int bpp)
 	hDC->hwnd->invalid->null = 1;
 
 	hDC->hwnd->count = 32;
-	hDC->hwnd->cinvalid = (HGDI_RGN) malloc(sizeof(GDI_RGN) * hDC->hwnd->count);
-	hDC->hwnd->ninvalid = 0;
+	gdi_InitRegion(&hDC->hwnd->region);
 
 	return hDC;
 }
@@ -216,8 +215,7 @@ int gdi_DeleteDC(HGDI_DC hdc)
 {
 	if (hdc->hwnd)
 	{
-		if (hdc->hwnd->cinvalid != NULL)
-			free(hdc->hwnd->cinvalid);
+		gdi_UninitRegion(&hdc->hwnd->region);
 
 		if (hdc->hwnd->invalid != NULL)
 			free(hdc->hwnd->invalid);
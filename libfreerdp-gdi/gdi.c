@@ -44,6 +44,7 @@
 #include <freerdp/gdi/gdi.h>
 
 #include "gdi.h"
+#include "rop.h"
 
 /* Ternary Raster Operation Table */
 static const uint32 rop3_code_table[] =
@@ -633,6 +634,40 @@ void gdi_mem3blt(rdpContext* context, MEM3BLT_ORDER* mem3blt)
 
 int tilenum = 0;
 
+/* decode a RemoteFX message straight into a 32bpp primary surface */
+static void gdi_surface_bits_rfx_direct(rdpGdi* gdi, RFX_CONTEXT* rfx_context,
+	SURFACE_BITS_COMMAND* surface_bits_command)
+{
+	int i;
+	int x1, y1, x2, y2;
+	RFX_MESSAGE* message;
+	HGDI_BITMAP bitmap = gdi->primary->bitmap;
+
+	message = rfx_process_message_to_surface(rfx_context,
+			surface_bits_command->bitmapData, surface_bits_command->bitmapDataLength,
+			bitmap->data, bitmap->width, bitmap->height, bitmap->scanline,
+			RFX_PIXEL_FORMAT_BGRA, surface_bits_command->destLeft, surface_bits_command->destTop);
+
+	if (message == NULL)
+		return;
+
+	DEBUG_GDI("num_rects %d num_tiles %d", message->num_rects, message->num_tiles);
+
+	/* the decoder only wrote inside the region, invalidate just that */
+	for (i = 0; i < message->num_rects; i++)
+	{
+		x1 = MAX(surface_bits_command->destLeft + message->rects[i].x, 0);
+		y1 = MAX(surface_bits_command->destTop + message->rects[i].y, 0);
+		x2 = MIN(surface_bits_command->destLeft + message->rects[i].x + message->rects[i].width, bitmap->width);
+		y2 = MIN(surface_bits_command->destTop + message->rects[i].y + message->rects[i].height, bitmap->height);
+
+		if (x1 < x2 && y1 < y2)
+			gdi_InvalidateRegion(gdi->primary->hdc, x1, y1, x2 - x1, y2 - y1);
+	}
+
+	rfx_message_free(rfx_context, message);
+}
+
 void gdi_surface_bits(rdpContext* context, SURFACE_BITS_COMMAND* surface_bits_command)
 {
 	int i, j;
@@ -653,7 +688,11 @@ void gdi_surface_bits(rdpContext* context, SURFACE_BITS_COMMAND* surface_bits_co
 
 	tile_bitmap = (char*) xzalloc(32);
 
-	if (surface_bits_command->codecID == CODEC_ID_REMOTEFX)
+	if (surface_bits_command->codecID == CODEC_ID_REMOTEFX && gdi->dstBpp == 32)
+	{
+		gdi_surface_bits_rfx_direct(gdi, rfx_context, surface_bits_command);
+	}
+	else if (surface_bits_command->codecID == CODEC_ID_REMOTEFX)
 	{
 		message = rfx_process_message(rfx_context,
 				surface_bits_command->bitmapData, surface_bits_command->bitmapDataLength);
@@ -745,6 +784,187 @@ void gdi_surface_bits(rdpContext* context, SURFACE_BITS_COMMAND* surface_bits_co
 		xfree(tile_bitmap);
 }
 
+/**
+ * Bitmap updates are decoded once into the scratch buffer (or used in place
+ * when uncompressed) and converted straight into the primary surface when
+ * no clipping region is set. Otherwise they go through a pooled bitmap of
+ * the smallest size class that fits, so no rectangle allocates anything.
+ */
+
+static uint8* gdi_bitmap_update_decode(rdpContext* context, BITMAP_DATA* bitmap_data, int* stride)
+{
+	int size;
+	bitmapExtra be;
+	rdpGdi* gdi = context->gdi;
+
+	*stride = (int) bitmap_data->width * (((int) bitmap_data->bitsPerPixel + 7) / 8);
+	size = *stride * (int) bitmap_data->height;
+
+	if (!bitmap_data->compressed)
+	{
+		if ((int) bitmap_data->bitmapLength < size)
+		{
+			printf("gdi_bitmap_update: short uncompressed bitmap (%d < %d)\n", bitmap_data->bitmapLength, size);
+			return NULL;
+		}
+
+		/* bottom-up rows, walk them backwards instead of flipping */
+		*stride = -(*stride);
+		return bitmap_data->bitmapDataStream - *stride * ((int) bitmap_data->height - 1);
+	}
+
+	if (size > gdi->bitmap_scratch_size)
+	{
+		xfree(gdi->bitmap_scratch);
+		gdi->bitmap_scratch = (uint8*) xmalloc(size);
+		gdi->bitmap_scratch_size = size;
+	}
+
+	memset(&be, 0, sizeof(be));
+	be.temp = context->temp;
+
+	if (!bitmap_decompress_ex(bitmap_data->bitmapDataStream, gdi->bitmap_scratch,
+			bitmap_data->width, bitmap_data->height, bitmap_data->bitmapLength,
+			bitmap_data->bitsPerPixel, bitmap_data->bitsPerPixel, &be))
+	{
+		printf("gdi_bitmap_update: Bitmap Decompression Failed\n");
+		return NULL;
+	}
+
+	return gdi->bitmap_scratch;
+}
+
+static void gdi_bitmap_update_convert(rdpGdi* gdi, uint8* src, int srcStride, int srcBpp,
+		uint8* dst, int dstStride, int width, int height)
+{
+	/* formats without a conversion hand back the source untouched */
+	if (freerdp_image_convert_ex(src, srcStride, dst, dstStride, width, height,
+			srcBpp, gdi->dstBpp, gdi->clrconv) != src || srcBpp != gdi->dstBpp)
+		return;
+
+	for (; height > 0; height--)
+	{
+		memcpy(dst, src, width * gdi->bytesPerPixel);
+		src += srcStride;
+		dst += dstStride;
+	}
+}
+
+static gdiBitmap* gdi_bitmap_pool_get(rdpGdi* gdi, int width, int height)
+{
+	int index;
+	int pixels;
+	int capacity;
+	gdiBitmap* bitmap;
+	HGDI_BITMAP hBitmap;
+
+	pixels = width * height;
+	capacity = GDI_BITMAP_POOL_MIN_PIXELS;
+
+	for (index = 0; index < GDI_BITMAP_POOL_CLASSES - 1 && capacity < pixels; index++)
+		capacity <<= 1;
+
+	capacity = MAX(capacity, pixels);
+	bitmap = gdi->bitmap_pool[index];
+
+	if (bitmap == NULL)
+	{
+		bitmap = gdi_bitmap_new_ex(gdi, capacity, 1, gdi->dstBpp, NULL);
+		gdi->bitmap_pool[index] = bitmap;
+		gdi->bitmap_pool_pixels[index] = capacity;
+		gdi->bitmap_pool_allocs++;
+	}
+	else if (gdi->bitmap_pool_pixels[index] < pixels)
+	{
+		/* only the last class is unbounded */
+		bitmap->bitmap->data = (uint8*) xrealloc(bitmap->bitmap->data, pixels * gdi->bytesPerPixel);
+		gdi->bitmap_pool_pixels[index] = pixels;
+		gdi->bitmap_pool_allocs++;
+	}
+
+	hBitmap = bitmap->bitmap;
+	hBitmap->width = width;
+	hBitmap->height = height;
+	hBitmap->scanline = width * hBitmap->bytesPerPixel;
+
+	return bitmap;
+}
+
+void gdi_bitmap_update(rdpContext* context, BITMAP_UPDATE* bitmap_update)
+{
+	int i;
+	uint8* src;
+	uint8* dst;
+	int stride;
+	int width, height;
+	gdiBitmap* bitmap;
+	BITMAP_DATA* bitmap_data;
+	rdpGdi* gdi = context->gdi;
+	HGDI_DC hdc = gdi->primary->hdc;
+	HGDI_BITMAP surface = gdi->primary->bitmap;
+
+	for (i = 0; i < (int) bitmap_update->number; i++)
+	{
+		bitmap_data = &bitmap_update->rectangles[i];
+
+		width = MIN((int) bitmap_data->destRight - (int) bitmap_data->destLeft + 1, (int) bitmap_data->width);
+		height = MIN((int) bitmap_data->destBottom - (int) bitmap_data->destTop + 1, (int) bitmap_data->height);
+
+		if (width <= 0 || height <= 0)
+			continue;
+
+		src = gdi_bitmap_update_decode(context, bitmap_data, &stride);
+
+		if (src == NULL)
+			continue;
+
+		if (hdc->clip->null && (int) bitmap_data->destLeft + width <= surface->width &&
+				(int) bitmap_data->destTop + height <= surface->height)
+		{
+			dst = surface->data + bitmap_data->destTop * surface->scanline +
+					bitmap_data->destLeft * surface->bytesPerPixel;
+
+			gdi_bitmap_update_convert(gdi, src, stride, bitmap_data->bitsPerPixel,
+					dst, surface->scanline, width, height);
+
+			gdi_InvalidateRegion(hdc, bitmap_data->destLeft, bitmap_data->destTop, width, height);
+			gdi->bitmap_rects_direct++;
+		}
+		else
+		{
+			bitmap = gdi_bitmap_pool_get(gdi, width, height);
+
+			gdi_bitmap_update_convert(gdi, src, stride, bitmap_data->bitsPerPixel,
+					bitmap->bitmap->data, bitmap->bitmap->scanline, width, height);
+
+			gdi_BitBlt(hdc, bitmap_data->destLeft, bitmap_data->destTop,
+					width, height, bitmap->hdc, 0, 0, GDI_SRCCOPY);
+			gdi->bitmap_rects_pooled++;
+		}
+	}
+}
+
+void gdi_get_bitmap_update_stats(rdpGdi* gdi, uint32* direct, uint32* pooled, uint32* allocs)
+{
+	*direct = gdi->bitmap_rects_direct;
+	*pooled = gdi->bitmap_rects_pooled;
+	*allocs = gdi->bitmap_pool_allocs;
+}
+
+/**
+ * Enable SIMD code in the RemoteFX decoder, the raster operations and the
+ * color conversions.
+ * @param gdi current GDI
+ * @param cpu_opt CPU_SSE2 and CPU_AVX2 flags of the running CPU
+ */
+
+void gdi_set_cpu_opt(rdpGdi* gdi, uint32 cpu_opt)
+{
+	rfx_context_set_cpu_opt((RFX_CONTEXT*) gdi->rfx_context, cpu_opt);
+	gdi_rop_set_cpu_opt(cpu_opt);
+	freerdp_color_set_cpu_opt(cpu_opt);
+}
+
 /**
  * Register GDI callbacks with libfreerdp-core.
  * @param inst current instance
@@ -797,8 +1017,7 @@ void gdi_init_primary(rdpGdi* gdi)
 	gdi->primary->hdc->hwnd->invalid->null = 1;
 
 	gdi->primary->hdc->hwnd->count = 32;
-	gdi->primary->hdc->hwnd->cinvalid = (HGDI_RGN) malloc(sizeof(GDI_RGN) * gdi->primary->hdc->hwnd->count);
-	gdi->primary->hdc->hwnd->ninvalid = 0;
+	gdi_InitRegion(&gdi->primary->hdc->hwnd->region);
 }
 
 void gdi_resize(rdpGdi* gdi, int width, int height)
@@ -909,6 +1128,9 @@ int gdi_init(freerdp* instance, uint32 flags, uint8* buffer)
 	offscreen_cache_register_callbacks(instance->update);
 	palette_cache_register_callbacks(instance->update);
 
+	/* replaces the generic Free/New per rectangle path of the bitmap cache */
+	instance->update->BitmapUpdate = gdi_bitmap_update;
+
 	gdi_register_graphics(instance->context->graphics);
 
 	gdi->rfx_context = rfx_context_new();
@@ -919,6 +1141,7 @@ int gdi_init(freerdp* instance, uint32 flags, uint8* buffer)
 
 void gdi_free(freerdp* instance)
 {
+	int i;
 	rdpGdi* gdi = instance->context->gdi;
 
 	if (gdi)
@@ -926,6 +1149,12 @@ void gdi_free(freerdp* instance)
 		gdi_bitmap_free_ex(gdi->primary);
 		gdi_bitmap_free_ex(gdi->tile);
 		gdi_bitmap_free_ex(gdi->image);
+
+		for (i = 0; i < GDI_BITMAP_POOL_CLASSES; i++)
+			gdi_bitmap_free_ex(gdi->bitmap_pool[i]);
+
+		xfree(gdi->bitmap_scratch);
+		xfree(gdi->glyph_run);
 		gdi_DeleteDC(gdi->hdc);
 		rfx_context_free((RFX_CONTEXT*)gdi->rfx_context);
 		free(gdi->clrconv);
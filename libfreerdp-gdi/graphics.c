@@ -26,6 +26,8 @@
 #include <freerdp/codec/rfx.h>
 #include <freerdp/gdi/drawing.h>
 #include <freerdp/gdi/clipping.h>
+#include <freerdp/gdi/16bpp.h>
+#include <freerdp/gdi/32bpp.h>
 #include <freerdp/codec/color.h>
 #include <freerdp/codec/bitmap.h>
 #include <freerdp/utils/memory.h>
@@ -97,7 +99,7 @@ void gdi_Bitmap_Decompress(rdpContext* context, rdpBitmap* bitmap,
 		uint8* data, int width, int height, int bpp, int length,
 		tbool compressed, int codec_id)
 {
-	uint16 size;
+	uint32 size;
 	RFX_MESSAGE* msg;
 	uint8* src;
 	uint8* dst;
@@ -187,6 +189,40 @@ void gdi_Bitmap_SetSurface(rdpContext* context, rdpBitmap* bitmap, tbool primary
 
 /* Glyph Class */
 
+/**
+ * Glyphs keep their 1bpp rows packed into 32-bit words next to the one
+ * byte per pixel mask used by BitBlt. Between BeginDraw and EndDraw, Draw
+ * only queues the glyph; EndDraw then renders the whole run in one pass,
+ * clipping once and skipping empty words, with masked 16 or 32-bit stores.
+ */
+
+static uint32* gdi_glyph_pack(int width, int height, uint8* data, int* stride)
+{
+	int x, y;
+	int scanline;
+	uint32* mask;
+	uint32* dstp;
+	uint8* srcp;
+
+	scanline = (width + 7) / 8;
+	*stride = (width + 31) / 32;
+
+	mask = (uint32*) xzalloc(MAX(*stride * height, 1) * sizeof(uint32));
+	dstp = mask;
+
+	for (y = 0; y < height; y++)
+	{
+		srcp = data + y * scanline;
+
+		for (x = 0; x < scanline; x++)
+			dstp[x / 4] |= (uint32) srcp[x] << (24 - 8 * (x % 4));
+
+		dstp += *stride;
+	}
+
+	return mask;
+}
+
 void gdi_Glyph_New(rdpContext* context, rdpGlyph* glyph)
 {
 	uint8* data;
@@ -205,6 +241,8 @@ void gdi_Glyph_New(rdpContext* context, rdpGlyph* glyph)
 
 	gdi_SelectObject(gdi_glyph->hdc, (HGDIOBJECT) gdi_glyph->bitmap);
 	gdi_glyph->org_bitmap = NULL;
+
+	gdi_glyph->mask = gdi_glyph_pack(glyph->cx, glyph->cy, glyph->aj, &gdi_glyph->mask_stride);
 }
 
 void gdi_Glyph_Free(rdpContext* context, rdpGlyph* glyph)
@@ -218,18 +256,174 @@ void gdi_Glyph_Free(rdpContext* context, rdpGlyph* glyph)
 		gdi_SelectObject(gdi_glyph->hdc, (HGDIOBJECT) gdi_glyph->org_bitmap);
 		gdi_DeleteObject((HGDIOBJECT) gdi_glyph->bitmap);
 		gdi_DeleteDC(gdi_glyph->hdc);
+		xfree(gdi_glyph->mask);
+	}
+}
+
+#if defined(__GNUC__)
+#define gdi_clz64(_x) __builtin_clzll(_x)
+#else
+static int gdi_clz64(uint64 x)
+{
+	int n = 0;
+
+	while (!(x & 0x8000000000000000ULL))
+	{
+		x <<= 1;
+		n++;
+	}
+
+	return n;
+}
+#endif
+
+/**
+ * Draw n pixels of one packed glyph row, starting at bit, over dst. Runs of
+ * set bits are found with count leading zeros and filled, empty words cost
+ * nothing. Like DSPDxax, the alpha byte of a 32bpp pixel is left alone.
+ */
+
+#define GDI_GLYPH_ROW(_type, _dst, _src, _bit, _n, _color, _keep) \
+	do { \
+		int _i, _j, _k, _pos; \
+		uint64 _w; \
+		for (_i = 0; _i < (_n); _i += _k) \
+		{ \
+			_k = MIN(32 - (((_bit) + _i) & 31), (_n) - _i); \
+			_w = (uint64) ((_src)[((_bit) + _i) >> 5] << (((_bit) + _i) & 31)) << 32; \
+			_w &= ~(0xFFFFFFFFFFFFFFFFULL >> _k); \
+			for (_pos = _i; _w != 0; ) \
+			{ \
+				_j = gdi_clz64(_w); \
+				_w <<= _j; \
+				_pos += _j; \
+				_j = gdi_clz64(~_w); \
+				_w <<= _j; \
+				for (; _j > 0; _j--, _pos++) \
+					(_dst)[_pos] = (_type) (((_dst)[_pos] & (_keep)) | ((_color) & ~(_keep))); \
+			} \
+		} \
+	} while (0)
+
+static void gdi_glyph_run_draw(rdpGdi* gdi)
+{
+	int i, y;
+	int x1, y1;
+	int x2, y2;
+	int bit;
+	uint8* dstp;
+	uint32* srcp;
+	uint32 color;
+	GDI_RECT clip;
+	GDI_RECT drawn;
+	gdiGlyph* glyph;
+	gdiGlyphPos* pos;
+	HGDI_DC hdc = gdi->drawing->hdc;
+	HGDI_BITMAP hBmp = (HGDI_BITMAP) hdc->selectedObject;
+
+	if (hdc->bytesPerPixel != 2 && hdc->bytesPerPixel != 4)
+	{
+		for (i = 0; i < gdi->glyph_run_count; i++)
+		{
+			pos = &gdi->glyph_run[i];
+			gdi_BitBlt(hdc, pos->x, pos->y, pos->glyph->bitmap->width,
+					pos->glyph->bitmap->height, pos->glyph->hdc, 0, 0, GDI_DSPDxax);
+		}
+
+		return;
+	}
+
+	gdi_CRgnToRect(0, 0, hBmp->width, hBmp->height, &clip);
+
+	if (!hdc->clip->null)
+	{
+		gdi_RgnToRect(hdc->clip, &drawn);
+		clip.left = MAX(clip.left, drawn.left);
+		clip.top = MAX(clip.top, drawn.top);
+		clip.right = MIN(clip.right, drawn.right);
+		clip.bottom = MIN(clip.bottom, drawn.bottom);
+	}
+
+	if (hdc->bytesPerPixel == 4)
+		color = gdi_get_color_32bpp(hdc, hdc->textColor);
+	else
+		color = gdi_get_color_16bpp(hdc, hdc->textColor);
+
+	drawn.left = clip.right + 1;
+	drawn.top = clip.bottom + 1;
+	drawn.right = clip.left - 1;
+	drawn.bottom = clip.top - 1;
+
+	for (i = 0; i < gdi->glyph_run_count; i++)
+	{
+		pos = &gdi->glyph_run[i];
+		glyph = pos->glyph;
+
+		x1 = MAX(pos->x, clip.left);
+		y1 = MAX(pos->y, clip.top);
+		x2 = MIN(pos->x + glyph->bitmap->width - 1, clip.right);
+		y2 = MIN(pos->y + glyph->bitmap->height - 1, clip.bottom);
+
+		if (x1 > x2 || y1 > y2)
+			continue;
+
+		bit = x1 - pos->x;
+		srcp = glyph->mask + (y1 - pos->y) * glyph->mask_stride;
+		dstp = hBmp->data + y1 * hBmp->scanline + x1 * hdc->bytesPerPixel;
+
+		for (y = y1; y <= y2; y++)
+		{
+			if (hdc->bytesPerPixel == 4)
+				GDI_GLYPH_ROW(uint32, (uint32*) dstp, srcp, bit, x2 - x1 + 1, color, 0xFF000000);
+			else
+				GDI_GLYPH_ROW(uint16, (uint16*) dstp, srcp, bit, x2 - x1 + 1, color, 0);
+
+			srcp += glyph->mask_stride;
+			dstp += hBmp->scanline;
+		}
+
+		drawn.left = MIN(drawn.left, x1);
+		drawn.top = MIN(drawn.top, y1);
+		drawn.right = MAX(drawn.right, x2);
+		drawn.bottom = MAX(drawn.bottom, y2);
+	}
+
+	if (drawn.left <= drawn.right && drawn.top <= drawn.bottom)
+	{
+		gdi_InvalidateRegion(hdc, drawn.left, drawn.top,
+				drawn.right - drawn.left + 1, drawn.bottom - drawn.top + 1);
 	}
 }
 
 void gdi_Glyph_Draw(rdpContext* context, rdpGlyph* glyph, int x, int y)
 {
 	gdiGlyph* gdi_glyph;
+	gdiGlyphPos* pos;
 	rdpGdi* gdi = context->gdi;
 
 	gdi_glyph = (gdiGlyph*) glyph;
 
-	gdi_BitBlt(gdi->drawing->hdc, x, y, gdi_glyph->bitmap->width,
-			gdi_glyph->bitmap->height, gdi_glyph->hdc, 0, 0, GDI_DSPDxax);
+	if (!gdi->glyph_batch)
+	{
+		gdi_BitBlt(gdi->drawing->hdc, x, y, gdi_glyph->bitmap->width,
+				gdi_glyph->bitmap->height, gdi_glyph->hdc, 0, 0, GDI_DSPDxax);
+		return;
+	}
+
+	if (gdi->glyph_run_count >= gdi->glyph_run_size)
+	{
+		gdi->glyph_run_size = MAX(gdi->glyph_run_size * 2, 64);
+
+		if (gdi->glyph_run == NULL)
+			gdi->glyph_run = (gdiGlyphPos*) xmalloc(gdi->glyph_run_size * sizeof(gdiGlyphPos));
+		else
+			gdi->glyph_run = (gdiGlyphPos*) xrealloc(gdi->glyph_run, gdi->glyph_run_size * sizeof(gdiGlyphPos));
+	}
+
+	pos = &gdi->glyph_run[gdi->glyph_run_count++];
+	pos->glyph = gdi_glyph;
+	pos->x = x;
+	pos->y = y;
 }
 
 void gdi_Glyph_BeginDraw(rdpContext* context, int x, int y, int width, int height, uint32 bgcolor, uint32 fgcolor)
@@ -246,14 +440,25 @@ void gdi_Glyph_BeginDraw(rdpContext* context, int x, int y, int width, int heigh
 	brush = gdi_CreateSolidBrush(fgcolor);
 
 	gdi_FillRect(gdi->drawing->hdc, &rect, brush);
+	gdi_DeleteObject((HGDIOBJECT) brush);
 
 	gdi->textColor = gdi_SetTextColor(gdi->drawing->hdc, bgcolor);
+
+	gdi->glyph_batch = true;
+	gdi->glyph_run_count = 0;
 }
 
 void gdi_Glyph_EndDraw(rdpContext* context, int x, int y, int width, int height, uint32 bgcolor, uint32 fgcolor)
 {
 	rdpGdi* gdi = context->gdi;
 
+	if (gdi->glyph_batch)
+	{
+		gdi_glyph_run_draw(gdi);
+		gdi->glyph_batch = false;
+		gdi->glyph_run_count = 0;
+	}
+
 	bgcolor = freerdp_color_convert_var_bgr(bgcolor, gdi->srcBpp, 32, gdi->clrconv);
 	gdi->textColor = gdi_SetTextColor(gdi->drawing->hdc, bgcolor);
 }
@@ -0,0 +1,109 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * GDI Raster Operation Kernels
+ *
+ * Copyright 2014 Jay Sorg <jay.sorg@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* do not include this file directly! */
+
+/**
+ * The including file defines the vector type and operations:
+ * ROP_VEC, ROP_VEC_SIZE (a power of two, at most GDI_ROP_TILE bytes),
+ * ROP_LOAD, ROP_STORE (unaligned), ROP_MASK (all ones or all zeroes),
+ * ROP_NOT, ROP_AND, ROP_OR, ROP_XOR, plus ROP_NAME for the kernel names
+ * and ROP_INIT for the function filling in a kernel table.
+ */
+
+/* whole vectors first, the tail goes through a vector sized buffer */
+#define ROP_ROW(_expr) \
+	for (i = 0; i + ROP_VEC_SIZE <= n; i += ROP_VEC_SIZE) \
+	{ \
+		D = ROP_LOAD(dst + i); \
+		S = ROP_LOAD(src + i); \
+		P = ROP_LOAD(pat + (i & (GDI_ROP_TILE - 1))); \
+		D = _expr; \
+		ROP_STORE(dst + i, D); \
+	} \
+	if (i < n) \
+	{ \
+		memcpy(d, dst + i, n - i); \
+		memcpy(s, src + i, n - i); \
+		D = ROP_LOAD(d); \
+		S = ROP_LOAD(s); \
+		P = ROP_LOAD(pat + (i & (GDI_ROP_TILE - 1))); \
+		D = _expr; \
+		ROP_STORE(d, D); \
+		memcpy(dst + i, d, n - i); \
+	}
+
+#define ROP_KERNEL(_rop3, _name, _expr) \
+static void ROP_NAME(_name)(uint8* dst, const uint8* src, const uint8* pat, int n, uint8 rop3) \
+{ \
+	int i; \
+	ROP_VEC D, S, P; \
+	uint8 d[ROP_VEC_SIZE]; \
+	uint8 s[ROP_VEC_SIZE]; \
+\
+	ROP_ROW(_expr) \
+}
+
+GDI_ROP_KERNELS(ROP_KERNEL)
+
+/* (_m & _a) | (~_m & _b) */
+#define ROP_SEL(_m, _a, _b)	ROP_OR(ROP_AND(_m, _a), ROP_AND(ROP_NOT(_m), _b))
+
+/**
+ * Any ROP3: bit (P << 2 | S << 1 | D) of the index is the result for
+ * those inputs, so select on P, then S, then D between the eight bits.
+ */
+
+static void ROP_NAME(generic)(uint8* dst, const uint8* src, const uint8* pat, int n, uint8 rop3)
+{
+	int i;
+	ROP_VEC D, S, P;
+	ROP_VEC m0, m1, m2, m3, m4, m5, m6, m7;
+	uint8 d[ROP_VEC_SIZE];
+	uint8 s[ROP_VEC_SIZE];
+
+	m0 = ROP_MASK(rop3 & 0x01);
+	m1 = ROP_MASK(rop3 & 0x02);
+	m2 = ROP_MASK(rop3 & 0x04);
+	m3 = ROP_MASK(rop3 & 0x08);
+	m4 = ROP_MASK(rop3 & 0x10);
+	m5 = ROP_MASK(rop3 & 0x20);
+	m6 = ROP_MASK(rop3 & 0x40);
+	m7 = ROP_MASK(rop3 & 0x80);
+
+	ROP_ROW(ROP_SEL(P,
+			ROP_SEL(S, ROP_SEL(D, m7, m6), ROP_SEL(D, m5, m4)),
+			ROP_SEL(S, ROP_SEL(D, m3, m2), ROP_SEL(D, m1, m0))))
+}
+
+void ROP_INIT(pRopRow* kernels)
+{
+	int i;
+
+	for (i = 0; i < 256; i++)
+		kernels[i] = ROP_NAME(generic);
+
+#define ROP_SET_KERNEL(_rop3, _name, _expr)	kernels[_rop3] = ROP_NAME(_name);
+	GDI_ROP_KERNELS(ROP_SET_KERNEL)
+#undef ROP_SET_KERNEL
+}
+
+#undef ROP_ROW
+#undef ROP_KERNEL
+#undef ROP_SEL
@@ -20,10 +20,12 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <limits.h>
 
 #include <freerdp/api.h>
 #include <freerdp/freerdp.h>
 #include <freerdp/gdi/gdi.h>
+#include <freerdp/utils/memory.h>
 
 #include <freerdp/gdi/region.h>
 
@@ -349,8 +351,464 @@ INLINE int gdi_PtInRect(HGDI_RECT rc, int x, int y)
 	return 0;
 }
 
+/**
+ * Initialize an empty region.
+ * @param region region
+ */
+
+void gdi_InitRegion(HGDI_REGION region)
+{
+	memset(region, 0, sizeof(GDI_REGION));
+	region->extents.objectType = GDIOBJECT_REGION;
+	region->extents.null = 1;
+}
+
+/**
+ * Free the rectangles of a region.
+ * @param region region
+ */
+
+void gdi_UninitRegion(HGDI_REGION region)
+{
+	xfree(region->rects);
+	xfree(region->spare);
+	gdi_InitRegion(region);
+}
+
+/**
+ * Empty a region, keeping its buffers.
+ * @param region region
+ */
+
+void gdi_EmptyRegion(HGDI_REGION region)
+{
+	region->count = 0;
+	region->extents.null = 1;
+}
+
+static void gdi_SetRectRegion(HGDI_REGION region, int x, int y, int w, int h)
+{
+	if (region->size < 1)
+	{
+		region->size = 8;
+		region->rects = (HGDI_RGN) xmalloc(sizeof(GDI_RGN) * region->size);
+	}
+
+	gdi_SetRgn(&region->rects[0], x, y, w, h);
+	gdi_SetRgn(&region->extents, x, y, w, h);
+	region->count = 1;
+}
+
+/* room for n rectangles in the spare buffer, keeping those already there */
+static HGDI_RGN gdi_ReserveSpare(HGDI_REGION region, int n)
+{
+	if (n > region->spareSize)
+	{
+		region->spareSize = MAX(n, region->spareSize * 2);
+
+		if (region->spare == NULL)
+			region->spare = (HGDI_RGN) xmalloc(sizeof(GDI_RGN) * region->spareSize);
+		else
+			region->spare = (HGDI_RGN) xrealloc(region->spare, sizeof(GDI_RGN) * region->spareSize);
+	}
+
+	return region->spare;
+}
+
+/* one past the last rectangle of the band starting at rectangle first */
+static INLINE int gdi_BandEnd(HGDI_REGION region, int first)
+{
+	int i;
+
+	for (i = first + 1; i < region->count; i++)
+	{
+		if (region->rects[i].y != region->rects[first].y)
+			break;
+	}
+
+	return i;
+}
+
+/* edge e of a band, the left side of rectangle e / 2 if e is even, its right side otherwise */
+#define GDI_BAND_EDGE(_rects, _e) \
+	(((_e) & 1) ? (_rects)[(_e) >> 1].x + (_rects)[(_e) >> 1].w : (_rects)[(_e) >> 1].x)
+
+static INLINE int gdi_CombineIn(int mode, int inA, int inB)
+{
+	switch (mode)
+	{
+		case GDI_RGN_AND:
+			return inA & inB;
+
+		case GDI_RGN_OR:
+			return inA | inB;
+
+		case GDI_RGN_XOR:
+			return inA ^ inB;
+
+		default:
+			return inA & !inB;
+	}
+}
+
+/**
+ * Sweep the na rectangles of a and the nb rectangles of b, all one band,
+ * from left to right, appending the spans where the mode holds as
+ * rectangles from y to y + h. Spans that touch come out as one rectangle.
+ * @return number of rectangles in out
+ */
+
+static int gdi_CombineBand(HGDI_RGN out, int n, HGDI_RGN a, int na, HGDI_RGN b, int nb, int y, int h, int mode)
+{
+	int x;
+	int xa;
+	int xb;
+	int ea;
+	int eb;
+	int left;
+	int open;
+
+	ea = 0;
+	eb = 0;
+	left = 0;
+	open = 0;
+
+	while (ea < na * 2 || eb < nb * 2)
+	{
+		xa = (ea < na * 2) ? GDI_BAND_EDGE(a, ea) : INT_MAX;
+		xb = (eb < nb * 2) ? GDI_BAND_EDGE(b, eb) : INT_MAX;
+		x = MIN(xa, xb);
+
+		while (ea < na * 2 && GDI_BAND_EDGE(a, ea) == x)
+			ea++;
+
+		while (eb < nb * 2 && GDI_BAND_EDGE(b, eb) == x)
+			eb++;
+
+		if (gdi_CombineIn(mode, ea & 1, eb & 1))
+		{
+			if (!open)
+			{
+				left = x;
+				open = 1;
+			}
+		}
+		else if (open)
+		{
+			gdi_SetRgn(&out[n++], left, y, x - left, h);
+			open = 0;
+		}
+	}
+
+	return n;
+}
+
+/* whether the bands starting at rectangles i and j are the same from left to right */
+static INLINE int gdi_EqualBands(HGDI_RGN rects, int i, int j, int end)
+{
+	if (end - j != j - i)
+		return 0;
+
+	for (; j < end; i++, j++)
+	{
+		if (rects[i].x != rects[j].x || rects[i].w != rects[j].w)
+			return 0;
+	}
+
+	return 1;
+}
+
+static void gdi_UpdateExtents(HGDI_REGION region)
+{
+	int i;
+	int left;
+	int right;
+	HGDI_RGN first;
+	HGDI_RGN last;
+
+	if (region->count < 1)
+	{
+		region->extents.null = 1;
+		return;
+	}
+
+	first = &region->rects[0];
+	last = &region->rects[region->count - 1];
+	left = first->x;
+	right = first->x + first->w;
+
+	for (i = 1; i < region->count; i++)
+	{
+		left = MIN(left, region->rects[i].x);
+		right = MAX(right, region->rects[i].x + region->rects[i].w);
+	}
+
+	gdi_SetRgn(&region->extents, left, first->y, right - left, last->y + last->h - first->y);
+}
+
+/**
+ * Combine two regions, like CombineRgn.\n
+ * @msdn{dd183465}
+ * @param dst destination region, may be src1 or src2
+ * @param src1 first region
+ * @param src2 second region
+ * @param mode GDI_RGN_AND, GDI_RGN_OR, GDI_RGN_XOR or GDI_RGN_DIFF (src1 minus src2)
+ * @return number of rectangles in dst
+ */
+
+int gdi_CombineRegion(HGDI_REGION dst, HGDI_REGION src1, HGDI_REGION src2, int mode)
+{
+	int i;
+	int y;
+	int n;
+	int ia;
+	int ib;
+	int ea;
+	int eb;
+	int na;
+	int nb;
+	int top;
+	int next;
+	int band;
+	int prev;
+	HGDI_RGN out;
+	HGDI_RGN swap;
+
+	ia = 0;
+	ib = 0;
+	ea = (src1->count > 0) ? gdi_BandEnd(src1, 0) : 0;
+	eb = (src2->count > 0) ? gdi_BandEnd(src2, 0) : 0;
+
+	n = 0;
+	prev = -1;
+	out = dst->spare;
+	y = MIN((src1->count > 0) ? src1->rects[0].y : INT_MAX, (src2->count > 0) ? src2->rects[0].y : INT_MAX);
+
+	/* y goes from band edge to band edge, each slice is one output band */
+	while (ia < src1->count || ib < src2->count)
+	{
+		if (ia >= src1->count && (mode == GDI_RGN_AND || mode == GDI_RGN_DIFF))
+			break;
+
+		if (ib >= src2->count && mode == GDI_RGN_AND)
+			break;
+
+		na = 0;
+		nb = 0;
+		next = INT_MAX;
+
+		if (ia < src1->count)
+		{
+			top = src1->rects[ia].y;
+
+			if (top <= y)
+			{
+				na = ea - ia;
+				next = top + src1->rects[ia].h;
+			}
+			else
+			{
+				next = top;
+			}
+		}
+
+		if (ib < src2->count)
+		{
+			top = src2->rects[ib].y;
+
+			if (top <= y)
+			{
+				nb = eb - ib;
+				next = MIN(next, top + src2->rects[ib].h);
+			}
+			else
+			{
+				next = MIN(next, top);
+			}
+		}
+
+		if (na > 0 || nb > 0)
+		{
+			out = gdi_ReserveSpare(dst, n + na + nb);
+			band = n;
+			n = gdi_CombineBand(out, n, &src1->rects[ia], na, &src2->rects[ib], nb, y, next - y, mode);
+
+			if (n > band)
+			{
+				/* grow the band above instead when it touches and has the same spans */
+				if (prev >= 0 && out[prev].y + out[prev].h == y && gdi_EqualBands(out, prev, band, n))
+				{
+					for (i = prev; i < band; i++)
+						out[i].h += next - y;
+
+					n = band;
+				}
+				else
+				{
+					prev = band;
+				}
+			}
+		}
+
+		y = next;
+
+		if (na > 0 && y >= src1->rects[ia].y + src1->rects[ia].h)
+		{
+			ia = ea;
+			ea = (ia < src1->count) ? gdi_BandEnd(src1, ia) : ia;
+		}
+
+		if (nb > 0 && y >= src2->rects[ib].y + src2->rects[ib].h)
+		{
+			ib = eb;
+			eb = (ib < src2->count) ? gdi_BandEnd(src2, ib) : ib;
+		}
+	}
+
+	/* the output becomes the region, its old rectangles the next output buffer */
+	swap = dst->rects;
+	dst->rects = out;
+	dst->spare = swap;
+
+	na = dst->size;
+	dst->size = dst->spareSize;
+	dst->spareSize = na;
+
+	dst->count = n;
+	gdi_UpdateExtents(dst);
+
+	return n;
+}
+
+/**
+ * Add a rectangle to a region.
+ * @param region region
+ * @param x x1
+ * @param y y1
+ * @param w width
+ * @param h height
+ * @return number of rectangles in the region
+ */
+
+int gdi_UnionRectRegion(HGDI_REGION region, int x, int y, int w, int h)
+{
+	int i;
+	GDI_RGN rect;
+	GDI_REGION single;
+	HGDI_RGN extents;
+
+	if (w <= 0 || h <= 0)
+		return region->count;
+
+	extents = &region->extents;
+
+	/* nothing there yet, or the rectangle covers it all */
+	if (region->count < 1 || (x <= extents->x && y <= extents->y &&
+		x + w >= extents->x + extents->w && y + h >= extents->y + extents->h))
+	{
+		gdi_SetRectRegion(region, x, y, w, h);
+		return 1;
+	}
+
+	/* already inside one of the rectangles, the common case of redrawing the same area */
+	if (x >= extents->x && y >= extents->y && x + w <= extents->x + extents->w && y + h <= extents->y + extents->h)
+	{
+		for (i = 0; i < region->count; i++)
+		{
+			if (region->rects[i].y > y)
+				break;
+
+			if (x >= region->rects[i].x && y >= region->rects[i].y &&
+				x + w <= region->rects[i].x + region->rects[i].w &&
+				y + h <= region->rects[i].y + region->rects[i].h)
+			{
+				return region->count;
+			}
+		}
+	}
+
+	gdi_SetRgn(&rect, x, y, w, h);
+
+	single.count = 1;
+	single.size = 1;
+	single.spareSize = 0;
+	single.rects = &rect;
+	single.spare = NULL;
+	single.extents = rect;
+
+	return gdi_CombineRegion(region, region, &single, GDI_RGN_OR);
+}
+
+/**
+ * Bring a region down to at most max rectangles by growing it. The two
+ * rectangles whose bounding box adds the least area are merged, until the
+ * region is small enough; if that does not get there quickly, the region
+ * becomes its bounding box.
+ * @param region region
+ * @param max most rectangles to keep, at least 1
+ * @return number of rectangles in the region
+ */
+
+int gdi_SimplifyRegion(HGDI_REGION region, int max)
+{
+	int i;
+	int j;
+	int pass;
+	int left;
+	int top;
+	int right;
+	int bottom;
+	sint64 waste;
+	sint64 best;
+	HGDI_RGN a;
+	HGDI_RGN b;
+	GDI_RGN merged;
+
+	for (pass = 0; region->count > max && pass < 8; pass++)
+	{
+		best = -1;
+		merged = region->extents;
+
+		for (i = 0; i < region->count; i++)
+		{
+			a = &region->rects[i];
+
+			for (j = i + 1; j < region->count; j++)
+			{
+				b = &region->rects[j];
+
+				left = MIN(a->x, b->x);
+				top = MIN(a->y, b->y);
+				right = MAX(a->x + a->w, b->x + b->w);
+				bottom = MAX(a->y + a->h, b->y + b->h);
+
+				waste = (sint64) (right - left) * (bottom - top) -
+					(sint64) a->w * a->h - (sint64) b->w * b->h;
+
+				if (best < 0 || waste < best)
+				{
+					best = waste;
+					gdi_SetRgn(&merged, left, top, right - left, bottom - top);
+				}
+			}
+		}
+
+		gdi_UnionRectRegion(region, merged.x, merged.y, merged.w, merged.h);
+	}
+
+	if (region->count > max)
+	{
+		merged = region->extents;
+		gdi_SetRectRegion(region, merged.x, merged.y, merged.w, merged.h);
+	}
+
+	return region->count;
+}
+
 /**
  * Invalidate a given region, such that it is redrawn on the next region update.\n
+ * The rectangle is added to hwnd->region, which stays a set of at most
+ * hwnd->count disjoint rectangles, and hwnd->invalid is their bounding box.
  * @msdn{dd145003}
  * @param hdc device context
  * @param x x1
@@ -362,62 +820,45 @@ INLINE int gdi_PtInRect(HGDI_RECT rc, int x, int y)
 
 INLINE int gdi_InvalidateRegion(HGDI_DC hdc, int x, int y, int w, int h)
 {
-	GDI_RECT inv;
-	GDI_RECT rgn;
+	HGDI_WND hwnd;
 	HGDI_RGN invalid;
-	HGDI_RGN cinvalid;
 
-	if (hdc->hwnd == NULL)
+	hwnd = hdc->hwnd;
+
+	if (hwnd == NULL)
 		return 0;
 
-	if (hdc->hwnd->invalid == NULL)
+	if (hwnd->invalid == NULL)
 		return 0;
 
-	cinvalid = hdc->hwnd->cinvalid;
+	invalid = hwnd->invalid;
+
+	/* painting ends by setting invalid->null, and invalid may also be set directly */
+	if (invalid->null)
+		gdi_EmptyRegion(&hwnd->region);
+	else if (hwnd->region.extents.null || !gdi_EqualRgn(invalid, &hwnd->region.extents))
+		gdi_SetRectRegion(&hwnd->region, invalid->x, invalid->y, invalid->w, invalid->h);
 
-	if (hdc->hwnd->ninvalid + 1 > hdc->hwnd->count)
+	if (x < 0)
 	{
-		hdc->hwnd->count *= 2;
-		cinvalid = (HGDI_RGN) realloc(cinvalid, sizeof(GDI_RGN) * (hdc->hwnd->count));
+		w += x;
+		x = 0;
 	}
 
-	gdi_SetRgn(&cinvalid[hdc->hwnd->ninvalid++], x, y, w, h);
-	hdc->hwnd->cinvalid = cinvalid;
-
-	invalid = hdc->hwnd->invalid;
-
-	if (invalid->null)
+	if (y < 0)
 	{
-		invalid->x = x;
-		invalid->y = y;
-		invalid->w = w;
-		invalid->h = h;
-		invalid->null = 0;
-		return 0;
+		h += y;
+		y = 0;
 	}
 
-	gdi_CRgnToRect(x, y, w, h, &rgn);
-	gdi_RgnToRect(invalid, &inv);
-
-	if (rgn.left < 0)
-		rgn.left = 0;
+	if (gdi_UnionRectRegion(&hwnd->region, x, y, w, h) > hwnd->count)
+		gdi_SimplifyRegion(&hwnd->region, hwnd->count);
 
-	if (rgn.top < 0)
-		rgn.top = 0;
-
-	if (rgn.left < inv.left)
-		inv.left = rgn.left;
-
-	if (rgn.top < inv.top)
-		inv.top = rgn.top;
-
-	if (rgn.right > inv.right)
-		inv.right = rgn.right;
-
-	if (rgn.bottom > inv.bottom)
-		inv.bottom = rgn.bottom;
+	if (hwnd->region.extents.null)
+		return 0;
 
-	gdi_RectToRgn(&inv, invalid);
+	gdi_SetRgn(invalid, hwnd->region.extents.x, hwnd->region.extents.y,
+		hwnd->region.extents.w, hwnd->region.extents.h);
 
 	return 0;
 }
@@ -0,0 +1,333 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * GDI Raster Operations
+ *
+ * Copyright 2014 Jay Sorg <jay.sorg@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <freerdp/constants.h>
+#include <freerdp/gdi/region.h>
+#include <freerdp/gdi/16bpp.h>
+#include <freerdp/gdi/32bpp.h>
+
+#include "rop.h"
+
+#ifdef WITH_SSE2
+#include "rop_sse2.h"
+#endif
+
+#ifdef WITH_AVX2
+#include "rop_avx2.h"
+#endif
+
+#ifndef GDI_ROP_INIT_SIMD
+#define GDI_ROP_INIT_SIMD(_kernels) do { } while (0)
+#endif
+
+#ifndef GDI_ROP_INIT_AVX2
+#define GDI_ROP_INIT_AVX2(_kernels) do { } while (0)
+#endif
+
+/* bytes per block when a row has to be done in pieces, a multiple of GDI_ROP_TILE */
+#define GDI_ROP_BLOCK		256
+
+static INLINE uint64 gdi_rop_load64(const uint8* p)
+{
+	uint64 v;
+
+	memcpy(&v, p, 8);
+	return v;
+}
+
+static INLINE void gdi_rop_store64(uint8* p, uint64 v)
+{
+	memcpy(p, &v, 8);
+}
+
+/* portable kernels, eight bytes at a time */
+
+#define ROP_VEC			uint64
+#define ROP_VEC_SIZE		8
+#define ROP_LOAD(_p)		gdi_rop_load64(_p)
+#define ROP_STORE(_p, _v)	gdi_rop_store64(_p, _v)
+#define ROP_MASK(_bit)		((_bit) ? ~((uint64) 0) : 0)
+#define ROP_NOT(_a)		(~(_a))
+#define ROP_AND(_a, _b)		((_a) & (_b))
+#define ROP_OR(_a, _b)		((_a) | (_b))
+#define ROP_XOR(_a, _b)		((_a) ^ (_b))
+#define ROP_NAME(_op)		gdi_rop_##_op
+#define ROP_INIT		gdi_rop_init
+
+#include "include/rop.c"
+
+static pRopRow gdi_rop_kernels[256];
+static tbool gdi_rop_ready = false;
+
+/**
+ * select the row kernels, they are shared by every GDI instance
+ *
+ * @param cpu_opt   CPU_SSE2 and CPU_AVX2 flags of the running CPU
+ */
+
+void gdi_rop_set_cpu_opt(uint32 cpu_opt)
+{
+	gdi_rop_init(gdi_rop_kernels);
+
+	if (cpu_opt & CPU_SSE2)
+		GDI_ROP_INIT_SIMD(gdi_rop_kernels);
+
+	/* the AVX2 kernels replace the SSE2 ones where the CPU has both */
+	if (cpu_opt & CPU_AVX2)
+		GDI_ROP_INIT_AVX2(gdi_rop_kernels);
+
+	gdi_rop_ready = true;
+}
+
+static void gdi_rop_fill_pixel(uint8* tile, uint8* pixel, int bpp)
+{
+	int i;
+
+	for (i = 0; i < GDI_ROP_TILE; i += bpp)
+		memcpy(&tile[i], pixel, bpp);
+}
+
+/* brush pixels (x, y) onwards, wrapping around the brush */
+static void gdi_rop_fill_pattern(uint8* tile, HGDI_BITMAP pattern, int bpp, int x, int y)
+{
+	int i;
+	uint8* row;
+
+	row = pattern->data + (y % pattern->height) * pattern->scanline;
+
+	for (i = 0; i < GDI_ROP_TILE; i += bpp, x++)
+		memcpy(&tile[i], row + (x % pattern->width) * pattern->bytesPerPixel, bpp);
+}
+
+static void gdi_rop_fill_solid(uint8* tile, HGDI_DC hdc)
+{
+	uint8 color8;
+	uint16 color16;
+	uint32 color32;
+
+	switch (hdc->bytesPerPixel)
+	{
+		case 1:
+			color8 = (hdc->brush->color >> 16) & 0xFF;
+			gdi_rop_fill_pixel(tile, &color8, 1);
+			break;
+
+		case 2:
+			color16 = gdi_get_color_16bpp(hdc, hdc->brush->color);
+			gdi_rop_fill_pixel(tile, (uint8*) &color16, 2);
+			break;
+
+		default:
+			color32 = gdi_get_color_32bpp(hdc, hdc->brush->color);
+			gdi_rop_fill_pixel(tile, (uint8*) &color32, 4);
+			break;
+	}
+}
+
+/**
+ * Raster operation on a clipped rectangle of an 8, 16 or 32bpp bitmap.
+ *
+ * The rectangle is clipped to both bitmaps. The pattern is the brush of
+ * hdcDest, its origin is the top left corner of the rectangle. Without a
+ * solid or pattern brush, the text color is used as is. When source and destination overlap on the same bitmap, the
+ * result is as if the source was read before anything was written.
+ *
+ * @return 0 on success, 1 if the raster operation cannot be done
+ */
+
+int gdi_rop_blt(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight,
+		HGDI_DC hdcSrc, int nXSrc, int nYSrc, int rop)
+{
+	int i;
+	int k;
+	int y;
+	int n;
+	int len;
+	int bpp;
+	int step;
+	int first;
+	int last;
+	int left;
+	int right;
+	int dstStride;
+	int srcStride;
+	uint8 rop3;
+	uint8* dstp;
+	uint8* srcp;
+	uint8* d;
+	uint8* s;
+	tbool refill;
+	tbool upward;
+	tbool backward;
+	pRopRow kernel;
+	HGDI_BRUSH brush;
+	HGDI_BITMAP pattern;
+	HGDI_BITMAP hDstBmp;
+	HGDI_BITMAP hSrcBmp;
+	uint8 tile[GDI_ROP_TILE];
+	uint8 tmp[GDI_ROP_BLOCK];
+
+	rop3 = (rop >> 16) & 0xFF;
+
+	if (gdi_rop3_code(rop3) != (uint32) rop)
+	{
+		printf("gdi_rop_blt: unknown rop: 0x%08X\n", rop);
+		return 1;
+	}
+
+	if (!GDI_ROP3_USES_SRC(rop3))
+	{
+		hdcSrc = NULL;
+	}
+	else if (hdcSrc == NULL)
+	{
+		printf("gdi_rop_blt: rop 0x%08X needs a source\n", rop);
+		return 1;
+	}
+
+	if (!gdi_rop_ready)
+		gdi_rop_set_cpu_opt(0);
+
+	kernel = gdi_rop_kernels[rop3];
+
+	bpp = hdcDest->bytesPerPixel;
+	hDstBmp = (HGDI_BITMAP) hdcDest->selectedObject;
+	dstStride = hDstBmp->width * bpp;
+
+	/* rows first to last and columns left to right of the rectangle are drawn */
+	first = MAX(0, -nYDest);
+	last = MIN(nHeight, hDstBmp->height - nYDest);
+	left = MAX(0, -nXDest);
+	right = MIN(nWidth, hDstBmp->width - nXDest);
+
+	upward = false;
+	backward = false;
+
+	if (hdcSrc != NULL)
+	{
+		hSrcBmp = (HGDI_BITMAP) hdcSrc->selectedObject;
+
+		if (hdcSrc->bytesPerPixel != bpp)
+		{
+			printf("gdi_rop_blt: %d bpp source for a %d bpp destination\n", hdcSrc->bitsPerPixel, hdcDest->bitsPerPixel);
+			return 1;
+		}
+
+		srcStride = hSrcBmp->width * bpp;
+
+		first = MAX(first, -nYSrc);
+		last = MIN(last, hSrcBmp->height - nYSrc);
+		left = MAX(left, -nXSrc);
+		right = MIN(right, hSrcBmp->width - nXSrc);
+
+		if ((hSrcBmp == hDstBmp) && gdi_CopyOverlap(nXDest, nYDest, nWidth, nHeight, nXSrc, nYSrc))
+		{
+			/* never write a source row or pixel before it has been read */
+			if (nYSrc < nYDest)
+				upward = true;
+			else if (nYSrc == nYDest && nXSrc < nXDest)
+				backward = true;
+		}
+	}
+	else
+	{
+		/* the kernel loads the source even if the operation ignores it */
+		hSrcBmp = hDstBmp;
+		srcStride = dstStride;
+		nXSrc = nXDest;
+		nYSrc = nYDest;
+	}
+
+	if (first >= last || left >= right)
+		return 0;
+
+	n = (right - left) * bpp;
+	dstp = hDstBmp->data + (nXDest + left) * bpp;
+	srcp = hSrcBmp->data + (nXSrc + left) * bpp;
+
+	brush = hdcDest->brush;
+	pattern = NULL;
+	refill = false;
+
+	if (!GDI_ROP3_USES_PAT(rop3))
+	{
+		memset(tile, 0, sizeof(tile));
+	}
+	else if (brush != NULL && brush->style == GDI_BS_PATTERN)
+	{
+		pattern = brush->pattern;
+
+		/* a brush row the tile does not hold a whole number of times is refilled every tile */
+		refill = (GDI_ROP_TILE % (pattern->width * bpp)) != 0;
+	}
+	else if (brush != NULL && brush->style == GDI_BS_SOLID)
+	{
+		gdi_rop_fill_solid(tile, hdcDest);
+	}
+	else
+	{
+		gdi_rop_fill_pixel(tile, (uint8*) &hdcDest->textColor, bpp);
+	}
+
+	step = refill ? GDI_ROP_TILE : n;
+
+	if (backward)
+		step = MIN(step, GDI_ROP_BLOCK);
+
+	for (k = first; k < last; k++)
+	{
+		y = upward ? (first + last - 1 - k) : k;
+		d = dstp + (nYDest + y) * dstStride;
+		s = srcp + (nYSrc + y) * srcStride;
+
+		if (pattern != NULL && !refill)
+			gdi_rop_fill_pattern(tile, pattern, bpp, left, y);
+
+		if (backward)
+		{
+			/* right to left, each block of source copied out before it is overwritten */
+			for (i = ((n - 1) / step) * step; i >= 0; i -= step)
+			{
+				len = MIN(step, n - i);
+				memcpy(tmp, s + i, len);
+
+				if (refill)
+					gdi_rop_fill_pattern(tile, pattern, bpp, left + i / bpp, y);
+
+				kernel(d + i, tmp, tile, len, rop3);
+			}
+		}
+		else
+		{
+			for (i = 0; i < n; i += step)
+			{
+				len = MIN(step, n - i);
+
+				if (refill)
+					gdi_rop_fill_pattern(tile, pattern, bpp, left + i / bpp, y);
+
+				kernel(d + i, s + i, tile, len, rop3);
+			}
+		}
+	}
+
+	return 0;
+}
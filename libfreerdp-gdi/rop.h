@@ -0,0 +1,70 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * GDI Raster Operations
+ *
+ * Copyright 2014 Jay Sorg <jay.sorg@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __GDI_ROP_H
+#define __GDI_ROP_H
+
+#include "config.h"
+
+#include <freerdp/api.h>
+#include <freerdp/freerdp.h>
+#include <freerdp/gdi/gdi.h>
+
+/**
+ * Raster operations are bitwise, so the engine treats a row of any depth as
+ * plain bytes. A row kernel combines n bytes of destination, source and
+ * pattern in place; the pattern is a tile of GDI_ROP_TILE bytes read at
+ * (offset & (GDI_ROP_TILE - 1)), which holds whole pixels for 8, 16 and
+ * 32bpp and whole rows of an 8 pixel wide brush. rop3 is the ROP3 index
+ * (bits 16 to 23 of the GDI raster operation code).
+ */
+
+#define GDI_ROP_TILE		64
+
+typedef void (*pRopRow)(uint8* dst, const uint8* src, const uint8* pat, int n, uint8 rop3);
+
+/* ROP3 indices with their own kernel, the others are evaluated generically */
+#define GDI_ROP_KERNELS(_ROP) \
+	_ROP(0x0C, SPna,	ROP_AND(S, ROP_NOT(P))) \
+	_ROP(0x11, NOTSRCERASE,	ROP_AND(ROP_NOT(S), ROP_NOT(D))) \
+	_ROP(0x22, DSna,	ROP_AND(D, ROP_NOT(S))) \
+	_ROP(0x33, NOTSRCCOPY,	ROP_NOT(S)) \
+	_ROP(0x44, SRCERASE,	ROP_AND(S, ROP_NOT(D))) \
+	_ROP(0x55, DSTINVERT,	ROP_NOT(D)) \
+	_ROP(0x5A, PATINVERT,	ROP_XOR(P, D)) \
+	_ROP(0x66, SRCINVERT,	ROP_XOR(D, S)) \
+	_ROP(0x88, SRCAND,	ROP_AND(D, S)) \
+	_ROP(0xA5, PDxn,	ROP_XOR(D, ROP_NOT(P))) \
+	_ROP(0xBB, MERGEPAINT,	ROP_OR(ROP_NOT(S), D)) \
+	_ROP(0xC0, MERGECOPY,	ROP_AND(S, P)) \
+	_ROP(0xEE, SRCPAINT,	ROP_OR(D, S)) \
+	_ROP(0xF0, PATCOPY,	P) \
+	_ROP(0xFB, PATPAINT,	ROP_OR(D, ROP_OR(P, ROP_NOT(S))))
+
+/* whether a ROP3 index reads the source or the pattern */
+#define GDI_ROP3_USES_SRC(_rop3)	((((_rop3) >> 2) ^ (_rop3)) & 0x33)
+#define GDI_ROP3_USES_PAT(_rop3)	((((_rop3) >> 4) ^ (_rop3)) & 0x0F)
+
+void gdi_rop_init(pRopRow* kernels);
+void gdi_rop_set_cpu_opt(uint32 cpu_opt);
+
+int gdi_rop_blt(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight,
+		HGDI_DC hdcSrc, int nXSrc, int nYSrc, int rop);
+
+#endif /* __GDI_ROP_H */
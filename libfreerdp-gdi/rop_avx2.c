@@ -0,0 +1,38 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * GDI Raster Operations, AVX2
+ *
+ * Copyright 2014 Jay Sorg <jay.sorg@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include <immintrin.h>
+
+#include "rop.h"
+#include "rop_avx2.h"
+
+#define ROP_VEC			__m256i
+#define ROP_VEC_SIZE		32
+#define ROP_LOAD(_p)		_mm256_loadu_si256((const __m256i*) (_p))
+#define ROP_STORE(_p, _v)	_mm256_storeu_si256((__m256i*) (_p), _v)
+#define ROP_MASK(_bit)		_mm256_set1_epi32((_bit) ? -1 : 0)
+#define ROP_NOT(_a)		_mm256_xor_si256(_a, _mm256_set1_epi32(-1))
+#define ROP_AND(_a, _b)		_mm256_and_si256(_a, _b)
+#define ROP_OR(_a, _b)		_mm256_or_si256(_a, _b)
+#define ROP_XOR(_a, _b)		_mm256_xor_si256(_a, _b)
+#define ROP_NAME(_op)		gdi_rop_##_op##_avx2
+#define ROP_INIT		gdi_rop_init_avx2
+
+#include "include/rop.c"
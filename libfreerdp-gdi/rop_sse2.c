@@ -0,0 +1,38 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * GDI Raster Operations, SSE2
+ *
+ * Copyright 2014 Jay Sorg <jay.sorg@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include <emmintrin.h>
+
+#include "rop.h"
+#include "rop_sse2.h"
+
+#define ROP_VEC			__m128i
+#define ROP_VEC_SIZE		16
+#define ROP_LOAD(_p)		_mm_loadu_si128((const __m128i*) (_p))
+#define ROP_STORE(_p, _v)	_mm_storeu_si128((__m128i*) (_p), _v)
+#define ROP_MASK(_bit)		_mm_set1_epi32((_bit) ? -1 : 0)
+#define ROP_NOT(_a)		_mm_xor_si128(_a, _mm_set1_epi32(-1))
+#define ROP_AND(_a, _b)		_mm_and_si128(_a, _b)
+#define ROP_OR(_a, _b)		_mm_or_si128(_a, _b)
+#define ROP_XOR(_a, _b)		_mm_xor_si128(_a, _b)
+#define ROP_NAME(_op)		gdi_rop_##_op##_sse2
+#define ROP_INIT		gdi_rop_init_sse2
+
+#include "include/rop.c"
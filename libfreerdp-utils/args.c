@@ -93,6 +93,9 @@ int freerdp_parse_args(rdpSettings* settings, int argc, char** argv,
 				"  -x: performance flags (m[odem], b[roadband] or l[an])\n"
 				"  -X: embed into another window with a given XID.\n"
 				"  -z: enable compression\n"
+				"  --compression-type: bulk compression type offered with -z (8k, 64k, rdp61), default is 64k,\n"
+				"    RDP 6.0, which a server may pick when rdp61 is offered, is not supported\n"
+				"  --compress-outbound: with -z, also compress data sent to the server\n"
 				"  --app: RemoteApp connection. This implies -g workarea\n"
 				"  --railhmw: RemoteApp, hide the main window\n"
 				"  --ext: load an extension\n"
@@ -101,6 +104,7 @@ int freerdp_parse_args(rdpSettings* settings, int argc, char** argv,
 				"  --gdi: graphics rendering (hw, sw)\n"
 				"  --no-osb: disable offscreen bitmaps\n"
 				"  --no-bmp-cache: disable bitmap cache\n"
+				"  --persist-cache: persistent bitmap cache file\n"
 				"  --bcv3: codec for bitmap cache v3 (rfx, nsc, jpeg)\n"
 				"  --plugin: load a virtual channel plugin\n"
 				"  --rfx: enable RemoteFX\n"
@@ -305,6 +309,30 @@ int freerdp_parse_args(rdpSettings* settings, int argc, char** argv,
 		{
 			settings->compression = true;
 		}
+		else if (strcmp("--compression-type", argv[index]) == 0)
+		{
+			index++;
+			if (index == argc)
+			{
+				printf("missing compression type\n");
+				return FREERDP_ARGS_PARSE_FAILURE;
+			}
+			if (strcmp("8k", argv[index]) == 0)
+				settings->compression_type = COMPRESSION_TYPE_8K;
+			else if (strcmp("64k", argv[index]) == 0)
+				settings->compression_type = COMPRESSION_TYPE_64K;
+			else if (strcmp("rdp61", argv[index]) == 0)
+				settings->compression_type = COMPRESSION_TYPE_RDP61;
+			else
+			{
+				printf("unknown compression type\n");
+				return FREERDP_ARGS_PARSE_FAILURE;
+			}
+		}
+		else if (strcmp("--compress-outbound", argv[index]) == 0)
+		{
+			settings->compress_outbound = true;
+		}
 		else if (strcmp("--ntlm", argv[index]) == 0)
 		{
 			index++;
@@ -326,6 +354,16 @@ int freerdp_parse_args(rdpSettings* settings, int argc, char** argv,
 		{
 			settings->bitmap_cache = false;
 		}
+		else if (strcmp("--persist-cache", argv[index]) == 0)
+		{
+			index++;
+			if (index == argc)
+			{
+				printf("missing file name\n");
+				return FREERDP_ARGS_PARSE_FAILURE;
+			}
+			settings->persistent_bitmap_cache_file = xstrdup(argv[index]);
+		}
 		else if (strcmp("--no-auth", argv[index]) == 0)
 		{
 			settings->authentication = false;
@@ -0,0 +1,321 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Hot Path Latency Profiler
+ *
+ * Copyright 2014 Jay Sorg <jay.sorg@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#define HOTPATH_TLS __declspec(thread)
+#else
+#include <signal.h>
+#include <unistd.h>
+#define HOTPATH_TLS __thread
+#endif
+
+#include <freerdp/utils/memory.h>
+#include <freerdp/utils/mutex.h>
+#include <freerdp/utils/hotpath.h>
+
+struct _HOTPATH_THREAD
+{
+	int id;
+	HOTPATH_COUNTER counters[HOTPATH_NUM_STAGES];
+	struct _HOTPATH_THREAD* next;
+};
+typedef struct _HOTPATH_THREAD HOTPATH_THREAD;
+
+static const char* const hotpath_stage_names[HOTPATH_NUM_STAGES] =
+{
+	"transport_read",
+	"fastpath_update",
+	"order_parse",
+	"bitmap_decompress",
+	"rfx_decode",
+	"nsc_decode",
+	"gdi_blit"
+};
+
+static int hotpath_on = 0;
+static char* hotpath_output = NULL;
+static freerdp_mutex hotpath_mutex = NULL;
+static HOTPATH_THREAD* hotpath_threads = NULL;
+static int hotpath_num_threads = 0;
+static HOTPATH_TLS HOTPATH_THREAD* hotpath_self = NULL;
+
+#ifndef _WIN32
+static volatile sig_atomic_t hotpath_dump_requested = 0;
+
+static void hotpath_signal_handler(int signum)
+{
+	/* only flag it, the next hotpath_exit writes the file */
+	hotpath_dump_requested = 1;
+}
+#endif
+
+static uint64 hotpath_now(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER freq;
+	LARGE_INTEGER count;
+
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&count);
+	return (uint64) ((double) count.QuadPart * 1000000000.0 / (double) freq.QuadPart);
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+static HOTPATH_THREAD* hotpath_get_thread(void)
+{
+	HOTPATH_THREAD* thread;
+
+	if (hotpath_self != NULL)
+		return hotpath_self;
+
+	/* first sample on this thread, blocks are kept until exit for the final dump */
+	thread = xnew(HOTPATH_THREAD);
+
+	freerdp_mutex_lock(hotpath_mutex);
+	thread->id = hotpath_num_threads++;
+	thread->next = hotpath_threads;
+	hotpath_threads = thread;
+	freerdp_mutex_unlock(hotpath_mutex);
+
+	hotpath_self = thread;
+	return thread;
+}
+
+/**
+ * Enable the profiler when FREERDP_HOTPATH is set. Meant to be called
+ * before the session starts any threads, more calls do nothing.
+ */
+void hotpath_init(void)
+{
+	char* env;
+
+	if (hotpath_mutex != NULL)
+		return;
+
+	hotpath_mutex = freerdp_mutex_new();
+
+	env = getenv("FREERDP_HOTPATH");
+
+	if (env != NULL && env[0] != '\0')
+		hotpath_set_output(env);
+}
+
+boolean hotpath_enabled(void)
+{
+	return hotpath_on ? true : false;
+}
+
+void hotpath_set_output(const char* filename)
+{
+#ifndef _WIN32
+	struct sigaction sa;
+#endif
+
+	if (hotpath_mutex == NULL)
+		hotpath_mutex = freerdp_mutex_new();
+
+	/* a NULL file name switches the profiler off again */
+	hotpath_on = 0;
+
+	xfree(hotpath_output);
+	hotpath_output = (filename != NULL) ? xstrdup(filename) : NULL;
+
+#ifndef _WIN32
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = (filename != NULL) ? hotpath_signal_handler : SIG_DFL;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = SA_RESTART;
+	sigaction(SIGUSR2, &sa, NULL);
+#endif
+
+	if (filename != NULL)
+		hotpath_on = 1;
+}
+
+uint64 hotpath_enter(void)
+{
+	if (!hotpath_on)
+		return 0;
+
+	return hotpath_now();
+}
+
+void hotpath_exit(HOTPATH_STAGE stage, uint64 start)
+{
+	int bucket;
+	uint64 ns;
+	HOTPATH_COUNTER* counter;
+
+	ns = hotpath_now() - start;
+	counter = &hotpath_get_thread()->counters[stage];
+
+	counter->count++;
+	counter->total_ns += ns;
+
+	if (ns > counter->max_ns)
+		counter->max_ns = ns;
+
+	/* floor(log2(ns)) */
+	bucket = 0;
+	while ((ns >> 1) != 0 && bucket < HOTPATH_NUM_BUCKETS - 1)
+	{
+		ns >>= 1;
+		bucket++;
+	}
+	counter->buckets[bucket]++;
+
+#ifndef _WIN32
+	if (hotpath_dump_requested)
+	{
+		hotpath_dump_requested = 0;
+		hotpath_dump();
+	}
+#endif
+}
+
+void hotpath_get_counter(HOTPATH_STAGE stage, HOTPATH_COUNTER* counter)
+{
+	int i;
+	HOTPATH_COUNTER* c;
+	HOTPATH_THREAD* thread;
+
+	memset(counter, 0, sizeof(HOTPATH_COUNTER));
+
+	if (hotpath_mutex == NULL)
+		return;
+
+	freerdp_mutex_lock(hotpath_mutex);
+
+	for (thread = hotpath_threads; thread != NULL; thread = thread->next)
+	{
+		c = &thread->counters[stage];
+		counter->count += c->count;
+		counter->total_ns += c->total_ns;
+		counter->max_ns = MAX(counter->max_ns, c->max_ns);
+
+		for (i = 0; i < HOTPATH_NUM_BUCKETS; i++)
+			counter->buckets[i] += c->buckets[i];
+	}
+
+	freerdp_mutex_unlock(hotpath_mutex);
+}
+
+void hotpath_reset(void)
+{
+	HOTPATH_THREAD* thread;
+
+	if (hotpath_mutex == NULL)
+		return;
+
+	freerdp_mutex_lock(hotpath_mutex);
+
+	for (thread = hotpath_threads; thread != NULL; thread = thread->next)
+		memset(thread->counters, 0, sizeof(thread->counters));
+
+	freerdp_mutex_unlock(hotpath_mutex);
+}
+
+static void hotpath_dump_counter(FILE* fp, HOTPATH_THREAD* thread, int stage)
+{
+	int i;
+	int last;
+	HOTPATH_COUNTER* counter = &thread->counters[stage];
+
+	/* trailing empty buckets are left out */
+	last = 0;
+	for (i = 0; i < HOTPATH_NUM_BUCKETS; i++)
+	{
+		if (counter->buckets[i] != 0)
+			last = i + 1;
+	}
+
+	fprintf(fp, "{\"thread\":%d,\"stage\":\"%s\",\"count\":%llu,\"total_ns\":%llu,\"max_ns\":%llu,\"log2_ns\":[",
+		thread->id, hotpath_stage_names[stage], (unsigned long long) counter->count,
+		(unsigned long long) counter->total_ns, (unsigned long long) counter->max_ns);
+
+	for (i = 0; i < last; i++)
+		fprintf(fp, i ? ",%llu" : "%llu", (unsigned long long) counter->buckets[i]);
+
+	fprintf(fp, "]}");
+}
+
+/**
+ * Append one JSON object to the output file, with an entry per thread
+ * and stage that has samples. Counters keep running, they are not reset.
+ */
+void hotpath_dump(void)
+{
+	int stage;
+	int first;
+	FILE* fp;
+	HOTPATH_THREAD* thread;
+
+	if (!hotpath_on)
+		return;
+
+	if (strcmp(hotpath_output, "-") == 0)
+		fp = stderr;
+	else
+		fp = fopen(hotpath_output, "a");
+
+	if (fp == NULL)
+	{
+		printf("hotpath_dump: can not open %s\n", hotpath_output);
+		return;
+	}
+
+	freerdp_mutex_lock(hotpath_mutex);
+
+	fprintf(fp, "{\"time\":%lu,\"stages\":[", (unsigned long) time(NULL));
+
+	first = 1;
+	for (thread = hotpath_threads; thread != NULL; thread = thread->next)
+	{
+		for (stage = 0; stage < HOTPATH_NUM_STAGES; stage++)
+		{
+			if (thread->counters[stage].count == 0)
+				continue;
+
+			if (!first)
+				fprintf(fp, ",");
+			hotpath_dump_counter(fp, thread, stage);
+			first = 0;
+		}
+	}
+
+	fprintf(fp, "]}\n");
+
+	freerdp_mutex_unlock(hotpath_mutex);
+
+	if (fp != stderr)
+		fclose(fp);
+	else
+		fflush(fp);
+}
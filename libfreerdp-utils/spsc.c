@@ -0,0 +1,150 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Client
+ * Single Producer Single Consumer Queue
+ *
+ * Copyright 2014 Jay Sorg <jay.sorg@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#ifdef _MSC_VER
+#include <windows.h>
+#endif
+
+#include <freerdp/utils/memory.h>
+#include <freerdp/utils/spsc.h>
+
+#ifdef _MSC_VER
+/* volatile accesses are acquire loads and release stores on MSVC */
+#define spsc_load_acquire(_p)		(*(volatile uint32*) (_p))
+#define spsc_store_release(_p, _v)	(*(volatile uint32*) (_p) = (_v))
+#define spsc_fence()			MemoryBarrier()
+#else
+#define spsc_load_acquire(_p)		__atomic_load_n(_p, __ATOMIC_ACQUIRE)
+#define spsc_store_release(_p, _v)	__atomic_store_n(_p, _v, __ATOMIC_RELEASE)
+#define spsc_fence()			__atomic_thread_fence(__ATOMIC_SEQ_CST)
+#endif
+
+#define SPSC_CACHE_LINE		64
+
+/**
+ * head and tail are free running counters, tail - head is the number of
+ * queued items. Each is written by one side only and sits on its own cache
+ * line so the two threads do not bounce a shared line on every item.
+ */
+
+struct _SPSC_QUEUE
+{
+	uint32 head; /* next slot to pop, written by the consumer */
+	uint8 pad0[SPSC_CACHE_LINE - sizeof(uint32)];
+	uint32 tail; /* next slot to push, written by the producer */
+	uint8 pad1[SPSC_CACHE_LINE - sizeof(uint32)];
+	uint32 mask;
+	int item_size;
+	uint8* slots;
+};
+
+/**
+ * create a queue
+ *
+ * @param count       number of slots, rounded up to a power of two
+ * @param item_size   size of one item in bytes
+ */
+
+SPSC_QUEUE* spsc_queue_new(int count, int item_size)
+{
+	uint32 size;
+	SPSC_QUEUE* queue;
+
+	for (size = 1; size < (uint32) count; size <<= 1)
+		;
+
+	queue = (SPSC_QUEUE*) xzalloc(sizeof(SPSC_QUEUE));
+	queue->mask = size - 1;
+	queue->item_size = item_size;
+	queue->slots = (uint8*) xmalloc(size * item_size);
+
+	return queue;
+}
+
+void spsc_queue_free(SPSC_QUEUE* queue)
+{
+	if (queue == NULL)
+		return;
+
+	xfree(queue->slots);
+	xfree(queue);
+}
+
+/**
+ * copy an item into the queue, producer side only
+ *
+ * @return   SPSC_QUEUE_FULL if there is no free slot, SPSC_QUEUE_WAKE if the
+ *           consumer had popped every earlier item and must be woken up,
+ *           SPSC_QUEUE_PUSHED otherwise
+ */
+
+int spsc_queue_push(SPSC_QUEUE* queue, const void* item)
+{
+	uint32 tail;
+
+	tail = queue->tail;
+
+	if (tail - spsc_load_acquire(&queue->head) > queue->mask)
+		return SPSC_QUEUE_FULL;
+
+	memcpy(queue->slots + (tail & queue->mask) * queue->item_size, item, queue->item_size);
+	spsc_store_release(&queue->tail, tail + 1);
+
+	/* pairs with the fence in spsc_queue_pop: either the consumer sees the
+	   new tail before it gives up, or we see it has drained the queue */
+	spsc_fence();
+
+	if (spsc_load_acquire(&queue->head) == tail)
+		return SPSC_QUEUE_WAKE;
+
+	return SPSC_QUEUE_PUSHED;
+}
+
+/**
+ * copy the oldest item out of the queue, consumer side only
+ *
+ * @return   True if an item was popped, False if the queue is empty
+ */
+
+boolean spsc_queue_pop(SPSC_QUEUE* queue, void* item)
+{
+	uint32 head;
+
+	head = queue->head;
+
+	if (spsc_load_acquire(&queue->tail) == head)
+	{
+		spsc_fence();
+
+		if (spsc_load_acquire(&queue->tail) == head)
+			return false;
+	}
+
+	memcpy(item, queue->slots + (head & queue->mask) * queue->item_size, queue->item_size);
+	spsc_store_release(&queue->head, head + 1);
+
+	return true;
+}
+
+boolean spsc_queue_is_empty(SPSC_QUEUE* queue)
+{
+	return (spsc_load_acquire(&queue->tail) == spsc_load_acquire(&queue->head));
+}
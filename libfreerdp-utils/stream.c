@@ -21,9 +21,30 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <freerdp/utils/mutex.h>
 #include <freerdp/utils/memory.h>
 #include <freerdp/utils/stream.h>
 
+struct _STREAM_POOL_ENTRY
+{
+	STREAM s; /* must be first */
+	int capacity;
+	int ref_count;
+	STREAM_POOL* pool;
+};
+typedef struct _STREAM_POOL_ENTRY STREAM_POOL_ENTRY;
+
+struct _STREAM_POOL
+{
+	int size;
+	int count;
+	int max_count;
+	int outstanding;
+	boolean freed;
+	STREAM_POOL_ENTRY** entries;
+	freerdp_mutex mutex;
+};
+
 STREAM* stream_new(int size)
 {
 	STREAM* stream;
@@ -74,3 +95,191 @@ void stream_extend(STREAM* stream, int request_size)
 	memset(stream->data + original_size, 0, increased_size);
 	stream_set_pos(stream, pos);
 }
+
+/**
+ * Create a pool of reusable STREAMs.
+ * @param size default buffer size of a pooled stream
+ * @param max_count maximum number of idle streams kept for reuse
+ * @return new pool
+ */
+
+STREAM_POOL* stream_pool_new(int size, int max_count)
+{
+	STREAM_POOL* pool;
+
+	pool = xnew(STREAM_POOL);
+
+	if (pool != NULL)
+	{
+		pool->size = size > 0 ? size : 0x400;
+		pool->max_count = max_count > 0 ? max_count : 1;
+		pool->entries = (STREAM_POOL_ENTRY**) xzalloc(sizeof(STREAM_POOL_ENTRY*) * pool->max_count);
+		pool->mutex = freerdp_mutex_new();
+	}
+
+	return pool;
+}
+
+static void stream_pool_entry_free(STREAM_POOL_ENTRY* entry)
+{
+	xfree(entry->s.data);
+	xfree(entry);
+}
+
+static void stream_pool_destroy(STREAM_POOL* pool)
+{
+	int index;
+
+	for (index = 0; index < pool->count; index++)
+		stream_pool_entry_free(pool->entries[index]);
+
+	xfree(pool->entries);
+	freerdp_mutex_free(pool->mutex);
+	xfree(pool);
+}
+
+/**
+ * Free a pool. Streams still referenced stay valid, the pool is
+ * destroyed once the last of them is released.
+ * @param pool pool
+ */
+
+void stream_pool_free(STREAM_POOL* pool)
+{
+	boolean destroy;
+
+	if (pool == NULL)
+		return;
+
+	freerdp_mutex_lock(pool->mutex);
+	pool->freed = true;
+	destroy = (pool->outstanding == 0);
+	freerdp_mutex_unlock(pool->mutex);
+
+	if (destroy)
+		stream_pool_destroy(pool);
+}
+
+/**
+ * Take a stream from the pool, with a reference count of one.
+ * The stream is positioned at 0 and sized to at least size bytes.
+ * @param pool pool
+ * @param size minimum buffer size, 0 for the pool default
+ * @return stream
+ */
+
+STREAM* stream_pool_take(STREAM_POOL* pool, int size)
+{
+	int index;
+	STREAM_POOL_ENTRY* entry;
+
+	if (size < 1)
+		size = pool->size;
+
+	entry = NULL;
+
+	freerdp_mutex_lock(pool->mutex);
+
+	/* prefer the most recently returned buffer that is large enough */
+	for (index = pool->count - 1; index >= 0; index--)
+	{
+		if (pool->entries[index]->capacity >= size)
+		{
+			entry = pool->entries[index];
+			pool->count--;
+			pool->entries[index] = pool->entries[pool->count];
+			break;
+		}
+	}
+
+	if ((entry == NULL) && (pool->count > 0))
+	{
+		pool->count--;
+		entry = pool->entries[pool->count];
+	}
+
+	pool->outstanding++;
+
+	freerdp_mutex_unlock(pool->mutex);
+
+	if (entry == NULL)
+	{
+		entry = xnew(STREAM_POOL_ENTRY);
+		entry->pool = pool;
+	}
+
+	if (entry->capacity < size)
+	{
+		size = size > pool->size ? size : pool->size;
+		xfree(entry->s.data);
+		entry->s.data = (uint8*) xmalloc(size);
+		entry->capacity = size;
+	}
+
+	entry->ref_count = 1;
+	entry->s.size = entry->capacity;
+	entry->s.p = entry->s.data;
+
+	return &entry->s;
+}
+
+/**
+ * Add a reference to a stream taken from a pool.
+ * @param stream pooled stream
+ */
+
+void stream_pool_add_ref(STREAM* stream)
+{
+	STREAM_POOL_ENTRY* entry = (STREAM_POOL_ENTRY*) stream;
+
+	freerdp_mutex_lock(entry->pool->mutex);
+	entry->ref_count++;
+	freerdp_mutex_unlock(entry->pool->mutex);
+}
+
+/**
+ * Drop a reference to a stream taken from a pool.
+ * The buffer goes back to the pool when the last reference is dropped.
+ * @param stream pooled stream
+ */
+
+void stream_pool_release(STREAM* stream)
+{
+	STREAM_POOL* pool;
+	STREAM_POOL_ENTRY* entry;
+	boolean destroy = false;
+
+	if (stream == NULL)
+		return;
+
+	entry = (STREAM_POOL_ENTRY*) stream;
+	pool = entry->pool;
+
+	freerdp_mutex_lock(pool->mutex);
+
+	entry->ref_count--;
+
+	if (entry->ref_count > 0)
+	{
+		freerdp_mutex_unlock(pool->mutex);
+		return;
+	}
+
+	pool->outstanding--;
+
+	if (!pool->freed && (pool->count < pool->max_count))
+	{
+		pool->entries[pool->count++] = entry;
+		entry = NULL;
+	}
+
+	destroy = pool->freed && (pool->outstanding == 0);
+
+	freerdp_mutex_unlock(pool->mutex);
+
+	if (entry != NULL)
+		stream_pool_entry_free(entry);
+
+	if (destroy)
+		stream_pool_destroy(pool);
+}
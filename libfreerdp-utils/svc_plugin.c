@@ -28,11 +28,17 @@
 #include <freerdp/utils/debug.h>
 #include <freerdp/utils/stream.h>
 #include <freerdp/utils/list.h>
+#include <freerdp/utils/spsc.h>
 #include <freerdp/utils/thread.h>
 #include <freerdp/utils/event.h>
 #include <freerdp/utils/svc_plugin.h>
 
-/* The list of all plugin instances. */
+/**
+ * Plugin instances are hashed by their init handle and by their open
+ * handle, and every bucket is guarded by one of a set of locks, so
+ * looking up the plugin of a packet is constant time and sessions of one
+ * process rarely contend.
+ */
 typedef struct rdp_svc_plugin_list rdpSvcPluginList;
 struct rdp_svc_plugin_list
 {
@@ -40,10 +46,20 @@ struct rdp_svc_plugin_list
 	rdpSvcPluginList* next;
 };
 
-static rdpSvcPluginList* g_svc_plugin_list = NULL;
+#define SVC_PLUGIN_HASH_BITS	10
+#define SVC_PLUGIN_HASH_SIZE	(1 << SVC_PLUGIN_HASH_BITS)
+#define SVC_PLUGIN_LOCKS	64
+
+#define SVC_PLUGIN_HASH(_key) \
+	((uint32) (((uint64) (_key) * 0x9E3779B97F4A7C15ULL) >> (64 - SVC_PLUGIN_HASH_BITS)))
+#define SVC_PLUGIN_LOCK(_hash)		freerdp_mutex_lock(g_mutex[(_hash) % SVC_PLUGIN_LOCKS])
+#define SVC_PLUGIN_UNLOCK(_hash)	freerdp_mutex_unlock(g_mutex[(_hash) % SVC_PLUGIN_LOCKS])
+
+static rdpSvcPluginList* g_svc_plugin_by_init_handle[SVC_PLUGIN_HASH_SIZE];
+static rdpSvcPluginList* g_svc_plugin_by_open_handle[SVC_PLUGIN_HASH_SIZE];
 
 /* For locking the global resources */
-static freerdp_mutex g_mutex = NULL;
+static freerdp_mutex g_mutex[SVC_PLUGIN_LOCKS];
 
 /* Queue for receiving packets */
 struct _svc_data_in_item
@@ -53,7 +69,9 @@ struct _svc_data_in_item
 };
 typedef struct _svc_data_in_item svc_data_in_item;
 
-static void svc_data_in_item_free(svc_data_in_item* item)
+#define SVC_DATA_IN_QUEUE_SIZE 256
+
+static void svc_data_in_item_release(svc_data_in_item* item)
 {
 	if (item->data_in)
 	{
@@ -65,7 +83,6 @@ static void svc_data_in_item_free(svc_data_in_item* item)
 		freerdp_event_free(item->event_in);
 		item->event_in = NULL;
 	}
-	xfree(item);
 }
 
 struct rdp_svc_plugin_private
@@ -74,87 +91,208 @@ struct rdp_svc_plugin_private
 	uint32 open_handle;
 	STREAM* data_in;
 
+	/**
+	 * The main thread is the only one feeding a plugin, so received data
+	 * and events go through a lock free queue to the plugin thread. When
+	 * it is full they spill into data_in_list, under the thread lock,
+	 * until the plugin thread has taken the spill.
+	 */
+	SPSC_QUEUE* data_in_queue;
 	LIST* data_in_list;
+	volatile int data_in_spilling;
 	freerdp_thread* thread;
+
+	/* receive counters, see svc_plugin_get_receive_stats */
+	uint64 messages_in;
+	uint64 messages_in_single;
+	uint64 bytes_copied;
 };
 
+static void svc_plugin_hash_add(rdpSvcPluginList** table, uint32 hash, rdpSvcPlugin* plugin)
+{
+	rdpSvcPluginList* list;
+
+	list = xnew(rdpSvcPluginList);
+	list->plugin = plugin;
+
+	SVC_PLUGIN_LOCK(hash);
+	list->next = table[hash];
+	table[hash] = list;
+	SVC_PLUGIN_UNLOCK(hash);
+}
+
+static void svc_plugin_hash_remove(rdpSvcPluginList** table, uint32 hash, rdpSvcPlugin* plugin)
+{
+	rdpSvcPluginList* list;
+	rdpSvcPluginList* prev;
+
+	SVC_PLUGIN_LOCK(hash);
+	for (prev = NULL, list = table[hash]; list; prev = list, list = list->next)
+	{
+		if (list->plugin == plugin)
+			break;
+	}
+	if (list)
+	{
+		if (prev)
+			prev->next = list->next;
+		else
+			table[hash] = list->next;
+		xfree(list);
+	}
+	SVC_PLUGIN_UNLOCK(hash);
+}
+
 static rdpSvcPlugin* svc_plugin_find_by_init_handle(void* init_handle)
 {
-	rdpSvcPluginList * list;
-	rdpSvcPlugin * plugin;
+	uint32 hash;
+	rdpSvcPluginList* list;
+	rdpSvcPlugin* plugin = NULL;
+
+	hash = SVC_PLUGIN_HASH((uintptr_t) init_handle);
 
-	freerdp_mutex_lock(g_mutex);
-	for (list = g_svc_plugin_list; list; list = list->next)
+	SVC_PLUGIN_LOCK(hash);
+	for (list = g_svc_plugin_by_init_handle[hash]; list; list = list->next)
 	{
-		plugin = list->plugin;
-		if (plugin->priv->init_handle == init_handle)
+		if (list->plugin->priv->init_handle == init_handle)
 		{
-			freerdp_mutex_unlock(g_mutex);
-			return plugin;
+			plugin = list->plugin;
+			break;
 		}
 	}
-	freerdp_mutex_unlock(g_mutex);
-	return NULL;
+	SVC_PLUGIN_UNLOCK(hash);
+
+	return plugin;
 }
 
 static rdpSvcPlugin* svc_plugin_find_by_open_handle(uint32 open_handle)
 {
-	rdpSvcPluginList * list;
-	rdpSvcPlugin * plugin;
+	uint32 hash;
+	rdpSvcPluginList* list;
+	rdpSvcPlugin* plugin = NULL;
+
+	hash = SVC_PLUGIN_HASH(open_handle);
 
-	freerdp_mutex_lock(g_mutex);
-	for (list = g_svc_plugin_list; list; list = list->next)
+	SVC_PLUGIN_LOCK(hash);
+	for (list = g_svc_plugin_by_open_handle[hash]; list; list = list->next)
 	{
-		plugin = list->plugin;
-		if (plugin->priv->open_handle == open_handle)
+		if (list->plugin->priv->open_handle == open_handle)
 		{
-			freerdp_mutex_unlock(g_mutex);
-			return plugin;
+			plugin = list->plugin;
+			break;
 		}
 	}
-	freerdp_mutex_unlock(g_mutex);
-	return NULL;
+	SVC_PLUGIN_UNLOCK(hash);
+
+	return plugin;
 }
 
 static void svc_plugin_remove(rdpSvcPlugin* plugin)
 {
-	rdpSvcPluginList* list;
-	rdpSvcPluginList* prev;
+	svc_plugin_hash_remove(g_svc_plugin_by_init_handle,
+		SVC_PLUGIN_HASH((uintptr_t) plugin->priv->init_handle), plugin);
 
-	/* Remove from global list */
-	freerdp_mutex_lock(g_mutex);
-	for (prev = NULL, list = g_svc_plugin_list; list; prev = list, list = list->next)
+	if (plugin->priv->thread != NULL)
 	{
-		if (list->plugin == plugin)
-			break;
+		svc_plugin_hash_remove(g_svc_plugin_by_open_handle,
+			SVC_PLUGIN_HASH(plugin->priv->open_handle), plugin);
 	}
-	if (list)
+}
+
+/* called only from main thread */
+static void svc_plugin_queue_data_in(rdpSvcPlugin* plugin, STREAM* data_in, RDP_EVENT* event_in)
+{
+	svc_data_in_item item;
+	svc_data_in_item* pitem;
+	rdpSvcPluginPrivate* priv = plugin->priv;
+
+	item.data_in = data_in;
+	item.event_in = event_in;
+
+	if (!priv->data_in_spilling)
 	{
-		if (prev)
-			prev->next = list->next;
-		else
-			g_svc_plugin_list = list->next;
-		xfree(list);
+		switch (spsc_queue_push(priv->data_in_queue, &item))
+		{
+			case SPSC_QUEUE_PUSHED:
+				return;
+
+			case SPSC_QUEUE_WAKE:
+				/* only signal when the plugin thread may be waiting */
+				freerdp_thread_signal(priv->thread);
+				return;
+		}
 	}
-	freerdp_mutex_unlock(g_mutex);
+
+	pitem = xnew(svc_data_in_item);
+	*pitem = item;
+
+	freerdp_thread_lock(priv->thread);
+	priv->data_in_spilling = 1;
+	list_enqueue(priv->data_in_list, pitem);
+	freerdp_thread_unlock(priv->thread);
+
+	freerdp_thread_signal(priv->thread);
 }
 
+/* a stream of exactly size bytes, left uninitialized as it is written over */
+static STREAM* svc_plugin_stream_resize(STREAM* s, uint32 size)
+{
+	if (s == NULL)
+		s = stream_new(0);
+
+	if (s->data == NULL)
+		s->data = (uint8*) xmalloc(MAX(size, 1));
+	else if (s->size != (int) size)
+		s->data = (uint8*) xrealloc(s->data, MAX(size, 1));
+
+	s->size = size;
+
+	s->p = s->data;
+
+	return s;
+}
+
+/**
+ * Received data is only valid during the open event, so it is copied
+ * exactly once before it goes to the plugin thread. A message that comes
+ * in a single chunk skips reassembly, a larger one is written into a
+ * buffer sized once from totalLength. The buffer of a message abandoned
+ * by a new first chunk is reused.
+ */
 static void svc_plugin_process_received(rdpSvcPlugin* plugin, void* pData, uint32 dataLength,
 	uint32 totalLength, uint32 dataFlags)
 {
 	STREAM* data_in;
-	svc_data_in_item* item;
+	rdpSvcPluginPrivate* priv = plugin->priv;
+
+	if (((dataFlags & (CHANNEL_FLAG_FIRST | CHANNEL_FLAG_LAST)) == (CHANNEL_FLAG_FIRST | CHANNEL_FLAG_LAST)) &&
+		(dataLength == totalLength))
+	{
+		data_in = svc_plugin_stream_resize(NULL, dataLength);
+		memcpy(data_in->data, pData, dataLength);
+
+		priv->messages_in++;
+		priv->messages_in_single++;
+		priv->bytes_copied += dataLength;
+
+		svc_plugin_queue_data_in(plugin, data_in, NULL);
+		return;
+	}
 
 	if (dataFlags & CHANNEL_FLAG_FIRST)
+		priv->data_in = svc_plugin_stream_resize(priv->data_in, MAX(totalLength, dataLength));
+
+	data_in = priv->data_in;
+
+	if (data_in == NULL)
 	{
-		if (plugin->priv->data_in != NULL)
-			stream_free(plugin->priv->data_in);
-		plugin->priv->data_in = stream_new(totalLength);
+		printf("svc_plugin_process_received: no first chunk\n");
+		return;
 	}
 
-	data_in = plugin->priv->data_in;
 	stream_check_size(data_in, (int) dataLength);
 	stream_write(data_in, pData, dataLength);
+	priv->bytes_copied += dataLength;
 
 	if (dataFlags & CHANNEL_FLAG_LAST)
 	{
@@ -163,32 +301,17 @@ static void svc_plugin_process_received(rdpSvcPlugin* plugin, void* pData, uint3
 			printf("svc_plugin_process_received: read error\n");
 		}
 
-		plugin->priv->data_in = NULL;
+		priv->data_in = NULL;
+		priv->messages_in++;
 		stream_set_pos(data_in, 0);
 
-		item = xnew(svc_data_in_item);
-		item->data_in = data_in;
-
-		freerdp_thread_lock(plugin->priv->thread);
-		list_enqueue(plugin->priv->data_in_list, item);
-		freerdp_thread_unlock(plugin->priv->thread);
-
-		freerdp_thread_signal(plugin->priv->thread);
+		svc_plugin_queue_data_in(plugin, data_in, NULL);
 	}
 }
 
 static void svc_plugin_process_event(rdpSvcPlugin* plugin, RDP_EVENT* event_in)
 {
-	svc_data_in_item* item;
-
-	item = xnew(svc_data_in_item);
-	item->event_in = event_in;
-
-	freerdp_thread_lock(plugin->priv->thread);
-	list_enqueue(plugin->priv->data_in_list, item);
-	freerdp_thread_unlock(plugin->priv->thread);
-
-	freerdp_thread_signal(plugin->priv->thread);
+	svc_plugin_queue_data_in(plugin, NULL, event_in);
 }
 
 static void svc_plugin_open_event(uint32 openHandle, uint32 event, void* pData, uint32 dataLength,
@@ -219,32 +342,46 @@ static void svc_plugin_open_event(uint32 openHandle, uint32 event, void* pData,
 	}
 }
 
+static void svc_plugin_dispatch_data_in(rdpSvcPlugin* plugin, svc_data_in_item* item)
+{
+	/* the ownership of the data is passed to the callback */
+	if (item->data_in)
+		IFCALL(plugin->receive_callback, plugin, item->data_in);
+	if (item->event_in)
+		IFCALL(plugin->event_callback, plugin, item->event_in);
+}
+
+/**
+ * The main thread stops feeding the plugin before it asks the thread to
+ * stop, so draining always ends and needs no stop check per item.
+ */
 static void svc_plugin_process_data_in(rdpSvcPlugin* plugin)
 {
-	svc_data_in_item* item;
+	LIST* spill;
+	svc_data_in_item item;
+	svc_data_in_item* pitem;
+	rdpSvcPluginPrivate* priv = plugin->priv;
 
-	while (1)
-	{
-		/* terminate signal */
-		if (freerdp_thread_is_stopped(plugin->priv->thread))
-			break;
+	while (spsc_queue_pop(priv->data_in_queue, &item))
+		svc_plugin_dispatch_data_in(plugin, &item);
 
-		freerdp_thread_lock(plugin->priv->thread);
-		item = list_dequeue(plugin->priv->data_in_list);
-		freerdp_thread_unlock(plugin->priv->thread);
+	if (!priv->data_in_spilling)
+		return;
 
-		if (item != NULL)
-		{
-			/* the ownership of the data is passed to the callback */
-			if (item->data_in)
-				IFCALL(plugin->receive_callback, plugin, item->data_in);
-			if (item->event_in)
-				IFCALL(plugin->event_callback, plugin, item->event_in);
-			xfree(item);
-		}
-		else
-			break;
+	/* everything queued before the spill is done, now the spill itself */
+	freerdp_thread_lock(priv->thread);
+	spill = priv->data_in_list;
+	priv->data_in_list = list_new();
+	priv->data_in_spilling = 0;
+	freerdp_thread_unlock(priv->thread);
+
+	while ((pitem = (svc_data_in_item*) list_dequeue(spill)) != NULL)
+	{
+		svc_plugin_dispatch_data_in(plugin, pitem);
+		xfree(pitem);
 	}
+
+	list_free(spill);
 }
 
 static void* svc_plugin_thread_func(void* arg)
@@ -292,15 +429,19 @@ static void svc_plugin_process_connected(rdpSvcPlugin* plugin, void* pData, uint
 		return;
 	}
 
+	plugin->priv->data_in_queue = spsc_queue_new(SVC_DATA_IN_QUEUE_SIZE, sizeof(svc_data_in_item));
 	plugin->priv->data_in_list = list_new();
 	plugin->priv->thread = freerdp_thread_new();
 
+	svc_plugin_hash_add(g_svc_plugin_by_open_handle, SVC_PLUGIN_HASH(plugin->priv->open_handle), plugin);
+
 	freerdp_thread_start(plugin->priv->thread, svc_plugin_thread_func, plugin);
 }
 
 static void svc_plugin_process_terminated(rdpSvcPlugin* plugin)
 {
-	svc_data_in_item* item;
+	svc_data_in_item item;
+	svc_data_in_item* pitem;
 
 	freerdp_thread_stop(plugin->priv->thread);
 	freerdp_thread_free(plugin->priv->thread);
@@ -310,8 +451,15 @@ static void svc_plugin_process_terminated(rdpSvcPlugin* plugin)
 
 	svc_plugin_remove(plugin);
 
-	while ((item = list_dequeue(plugin->priv->data_in_list)) != NULL)
-		svc_data_in_item_free(item);
+	while (spsc_queue_pop(plugin->priv->data_in_queue, &item))
+		svc_data_in_item_release(&item);
+	spsc_queue_free(plugin->priv->data_in_queue);
+
+	while ((pitem = list_dequeue(plugin->priv->data_in_list)) != NULL)
+	{
+		svc_data_in_item_release(pitem);
+		xfree(pitem);
+	}
 	list_free(plugin->priv->data_in_list);
 
 	if (plugin->priv->data_in != NULL)
@@ -352,30 +500,27 @@ static void svc_plugin_init_event(void* pInitHandle, uint32 event, void* pData,
 
 void svc_plugin_init(rdpSvcPlugin* plugin, CHANNEL_ENTRY_POINTS* pEntryPoints)
 {
-	rdpSvcPluginList* list;
+	int i;
 
 	/**
 	 * The channel manager will guarantee only one thread can call
 	 * VirtualChannelInit at a time. So this should be safe.
 	 */
-	if (g_mutex == NULL)
-		g_mutex = freerdp_mutex_new();
+	if (g_mutex[0] == NULL)
+	{
+		for (i = 0; i < SVC_PLUGIN_LOCKS; i++)
+			g_mutex[i] = freerdp_mutex_new();
+	}
 
 	memcpy(&plugin->channel_entry_points, pEntryPoints, pEntryPoints->cbSize);
 
 	plugin->priv = xnew(rdpSvcPluginPrivate);
 
-	/* Add it to the global list */
-	list = xnew(rdpSvcPluginList);
-	list->plugin = plugin;
-
-	freerdp_mutex_lock(g_mutex);
-	list->next = g_svc_plugin_list;
-	g_svc_plugin_list = list;
-	freerdp_mutex_unlock(g_mutex);
-
 	plugin->channel_entry_points.pVirtualChannelInit(&plugin->priv->init_handle,
 		&plugin->channel_def, 1, VIRTUAL_CHANNEL_VERSION_WIN2000, svc_plugin_init_event);
+
+	/* the init events come later, once the handle is known */
+	svc_plugin_hash_add(g_svc_plugin_by_init_handle, SVC_PLUGIN_HASH((uintptr_t) plugin->priv->init_handle), plugin);
 }
 
 int svc_plugin_send(rdpSvcPlugin* plugin, STREAM* data_out)
@@ -408,3 +553,18 @@ int svc_plugin_send_event(rdpSvcPlugin* plugin, RDP_EVENT* event)
 
 	return error;
 }
+
+/**
+ * Counters of the data received for a plugin.
+ * @param plugin plugin
+ * @param messages number of messages passed to the plugin thread
+ * @param single_chunk how many of them came in a single chunk
+ * @param bytes_copied bytes copied out of the received chunks
+ */
+
+void svc_plugin_get_receive_stats(rdpSvcPlugin* plugin, uint64* messages, uint64* single_chunk, uint64* bytes_copied)
+{
+	*messages = plugin->priv->messages_in;
+	*single_chunk = plugin->priv->messages_in_single;
+	*bytes_copied = plugin->priv->bytes_copied;
+}
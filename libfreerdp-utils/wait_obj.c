@@ -21,10 +21,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <freerdp/types.h>
 #include <freerdp/utils/memory.h>
 #include <freerdp/utils/wait_obj.h>
 
 #ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <sys/time.h>
 #else
 #include <winsock2.h>
@@ -34,6 +38,20 @@
 #include <unistd.h>
 #endif
 
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
+/**
+ * On linux the object is an eventfd, both pipe_fd entries are then the
+ * same descriptor. Elsewhere it is a pipe. Either way the descriptors are
+ * non blocking, so setting never has to check the state first: an eventfd
+ * just adds to its counter and a full pipe is set already.
+ */
 struct wait_obj
 {
 #ifdef _WIN32
@@ -44,6 +62,10 @@ struct wait_obj
 	int attached;
 };
 
+#ifndef _WIN32
+#define wait_obj_is_eventfd(_obj) ((_obj)->pipe_fd[0] == (_obj)->pipe_fd[1])
+#endif
+
 struct wait_obj*
 wait_obj_new(void)
 {
@@ -57,12 +79,20 @@ wait_obj_new(void)
 #else
 	obj->pipe_fd[0] = -1;
 	obj->pipe_fd[1] = -1;
+#ifdef HAVE_SYS_EVENTFD_H
+	obj->pipe_fd[0] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	obj->pipe_fd[1] = obj->pipe_fd[0];
+	if (obj->pipe_fd[0] != -1)
+		return obj;
+#endif
 	if (pipe(obj->pipe_fd) < 0)
 	{
 		printf("wait_obj_new: pipe failed\n");
 		xfree(obj);
 		return NULL;
 	}
+	fcntl(obj->pipe_fd[0], F_SETFL, fcntl(obj->pipe_fd[0], F_GETFL) | O_NONBLOCK);
+	fcntl(obj->pipe_fd[1], F_SETFL, fcntl(obj->pipe_fd[1], F_GETFL) | O_NONBLOCK);
 #endif
 
 	return obj;
@@ -100,6 +130,10 @@ wait_obj_free(struct wait_obj* obj)
 				obj->event = NULL;
 			}
 #else
+			/* an eventfd is both entries, close it once */
+			if (wait_obj_is_eventfd(obj))
+				obj->pipe_fd[1] = -1;
+
 			if (obj->pipe_fd[0] != -1)
 			{
 				close(obj->pipe_fd[0]);
@@ -123,15 +157,12 @@ wait_obj_is_set(struct wait_obj* obj)
 #ifdef _WIN32
 	return (WaitForSingleObject(obj->event, 0) == WAIT_OBJECT_0);
 #else
-	fd_set rfds;
-	int num_set;
-	struct timeval time;
+	struct pollfd pfd;
 
-	FD_ZERO(&rfds);
-	FD_SET(obj->pipe_fd[0], &rfds);
-	memset(&time, 0, sizeof(time));
-	num_set = select(obj->pipe_fd[0] + 1, &rfds, 0, 0, &time);
-	return (num_set == 1);
+	pfd.fd = obj->pipe_fd[0];
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	return (poll(&pfd, 1, 0) == 1);
 #endif
 }
 
@@ -142,11 +173,18 @@ wait_obj_set(struct wait_obj* obj)
 	SetEvent(obj->event);
 #else
 	int len;
+	uint64 value;
 
-	if (wait_obj_is_set(obj))
-		return;
-	len = write(obj->pipe_fd[1], "sig", 4);
-	if (len != 4)
+	if (wait_obj_is_eventfd(obj))
+	{
+		value = 1;
+		len = write(obj->pipe_fd[1], &value, sizeof(value));
+	}
+	else
+	{
+		len = write(obj->pipe_fd[1], "sig", 4);
+	}
+	if (len < 0 && errno != EAGAIN)
 		printf("wait_obj_set: error\n");
 #endif
 }
@@ -158,13 +196,26 @@ wait_obj_clear(struct wait_obj* obj)
 	ResetEvent(obj->event);
 #else
 	int len;
+	uint8 buf[64];
 
-	while (wait_obj_is_set(obj))
+	if (obj->attached)
 	{
-		len = read(obj->pipe_fd[0], &len, 4);
-		if (len != 4)
-			printf("wait_obj_clear: error\n");
+		/* not ours, it may be blocking */
+		while (wait_obj_is_set(obj))
+		{
+			len = read(obj->pipe_fd[0], buf, 4);
+			if (len != 4)
+				printf("wait_obj_clear: error\n");
+		}
+		return;
 	}
+
+	/* one read resets an eventfd, a pipe is read until it is empty */
+	do
+	{
+		len = read(obj->pipe_fd[0], buf, sizeof(buf));
+	}
+	while (len > 0 && !wait_obj_is_eventfd(obj));
 #endif
 }
 
@@ -172,12 +223,28 @@ int
 wait_obj_select(struct wait_obj** listobj, int numobj, int timeout)
 {
 #ifndef _WIN32
-	int max;
-	int sock;
 	int index;
-#endif
-	fd_set fds;
 	int status;
+	struct pollfd pfds_stack[8];
+	struct pollfd* pfds;
+
+	pfds = (numobj > 8) ? (struct pollfd*) xmalloc(numobj * sizeof(struct pollfd)) : pfds_stack;
+
+	for (index = 0; index < numobj; index++)
+	{
+		pfds[index].fd = listobj[index]->pipe_fd[0];
+		pfds[index].events = POLLIN;
+		pfds[index].revents = 0;
+	}
+
+	status = poll(pfds, numobj, timeout);
+
+	if (pfds != pfds_stack)
+		xfree(pfds);
+
+	return status;
+#else
+	fd_set fds;
 	struct timeval time;
 	struct timeval* ptime;
 
@@ -189,26 +256,8 @@ wait_obj_select(struct wait_obj** listobj, int numobj, int timeout)
 		ptime = &time;
 	}
 
-#ifndef _WIN32
-	max = 0;
-	FD_ZERO(&fds);
-	if (listobj)
-	{
-		for (index = 0; index < numobj; index++)
-		{
-			sock = listobj[index]->pipe_fd[0];
-			FD_SET(sock, &fds);
-
-			if (sock > max)
-				max = sock;
-		}
-	}
-	status = select(max + 1, &fds, 0, 0, ptime);
-#else
-	status = select(0, &fds, 0, 0, ptime);
+	return select(0, &fds, 0, 0, ptime);
 #endif
-
-	return status;
 }
 
 void wait_obj_get_fds(struct wait_obj* obj, void** fds, int* count)
@@ -223,3 +272,82 @@ void wait_obj_get_fds(struct wait_obj* obj, void** fds, int* count)
 #endif
 	(*count)++;
 }
+
+/**
+ * Register descriptors, as gathered by the get_fds functions, for read
+ * readiness with a caller owned epoll instance. Registering again only
+ * updates the data pointer.
+ * @param epfd epoll instance
+ * @param fds descriptors
+ * @param count number of descriptors
+ * @param data returned in epoll_event.data.ptr
+ * @return 0 on success, -1 on error or when epoll is not available
+ */
+
+int wait_obj_epoll_add_fds(int epfd, void** fds, int count, void* data)
+{
+#ifdef HAVE_SYS_EPOLL_H
+	int index;
+	int fd;
+	struct epoll_event event;
+
+	for (index = 0; index < count; index++)
+	{
+		fd = (int)(long) fds[index];
+		memset(&event, 0, sizeof(event));
+		event.events = EPOLLIN;
+		event.data.ptr = data;
+
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &event) == 0)
+			continue;
+
+		if (errno != EEXIST || epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &event) != 0)
+			return -1;
+	}
+
+	return 0;
+#else
+	return -1;
+#endif
+}
+
+int wait_obj_epoll_del_fds(int epfd, void** fds, int count)
+{
+#ifdef HAVE_SYS_EPOLL_H
+	int index;
+	int status = 0;
+	struct epoll_event event;
+
+	for (index = 0; index < count; index++)
+	{
+		/* already closed descriptors left the epoll set on their own */
+		if (epoll_ctl(epfd, EPOLL_CTL_DEL, (int)(long) fds[index], &event) != 0 &&
+				errno != ENOENT && errno != EBADF)
+			status = -1;
+	}
+
+	return status;
+#else
+	return -1;
+#endif
+}
+
+int wait_obj_epoll_add(struct wait_obj* obj, int epfd, void* data)
+{
+	int count = 0;
+	void* fds[1];
+
+	wait_obj_get_fds(obj, fds, &count);
+
+	return wait_obj_epoll_add_fds(epfd, fds, count, data);
+}
+
+int wait_obj_epoll_del(struct wait_obj* obj, int epfd)
+{
+	int count = 0;
+	void* fds[1];
+
+	wait_obj_get_fds(obj, fds, &count);
+
+	return wait_obj_epoll_del_fds(epfd, fds, count);
+}
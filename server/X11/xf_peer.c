@@ -17,6 +17,7 @@
  * limitations under the License.
  */
 
+#include "config.h"
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -27,12 +28,17 @@
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 #include <sys/select.h>
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
 #include <freerdp/kbd/kbd.h>
+#include <freerdp/constants.h>
 #include <freerdp/codec/color.h>
 #include <freerdp/utils/file.h>
 #include <freerdp/utils/sleep.h>
 #include <freerdp/utils/memory.h>
 #include <freerdp/utils/thread.h>
+#include <freerdp/utils/wait_obj.h>
 
 extern char* xf_pcap_file;
 extern tbool xf_pcap_dump_realtime;
@@ -254,6 +260,65 @@ xfInfo* xf_info_init()
 	return xfi;
 }
 
+#if defined(WITH_SSE2) || defined(WITH_AVX2)
+
+static void cpuid(unsigned info, unsigned *eax, unsigned *ebx, unsigned *ecx, unsigned *edx)
+{
+#ifdef __GNUC__
+#if defined(__i386__) || defined(__x86_64__)
+	*eax = info;
+	*ecx = 0; /* sub-leaf, needed for leaf 7 */
+	__asm volatile
+		("mov %%ebx, %%edi;" /* 32bit PIC: don't clobber ebx */
+		 "cpuid;"
+		 "mov %%ebx, %%esi;"
+		 "mov %%edi, %%ebx;"
+		 :"+a" (*eax), "=S" (*ebx), "+c" (*ecx), "=d" (*edx)
+		 : :"edi");
+#endif
+#endif
+}
+
+/* XCR0, tells which register states the OS saves on context switch */
+static unsigned xgetbv0()
+{
+#ifdef __GNUC__
+#if defined(__i386__) || defined(__x86_64__)
+	unsigned eax, edx;
+	__asm volatile
+		(".byte 0x0f, 0x01, 0xd0" /* xgetbv */
+		 :"=a" (eax), "=d" (edx)
+		 :"c" (0));
+	return eax;
+#endif
+#endif
+	return 0;
+}
+
+static uint32 xf_detect_cpu()
+{
+	unsigned int eax, ebx, ecx, edx = 0;
+	uint32 cpu_opt = 0;
+
+	cpuid(1, &eax, &ebx, &ecx, &edx);
+
+	if (edx & (1<<26))
+		cpu_opt |= CPU_SSE2;
+
+	/* AVX2 needs OSXSAVE and the OS saving the XMM and YMM state */
+	if ((ecx & (1<<27)) && ((xgetbv0() & 0x6) == 0x6))
+	{
+		cpuid(7, &eax, &ebx, &ecx, &edx);
+
+		if (ebx & (1<<5))
+			cpu_opt |= CPU_AVX2;
+	}
+
+	return cpu_opt;
+}
+
+#endif
+
 void xf_peer_context_new(freerdp_peer* client, xfPeerContext* context)
 {
 	context->info = xf_info_init();
@@ -264,13 +329,31 @@ void xf_peer_context_new(freerdp_peer* client, xfPeerContext* context)
 
 	rfx_context_set_pixel_format(context->rfx_context, RFX_PIXEL_FORMAT_BGRA);
 
+#if defined(WITH_SSE2) || defined(WITH_AVX2)
+	/* the encoder has SIMD kernels too */
+	rfx_context_set_cpu_opt(context->rfx_context, xf_detect_cpu());
+#endif
+
+	/* XShm frames always start at the screen origin, so unchanged tiles can be skipped */
+	if (context->info->use_xshm)
+		rfx_context_set_tile_cache(context->rfx_context, true);
+
 	context->s = stream_new(65536);
 }
 
 void xf_peer_context_free(freerdp_peer* client, xfPeerContext* context)
 {
+	uint32 encoded;
+	uint32 skipped;
+
 	if (context)
 	{
+		if (context->info->use_xshm)
+		{
+			rfx_context_get_tile_stats(context->rfx_context, &encoded, &skipped);
+			printf("RemoteFX tiles encoded: %u skipped: %u\n", encoded, skipped);
+		}
+
 		stream_free(context->s);
 		rfx_context_free(context->rfx_context);
 		xfree(context);
@@ -390,12 +473,16 @@ void xf_peer_dump_rfx(freerdp_peer* client)
 	}
 }
 
-void xf_peer_rfx_update(freerdp_peer* client, int x, int y, int width, int height)
+void xf_peer_rfx_update(freerdp_peer* client, HGDI_REGION region)
 {
+	int i;
+	int x, y;
+	int width;
+	int height;
 	STREAM* s;
 	uint8* data;
 	xfInfo* xfi;
-	RFX_RECT rect;
+	RFX_RECT* rects;
 	XImage* image;
 	rdpUpdate* update;
 	xfPeerContext* xfp;
@@ -406,56 +493,72 @@ void xf_peer_rfx_update(freerdp_peer* client, int x, int y, int width, int heigh
 	cmd = &update->surface_bits_command;
 	xfi = xfp->info;
 
-	if (width * height <= 0)
+	if (region->count <= 0 || region->extents.w * region->extents.h <= 0)
 		return;
 
+	/* all the damaged rectangles go in one message over one snapshot */
+	rects = (RFX_RECT*) xmalloc(sizeof(RFX_RECT) * region->count);
+
 	s = xf_peer_stream_init(xfp);
 
 	if (xfi->use_xshm)
 	{
-		width = x + width;
-		height = y + height;
+		/* the region is the damage, tiles stay aligned to the screen origin */
+		for (i = 0; i < region->count; i++)
+		{
+			rects[i].x = region->rects[i].x;
+			rects[i].y = region->rects[i].y;
+			rects[i].width = region->rects[i].w;
+			rects[i].height = region->rects[i].h;
+		}
+
 		x = 0;
 		y = 0;
-
-		rect.x = x;
-		rect.y = y;
-		rect.width = width;
-		rect.height = height;
+		width = region->extents.x + region->extents.w;
+		height = region->extents.y + region->extents.h;
 
 		image = xf_snapshot(xfp, x, y, width, height);
 
 		data = (uint8*) image->data;
 		data = &data[(y * image->bytes_per_line) + (x * image->bits_per_pixel)];
 
-		rfx_compose_message(xfp->rfx_context, s, &rect, 1, data,
+		rfx_compose_message(xfp->rfx_context, s, rects, region->count, data,
 				width, height, image->bytes_per_line);
-
-		cmd->destLeft = x;
-		cmd->destTop = y;
-		cmd->destRight = x + width;
-		cmd->destBottom = y + height;
 	}
 	else
 	{
-		rect.x = 0;
-		rect.y = 0;
-		rect.width = width;
-		rect.height = height;
+		/* the snapshot covers the bounding box, rectangles are relative to it */
+		x = region->extents.x;
+		y = region->extents.y;
+		width = region->extents.w;
+		height = region->extents.h;
+
+		for (i = 0; i < region->count; i++)
+		{
+			rects[i].x = region->rects[i].x - x;
+			rects[i].y = region->rects[i].y - y;
+			rects[i].width = region->rects[i].w;
+			rects[i].height = region->rects[i].h;
+		}
 
 		image = xf_snapshot(xfp, x, y, width, height);
 
-		rfx_compose_message(xfp->rfx_context, s, &rect, 1,
+		rfx_compose_message(xfp->rfx_context, s, rects, region->count,
 				(uint8*) image->data, width, height, width * xfi->bytesPerPixel);
 
-		cmd->destLeft = x;
-		cmd->destTop = y;
-		cmd->destRight = x + width;
-		cmd->destBottom = y + height;
-
 		XDestroyImage(image);
 	}
 
+	xfree(rects);
+
+	/* no tile changed */
+	if (stream_get_length(s) == 0)
+		return;
+
+	cmd->destLeft = x;
+	cmd->destTop = y;
+	cmd->destRight = x + width;
+	cmd->destBottom = y + height;
 	cmd->bpp = 32;
 	cmd->codecID = client->settings->rfx_codec_id;
 	cmd->width = width;
@@ -509,12 +612,11 @@ tbool xf_peer_check_fds(freerdp_peer* client)
 
 			if (invalid_region->null == false)
 			{
-				xf_peer_rfx_update(client, invalid_region->x, invalid_region->y,
-					invalid_region->w, invalid_region->h);
+				/* only the damaged rectangles, not their bounding box */
+				xf_peer_rfx_update(client, &xfp->hdc->hwnd->region);
 			}
 
 			invalid_region->null = 1;
-			xfp->hdc->hwnd->ninvalid = 0;
 
 			xf_event_free(event);
 		}
@@ -600,6 +702,15 @@ void* xf_peer_main_loop(void* arg)
 	rdpSettings* settings;
 	char* server_file_path;
 	freerdp_peer* client = (freerdp_peer*) arg;
+#ifdef HAVE_SYS_EPOLL_H
+	int epfd;
+	int epoll_count;
+	void* epoll_fds[32];
+	struct epoll_event events[8];
+
+	epfd = epoll_create(32);
+	epoll_count = 0;
+#endif
 
 	memset(rfds, 0, sizeof(rfds));
 
@@ -651,32 +762,63 @@ void* xf_peer_main_loop(void* arg)
 			break;
 		}
 
-		max_fds = 0;
-		FD_ZERO(&rfds_set);
-
-		for (i = 0; i < rcount; i++)
+#ifdef HAVE_SYS_EPOLL_H
+		if (epfd != -1)
 		{
-			fds = (int)(long)(rfds[i]);
+			/* only touch the epoll set when the descriptors change */
+			if ((rcount != epoll_count) || (memcmp(rfds, epoll_fds, rcount * sizeof(void*)) != 0))
+			{
+				wait_obj_epoll_del_fds(epfd, epoll_fds, epoll_count);
 
-			if (fds > max_fds)
-				max_fds = fds;
+				if (wait_obj_epoll_add_fds(epfd, rfds, rcount, client) != 0)
+				{
+					printf("epoll_ctl failed\n");
+					break;
+				}
 
-			FD_SET(fds, &rfds_set);
-		}
+				memcpy(epoll_fds, rfds, rcount * sizeof(void*));
+				epoll_count = rcount;
+			}
 
-		if (max_fds == 0)
-			break;
+			if (rcount == 0)
+				break;
 
-		if (select(max_fds + 1, &rfds_set, NULL, NULL, NULL) == -1)
+			if ((epoll_wait(epfd, events, 8, -1) == -1) && (errno != EINTR))
+			{
+				printf("epoll_wait failed\n");
+				break;
+			}
+		}
+		else
+#endif
 		{
-			/* these are not really errors */
-			if (!((errno == EAGAIN) ||
-				(errno == EWOULDBLOCK) ||
-				(errno == EINPROGRESS) ||
-				(errno == EINTR))) /* signal occurred */
+			max_fds = 0;
+			FD_ZERO(&rfds_set);
+
+			for (i = 0; i < rcount; i++)
 			{
-				printf("select failed\n");
+				fds = (int)(long)(rfds[i]);
+
+				if (fds > max_fds)
+					max_fds = fds;
+
+				FD_SET(fds, &rfds_set);
+			}
+
+			if (max_fds == 0)
 				break;
+
+			if (select(max_fds + 1, &rfds_set, NULL, NULL, NULL) == -1)
+			{
+				/* these are not really errors */
+				if (!((errno == EAGAIN) ||
+					(errno == EWOULDBLOCK) ||
+					(errno == EINPROGRESS) ||
+					(errno == EINTR))) /* signal occurred */
+				{
+					printf("select failed\n");
+					break;
+				}
 			}
 		}
 
@@ -694,6 +836,11 @@ void* xf_peer_main_loop(void* arg)
 
 	printf("Client %s disconnected.\n", client->hostname);
 
+#ifdef HAVE_SYS_EPOLL_H
+	if (epfd != -1)
+		close(epfd);
+#endif
+
 	client->Disconnect(client);
 	freerdp_peer_context_free(client);
 	freerdp_peer_free(client);